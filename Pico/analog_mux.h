@@ -0,0 +1,76 @@
+/**
+ * Analog Multiplexer Scanner Header File
+ *
+ * Drives an external CD4051 (8 channel) or 74HC4067 (16 channel) analog
+ * multiplexer from GPIO select lines and scans every channel into the
+ * RP2040 ADC using DMA. Mux switching and settle delays are driven from
+ * the DMA completion interrupt and a hardware alarm, so a full scan runs
+ * in the background without the CPU polling the ADC.
+ *
+ * Author: Smart Agriculture Team
+ * Date: October 2024
+ */
+
+#ifndef ANALOG_MUX_H
+#define ANALOG_MUX_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define ANALOG_MUX_MAX_SELECT_BITS 4    // 74HC4067 uses S0-S3
+#define ANALOG_MUX_MAX_CHANNELS 16
+#define ANALOG_MUX_MAX_SAMPLES 32       // Samples averaged per channel
+
+// Mux wiring and per-channel timing
+typedef struct {
+    uint8_t select_pins[ANALOG_MUX_MAX_SELECT_BITS]; // GPIO for S0..S3
+    uint8_t select_bits;        // 3 for CD4051, 4 for 74HC4067
+    int8_t enable_pin;          // Active-low INH/EN GPIO, -1 if tied to GND
+    uint8_t adc_input;          // ADC input wired to the mux common (0-2)
+    uint8_t channel_count;      // Channels to scan, starting at channel 0
+    uint8_t samples_per_channel;
+    uint16_t settle_us[ANALOG_MUX_MAX_CHANNELS]; // Settle time after switching
+} analog_mux_config_t;
+
+/**
+ * Initialize mux select GPIOs, the ADC FIFO and a DMA channel
+ *
+ * @param config Mux wiring and timing, copied internally
+ * @return true on success, false if the configuration is invalid
+ */
+bool analog_mux_init(const analog_mux_config_t *config);
+
+/**
+ * Start a background scan of all configured channels
+ *
+ * @return false if a scan is already running
+ */
+bool analog_mux_start_scan(void);
+
+/**
+ * Check whether the last scan started with analog_mux_start_scan() finished
+ */
+bool analog_mux_scan_done(void);
+
+/**
+ * Block in low-power wait until the running scan completes
+ */
+void analog_mux_wait(void);
+
+/**
+ * Get the averaged result of a channel from the last completed scan
+ *
+ * Values are 12-bit counts (0-4095), the same scale as adc_read() on the
+ * directly wired sensors, so one set of calibration constants fits both.
+ *
+ * @param channel Mux channel number
+ * @return Averaged raw ADC value, 0 for an unconfigured channel
+ */
+uint16_t analog_mux_get(uint8_t channel);
+
+/**
+ * Duration of the last completed scan in microseconds
+ */
+uint32_t analog_mux_last_scan_us(void);
+
+#endif // ANALOG_MUX_H
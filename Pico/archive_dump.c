@@ -0,0 +1,333 @@
+/**
+ * SD Card Archive Dump Tool (host build)
+ *
+ * Decodes an AGRI.LOG archive copied off the node's SD card and prints
+ * readings as CSV. A time range is resolved through the index block
+ * chain, so only the data blocks overlapping the range are read.
+ *
+ * Times are seconds of uptime and restart at every boot, so readings are
+ * grouped into boot sessions, numbered from 1 by their schema blocks in
+ * file order. Schema blocks are the only blocks neither indexed nor part
+ * of the index chain, so they are found without scanning the file.
+ * --sessions lists them; --session N limits a time range to one boot.
+ *
+ * Usage: archive_dump <AGRI.LOG> [--session N] [from_s] [to_s]
+ *        archive_dump <AGRI.LOG> --sessions
+ *        archive_dump <AGRI.LOG> --schema
+ *
+ * Author: Smart Agriculture Team
+ * Date: October 2024
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "archive_format.h"
+
+typedef struct {
+    archive_index_entry_t *items;
+    size_t count;
+    size_t capacity;
+} entry_list_t;
+
+typedef struct {
+    uint32_t start_block;     // Its schema block
+    uint32_t boot_id;
+    int has_boot_id;          // Archives from older firmware carry none
+    uint32_t blocks;          // Data blocks
+    uint32_t t_first;
+    uint32_t t_last;
+} session_t;
+
+typedef struct {
+    session_t *items;
+    size_t count;
+} session_list_t;
+
+static uint8_t block[ARCHIVE_BLOCK_SIZE];
+
+static int read_block(FILE *file, uint32_t number) {
+    if (fseek(file, (long)number * ARCHIVE_BLOCK_SIZE, SEEK_SET) != 0 ||
+        fread(block, 1, ARCHIVE_BLOCK_SIZE, file) != ARCHIVE_BLOCK_SIZE) {
+        return 0;
+    }
+    return archive_block_valid(block);
+}
+
+static void *grow(void *items, size_t count, size_t *capacity, size_t size) {
+    if (count < *capacity) {
+        return items;
+    }
+    *capacity = *capacity ? *capacity * 2 : 256;
+    items = realloc(items, *capacity * size);
+    if (items == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        exit(1);
+    }
+    return items;
+}
+
+static void add_entry(entry_list_t *list, archive_index_entry_t entry) {
+    list->items = grow(list->items, list->count, &list->capacity, sizeof(*list->items));
+    list->items[list->count++] = entry;
+}
+
+static int compare_entries(const void *a, const void *b) {
+    uint32_t x = ((const archive_index_entry_t *)a)->block;
+    uint32_t y = ((const archive_index_entry_t *)b)->block;
+    return (x > y) - (x < y);
+}
+
+/**
+ * Collect every data block's time range from the index chain, plus the
+ * unindexed blocks after the last index block; index_blocks receives the
+ * chain's own block numbers
+ */
+static void load_index(FILE *file, uint32_t blocks, entry_list_t *list, entry_list_t *index_blocks) {
+    uint32_t last_index = ARCHIVE_NO_BLOCK;
+
+    // The last index block is at most one interval from the end
+    for (uint32_t i = 0; i < blocks && i <= ARCHIVE_INDEX_INTERVAL * 2; i++) {
+        uint32_t number = blocks - 1 - i;
+        if (read_block(file, number) &&
+            ((archive_block_header_t *)block)->type == ARCHIVE_BLOCK_INDEX) {
+            last_index = number;
+            break;
+        }
+    }
+
+    // Tail after the last index
+    uint32_t tail_start = last_index == ARCHIVE_NO_BLOCK ? 0 : last_index + 1;
+    for (uint32_t number = tail_start; number < blocks; number++) {
+        archive_block_header_t *header = (archive_block_header_t *)block;
+        if (read_block(file, number) && header->type == ARCHIVE_BLOCK_DATA) {
+            archive_index_entry_t entry = {number, header->t_first, header->t_last};
+            add_entry(list, entry);
+        }
+    }
+
+    // Walk the chain backwards
+    uint32_t number = last_index;
+    while (number != ARCHIVE_NO_BLOCK && number < blocks && read_block(file, number)) {
+        archive_block_header_t *header = (archive_block_header_t *)block;
+        archive_index_payload_t *index = (archive_index_payload_t *)(block + sizeof(*header));
+        if (header->type != ARCHIVE_BLOCK_INDEX) {
+            break;
+        }
+        archive_index_entry_t self = {number, 0, 0};
+        add_entry(index_blocks, self);
+        for (uint16_t i = 0; i < header->count && i < ARCHIVE_INDEX_INTERVAL; i++) {
+            add_entry(list, index->entries[i]);
+        }
+        if (index->prev_index_block >= number) {
+            break;  // Chain must point backwards
+        }
+        number = index->prev_index_block;
+    }
+
+    qsort(list->items, list->count, sizeof(*list->items), compare_entries);
+    qsort(index_blocks->items, index_blocks->count, sizeof(*index_blocks->items), compare_entries);
+}
+
+/**
+ * Session number (from 1) a block belongs to, 0 if before any schema block
+ */
+static size_t session_of(const session_list_t *sessions, uint32_t number) {
+    size_t low = 0, high = sessions->count;
+    while (low < high) {
+        size_t mid = low + (high - low) / 2;
+        if (sessions->items[mid].start_block < number) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return low;
+}
+
+/**
+ * Boot sessions from the schema blocks, which are the gaps between the
+ * indexed data blocks and the index blocks
+ */
+static void load_sessions(FILE *file, uint32_t blocks, const entry_list_t *data,
+                          const entry_list_t *index_blocks, session_list_t *sessions) {
+    size_t capacity = 0;
+    size_t d = 0, x = 0;
+    for (uint32_t number = 0; number < blocks; number++) {
+        while (d < data->count && data->items[d].block < number) {
+            d++;
+        }
+        while (x < index_blocks->count && index_blocks->items[x].block < number) {
+            x++;
+        }
+        if ((d < data->count && data->items[d].block == number) ||
+            (x < index_blocks->count && index_blocks->items[x].block == number)) {
+            continue;
+        }
+        archive_block_header_t *header = (archive_block_header_t *)block;
+        if (!read_block(file, number) || header->type != ARCHIVE_BLOCK_SCHEMA) {
+            continue;     // Torn or unindexed block
+        }
+        sessions->items = grow(sessions->items, sessions->count, &capacity, sizeof(session_t));
+        session_t *session = &sessions->items[sessions->count++];
+        memset(session, 0, sizeof(*session));
+        session->start_block = number;
+        block[ARCHIVE_BLOCK_SIZE - 1] = '\0';
+        const char *boot = strstr((const char *)block + sizeof(*header), "boot_id=");
+        if (boot != NULL) {
+            session->boot_id = (uint32_t)strtoul(boot + 8, NULL, 16);
+            session->has_boot_id = 1;
+        }
+    }
+
+    for (size_t i = 0; i < data->count; i++) {
+        size_t s = session_of(sessions, data->items[i].block);
+        if (s == 0) {
+            continue;
+        }
+        session_t *session = &sessions->items[s - 1];
+        if (session->blocks == 0 || data->items[i].t_first < session->t_first) {
+            session->t_first = data->items[i].t_first;
+        }
+        if (data->items[i].t_last > session->t_last) {
+            session->t_last = data->items[i].t_last;
+        }
+        session->blocks++;
+    }
+}
+
+static void print_sessions(const session_list_t *sessions) {
+    printf("session,schema_block,boot_id,data_blocks,uptime_from_s,uptime_to_s\n");
+    for (size_t i = 0; i < sessions->count; i++) {
+        const session_t *session = &sessions->items[i];
+        printf("%zu,%u,", i + 1, session->start_block);
+        if (session->has_boot_id) {
+            printf("%08x,", session->boot_id);
+        } else {
+            printf("-,");
+        }
+        printf("%u,%u,%u\n", session->blocks, session->t_first, session->t_last);
+    }
+}
+
+static void print_schemas(FILE *file, uint32_t blocks) {
+    for (uint32_t number = 0; number < blocks; number++) {
+        archive_block_header_t *header = (archive_block_header_t *)block;
+        if (read_block(file, number) && header->type == ARCHIVE_BLOCK_SCHEMA) {
+            block[ARCHIVE_BLOCK_SIZE - 1] = '\0';
+            printf("# block %u seq %u\n%s", number, header->block_seq,
+                   (const char *)block + sizeof(*header));
+        }
+    }
+}
+
+static void print_block_readings(size_t session, uint32_t from, uint32_t to) {
+    archive_block_header_t *header = (archive_block_header_t *)block;
+    uint32_t offset = sizeof(*header);
+
+    for (uint16_t i = 0; i < header->count; i++) {
+        if (offset + sizeof(archive_record_header_t) > ARCHIVE_BLOCK_SIZE) {
+            break;
+        }
+        archive_record_header_t record;
+        memcpy(&record, block + offset, sizeof(record));
+        offset += sizeof(record);
+        if (record.type == ARCHIVE_RECORD_PAD || offset + record.length > ARCHIVE_BLOCK_SIZE) {
+            break;
+        }
+
+        if (record.type == ARCHIVE_RECORD_READING) {
+            archive_reading_t reading;
+            memset(&reading, 0, sizeof(reading));
+            memcpy(&reading, block + offset,
+                   record.length < sizeof(reading) ? record.length : sizeof(reading));
+
+            if (reading.timestamp >= from && reading.timestamp <= to) {
+                printf("%zu,%u,%.2f,%.2f,%.2f,%.2f,%.3f,", session, reading.timestamp,
+                       reading.soil_moisture, reading.soil_temperature, reading.humidity,
+                       reading.light_intensity, reading.vsys);
+                for (uint8_t p = 0; p < reading.probe_count && p < ARCHIVE_MAX_PROBES; p++) {
+                    printf(p == 0 ? "%.2f" : ";%.2f", reading.probes[p]);
+                }
+                printf("\n");
+            }
+        }
+        offset += record.length;
+    }
+}
+
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        fprintf(stderr, "Usage: %s <AGRI.LOG> [--session N] [from_s] [to_s] | --sessions | --schema\n", argv[0]);
+        return 1;
+    }
+
+    FILE *file = fopen(argv[1], "rb");
+    if (file == NULL) {
+        fprintf(stderr, "Cannot open %s\n", argv[1]);
+        return 1;
+    }
+    fseek(file, 0, SEEK_END);
+    uint32_t blocks = (uint32_t)(ftell(file) / ARCHIVE_BLOCK_SIZE);
+
+    if (argc > 2 && strcmp(argv[2], "--schema") == 0) {
+        print_schemas(file, blocks);
+        fclose(file);
+        return 0;
+    }
+
+    entry_list_t list = {0};
+    entry_list_t index_blocks = {0};
+    session_list_t sessions = {0};
+    load_index(file, blocks, &list, &index_blocks);
+    load_sessions(file, blocks, &list, &index_blocks, &sessions);
+
+    if (argc > 2 && strcmp(argv[2], "--sessions") == 0) {
+        print_sessions(&sessions);
+        free(list.items);
+        free(index_blocks.items);
+        free(sessions.items);
+        fclose(file);
+        return 0;
+    }
+
+    // Uptime alone is ambiguous across boots: --session N pins the range to one
+    int arg = 2;
+    size_t only_session = 0;
+    if (argc > 3 && strcmp(argv[2], "--session") == 0) {
+        only_session = strtoul(argv[3], NULL, 10);
+        if (only_session == 0 || only_session > sessions.count) {
+            fprintf(stderr, "No session %s (archive has %zu)\n", argv[3], sessions.count);
+            fclose(file);
+            return 1;
+        }
+        arg = 4;
+    }
+    uint32_t from = argc > arg ? (uint32_t)strtoul(argv[arg], NULL, 10) : 0;
+    uint32_t to = argc > arg + 1 ? (uint32_t)strtoul(argv[arg + 1], NULL, 10) : 0xffffffffu;
+
+    size_t blocks_read = 0;
+    printf("session,timestamp,soil_moisture,soil_temperature,humidity,light_intensity,vsys,probes\n");
+    for (size_t i = 0; i < list.count; i++) {
+        const archive_index_entry_t *entry = &list.items[i];
+        if (entry->t_last < from || entry->t_first > to) {
+            continue;  // Block entirely outside the range
+        }
+        size_t session = session_of(&sessions, entry->block);
+        if (only_session != 0 && session != only_session) {
+            continue;
+        }
+        if (read_block(file, entry->block)) {
+            print_block_readings(session, from, to);
+            blocks_read++;
+        }
+    }
+
+    fprintf(stderr, "%u blocks in archive, %zu indexed, %zu sessions, %zu read\n",
+            blocks, list.count, sessions.count, blocks_read);
+    free(list.items);
+    free(index_blocks.items);
+    free(sessions.items);
+    fclose(file);
+    return 0;
+}
@@ -0,0 +1,137 @@
+/**
+ * SD Card Archive File Format
+ *
+ * Shared by the firmware logger (sd_archive.c) and the host tools that
+ * decode archives (archive_dump.c). Plain C, no SDK dependencies.
+ *
+ * The archive is an append-only file of fixed 4 KB blocks:
+ *
+ *   [schema][data][data]...[data][index][data]...[schema][data]...
+ *
+ * - A schema block starts every boot session. Its payload is the boot_id
+ *   nonce the node also sends to the backend and a text description of
+ *   every record type ("1 reading ts:u32 soil_moisture:f32 ..."), so a
+ *   decoder never needs to be rebuilt for new firmware.
+ * - Record, block and index times are seconds of uptime, which restart at
+ *   every boot: a time only identifies a reading together with its
+ *   session. Readers number sessions by their schema blocks in file order
+ *   and seek by (session, uptime); see archive_dump --sessions.
+ * - Data blocks hold whole records, never split across blocks:
+ *   [type u8][length u8][payload]. Type 0 marks end of block padding.
+ * - After every ARCHIVE_INDEX_INTERVAL data blocks an index block lists
+ *   the block number and time range of each, and links back to the
+ *   previous index block, so readers can seek by time without scanning.
+ *
+ * All integers and floats are little endian. The header CRC covers the
+ * whole block with the crc field set to zero.
+ *
+ * Author: Smart Agriculture Team
+ * Date: October 2024
+ */
+
+#ifndef ARCHIVE_FORMAT_H
+#define ARCHIVE_FORMAT_H
+
+#include <stdint.h>
+
+#define ARCHIVE_BLOCK_SIZE 4096
+#define ARCHIVE_MAGIC 0x424c4741u     // "AGLB"
+#define ARCHIVE_VERSION 1
+#define ARCHIVE_INDEX_INTERVAL 64     // Data blocks per index block
+#define ARCHIVE_NO_BLOCK 0xffffffffu
+
+// Block types
+#define ARCHIVE_BLOCK_SCHEMA 1
+#define ARCHIVE_BLOCK_DATA 2
+#define ARCHIVE_BLOCK_INDEX 3
+
+// Record types
+#define ARCHIVE_RECORD_PAD 0
+#define ARCHIVE_RECORD_READING 1
+
+typedef struct __attribute__((packed)) {
+    uint32_t magic;
+    uint8_t type;
+    uint8_t version;
+    uint16_t count;       // Records (data) or entries (index)
+    uint32_t block_seq;   // Monotonic across the whole file
+    uint32_t t_first;     // Earliest record time in the block (s)
+    uint32_t t_last;      // Latest record time in the block (s)
+    uint32_t crc;         // CRC-32 of the block with this field zeroed
+} archive_block_header_t;
+
+#define ARCHIVE_PAYLOAD_SIZE (ARCHIVE_BLOCK_SIZE - sizeof(archive_block_header_t))
+
+typedef struct __attribute__((packed)) {
+    uint8_t type;
+    uint8_t length;       // Payload bytes following this header
+} archive_record_header_t;
+
+// Index block payload: previous index block then one entry per data block
+typedef struct __attribute__((packed)) {
+    uint32_t block;       // Block number within the file
+    uint32_t t_first;
+    uint32_t t_last;
+} archive_index_entry_t;
+
+typedef struct __attribute__((packed)) {
+    uint32_t prev_index_block;    // ARCHIVE_NO_BLOCK for the first
+    archive_index_entry_t entries[ARCHIVE_INDEX_INTERVAL];
+} archive_index_payload_t;
+
+// Reading record payload, described as text in the schema block
+#define ARCHIVE_MAX_PROBES 16
+typedef struct __attribute__((packed)) {
+    uint32_t timestamp;
+    float soil_moisture;
+    float soil_temperature;
+    float humidity;
+    float light_intensity;
+    float vsys;
+    uint8_t probe_count;
+    float probes[ARCHIVE_MAX_PROBES];  // Only probe_count are stored
+} archive_reading_t;
+
+#define ARCHIVE_READING_SCHEMA \
+    "1 reading timestamp:u32 soil_moisture:f32 soil_temperature:f32 " \
+    "humidity:f32 light_intensity:f32 vsys:f32 probe_count:u8 probes:f32[probe_count]\n"
+
+/**
+ * CRC-32 (IEEE 802.3), bitwise to avoid a 1 KB table on the device
+ */
+static inline uint32_t archive_crc32(const uint8_t *data, uint32_t length) {
+    uint32_t crc = 0xffffffffu;
+    for (uint32_t i = 0; i < length; i++) {
+        crc ^= data[i];
+        for (int bit = 0; bit < 8; bit++) {
+            crc = (crc >> 1) ^ (0xedb88320u & -(crc & 1u));
+        }
+    }
+    return ~crc;
+}
+
+/**
+ * Compute and store the CRC of a complete block
+ */
+static inline void archive_seal_block(uint8_t *block) {
+    archive_block_header_t *header = (archive_block_header_t *)block;
+    header->crc = 0;
+    header->crc = archive_crc32(block, ARCHIVE_BLOCK_SIZE);
+}
+
+/**
+ * Check magic and CRC of a block read back from the archive
+ */
+static inline int archive_block_valid(uint8_t *block) {
+    archive_block_header_t *header = (archive_block_header_t *)block;
+    if (header->magic != ARCHIVE_MAGIC) {
+        return 0;
+    }
+    uint32_t stored = header->crc;
+    header->crc = 0;
+    uint32_t actual = archive_crc32(block, ARCHIVE_BLOCK_SIZE);
+    header->crc = stored;
+    return stored == actual;
+}
+
+#endif // ARCHIVE_FORMAT_H
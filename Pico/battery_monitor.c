@@ -0,0 +1,72 @@
+/**
+ * Battery / VSYS Monitor for Raspberry Pi Pico W
+ *
+ * On the Pico W, GPIO29 is both the VSYS/3 divider (ADC3) and the clock
+ * line to the CYW43 wireless chip. The ADC is only sampled while holding
+ * the cyw43 lock, and the driver reclaims the pin on its next transfer.
+ *
+ * Author: Smart Agriculture Team
+ * Date: October 2024
+ */
+
+#include "pico/stdlib.h"
+#include "pico/cyw43_arch.h"
+#include "hardware/adc.h"
+#include "hardware/gpio.h"
+#include "battery_monitor.h"
+#include "energy_policy.h"
+
+#define VSYS_PIN 29
+#define VSYS_ADC_INPUT 3
+#define VSYS_SAMPLES 16
+#define VSYS_DIVIDER 3.0f
+#define ADC_VREF 3.3f
+#define VSYS_SMOOTHING 0.25f    // EWMA weight of each new reading
+
+static int charge_pin = -1;
+static float vsys_filtered = 0.0f;
+
+void battery_monitor_init(int charge_status_pin) {
+    charge_pin = charge_status_pin;
+    if (charge_pin >= 0) {
+        gpio_init((uint)charge_pin);
+        gpio_set_dir((uint)charge_pin, GPIO_IN);
+        gpio_pull_up((uint)charge_pin);  // CHRG is open drain
+    }
+    vsys_filtered = 0.0f;
+}
+
+static float read_vsys_voltage(void) {
+    uint32_t sum = 0;
+
+    cyw43_thread_enter();
+    adc_gpio_init(VSYS_PIN);
+    adc_select_input(VSYS_ADC_INPUT);
+    for (int i = 0; i < VSYS_SAMPLES; i++) {
+        sum += adc_read();
+    }
+    cyw43_thread_exit();
+
+    float adc_v = ((float)sum / VSYS_SAMPLES) * ADC_VREF / 4096.0f;
+    return adc_v * VSYS_DIVIDER;
+}
+
+battery_status_t battery_monitor_read(void) {
+    battery_status_t status = {0};
+
+    // Filter out dips from Wi-Fi transmit bursts
+    float vsys = read_vsys_voltage();
+    if (vsys_filtered == 0.0f) {
+        vsys_filtered = vsys;
+    } else {
+        vsys_filtered += VSYS_SMOOTHING * (vsys - vsys_filtered);
+    }
+
+    status.vsys_v = vsys_filtered;
+    status.usb_power = cyw43_arch_gpio_get(CYW43_WL_GPIO_VBUS_PIN);
+    status.charging = charge_pin >= 0 && !gpio_get((uint)charge_pin);
+
+    // On USB power VSYS is not the battery voltage
+    status.soc_pct = status.usb_power ? 100.0f : energy_policy_soc_from_voltage(vsys_filtered);
+    return status;
+}
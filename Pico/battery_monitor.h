@@ -0,0 +1,41 @@
+/**
+ * Battery / VSYS Monitor Header File
+ *
+ * Reads VSYS/3 through ADC3 and the solar charger status pin so the
+ * scheduler can adapt to the remaining battery energy.
+ *
+ * Author: Smart Agriculture Team
+ * Date: October 2024
+ */
+
+#ifndef BATTERY_MONITOR_H
+#define BATTERY_MONITOR_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Snapshot of the power supply state
+typedef struct {
+    float vsys_v;       // Smoothed VSYS voltage in volts
+    float soc_pct;      // Estimated state of charge, 0-100%
+    bool usb_power;     // VBUS present
+    bool charging;      // Solar charger reports charging
+} battery_status_t;
+
+/**
+ * Initialize the VSYS ADC input and charger status pin
+ *
+ * @param charge_status_pin GPIO connected to the charger's active-low
+ *                          CHRG output, or -1 if not wired
+ */
+void battery_monitor_init(int charge_status_pin);
+
+/**
+ * Sample VSYS and charger status
+ *
+ * Must be called after cyw43_arch_init() because ADC3 shares GPIO29 with
+ * the wireless chip's SPI clock.
+ */
+battery_status_t battery_monitor_read(void);
+
+#endif // BATTERY_MONITOR_H
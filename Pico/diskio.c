@@ -0,0 +1,71 @@
+/**
+ * FatFS Disk I/O Layer for the SD Card SPI Driver
+ *
+ * Glue between FatFS (http://elm-chan.org/fsw/ff/) and sd_spi.c. Only
+ * physical drive 0 is supported.
+ *
+ * Author: Smart Agriculture Team
+ * Date: October 2024
+ */
+
+#include "ff.h"
+#include "diskio.h"
+#include "sd_spi.h"
+
+DSTATUS disk_status(BYTE pdrv) {
+    return (pdrv == 0 && sd_spi_ready()) ? 0 : STA_NOINIT;
+}
+
+DSTATUS disk_initialize(BYTE pdrv) {
+    if (pdrv != 0) {
+        return STA_NOINIT;
+    }
+    if (!sd_spi_ready() && !sd_spi_init()) {
+        return STA_NOINIT | STA_NODISK;
+    }
+    return 0;
+}
+
+DRESULT disk_read(BYTE pdrv, BYTE *buff, LBA_t sector, UINT count) {
+    if (pdrv != 0 || !sd_spi_ready()) {
+        return RES_NOTRDY;
+    }
+    return sd_spi_read(buff, (uint32_t)sector, count) ? RES_OK : RES_ERROR;
+}
+
+DRESULT disk_write(BYTE pdrv, const BYTE *buff, LBA_t sector, UINT count) {
+    if (pdrv != 0 || !sd_spi_ready()) {
+        return RES_NOTRDY;
+    }
+    return sd_spi_write(buff, (uint32_t)sector, count) ? RES_OK : RES_ERROR;
+}
+
+DRESULT disk_ioctl(BYTE pdrv, BYTE cmd, void *buff) {
+    if (pdrv != 0 || !sd_spi_ready()) {
+        return RES_NOTRDY;
+    }
+
+    switch (cmd) {
+        case CTRL_SYNC:
+            return RES_OK;  // Writes complete before sd_spi_write returns
+        case GET_SECTOR_COUNT:
+            *(LBA_t *)buff = sd_spi_sector_count();
+            return RES_OK;
+        case GET_SECTOR_SIZE:
+            *(WORD *)buff = SD_SECTOR_SIZE;
+            return RES_OK;
+        case GET_BLOCK_SIZE:
+            *(DWORD *)buff = 1;  // Erase block size unknown
+            return RES_OK;
+        default:
+            return RES_PARERR;
+    }
+}
+
+/**
+ * FAT timestamp for new files. The node has no RTC, so files are stamped
+ * with a fixed date; record times live inside the archive itself.
+ */
+DWORD get_fattime(void) {
+    return ((DWORD)(2024 - 1980) << 25) | ((DWORD)10 << 21) | ((DWORD)1 << 16);
+}
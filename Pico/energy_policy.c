@@ -0,0 +1,83 @@
+/**
+ * Energy-Aware Scheduling Policy
+ *
+ * Author: Smart Agriculture Team
+ * Date: October 2024
+ */
+
+#include <stddef.h>
+#include "energy_policy.h"
+
+// ==================== DEFAULT POLICY ====================
+
+const energy_policy_row_t energy_policy_default_table[] = {
+    // min SoC, sample interval, batch, radio wake
+    {70,    5000,  1,     5000},    // Full: original 5 s cadence
+    {40,   15000,  4,    60000},    // Healthy: upload once a minute
+    {20,   60000, 10,   600000},    // Low: 1 min samples, radio every 10 min
+    {10,  300000, 12,  3600000},    // Very low: 5 min samples, hourly uploads
+    { 0,  900000, 16, 21600000},    // Critical: 15 min samples, radio every 6 h
+};
+const uint8_t energy_policy_default_rows =
+    sizeof(energy_policy_default_table) / sizeof(energy_policy_default_table[0]);
+
+// Resting voltage of a 1S Li-ion cell versus state of charge
+static const struct {
+    float voltage;
+    float soc;
+} li_ion_curve[] = {
+    {4.20f, 100.0f},
+    {4.06f,  90.0f},
+    {3.98f,  80.0f},
+    {3.92f,  70.0f},
+    {3.87f,  60.0f},
+    {3.82f,  50.0f},
+    {3.79f,  40.0f},
+    {3.77f,  30.0f},
+    {3.74f,  20.0f},
+    {3.68f,  10.0f},
+    {3.45f,   5.0f},
+    {3.30f,   0.0f},
+};
+
+// ==================== POLICY FUNCTIONS ====================
+
+void energy_policy_init(energy_policy_t *policy, const energy_policy_row_t *table, uint8_t rows) {
+    policy->table = table;
+    policy->rows = rows;
+    policy->current_row = 0;
+}
+
+const energy_policy_row_t *energy_policy_update(energy_policy_t *policy, float soc_pct, bool charging) {
+    // Step down as far as the SoC requires
+    uint8_t row = policy->current_row;
+    while (row + 1 < policy->rows && soc_pct < policy->table[row].min_soc_pct) {
+        row++;
+    }
+
+    // Step up only with margin, or freely while charging
+    float margin = charging ? 0.0f : (float)ENERGY_POLICY_HYSTERESIS_PCT;
+    while (row > 0 && soc_pct >= policy->table[row - 1].min_soc_pct + margin) {
+        row--;
+    }
+
+    policy->current_row = row;
+    return &policy->table[row];
+}
+
+float energy_policy_soc_from_voltage(float voltage) {
+    const size_t points = sizeof(li_ion_curve) / sizeof(li_ion_curve[0]);
+
+    if (voltage >= li_ion_curve[0].voltage) {
+        return 100.0f;
+    }
+    for (size_t i = 1; i < points; i++) {
+        if (voltage >= li_ion_curve[i].voltage) {
+            // Linear interpolation between curve points
+            float span = li_ion_curve[i - 1].voltage - li_ion_curve[i].voltage;
+            float frac = (voltage - li_ion_curve[i].voltage) / span;
+            return li_ion_curve[i].soc + frac * (li_ion_curve[i - 1].soc - li_ion_curve[i].soc);
+        }
+    }
+    return 0.0f;
+}
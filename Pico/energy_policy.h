@@ -0,0 +1,63 @@
+/**
+ * Energy-Aware Scheduling Policy Header File
+ *
+ * Maps battery state of charge to a sampling interval, upload batch size
+ * and radio wake period. The policy is plain C with no SDK dependencies
+ * so the same table can be run in the host simulator (energy_sim.c)
+ * against recorded solar profiles before it is flashed.
+ *
+ * Author: Smart Agriculture Team
+ * Date: October 2024
+ */
+
+#ifndef ENERGY_POLICY_H
+#define ENERGY_POLICY_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define ENERGY_POLICY_HYSTERESIS_PCT 5  // SoC margin before stepping back up
+
+// One row of the policy table, rows ordered by descending min_soc_pct
+typedef struct {
+    uint8_t min_soc_pct;          // Row applies at or above this SoC
+    uint32_t sample_interval_ms;  // Time between sensor reads
+    uint8_t batch_size;           // Readings queued per upload
+    uint32_t radio_wake_ms;       // Maximum time between Wi-Fi wakes
+} energy_policy_row_t;
+
+// Policy selection state, keeps hysteresis between calls
+typedef struct {
+    const energy_policy_row_t *table;
+    uint8_t rows;
+    uint8_t current_row;
+} energy_policy_t;
+
+extern const energy_policy_row_t energy_policy_default_table[];
+extern const uint8_t energy_policy_default_rows;
+
+/**
+ * Initialize the policy at its most generous row
+ */
+void energy_policy_init(energy_policy_t *policy, const energy_policy_row_t *table, uint8_t rows);
+
+/**
+ * Select the row for the current battery state
+ *
+ * Dropping SoC steps down immediately. Rising SoC steps back up only
+ * once it clears the row threshold by ENERGY_POLICY_HYSTERESIS_PCT,
+ * unless the battery is charging.
+ *
+ * @return The active policy row
+ */
+const energy_policy_row_t *energy_policy_update(energy_policy_t *policy, float soc_pct, bool charging);
+
+/**
+ * Estimate state of charge of a single Li-ion cell from its resting voltage
+ *
+ * @param voltage Battery voltage in volts
+ * @return State of charge, 0-100%
+ */
+float energy_policy_soc_from_voltage(float voltage);
+
+#endif // ENERGY_POLICY_H
@@ -0,0 +1,169 @@
+/**
+ * Energy Policy Simulator (host build)
+ *
+ * Replays a recorded solar charge profile against a battery model and the
+ * firmware's energy policy table, so policy changes can be checked for
+ * brown-outs before they are flashed to a field node.
+ *
+ * Profile format (CSV, '#' comments allowed), repeated to fill the run:
+ *   hour,solar_ma
+ *   0.0,0
+ *   6.5,40
+ *   12.0,310
+ *
+ * Usage: energy_sim <profile.csv> [days] [capacity_mAh] [initial_soc_pct]
+ *
+ * Author: Smart Agriculture Team
+ * Date: October 2024
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "energy_policy.h"
+
+#define MAX_PROFILE_POINTS 1024
+
+// Load model for a Pico W node (mA and seconds)
+#define IDLE_CURRENT_MA 1.8f        // Dormant between wakes, radio off
+#define SAMPLE_CURRENT_MA 28.0f     // Core awake reading sensors
+#define SAMPLE_DURATION_S 0.3f
+#define RADIO_CURRENT_MA 65.0f      // Wi-Fi associate and post
+#define RADIO_CONNECT_S 3.0f
+#define RADIO_PER_UPLOAD_S 0.4f
+#define CHARGE_EFFICIENCY 0.85f
+
+typedef struct {
+    float hour;
+    float solar_ma;
+} profile_point_t;
+
+static profile_point_t profile[MAX_PROFILE_POINTS];
+static int profile_points = 0;
+
+static bool load_profile(const char *path) {
+    FILE *file = fopen(path, "r");
+    if (file == NULL) {
+        fprintf(stderr, "Cannot open profile %s\n", path);
+        return false;
+    }
+
+    char line[128];
+    while (fgets(line, sizeof(line), file) && profile_points < MAX_PROFILE_POINTS) {
+        profile_point_t point;
+        if (line[0] == '#' || sscanf(line, "%f,%f", &point.hour, &point.solar_ma) != 2) {
+            continue;  // Comments and header
+        }
+        profile[profile_points++] = point;
+    }
+    fclose(file);
+
+    if (profile_points < 2) {
+        fprintf(stderr, "Profile %s needs at least two points\n", path);
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Solar charge current at a point in time, interpolated and wrapped
+ * around the length of the profile
+ */
+static float solar_current_at(double hours) {
+    float span = profile[profile_points - 1].hour;
+    float t = span > 0.0f ? (float)(hours - span * (long)(hours / span)) : 0.0f;
+
+    for (int i = 1; i < profile_points; i++) {
+        if (t <= profile[i].hour) {
+            float width = profile[i].hour - profile[i - 1].hour;
+            float frac = width > 0.0f ? (t - profile[i - 1].hour) / width : 0.0f;
+            return profile[i - 1].solar_ma + frac * (profile[i].solar_ma - profile[i - 1].solar_ma);
+        }
+    }
+    return profile[profile_points - 1].solar_ma;
+}
+
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        fprintf(stderr, "Usage: %s <profile.csv> [days] [capacity_mAh] [initial_soc_pct]\n", argv[0]);
+        return 1;
+    }
+
+    int days = argc > 2 ? atoi(argv[2]) : 7;
+    float capacity_mah = argc > 3 ? (float)atof(argv[3]) : 2000.0f;
+    float soc = argc > 4 ? (float)atof(argv[4]) : 80.0f;
+
+    if (!load_profile(argv[1]) || days <= 0 || capacity_mah <= 0.0f) {
+        return 1;
+    }
+
+    energy_policy_t policy;
+    energy_policy_init(&policy, energy_policy_default_table, energy_policy_default_rows);
+
+    float charge_mah = capacity_mah * soc / 100.0f;
+    double next_sample_s = 0.0;
+    double next_radio_s = 0.0;
+    int queued = 0;
+    bool browned_out = false;
+
+    printf("day,min_soc,max_soc,end_soc,samples,uploads,row_hours\n");
+
+    for (int day = 0; day < days; day++) {
+        float min_soc = 100.0f;
+        float max_soc = 0.0f;
+        long samples = 0;
+        long uploads = 0;
+        double row_seconds[16] = {0};
+
+        for (int second = 0; second < 86400; second++) {
+            double now = (double)day * 86400.0 + second;
+            float solar_ma = solar_current_at(now / 3600.0);
+            bool charging = solar_ma > 0.0f && soc < 100.0f;
+            const energy_policy_row_t *row = energy_policy_update(&policy, soc, charging);
+
+            // Charge drawn and gained over this second, in mA*s
+            float load_mas = IDLE_CURRENT_MA;
+            if (now >= next_sample_s) {
+                load_mas += (SAMPLE_CURRENT_MA - IDLE_CURRENT_MA) * SAMPLE_DURATION_S;
+                samples++;
+                queued++;
+                next_sample_s = now + row->sample_interval_ms / 1000.0;
+            }
+            if (queued > 0 && (queued >= row->batch_size || now >= next_radio_s)) {
+                float radio_s = RADIO_CONNECT_S + RADIO_PER_UPLOAD_S * queued;
+                load_mas += (RADIO_CURRENT_MA - IDLE_CURRENT_MA) * radio_s;
+                uploads += queued;
+                queued = 0;
+                next_radio_s = now + row->radio_wake_ms / 1000.0;
+            }
+
+            charge_mah += (solar_ma * CHARGE_EFFICIENCY - load_mas) / 3600.0f;
+            if (charge_mah > capacity_mah) {
+                charge_mah = capacity_mah;
+            }
+            if (charge_mah <= 0.0f) {
+                charge_mah = 0.0f;
+                browned_out = true;
+            }
+
+            soc = charge_mah / capacity_mah * 100.0f;
+            if (soc < min_soc) min_soc = soc;
+            if (soc > max_soc) max_soc = soc;
+            if (policy.current_row < 16) {
+                row_seconds[policy.current_row] += 1.0;
+            }
+        }
+
+        printf("%d,%.1f,%.1f,%.1f,%ld,%ld,", day + 1, min_soc, max_soc, soc, samples, uploads);
+        for (int r = 0; r < policy.rows; r++) {
+            printf(r == 0 ? "%.1f" : "/%.1f", row_seconds[r] / 3600.0);
+        }
+        printf("\n");
+    }
+
+    if (browned_out) {
+        printf("WARNING: battery fully depleted during the run\n");
+        return 2;
+    }
+    return 0;
+}
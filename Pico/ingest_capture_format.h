@@ -0,0 +1,52 @@
+/**
+ * Ingest Capture File Format
+ *
+ * Written by the backend when INGEST_CAPTURE_PATH is set
+ * (backend/app/ingest_capture.py) and replayed by ingest_replay.c.
+ *
+ * A gzip stream of one header followed by one record per ingest request:
+ *
+ *   [header][record][body][record][body]...
+ *
+ * - delta_us is the time since the previous request arrived (0 for the
+ *   first), saturating at UINT32_MAX, so replays keep the recorded pacing.
+ * - The body is the request body exactly as received (JSON).
+ *
+ * All integers are little endian.
+ *
+ * Author: Smart Agriculture Team
+ * Date: October 2024
+ */
+
+#ifndef INGEST_CAPTURE_FORMAT_H
+#define INGEST_CAPTURE_FORMAT_H
+
+#include <stdint.h>
+
+#define INGEST_CAPTURE_MAGIC 0x43494741u     // "AGIC"
+#define INGEST_CAPTURE_VERSION 1
+
+// Routes, by index in the record
+#define INGEST_ROUTE_DATA 0
+#define INGEST_ROUTE_BATCH 1
+#define INGEST_ROUTE_COUNT 2
+
+static const char *const INGEST_ROUTE_PATHS[INGEST_ROUTE_COUNT] = {
+    "/api/sensors/data",
+    "/api/sensors/data/batch",
+};
+
+typedef struct __attribute__((packed)) {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t reserved;
+    uint64_t start_unix_us;   // Wall clock of the first request slot
+} ingest_capture_header_t;
+
+typedef struct __attribute__((packed)) {
+    uint32_t delta_us;        // Since the previous request arrived
+    uint32_t length;          // Body bytes following this record
+    uint8_t route;            // INGEST_ROUTE_*
+} ingest_capture_record_t;
+
+#endif // INGEST_CAPTURE_FORMAT_H
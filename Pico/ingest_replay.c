@@ -0,0 +1,737 @@
+/**
+ * Ingest Replay Harness (host build, zlib + pthreads)
+ *
+ * Replays ingest traffic captured by the backend (INGEST_CAPTURE_PATH,
+ * see ingest_capture_format.h) against a local backend: at the recorded
+ * pace scaled by --speed, or as fast as the connections allow. Reports
+ * throughput, latency percentiles and error classes; --save writes the
+ * report as JSON and --baseline compares the run with a saved report, so
+ * two builds of the ingest path can be compared head to head.
+ *
+ * Paced runs are open loop: each request is due at its recorded offset
+ * divided by the speed, and its latency counts from then, so a server
+ * that falls behind shows up in the percentiles instead of slowing the
+ * harness down with it.
+ *
+ * Usage: ingest_replay <capture.agic.gz> [--url http://127.0.0.1:8000]
+ *            [--speed 1|10|max] [--concurrency 8] [--no-reuse] [--loops 1]
+ *            [--save report.json] [--baseline report.json]
+ *        ingest_replay <capture.agic.gz> --info
+ *
+ * Author: Smart Agriculture Team
+ * Date: October 2024
+ */
+
+#define _GNU_SOURCE     // memmem, strcasestr
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <time.h>
+#include <errno.h>
+#include <signal.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <zlib.h>
+#include "ingest_capture_format.h"
+
+#define MAX_CONCURRENCY 256
+#define MAX_BODY (16 * 1024 * 1024)
+#define IO_TIMEOUT_S 10
+#define READ_BUFFER 16384
+
+typedef struct {
+    double offset_s;          // Since the first request of the capture
+    uint32_t length;
+    uint8_t route;
+    char *body;
+} request_t;
+
+static request_t *requests = NULL;
+static size_t request_count = 0;
+static double capture_span_s = 0;
+
+// Run configuration
+static char host[256] = "127.0.0.1";
+static char port[8] = "8000";
+static double speed = 1.0;            // 0: as fast as possible
+static int concurrency = 8;
+static int reuse = 1;
+static int loops = 1;
+static struct addrinfo *server = NULL;
+
+// Error classes; 0 is success
+#define ERR_CONNECT 1
+#define ERR_SEND 2
+#define ERR_TIMEOUT 3
+#define ERR_RESPONSE 4
+#define ERR_HTTP_4XX 5
+#define ERR_HTTP_5XX 6
+#define ERR_CLASSES 7
+
+static const char *const ERROR_NAMES[ERR_CLASSES] = {
+    "ok", "connect", "send", "timeout", "bad_response", "http_4xx", "http_5xx",
+};
+
+typedef struct {
+    double *latencies;        // Seconds, 2xx responses only
+    size_t count;
+    uint64_t errors[ERR_CLASSES];
+    uint64_t statuses[600];
+    uint64_t bytes_sent;
+    uint64_t connections;
+    double max_lag_s;         // Paced runs: latest start behind schedule
+} worker_stats_t;
+
+static atomic_size_t next_request;
+static double run_start = 0;
+
+static double now_s(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void sleep_until(double t) {
+    double wait = t - now_s();
+    if (wait > 0) {
+        struct timespec ts = {(time_t)wait, (long)((wait - (time_t)wait) * 1e9)};
+        nanosleep(&ts, NULL);
+    }
+}
+
+// ==================== CAPTURE ====================
+
+static int load_capture(const char *path) {
+    gzFile file = gzopen(path, "rb");
+    if (file == NULL) {
+        fprintf(stderr, "Cannot open %s\n", path);
+        return 0;
+    }
+    gzbuffer(file, 1 << 20);
+
+    ingest_capture_header_t header;
+    if (gzread(file, &header, sizeof(header)) != (int)sizeof(header) ||
+        header.magic != INGEST_CAPTURE_MAGIC || header.version != INGEST_CAPTURE_VERSION) {
+        fprintf(stderr, "%s is not an ingest capture\n", path);
+        gzclose(file);
+        return 0;
+    }
+
+    size_t capacity = 0;
+    double offset = 0;
+    ingest_capture_record_t record;
+    int got;
+    while ((got = gzread(file, &record, sizeof(record))) == (int)sizeof(record)) {
+        if (record.route >= INGEST_ROUTE_COUNT || record.length > MAX_BODY) {
+            fprintf(stderr, "Corrupt record %zu\n", request_count);
+            break;
+        }
+        if (request_count == capacity) {
+            capacity = capacity ? capacity * 2 : 4096;
+            request_t *grown = realloc(requests, capacity * sizeof(request_t));
+            if (grown == NULL) {
+                fprintf(stderr, "Out of memory\n");
+                break;
+            }
+            requests = grown;
+        }
+        request_t *r = &requests[request_count];
+        r->body = malloc(record.length ? record.length : 1);
+        if (r->body == NULL || gzread(file, r->body, record.length) != (int)record.length) {
+            fprintf(stderr, "Truncated record %zu\n", request_count);
+            free(r->body);
+            break;
+        }
+        offset += request_count ? record.delta_us / 1e6 : 0;
+        r->offset_s = offset;
+        r->length = record.length;
+        r->route = record.route;
+        request_count++;
+    }
+    if (got < 0) {
+        int code;
+        fprintf(stderr, "Read error: %s (replaying the %zu requests read)\n",
+                gzerror(file, &code), request_count);
+    }
+    gzclose(file);
+
+    // A loop lasts the capture plus one mean gap, so loops do not overlap
+    if (request_count > 1) {
+        capture_span_s = offset + offset / (request_count - 1);
+    }
+    return request_count > 0;
+}
+
+static void print_capture(void) {
+    size_t batches = 0;
+    uint64_t bytes = 0;
+    for (size_t i = 0; i < request_count; i++) {
+        batches += requests[i].route == INGEST_ROUTE_BATCH;
+        bytes += requests[i].length;
+    }
+    printf("capture: %zu requests (%zu batches), %.2f MB of bodies over %.1f s (%.1f req/s)\n",
+           request_count, batches, bytes / 1e6, capture_span_s,
+           capture_span_s > 0 ? request_count / capture_span_s : 0.0);
+}
+
+// ==================== HTTP ====================
+
+typedef struct {
+    int fd;
+    char data[READ_BUFFER];
+    size_t length;
+    size_t pos;
+} reader_t;
+
+/** @return 1 with more data buffered, 0 on close, -ERR_* on failure */
+static int fill(reader_t *reader) {
+    if (reader->pos == reader->length) {
+        reader->pos = reader->length = 0;
+    }
+    if (reader->length == sizeof(reader->data)) {
+        return -ERR_RESPONSE;
+    }
+    ssize_t n = recv(reader->fd, reader->data + reader->length,
+                     sizeof(reader->data) - reader->length, 0);
+    if (n < 0) {
+        return errno == EAGAIN || errno == EWOULDBLOCK ? -ERR_TIMEOUT : -ERR_RESPONSE;
+    }
+    reader->length += n;
+    return n > 0;
+}
+
+/** Next CRLF-terminated line, NUL terminated in place; NULL on failure */
+static char *read_line(reader_t *reader, int *error) {
+    for (;;) {
+        char *start = reader->data + reader->pos;
+        char *end = memmem(start, reader->length - reader->pos, "\r\n", 2);
+        if (end != NULL) {
+            *end = '\0';
+            reader->pos = end + 2 - reader->data;
+            return start;
+        }
+        // Keep the partial line at the front and read more
+        memmove(reader->data, start, reader->length - reader->pos);
+        reader->length -= reader->pos;
+        reader->pos = 0;
+        int rc = fill(reader);
+        if (rc <= 0) {
+            *error = rc < 0 ? -rc : ERR_RESPONSE;
+            return NULL;
+        }
+    }
+}
+
+/** @return 0, or ERR_* */
+static int skip_bytes(reader_t *reader, uint64_t n) {
+    while (n > 0) {
+        if (reader->pos == reader->length) {
+            int rc = fill(reader);
+            if (rc <= 0) {
+                return rc < 0 ? -rc : ERR_RESPONSE;
+            }
+        }
+        size_t take = reader->length - reader->pos;
+        if (take > n) {
+            take = n;
+        }
+        reader->pos += take;
+        n -= take;
+    }
+    return 0;
+}
+
+static int connect_server(void) {
+    for (struct addrinfo *a = server; a != NULL; a = a->ai_next) {
+        int fd = socket(a->ai_family, a->ai_socktype, a->ai_protocol);
+        if (fd < 0) {
+            continue;
+        }
+        struct timeval timeout = {IO_TIMEOUT_S, 0};
+        int one = 1;
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        if (connect(fd, a->ai_addr, a->ai_addrlen) == 0) {
+            return fd;
+        }
+        close(fd);
+    }
+    return -1;
+}
+
+/**
+ * Send one request and read its whole response
+ *
+ * @return HTTP status, or -ERR_* on failure; *keep says whether the
+ *         connection can carry another request
+ */
+static int exchange(int fd, const request_t *r, int *keep, uint64_t *sent) {
+    char head[512];
+    int head_length = snprintf(head, sizeof(head),
+                               "POST %s HTTP/1.1\r\nHost: %s:%s\r\n"
+                               "Content-Type: application/json\r\nContent-Length: %u\r\n"
+                               "Connection: %s\r\n\r\n",
+                               INGEST_ROUTE_PATHS[r->route], host, port, r->length,
+                               reuse ? "keep-alive" : "close");
+    struct iovec parts[2] = {{head, (size_t)head_length}, {r->body, r->length}};
+    size_t remaining = head_length + r->length;
+    int part = 0;
+    while (remaining > 0) {
+        ssize_t n = writev(fd, parts + part, 2 - part);
+        if (n <= 0) {
+            return errno == EAGAIN || errno == EWOULDBLOCK ? -ERR_TIMEOUT : -ERR_SEND;
+        }
+        remaining -= n;
+        *sent += n;
+        while (part < 2 && (size_t)n >= parts[part].iov_len) {
+            n -= parts[part].iov_len;
+            part++;
+        }
+        if (part < 2) {
+            parts[part].iov_base = (char *)parts[part].iov_base + n;
+            parts[part].iov_len -= n;
+        }
+    }
+
+    reader_t *reader = malloc(sizeof(reader_t));
+    if (reader == NULL) {
+        return -ERR_RESPONSE;
+    }
+    reader->fd = fd;
+    reader->length = reader->pos = 0;
+    int error = ERR_RESPONSE;
+    int status = -1;
+    long long content_length = -1;
+    int chunked = 0;
+    *keep = reuse;
+
+    char *line = read_line(reader, &error);
+    if (line == NULL || sscanf(line, "HTTP/1.%*d %d", &status) != 1) {
+        free(reader);
+        return -error;
+    }
+    while ((line = read_line(reader, &error)) != NULL && *line != '\0') {
+        if (strncasecmp(line, "Content-Length:", 15) == 0) {
+            content_length = atoll(line + 15);
+        } else if (strncasecmp(line, "Transfer-Encoding:", 18) == 0 && strcasestr(line, "chunked")) {
+            chunked = 1;
+        } else if (strncasecmp(line, "Connection:", 11) == 0 && strcasestr(line, "close")) {
+            *keep = 0;
+        }
+    }
+    if (line == NULL) {
+        free(reader);
+        return -error;
+    }
+
+    int rc = 0;
+    if (chunked) {
+        for (;;) {
+            line = read_line(reader, &error);
+            if (line == NULL) {
+                rc = error;
+                break;
+            }
+            long long size = strtoll(line, NULL, 16);
+            if (size == 0) {
+                // Trailers end with an empty line
+                while ((line = read_line(reader, &error)) != NULL && *line != '\0') {
+                }
+                rc = line == NULL ? error : 0;
+                break;
+            }
+            if ((rc = skip_bytes(reader, size + 2)) != 0) {
+                break;
+            }
+        }
+    } else if (content_length >= 0) {
+        rc = skip_bytes(reader, content_length);
+    } else {
+        *keep = 0;      // Body runs to the close
+        while ((rc = fill(reader)) > 0) {
+            reader->pos = reader->length;
+        }
+        rc = -rc;
+    }
+    free(reader);
+    return rc ? -rc : status;
+}
+
+// ==================== WORKERS ====================
+
+static void *worker(void *arg) {
+    worker_stats_t *stats = arg;
+    size_t total = request_count * loops;
+    int fd = -1;
+
+    for (;;) {
+        size_t n = atomic_fetch_add(&next_request, 1);
+        if (n >= total) {
+            break;
+        }
+        const request_t *r = &requests[n % request_count];
+        double started;
+        if (speed > 0) {
+            double due = run_start + ((n / request_count) * capture_span_s + r->offset_s) / speed;
+            sleep_until(due);
+            double lag = now_s() - due;
+            if (lag > stats->max_lag_s) {
+                stats->max_lag_s = lag;
+            }
+            started = due;
+        } else {
+            started = now_s();
+        }
+
+        // A reused connection may have been closed by the server while
+        // idle: retry once on a fresh one
+        int status = -ERR_CONNECT;
+        int keep = 0;
+        for (int attempt = 0; attempt < 2; attempt++) {
+            int reused = fd >= 0;
+            if (fd < 0) {
+                fd = connect_server();
+                if (fd < 0) {
+                    status = -ERR_CONNECT;
+                    break;
+                }
+                stats->connections++;
+            }
+            status = exchange(fd, r, &keep, &stats->bytes_sent);
+            if (status < 0 || !keep) {
+                close(fd);
+                fd = -1;
+            }
+            if (status >= 0 || !reused || status == -ERR_TIMEOUT) {
+                break;
+            }
+        }
+
+        double latency = now_s() - started;
+        if (status < 0) {
+            stats->errors[-status]++;
+            continue;
+        }
+        if (status < 600) {
+            stats->statuses[status]++;
+        }
+        if (status >= 500) {
+            stats->errors[ERR_HTTP_5XX]++;
+        } else if (status >= 400) {
+            stats->errors[ERR_HTTP_4XX]++;
+        } else {
+            stats->latencies[stats->count++] = latency;
+        }
+    }
+    if (fd >= 0) {
+        close(fd);
+    }
+    return NULL;
+}
+
+// ==================== REPORT ====================
+
+typedef struct {
+    double seconds;
+    uint64_t requests;
+    double throughput_rps;
+    double mb_per_s;
+    double mean_ms, p50_ms, p90_ms, p99_ms, p999_ms, max_ms;
+    uint64_t errors;
+    uint64_t error_classes[ERR_CLASSES];
+    double max_lag_ms;
+    uint64_t connections;
+} report_t;
+
+static int compare_doubles(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+static double percentile(const double *sorted, size_t n, double q) {
+    if (n == 0) {
+        return 0;
+    }
+    size_t i = (size_t)(q * n);
+    return sorted[i < n ? i : n - 1] * 1000;
+}
+
+static const char *const REPORT_KEYS[] = {
+    "throughput_rps", "p50_ms", "p90_ms", "p99_ms", "p999_ms", "max_ms", "errors",
+};
+
+static double report_value(const report_t *report, int key) {
+    switch (key) {
+        case 0: return report->throughput_rps;
+        case 1: return report->p50_ms;
+        case 2: return report->p90_ms;
+        case 3: return report->p99_ms;
+        case 4: return report->p999_ms;
+        case 5: return report->max_ms;
+        default: return report->errors;
+    }
+}
+
+static int save_report(const char *path, const report_t *report) {
+    FILE *file = fopen(path, "w");
+    if (file == NULL) {
+        fprintf(stderr, "Cannot write %s\n", path);
+        return 0;
+    }
+    fprintf(file, "{\n  \"speed\": %g,\n  \"concurrency\": %d,\n  \"reuse\": %d,\n"
+            "  \"seconds\": %.3f,\n  \"requests\": %llu,\n  \"mb_per_s\": %.3f,\n"
+            "  \"mean_ms\": %.3f,\n  \"max_lag_ms\": %.3f,\n  \"connections\": %llu,\n",
+            speed, concurrency, reuse, report->seconds, (unsigned long long)report->requests,
+            report->mb_per_s, report->mean_ms, report->max_lag_ms,
+            (unsigned long long)report->connections);
+    for (int e = ERR_CONNECT; e < ERR_CLASSES; e++) {
+        fprintf(file, "  \"error_%s\": %llu,\n", ERROR_NAMES[e],
+                (unsigned long long)report->error_classes[e]);
+    }
+    for (size_t k = 0; k < sizeof(REPORT_KEYS) / sizeof(REPORT_KEYS[0]); k++) {
+        fprintf(file, "  \"%s\": %.3f%s\n", REPORT_KEYS[k], report_value(report, k),
+                k + 1 < sizeof(REPORT_KEYS) / sizeof(REPORT_KEYS[0]) ? "," : "");
+    }
+    fprintf(file, "}\n");
+    fclose(file);
+    return 1;
+}
+
+/** Read a number saved by save_report; NAN if absent */
+static double saved_value(const char *text, const char *key) {
+    char pattern[64];
+    snprintf(pattern, sizeof(pattern), "\"%s\":", key);
+    const char *at = strstr(text, pattern);
+    return at != NULL ? strtod(at + strlen(pattern), NULL) : 0.0 / 0.0;
+}
+
+static void compare_baseline(const char *path, const report_t *report) {
+    FILE *file = fopen(path, "r");
+    if (file == NULL) {
+        fprintf(stderr, "Cannot read baseline %s\n", path);
+        return;
+    }
+    char text[8192];
+    size_t n = fread(text, 1, sizeof(text) - 1, file);
+    text[n] = '\0';
+    fclose(file);
+
+    printf("\nvs baseline %s:\n", path);
+    printf("  %-16s %12s %12s %9s\n", "", "baseline", "this run", "change");
+    for (size_t k = 0; k < sizeof(REPORT_KEYS) / sizeof(REPORT_KEYS[0]); k++) {
+        double before = saved_value(text, REPORT_KEYS[k]);
+        double after = report_value(report, k);
+        if (before != before) {
+            continue;
+        }
+        if (before != 0) {
+            printf("  %-16s %12.3f %12.3f %+8.1f%%\n", REPORT_KEYS[k], before, after,
+                   (after - before) / before * 100);
+        } else {
+            printf("  %-16s %12.3f %12.3f %9s\n", REPORT_KEYS[k], before, after, "-");
+        }
+    }
+}
+
+// ==================== MAIN ====================
+
+static int parse_url(const char *url) {
+    if (strncmp(url, "http://", 7) != 0) {
+        fprintf(stderr, "Only http:// URLs are supported\n");
+        return 0;
+    }
+    const char *start = url + 7;
+    size_t length = strcspn(start, ":/");
+    if (length == 0 || length >= sizeof(host)) {
+        return 0;
+    }
+    memcpy(host, start, length);
+    host[length] = '\0';
+    if (start[length] == ':') {
+        size_t digits = strcspn(start + length + 1, "/");
+        if (digits == 0 || digits >= sizeof(port)) {
+            return 0;
+        }
+        memcpy(port, start + length + 1, digits);
+        port[digits] = '\0';
+    } else {
+        strcpy(port, "80");
+    }
+    return 1;
+}
+
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        fprintf(stderr, "Usage: %s <capture.agic.gz> [--url URL] [--speed 1|10|max] "
+                "[--concurrency N] [--no-reuse] [--loops N] [--save FILE] [--baseline FILE] "
+                "| --info\n", argv[0]);
+        return 1;
+    }
+    const char *save_path = NULL;
+    const char *baseline_path = NULL;
+    int info = 0;
+    for (int i = 2; i < argc; i++) {
+        const char *value = i + 1 < argc ? argv[i + 1] : NULL;
+        if (strcmp(argv[i], "--info") == 0) {
+            info = 1;
+        } else if (strcmp(argv[i], "--no-reuse") == 0) {
+            reuse = 0;
+        } else if (value == NULL) {
+            fprintf(stderr, "%s needs a value\n", argv[i]);
+            return 1;
+        } else if (strcmp(argv[i], "--url") == 0) {
+            if (!parse_url(value)) {
+                fprintf(stderr, "Bad URL %s\n", value);
+                return 1;
+            }
+            i++;
+        } else if (strcmp(argv[i], "--speed") == 0) {
+            speed = strcmp(value, "max") == 0 ? 0 : atof(value);
+            i++;
+        } else if (strcmp(argv[i], "--concurrency") == 0) {
+            concurrency = atoi(value);
+            i++;
+        } else if (strcmp(argv[i], "--loops") == 0) {
+            loops = atoi(value);
+            i++;
+        } else if (strcmp(argv[i], "--save") == 0) {
+            save_path = value;
+            i++;
+        } else if (strcmp(argv[i], "--baseline") == 0) {
+            baseline_path = value;
+            i++;
+        } else {
+            fprintf(stderr, "Unknown option %s\n", argv[i]);
+            return 1;
+        }
+    }
+    if (speed < 0 || concurrency < 1 || concurrency > MAX_CONCURRENCY || loops < 1) {
+        fprintf(stderr, "Need speed > 0 or max, concurrency 1-%d, loops >= 1\n", MAX_CONCURRENCY);
+        return 1;
+    }
+
+    if (!load_capture(argv[1])) {
+        return 1;
+    }
+    print_capture();
+    if (info) {
+        return 0;
+    }
+
+    struct addrinfo hints = {0};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    int rc = getaddrinfo(host, port, &hints, &server);
+    if (rc != 0) {
+        fprintf(stderr, "Cannot resolve %s: %s\n", host, gai_strerror(rc));
+        return 1;
+    }
+    signal(SIGPIPE, SIG_IGN);
+
+    size_t total = request_count * loops;
+    worker_stats_t *stats = calloc(concurrency, sizeof(worker_stats_t));
+    pthread_t *threads = calloc(concurrency, sizeof(pthread_t));
+    if (stats == NULL || threads == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        return 1;
+    }
+    printf("replay: %zu requests to %s:%s, concurrency %d, %s connections, ",
+           total, host, port, concurrency, reuse ? "reused" : "new");
+    if (speed > 0) {
+        printf("%gx speed (about %.1f s)\n", speed, loops * capture_span_s / speed);
+    } else {
+        printf("max speed\n");
+    }
+
+    atomic_init(&next_request, 0);
+    run_start = now_s() + 0.1;
+    for (int t = 0; t < concurrency; t++) {
+        stats[t].latencies = malloc(total * sizeof(double));
+        if (stats[t].latencies == NULL ||
+            pthread_create(&threads[t], NULL, worker, &stats[t]) != 0) {
+            fprintf(stderr, "Cannot start worker %d\n", t);
+            return 1;
+        }
+    }
+    for (int t = 0; t < concurrency; t++) {
+        pthread_join(threads[t], NULL);
+    }
+
+    // Merge the workers
+    report_t report = {0};
+    report.seconds = now_s() - run_start;
+    double *latencies = malloc((total ? total : 1) * sizeof(double));
+    uint64_t statuses[600] = {0};
+    uint64_t bytes = 0;
+    size_t ok = 0;
+    double sum = 0;
+    for (int t = 0; t < concurrency; t++) {
+        memcpy(latencies + ok, stats[t].latencies, stats[t].count * sizeof(double));
+        ok += stats[t].count;
+        for (size_t i = 0; i < stats[t].count; i++) {
+            sum += stats[t].latencies[i];
+        }
+        for (int e = ERR_CONNECT; e < ERR_CLASSES; e++) {
+            report.error_classes[e] += stats[t].errors[e];
+            report.errors += stats[t].errors[e];
+        }
+        for (int s = 0; s < 600; s++) {
+            statuses[s] += stats[t].statuses[s];
+        }
+        bytes += stats[t].bytes_sent;
+        report.connections += stats[t].connections;
+        if (stats[t].max_lag_s * 1000 > report.max_lag_ms) {
+            report.max_lag_ms = stats[t].max_lag_s * 1000;
+        }
+    }
+    qsort(latencies, ok, sizeof(double), compare_doubles);
+    report.requests = total;
+    report.throughput_rps = ok / report.seconds;
+    report.mb_per_s = bytes / 1e6 / report.seconds;
+    report.mean_ms = ok ? sum / ok * 1000 : 0;
+    report.p50_ms = percentile(latencies, ok, 0.50);
+    report.p90_ms = percentile(latencies, ok, 0.90);
+    report.p99_ms = percentile(latencies, ok, 0.99);
+    report.p999_ms = percentile(latencies, ok, 0.999);
+    report.max_ms = ok ? latencies[ok - 1] * 1000 : 0;
+
+    printf("\n%zu ok of %zu in %.2f s: %.1f req/s, %.2f MB/s sent, %llu connections\n",
+           ok, total, report.seconds, report.throughput_rps, report.mb_per_s,
+           (unsigned long long)report.connections);
+    printf("latency ms: mean %.2f  p50 %.2f  p90 %.2f  p99 %.2f  p99.9 %.2f  max %.2f\n",
+           report.mean_ms, report.p50_ms, report.p90_ms, report.p99_ms, report.p999_ms,
+           report.max_ms);
+    if (speed > 0) {
+        printf("max start lag behind schedule: %.1f ms\n", report.max_lag_ms);
+    }
+    printf("errors: %llu", (unsigned long long)report.errors);
+    for (int e = ERR_CONNECT; e < ERR_CLASSES; e++) {
+        if (report.error_classes[e]) {
+            printf("  %s %llu", ERROR_NAMES[e], (unsigned long long)report.error_classes[e]);
+        }
+    }
+    printf("\nstatus:");
+    for (int s = 0; s < 600; s++) {
+        if (statuses[s]) {
+            printf("  %d x%llu", s, (unsigned long long)statuses[s]);
+        }
+    }
+    printf("\n");
+
+    if (save_path != NULL && save_report(save_path, &report)) {
+        printf("report saved to %s\n", save_path);
+    }
+    if (baseline_path != NULL) {
+        compare_baseline(baseline_path, &report);
+    }
+    return report.errors ? 2 : 0;
+}
@@ -8,6 +8,7 @@
  * - DHT22 (Temperature & Humidity)
  * - Soil Moisture (Analog)
  * - LDR Light Sensor (Analog)
+ * - Up to 16 soil moisture probes through an analog mux (CD4051/74HC4067)
  * - Additional analog sensors can be easily added
  * 
  * Author: Smart Agriculture Team
@@ -25,6 +26,14 @@
 #include "hardware/adc.h"
 #include "hardware/gpio.h"
 #include "pico/time.h"
+#include "pico/rand.h"
+#include "analog_mux.h"
+#include "sensor_power.h"
+#include "battery_monitor.h"
+#include "energy_policy.h"
+#include "sd_archive.h"
+#include "usb_dump.h"
+#include "telemetry_schema.h"
 
 // ==================== CONFIGURATION ====================
 // Wi-Fi Configuration - EDIT THESE VALUES
@@ -35,6 +44,7 @@
 #define SERVER_HOST "smart-agriculture-backend-y747.onrender.com"  // Your deployed backend URL
 #define SERVER_PORT 443  // Use 443 for HTTPS, 80 for HTTP
 #define API_ENDPOINT "/api/sensors/data"  // New endpoint for receiving Pico data
+#define DEVICE_ID "pico_w_001"
 
 // Pin Configurations
 #define DHT22_PIN 15         // GPIO15 for DHT22 data pin
@@ -42,20 +52,78 @@
 #define LDR_PIN 27          // ADC1 (GPIO27) for light sensor
 #define STATUS_LED_PIN 25   // Built-in LED for status indication
 
+// Analog Mux Configuration (soil moisture probe array)
+#define MUX_ENABLED 1        // Set to 0 if no mux board is fitted
+#define MUX_ADC_INPUT 2      // ADC2 (GPIO28) wired to mux common pin
+#define MUX_S0_PIN 2         // GPIO2-5 drive select lines S0-S3
+#define MUX_S1_PIN 3
+#define MUX_S2_PIN 4
+#define MUX_S3_PIN 5
+#define MUX_EN_PIN 6         // Active-low enable, -1 if tied to GND
+#define MUX_SELECT_BITS 4    // 3 for CD4051, 4 for 74HC4067
+#define MUX_PROBE_COUNT 16   // Probes wired to channels 0..N-1
+#define MUX_SAMPLES 16       // ADC samples averaged per probe
+#define MUX_SETTLE_US 100    // Settle time after switching (long probe leads)
+
+// ADC Calibration, in 12-bit counts (adc_read() and analog_mux_get())
+#define ADC_MAX_COUNT 4095
+#define SOIL_DRY_COUNT 4062  // Dry soil (calibrate for your sensor)
+#define SOIL_WET_COUNT 1875  // Wet soil
+
+// Probe Power Gating (GPIO driven MOSFET per probe supply)
+#define SOIL_POWER_PIN 7     // Soil moisture probe VCC switch
+#define LDR_POWER_PIN 8      // LDR divider VCC switch
+#define PROBES_POWER_PIN 9   // Mux probe array VCC switch
+#define SOIL_WARMUP_US 100000   // Initial value, refined by learning
+#define LDR_WARMUP_US 2000      // Initial value, refined by learning
+#define PROBES_WARMUP_US 20000  // Configured, mux probes cannot be learned
+#define SAMPLE_WINDOW_US 50000  // Rails are forced off this long after the slowest is warm
+#define WARMUP_RELEARN_CYCLES 720  // Re-learn warm-up about once an hour
+
+// SD Card Archive (SPI0: GPIO16-19, see sd_spi.c)
+#define SD_ARCHIVE_ENABLED 1     // Set to 0 if no SD card socket is fitted
+#define SD_BENCH_BLOCKS 64       // 256 KB write benchmark at boot
+#define SD_FLUSH_INTERVAL_MS 900000  // Partial blocks reach the card at least every 15 min
+
+// Battery Monitoring
+#define CHARGE_STATUS_PIN 10 // Solar charger CHRG output (active low), -1 if none
+
 // Timing Configuration
-#define SENSOR_READ_INTERVAL_MS 5000  // Read sensors every 5 seconds
+// Sample interval, upload batch size and radio wake period come from the
+// energy policy table in energy_policy.c and stretch as the battery drains
+#define MAX_PENDING_PAYLOADS 16      // Readings queued between radio wakes
 #define HTTP_RETRY_DELAY_MS 2000     // Retry delay on HTTP failure
 #define MAX_HTTP_RETRIES 3           // Maximum HTTP retry attempts
 
 // Buffer sizes
 #define HTTP_BUFFER_SIZE 1024
-#define JSON_BUFFER_SIZE 512
+#define JSON_BUFFER_SIZE 1024
 
 // ==================== GLOBAL VARIABLES ====================
 static char json_payload[JSON_BUFFER_SIZE];
 static char http_response_buffer[HTTP_BUFFER_SIZE];
 static bool wifi_connected = false;
 static bool server_available = false;
+static bool mux_available = false;
+static float probe_moisture[MUX_PROBE_COUNT];
+static uint32_t sensor_cycle_count = 0;
+
+// Clock identity: readings are stamped with uptime, so the backend needs
+// to know which boot a timestamp belongs to and in what order it was taken
+static uint32_t boot_id;
+static uint32_t reading_seq = 0;
+
+// Energy-aware scheduling state
+static energy_policy_t energy_policy;
+static const energy_policy_row_t *active_policy = NULL;
+static battery_status_t battery_status;
+static char pending_payloads[MAX_PENDING_PAYLOADS][JSON_BUFFER_SIZE];
+static int pending_count = 0;
+static bool sd_available = false;
+
+// Rail indexes into the sensor_power table
+enum { RAIL_SOIL = 0, RAIL_LDR, RAIL_PROBES, RAIL_COUNT };
+#define RAIL_MASK_ALL ((1u << RAIL_COUNT) - 1)
 
 // ==================== DHT22 FUNCTIONS ====================
 // Simplified DHT22 implementation for this example
@@ -95,19 +163,11 @@ void init_adc() {
 }
 
 /**
- * Read soil moisture sensor (0-100%)
+ * Convert a 12-bit ADC value to soil moisture (0-100%)
  * Returns percentage where 0% = very dry, 100% = very wet
  */
-float read_soil_moisture() {
-    adc_select_input(0);  // Select ADC0 (GPIO26)
-    uint16_t raw = adc_read();
-    
-    // Convert to percentage (calibrate these values based on your sensor)
-    // Typical values: dry soil ~65000, wet soil ~30000
-    const uint16_t DRY_VALUE = 65000;
-    const uint16_t WET_VALUE = 30000;
-    
-    float moisture = ((float)(DRY_VALUE - raw) / (DRY_VALUE - WET_VALUE)) * 100.0f;
+float soil_moisture_from_raw(uint16_t raw) {
+    float moisture = ((float)(SOIL_DRY_COUNT - (int32_t)raw) / (SOIL_DRY_COUNT - SOIL_WET_COUNT)) * 100.0f;
     
     // Clamp to 0-100%
     if (moisture < 0) moisture = 0;
@@ -116,6 +176,66 @@ float read_soil_moisture() {
     return moisture;
 }
 
+/**
+ * Read the directly wired soil moisture sensor (0-100%)
+ */
+float read_soil_moisture() {
+    adc_select_input(0);  // Select ADC0 (GPIO26)
+    return soil_moisture_from_raw(adc_read());
+}
+
+static uint16_t sample_soil_raw(void) {
+    adc_select_input(0);
+    return adc_read();
+}
+
+static uint16_t sample_ldr_raw(void) {
+    adc_select_input(1);
+    return adc_read();
+}
+
+/**
+ * Initialize probe power switches and learn initial warm-up times
+ */
+void init_sensor_power() {
+    const sensor_power_rail_t rails[RAIL_COUNT] = {
+        [RAIL_SOIL] = {"soil", SOIL_POWER_PIN, true, SOIL_WARMUP_US, SAMPLE_WINDOW_US, 5.0f, sample_soil_raw},
+        [RAIL_LDR] = {"ldr", LDR_POWER_PIN, true, LDR_WARMUP_US, SAMPLE_WINDOW_US, 0.3f, sample_ldr_raw},
+        [RAIL_PROBES] = {"probes", PROBES_POWER_PIN, true, PROBES_WARMUP_US, SAMPLE_WINDOW_US, 16.0f, NULL},
+    };
+    sensor_power_init(rails, RAIL_COUNT);
+    
+    for (int i = 0; i < RAIL_COUNT; i++) {
+        uint32_t warmup = sensor_power_learn_warmup(i);
+        if (warmup > 0) {
+            printf("Learned %s warm-up: %lu us\n", rails[i].name, (unsigned long)warmup);
+        }
+    }
+}
+
+/**
+ * Initialize the analog mux probe array
+ */
+void init_mux() {
+#if MUX_ENABLED
+    analog_mux_config_t config = {
+        .select_pins = {MUX_S0_PIN, MUX_S1_PIN, MUX_S2_PIN, MUX_S3_PIN},
+        .select_bits = MUX_SELECT_BITS,
+        .enable_pin = MUX_EN_PIN,
+        .adc_input = MUX_ADC_INPUT,
+        .channel_count = MUX_PROBE_COUNT,
+        .samples_per_channel = MUX_SAMPLES,
+    };
+    for (int i = 0; i < MUX_PROBE_COUNT; i++) {
+        config.settle_us[i] = MUX_SETTLE_US;
+    }
+    mux_available = analog_mux_init(&config);
+    if (!mux_available) {
+        printf("✗ Analog mux configuration invalid - probe array disabled\n");
+    }
+#endif
+}
+
 /**
  * Read light sensor (0-100%)
  * Returns percentage where 0% = dark, 100% = bright
@@ -125,7 +245,7 @@ float read_light_intensity() {
     uint16_t raw = adc_read();
     
     // Convert to percentage (0-100%)
-    float light = ((float)raw / 65535.0f) * 100.0f;
+    float light = ((float)raw / ADC_MAX_COUNT) * 100.0f;
     
     return light;
 }
@@ -152,27 +272,71 @@ void status_led_blink(int count, int delay_ms) {
  * Create JSON payload with sensor data
  */
 void create_json_payload(dht22_reading_t dht, float soil_moisture, float light_intensity) {
-    snprintf(json_payload, JSON_BUFFER_SIZE,
-        "{"
-        "\"device_id\":\"pico_w_001\","
-        "\"timestamp\":%llu,"
-        "\"soil_moisture\":%.2f,"
-        "\"soil_temperature\":%.2f,"
-        "\"humidity\":%.2f,"
-        "\"light_intensity\":%.2f,"
-        "\"soil_ph\":7.0,"  // Placeholder - add actual pH sensor if available
-        "\"npk\":{"
-            "\"nitrogen\":50,"
-            "\"phosphorus\":30,"
-            "\"potassium\":40"
-        "}"
-        "}",
-        to_us_since_boot(get_absolute_time()) / 1000000,  // Unix timestamp approximation
-        soil_moisture,
-        dht.temperature,
-        dht.humidity,
-        light_intensity
-    );
+    sensor_power_stats_t power_stats;
+    sensor_power_get_stats(&power_stats);
+    
+    telemetry_pico_env_t reading = {
+        .timestamp = to_us_since_boot(get_absolute_time()) / 1000000,  // Uptime; mapped to Unix time by the backend
+        .soil_moisture = soil_moisture,
+        .soil_temperature = dht.temperature,
+        .humidity = dht.humidity,
+        .light_intensity = light_intensity
+    };
+    
+    // Record type PICO_ENV (telemetry_schema.h): no pH/NPK hardware, so
+    // those fields are absent rather than placeholders. Left open for the
+    // extras below.
+    int len = telemetry_pico_env_encode_json(json_payload, JSON_BUFFER_SIZE, DEVICE_ID, &reading);
+    if (len < JSON_BUFFER_SIZE) {
+        len += snprintf(json_payload + len, JSON_BUFFER_SIZE - len, ",\"boot_id\":%lu,\"seq\":%lu",
+                        (unsigned long)boot_id, (unsigned long)reading_seq++);
+    }
+    
+    // Per-probe moisture from the mux array
+    if (mux_available && len < JSON_BUFFER_SIZE) {
+        len += snprintf(json_payload + len, JSON_BUFFER_SIZE - len, ",\"soil_moisture_probes\":[");
+        for (int i = 0; i < MUX_PROBE_COUNT && len < JSON_BUFFER_SIZE; i++) {
+            len += snprintf(json_payload + len, JSON_BUFFER_SIZE - len,
+                            i == 0 ? "%.2f" : ",%.2f", probe_moisture[i]);
+        }
+        if (len < JSON_BUFFER_SIZE) {
+            len += snprintf(json_payload + len, JSON_BUFFER_SIZE - len, "]");
+        }
+    }
+    
+    // Stats object: probe power, battery policy and SD archive
+    if (len < JSON_BUFFER_SIZE) {
+        len += snprintf(json_payload + len, JSON_BUFFER_SIZE - len,
+            ",\"stats\":{"
+            "\"probe_duty_pct\":%.3f,"
+            "\"probe_energy_saved_mwh\":%.2f,"
+            "\"vsys_v\":%.3f,"
+            "\"battery_soc_pct\":%.1f,"
+            "\"charging\":%s,"
+            "\"policy_row\":%u",
+            power_stats.avg_duty_pct,
+            power_stats.energy_saved_mwh,
+            battery_status.vsys_v,
+            battery_status.soc_pct,
+            battery_status.charging ? "true" : "false",
+            energy_policy.current_row
+        );
+    }
+    if (sd_available && len < JSON_BUFFER_SIZE) {
+        sd_archive_stats_t archive_stats;
+        sd_archive_get_stats(&archive_stats);
+        len += snprintf(json_payload + len, JSON_BUFFER_SIZE - len,
+            ",\"archive_records\":%lu,"
+            "\"archive_dropped\":%lu,"
+            "\"archive_write_kbps\":%.1f",
+            (unsigned long)archive_stats.records,
+            (unsigned long)archive_stats.dropped,
+            archive_stats.write_kbps
+        );
+    }
+    if (len < JSON_BUFFER_SIZE) {
+        snprintf(json_payload + len, JSON_BUFFER_SIZE - len, "}}");
+    }
 }
 
 // ==================== HTTP CLIENT FUNCTIONS ====================
@@ -262,16 +426,9 @@ bool send_sensor_data() {
 // ==================== WIFI FUNCTIONS ====================
 
 /**
- * Initialize Wi-Fi and connect to network
+ * Join the configured network, used at startup and after radio sleep
  */
-bool wifi_init_and_connect() {
-    printf("Initializing Wi-Fi...\n");
-    
-    if (cyw43_arch_init()) {
-        printf("✗ Wi-Fi init failed\n");
-        return false;
-    }
-    
+bool wifi_connect() {
     cyw43_arch_enable_sta_mode();
     printf("Connecting to Wi-Fi network: %s\n", WIFI_SSID);
     
@@ -291,6 +448,31 @@ bool wifi_init_and_connect() {
     return true;
 }
 
+/**
+ * Initialize Wi-Fi and connect to network
+ */
+bool wifi_init_and_connect() {
+    printf("Initializing Wi-Fi...\n");
+    
+    if (cyw43_arch_init()) {
+        printf("✗ Wi-Fi init failed\n");
+        return false;
+    }
+    
+    return wifi_connect();
+}
+
+/**
+ * Switch the radio off between wakes when the policy batches uploads
+ */
+void wifi_sleep() {
+    if (wifi_connected) {
+        cyw43_arch_disable_sta_mode();
+        wifi_connected = false;
+        printf("Wi-Fi radio sleeping until next wake\n");
+    }
+}
+
 // ==================== TEST FUNCTIONS ====================
 
 /**
@@ -321,6 +503,11 @@ void init_sensors() {
     
     // Initialize ADC for analog sensors
     init_adc();
+    init_mux();
+    init_sensor_power();
+    battery_monitor_init(CHARGE_STATUS_PIN);
+    energy_policy_init(&energy_policy, energy_policy_default_table, energy_policy_default_rows);
+    active_policy = &energy_policy_default_table[0];
     
     // Initialize DHT22 pin
     gpio_init(DHT22_PIN);
@@ -339,24 +526,138 @@ void init_sensors() {
 void read_and_display_sensors() {
     printf("\n=== Reading Sensors ===\n");
     
+    // Periodically re-learn warm-up as probes and soil conditions age
+    if (++sensor_cycle_count % WARMUP_RELEARN_CYCLES == 0) {
+        sensor_power_learn_warmup(RAIL_SOIL);
+        sensor_power_learn_warmup(RAIL_LDR);
+    }
+    
+    // Power the probes and read the DHT22 while they warm up
+    uint32_t rails = (1u << RAIL_SOIL) | (1u << RAIL_LDR);
+    if (mux_available) {
+        rails |= 1u << RAIL_PROBES;
+    }
+    sensor_power_on(rails);
+    
     // Read DHT22
     dht22_reading_t dht = read_dht22();
     
+    sensor_power_wait_ready(rails);
+    
+    // Scan the probe array before using the ADC directly
+    if (mux_available) {
+        analog_mux_start_scan();
+        analog_mux_wait();
+        for (int i = 0; i < MUX_PROBE_COUNT; i++) {
+            probe_moisture[i] = soil_moisture_from_raw(analog_mux_get(i));
+        }
+    }
+    
     // Read analog sensors
     float soil_moisture = read_soil_moisture();
     float light_intensity = read_light_intensity();
+    sensor_power_off(RAIL_MASK_ALL);
+    
+    // Battery state drives the sampling and upload policy
+    battery_status = battery_monitor_read();
+    uint8_t previous_row = energy_policy.current_row;
+    active_policy = energy_policy_update(&energy_policy, battery_status.soc_pct,
+                                         battery_status.charging);
     
     // Display readings
     printf("Temperature: %.2f°C\n", dht.temperature);
     printf("Humidity: %.2f%%\n", dht.humidity);
     printf("Soil Moisture: %.2f%%\n", soil_moisture);
     printf("Light Intensity: %.2f%%\n", light_intensity);
+    printf("Battery: %.2fV (%.0f%%)%s, policy row %u\n", battery_status.vsys_v,
+           battery_status.soc_pct, battery_status.charging ? " charging" : "",
+           energy_policy.current_row);
+    if (mux_available) {
+        printf("Probe Array (%lu us scan):", (unsigned long)analog_mux_last_scan_us());
+        for (int i = 0; i < MUX_PROBE_COUNT; i++) {
+            printf(" %.1f", probe_moisture[i]);
+        }
+        printf("\n");
+    }
+    
+    // Archive the raw reading locally
+    if (sd_available) {
+        archive_reading_t record = {
+            .timestamp = (uint32_t)(to_us_since_boot(get_absolute_time()) / 1000000),
+            .soil_moisture = soil_moisture,
+            .soil_temperature = dht.temperature,
+            .humidity = dht.humidity,
+            .light_intensity = light_intensity,
+            .vsys = battery_status.vsys_v,
+            .probe_count = mux_available ? MUX_PROBE_COUNT : 0,
+        };
+        for (int i = 0; i < record.probe_count; i++) {
+            record.probes[i] = probe_moisture[i];
+        }
+        sd_archive_append(&record);
+        
+        // Stepping down to a slower row: the next block may take hours to
+        // fill, so write out what the battery might not live to flush
+        if (energy_policy.current_row > previous_row) {
+            sd_archive_flush();
+        }
+    }
     
     // Create JSON payload
     create_json_payload(dht, soil_moisture, light_intensity);
     printf("JSON Payload: %s\n", json_payload);
 }
 
+/**
+ * Queue the current JSON payload for the next radio wake
+ */
+void queue_payload() {
+    if (pending_count == MAX_PENDING_PAYLOADS) {
+        // Queue full - drop the oldest reading
+        memmove(pending_payloads[0], pending_payloads[1],
+                (MAX_PENDING_PAYLOADS - 1) * JSON_BUFFER_SIZE);
+        pending_count--;
+    }
+    strcpy(pending_payloads[pending_count++], json_payload);
+}
+
+/**
+ * Upload queued payloads, keeping any that fail for the next wake
+ */
+void flush_pending_payloads() {
+    int sent = 0;
+    int retry_count = 0;
+    
+    while (sent < pending_count) {
+        strcpy(json_payload, pending_payloads[sent]);
+        
+        if (send_sensor_data()) {
+            sent++;
+            retry_count = 0;  // Reset retry counter on success
+            
+            // Let lwIP process the request before the next one
+            sleep_ms(100);
+            cyw43_arch_poll();
+        } else {
+            retry_count++;
+            printf("HTTP send failed, retry %d/%d\n", retry_count, MAX_HTTP_RETRIES);
+            
+            if (retry_count >= MAX_HTTP_RETRIES) {
+                printf("Max retries reached, will try again next wake\n");
+                break;
+            }
+            sleep_ms(HTTP_RETRY_DELAY_MS);
+        }
+    }
+    
+    // Keep unsent payloads at the front of the queue
+    if (sent > 0) {
+        memmove(pending_payloads[0], pending_payloads[sent],
+                (size_t)(pending_count - sent) * JSON_BUFFER_SIZE);
+        pending_count -= sent;
+    }
+}
+
 /**
  * Main application loop
  */
@@ -364,43 +665,56 @@ void main_loop() {
     printf("\n=== Starting Main Loop ===\n");
     
     absolute_time_t last_sensor_read = get_absolute_time();
-    int retry_count = 0;
+    absolute_time_t last_radio_wake = get_absolute_time();
+    absolute_time_t last_archive_flush = get_absolute_time();
     
     while (true) {
         // Check if it's time to read sensors
         if (absolute_time_diff_us(last_sensor_read, get_absolute_time()) >= 
-            SENSOR_READ_INTERVAL_MS * 1000) {
+            (int64_t)active_policy->sample_interval_ms * 1000) {
             
-            // Read all sensors
+            // Read all sensors and queue the reading
             read_and_display_sensors();
+            queue_payload();
+            last_sensor_read = get_absolute_time();
+        }
+        
+        // Wake the radio when a batch is full or the wake period elapsed
+        bool radio_due = pending_count >= active_policy->batch_size ||
+            absolute_time_diff_us(last_radio_wake, get_absolute_time()) >=
+            (int64_t)active_policy->radio_wake_ms * 1000;
+        
+        if (pending_count > 0 && radio_due) {
+            if (!wifi_connected) {
+                wifi_connect();
+            }
             
             // Send data to server if Wi-Fi is connected
             if (wifi_connected) {
-                bool success = send_sensor_data();
-                
-                if (success) {
-                    retry_count = 0;  // Reset retry counter on success
-                } else {
-                    retry_count++;
-                    printf("HTTP send failed, retry %d/%d\n", retry_count, MAX_HTTP_RETRIES);
-                    
-                    if (retry_count >= MAX_HTTP_RETRIES) {
-                        printf("Max retries reached, will try again next cycle\n");
-                        retry_count = 0;
-                    } else {
-                        sleep_ms(HTTP_RETRY_DELAY_MS);
-                        continue;  // Skip updating last_sensor_read to retry immediately
-                    }
-                }
+                flush_pending_payloads();
             } else {
-                printf("Wi-Fi not connected, skipping server upload\n");
+                printf("Wi-Fi not connected, keeping %d readings queued\n", pending_count);
             }
+            last_radio_wake = get_absolute_time();
             
-            last_sensor_read = get_absolute_time();
+            // Keep the radio up only while the policy uploads every sample
+            if (active_policy->radio_wake_ms > active_policy->sample_interval_ms) {
+                wifi_sleep();
+            }
+        }
+        
+        // Bound what a brown-out can lose from a slowly filling block
+        if (sd_available && absolute_time_diff_us(last_archive_flush, get_absolute_time()) >=
+            (int64_t)SD_FLUSH_INTERVAL_MS * 1000) {
+            sd_archive_flush();
+            last_archive_flush = get_absolute_time();
         }
         
-        // Small delay to prevent busy waiting
-        sleep_ms(100);
+        // Hand finished card reads back to a paused USB dump
+        usb_dump_task();
+        
+        // Small delay to prevent busy waiting, short while a dump streams
+        sleep_ms(usb_dump_active() ? 1 : 100);
         
         // Handle Wi-Fi events
         cyw43_arch_poll();
@@ -417,12 +731,16 @@ int main() {
     // Wait for serial connection (for debugging)
     sleep_ms(3000);
     
+    // Fresh per boot, from the ROSC/timer entropy of pico_rand
+    boot_id = get_rand_32();
+    
     printf("\n");
     printf("========================================\n");
     printf("  Smart Agriculture - Pico W IoT Node  \n");
     printf("========================================\n");
     printf("Firmware Version: 1.0\n");
     printf("Build Date: %s %s\n", __DATE__, __TIME__);
+    printf("Boot ID: %08lx\n", (unsigned long)boot_id);
     printf("Wi-Fi Network: %s\n", WIFI_SSID);
     printf("Backend Server: %s\n", SERVER_HOST);
     printf("========================================\n\n");
@@ -430,6 +748,19 @@ int main() {
     // Initialize sensors
     init_sensors();
     
+    // Open the SD archive and check it keeps up with the sampling rate
+#if SD_ARCHIVE_ENABLED
+    sd_available = sd_archive_init(boot_id);
+    if (sd_available) {
+        float kbps = sd_archive_benchmark(SD_BENCH_BLOCKS);
+        float needed_kbps = (float)(sizeof(archive_record_header_t) + sizeof(archive_reading_t)) /
+                            1024.0f / (energy_policy_default_table[0].sample_interval_ms / 1000.0f);
+        printf("SD sustained write: %.1f KB/s, sampling needs %.3f KB/s (%.0fx headroom)\n",
+               kbps, needed_kbps, needed_kbps > 0 ? kbps / needed_kbps : 0);
+    }
+    usb_dump_init(sd_available);
+#endif
+    
     // Initialize and connect to Wi-Fi
     if (!wifi_init_and_connect()) {
         printf("✗ Startup failed - Wi-Fi connection failed\n");
@@ -0,0 +1,390 @@
+/**
+ * SD Card Archive Logger for Raspberry Pi Pico W
+ *
+ * Core 0 packs records into the active half of a 4 KB double buffer.
+ * When a record no longer fits, the half is handed to core 1 through the
+ * multicore FIFO and packing continues in the other half. Core 1 owns
+ * FatFS: it stamps the block sequence and CRC, writes the block with a
+ * single aligned f_write (FatFS passes whole sectors straight to the DMA
+ * driver), and emits an index block every ARCHIVE_INDEX_INTERVAL blocks.
+ *
+ * Author: Smart Agriculture Team
+ * Date: October 2024
+ */
+
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include "pico/stdlib.h"
+#include "pico/multicore.h"
+#include "hardware/sync.h"
+#include "ff.h"
+#include "sd_archive.h"
+
+#define SYNC_INTERVAL_BLOCKS 16       // f_sync at least every 64 KB
+#define RECOVERY_SCAN_BLOCKS (ARCHIVE_INDEX_INTERVAL + 1)
+#define BENCH_FILE "BENCH.TMP"
+
+// Core 0 -> core 1 FIFO commands
+#define CMD_WRITE_BUFFER 0x00000000u  // | buffer index
+#define CMD_BENCHMARK 0x80000000u     // | block count
+#define CMD_READ_BLOCK 0x40000000u    // followed by a sd_archive_read_t pointer
+
+// ==================== STATE ====================
+static FATFS fs;
+static FIL archive;
+static bool archive_open = false;
+
+// Double buffer, aligned for whole-sector transfers
+static uint8_t buffers[2][ARCHIVE_BLOCK_SIZE] __attribute__((aligned(4)));
+static volatile bool buffer_busy[2] = {false, false};
+static uint8_t active = 0;
+static uint32_t fill = 0;     // Bytes used in the active buffer
+
+// Writer state, only touched by core 1 after launch
+static uint8_t writer_block[ARCHIVE_BLOCK_SIZE] __attribute__((aligned(4)));
+static uint32_t next_seq = 0;
+static uint32_t prev_index_block = ARCHIVE_NO_BLOCK;
+static archive_index_payload_t pending_index;
+static uint32_t pending_entries = 0;
+static uint32_t blocks_since_sync = 0;
+
+static volatile sd_archive_stats_t stats;
+static volatile uint64_t write_us_total = 0;
+static volatile float bench_result = -1.0f;
+
+// ==================== BLOCK WRITING (core 1) ====================
+
+static uint32_t current_block_number(void) {
+    return (uint32_t)(f_tell(&archive) / ARCHIVE_BLOCK_SIZE);
+}
+
+/**
+ * Stamp sequence number and CRC, then append one block to the archive
+ */
+static bool write_block(uint8_t *block) {
+    archive_block_header_t *header = (archive_block_header_t *)block;
+    header->block_seq = next_seq++;
+    archive_seal_block(block);
+
+    uint64_t start = time_us_64();
+    UINT written = 0;
+    FRESULT res = f_write(&archive, block, ARCHIVE_BLOCK_SIZE, &written);
+    if (++blocks_since_sync >= SYNC_INTERVAL_BLOCKS) {
+        f_sync(&archive);
+        blocks_since_sync = 0;
+    }
+    write_us_total += time_us_64() - start;
+
+    if (res != FR_OK || written != ARCHIVE_BLOCK_SIZE) {
+        stats.write_errors++;
+        return false;
+    }
+    stats.blocks_written++;
+    stats.archive_blocks = current_block_number();
+    if (write_us_total > 0) {
+        stats.write_kbps = (float)stats.blocks_written * (ARCHIVE_BLOCK_SIZE / 1024.0f) /
+                           ((float)write_us_total / 1e6f);
+    }
+    return true;
+}
+
+static void write_index_block(void) {
+    memset(writer_block, 0, sizeof(writer_block));
+    archive_block_header_t *header = (archive_block_header_t *)writer_block;
+    header->magic = ARCHIVE_MAGIC;
+    header->type = ARCHIVE_BLOCK_INDEX;
+    header->version = ARCHIVE_VERSION;
+    header->count = (uint16_t)pending_entries;
+    header->t_first = pending_index.entries[0].t_first;
+    header->t_last = pending_index.entries[pending_entries - 1].t_last;
+
+    pending_index.prev_index_block = prev_index_block;
+    memcpy(writer_block + sizeof(*header), &pending_index, sizeof(pending_index));
+
+    uint32_t block_number = current_block_number();
+    if (write_block(writer_block)) {
+        prev_index_block = block_number;
+        f_sync(&archive);
+        blocks_since_sync = 0;
+    }
+    pending_entries = 0;
+}
+
+static void write_data_block(uint8_t *block) {
+    archive_block_header_t *header = (archive_block_header_t *)block;
+    uint32_t block_number = current_block_number();
+
+    if (write_block(block)) {
+        archive_index_entry_t *entry = &pending_index.entries[pending_entries++];
+        entry->block = block_number;
+        entry->t_first = header->t_first;
+        entry->t_last = header->t_last;
+
+        if (pending_entries == ARCHIVE_INDEX_INTERVAL) {
+            write_index_block();
+        }
+    }
+}
+
+static float run_benchmark(uint32_t blocks) {
+    FIL bench;
+    if (f_open(&bench, BENCH_FILE, FA_WRITE | FA_CREATE_ALWAYS) != FR_OK) {
+        return 0.0f;
+    }
+
+    memset(writer_block, 0xa5, sizeof(writer_block));
+    uint64_t start = time_us_64();
+    bool ok = true;
+    for (uint32_t i = 0; i < blocks && ok; i++) {
+        UINT written = 0;
+        ok = f_write(&bench, writer_block, ARCHIVE_BLOCK_SIZE, &written) == FR_OK &&
+             written == ARCHIVE_BLOCK_SIZE;
+    }
+    ok = f_sync(&bench) == FR_OK && ok;
+    uint64_t elapsed = time_us_64() - start;
+
+    f_close(&bench);
+    f_unlink(BENCH_FILE);
+
+    if (!ok || elapsed == 0) {
+        return 0.0f;
+    }
+    return (float)blocks * (ARCHIVE_BLOCK_SIZE / 1024.0f) / ((float)elapsed / 1e6f);
+}
+
+/**
+ * Read a block for a dump client, then return to the end of the file so
+ * appends continue where they left off
+ */
+static void read_block(sd_archive_read_t *request) {
+    FSIZE_t end = f_tell(&archive);
+    UINT read = 0;
+
+    bool ok = request->block < current_block_number() &&
+              f_lseek(&archive, (FSIZE_t)request->block * ARCHIVE_BLOCK_SIZE) == FR_OK &&
+              f_read(&archive, request->buffer, ARCHIVE_BLOCK_SIZE, &read) == FR_OK &&
+              read == ARCHIVE_BLOCK_SIZE;
+    f_lseek(&archive, end);
+
+    request->state = ok ? SD_READ_DONE : SD_READ_ERROR;
+}
+
+static void writer_main(void) {
+    while (true) {
+        uint32_t command = multicore_fifo_pop_blocking();
+
+        if (command & CMD_BENCHMARK) {
+            bench_result = run_benchmark(command & ~CMD_BENCHMARK);
+            continue;
+        }
+        if (command == CMD_READ_BLOCK) {
+            read_block((sd_archive_read_t *)(uintptr_t)multicore_fifo_pop_blocking());
+            continue;
+        }
+
+        uint8_t index = command & 1u;
+        write_data_block(buffers[index]);
+        buffer_busy[index] = false;
+    }
+}
+
+// ==================== RECOVERY ====================
+
+/**
+ * Drop a torn trailing block and find the sequence number and last index
+ * block so the chain continues across reboots. Data blocks written after
+ * that index are queued again so the next index block covers them.
+ */
+static bool recover_archive_tail(void) {
+    FSIZE_t size = f_size(&archive);
+    FSIZE_t aligned = size - (size % ARCHIVE_BLOCK_SIZE);
+
+    if (aligned != size) {
+        if (f_lseek(&archive, aligned) != FR_OK || f_truncate(&archive) != FR_OK) {
+            return false;
+        }
+    }
+
+    uint32_t blocks = (uint32_t)(aligned / ARCHIVE_BLOCK_SIZE);
+    bool found_seq = false;
+    archive_index_entry_t unindexed[ARCHIVE_INDEX_INTERVAL];
+    uint32_t unindexed_count = 0;
+
+    for (uint32_t i = 0; i < RECOVERY_SCAN_BLOCKS && i < blocks; i++) {
+        uint32_t block_number = blocks - 1 - i;
+        UINT read = 0;
+
+        if (f_lseek(&archive, (FSIZE_t)block_number * ARCHIVE_BLOCK_SIZE) != FR_OK ||
+            f_read(&archive, writer_block, ARCHIVE_BLOCK_SIZE, &read) != FR_OK ||
+            read != ARCHIVE_BLOCK_SIZE || !archive_block_valid(writer_block)) {
+            continue;
+        }
+
+        archive_block_header_t *header = (archive_block_header_t *)writer_block;
+        if (!found_seq) {
+            next_seq = header->block_seq + 1;
+            found_seq = true;
+        }
+        if (header->type == ARCHIVE_BLOCK_INDEX) {
+            prev_index_block = block_number;
+            break;
+        }
+        if (header->type == ARCHIVE_BLOCK_DATA && unindexed_count < ARCHIVE_INDEX_INTERVAL) {
+            archive_index_entry_t *entry = &unindexed[unindexed_count++];
+            entry->block = block_number;
+            entry->t_first = header->t_first;
+            entry->t_last = header->t_last;
+        }
+    }
+
+    // Collected newest first
+    pending_entries = 0;
+    while (unindexed_count > 0 && pending_entries < ARCHIVE_INDEX_INTERVAL - 1) {
+        pending_index.entries[pending_entries++] = unindexed[--unindexed_count];
+    }
+
+    return f_lseek(&archive, aligned) == FR_OK;
+}
+
+// ==================== BUFFER PACKING (core 0) ====================
+
+static void start_block(uint8_t *block) {
+    memset(block, 0, ARCHIVE_BLOCK_SIZE);
+    archive_block_header_t *header = (archive_block_header_t *)block;
+    header->magic = ARCHIVE_MAGIC;
+    header->type = ARCHIVE_BLOCK_DATA;
+    header->version = ARCHIVE_VERSION;
+    fill = sizeof(archive_block_header_t);
+}
+
+static bool write_schema_block(uint32_t boot_id) {
+    start_block(writer_block);
+    archive_block_header_t *header = (archive_block_header_t *)writer_block;
+    header->type = ARCHIVE_BLOCK_SCHEMA;
+
+    snprintf((char *)writer_block + sizeof(*header), ARCHIVE_PAYLOAD_SIZE,
+             "agri-archive v%d block=%d index_interval=%d boot_id=%08lx\n" ARCHIVE_READING_SCHEMA,
+             ARCHIVE_VERSION, ARCHIVE_BLOCK_SIZE, ARCHIVE_INDEX_INTERVAL, (unsigned long)boot_id);
+    return write_block(writer_block);
+}
+
+/**
+ * Hand the active buffer to core 1 and switch to the other half
+ *
+ * @return false if the other half is still being written
+ */
+static bool swap_buffers(void) {
+    uint8_t next = active ^ 1u;
+    if (buffer_busy[next]) {
+        return false;
+    }
+
+    buffer_busy[active] = true;
+    multicore_fifo_push_blocking(CMD_WRITE_BUFFER | active);
+    active = next;
+    start_block(buffers[active]);
+    return true;
+}
+
+// ==================== PUBLIC API ====================
+
+bool sd_archive_init(uint32_t boot_id) {
+    memset((void *)&stats, 0, sizeof(stats));
+
+    if (f_mount(&fs, "", 1) != FR_OK) {
+        printf("✗ SD card not found or not FAT formatted\n");
+        return false;
+    }
+    if (f_open(&archive, SD_ARCHIVE_FILE, FA_READ | FA_WRITE | FA_OPEN_ALWAYS) != FR_OK) {
+        printf("✗ Cannot open %s\n", SD_ARCHIVE_FILE);
+        return false;
+    }
+    if (!recover_archive_tail() || !write_schema_block(boot_id)) {
+        f_close(&archive);
+        return false;
+    }
+    f_sync(&archive);
+
+    start_block(buffers[active]);
+    stats.archive_blocks = current_block_number();
+    archive_open = true;
+    multicore_launch_core1(writer_main);
+
+    printf("✓ SD archive open: %s, %lu blocks, next seq %lu\n", SD_ARCHIVE_FILE,
+           (unsigned long)current_block_number(), (unsigned long)next_seq);
+    return true;
+}
+
+bool sd_archive_append(const archive_reading_t *reading) {
+    if (!archive_open) {
+        return false;
+    }
+
+    uint8_t probes = reading->probe_count > ARCHIVE_MAX_PROBES ? ARCHIVE_MAX_PROBES
+                                                               : reading->probe_count;
+    uint32_t payload = offsetof(archive_reading_t, probes) + probes * sizeof(float);
+    uint32_t needed = sizeof(archive_record_header_t) + payload;
+
+    if (fill + needed > ARCHIVE_BLOCK_SIZE && !swap_buffers()) {
+        stats.dropped++;
+        return false;
+    }
+
+    uint8_t *block = buffers[active];
+    archive_block_header_t *header = (archive_block_header_t *)block;
+    archive_record_header_t record = {ARCHIVE_RECORD_READING, (uint8_t)payload};
+
+    memcpy(block + fill, &record, sizeof(record));
+    memcpy(block + fill + sizeof(record), reading, payload);
+    block[fill + sizeof(record) + offsetof(archive_reading_t, probe_count)] = probes;
+    fill += needed;
+
+    if (header->count == 0) {
+        header->t_first = reading->timestamp;
+    }
+    header->t_last = reading->timestamp;
+    header->count++;
+
+    stats.records++;
+    return true;
+}
+
+void sd_archive_flush(void) {
+    if (archive_open && ((archive_block_header_t *)buffers[active])->count > 0) {
+        swap_buffers();
+    }
+}
+
+void sd_archive_get_stats(sd_archive_stats_t *out) {
+    memcpy(out, (const void *)&stats, sizeof(*out));
+}
+
+bool sd_archive_read_async(sd_archive_read_t *request) {
+    if (!archive_open) {
+        request->state = SD_READ_ERROR;
+        return false;
+    }
+
+    request->state = SD_READ_PENDING;
+
+    // Both words must reach the FIFO back to back
+    uint32_t saved = save_and_disable_interrupts();
+    multicore_fifo_push_blocking(CMD_READ_BLOCK);
+    multicore_fifo_push_blocking((uint32_t)(uintptr_t)request);
+    restore_interrupts(saved);
+    return true;
+}
+
+float sd_archive_benchmark(uint32_t blocks) {
+    if (!archive_open || blocks == 0) {
+        return 0.0f;
+    }
+
+    bench_result = -1.0f;
+    multicore_fifo_push_blocking(CMD_BENCHMARK | blocks);
+    while (bench_result < 0.0f) {
+        sleep_ms(10);
+    }
+    return bench_result;
+}
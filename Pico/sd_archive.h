@@ -0,0 +1,92 @@
+/**
+ * SD Card Archive Logger Header File
+ *
+ * Appends raw readings to an append-only archive file on the SD card
+ * (format in archive_format.h). Records are packed into one half of a
+ * 4 KB double buffer while core 1 writes the other half to the card, so
+ * sampling never waits on SD latency.
+ *
+ * Author: Smart Agriculture Team
+ * Date: October 2024
+ */
+
+#ifndef SD_ARCHIVE_H
+#define SD_ARCHIVE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "archive_format.h"
+
+#define SD_ARCHIVE_FILE "AGRI.LOG"
+
+typedef struct {
+    uint32_t records;         // Records accepted since boot
+    uint32_t dropped;         // Records lost because both buffers were busy
+    uint32_t blocks_written;  // Data, index and schema blocks
+    uint32_t write_errors;
+    uint32_t archive_blocks;  // Blocks in the file, including earlier sessions
+    float write_kbps;         // Sustained rate while writing blocks
+} sd_archive_stats_t;
+
+// Asynchronous block read states
+#define SD_READ_PENDING 0
+#define SD_READ_DONE 1
+#define SD_READ_ERROR 2
+
+typedef struct {
+    uint8_t *buffer;          // ARCHIVE_BLOCK_SIZE bytes, word aligned
+    uint32_t block;           // Block number within the archive file
+    volatile uint8_t state;
+} sd_archive_read_t;
+
+/**
+ * Mount the card, open the archive, write a schema block for this boot
+ * session and start the writer on core 1
+ *
+ * @param boot_id Nonce of this boot, recorded in the schema block so the
+ *                session's uptime stamps can be told from other boots'
+ * @return false if no card is present or the file cannot be opened
+ */
+bool sd_archive_init(uint32_t boot_id);
+
+/**
+ * Append a reading. Only the used part of the probe array is stored.
+ *
+ * @return false if the archive is unavailable or the record was dropped
+ */
+bool sd_archive_append(const archive_reading_t *reading);
+
+/**
+ * Close the partially filled block and queue it for writing
+ *
+ * Records reach the card only in whole blocks, so call this before the
+ * node slows down (or on a timer) to bound what a brown-out can lose.
+ */
+void sd_archive_flush(void);
+
+/**
+ * Get logger statistics
+ */
+void sd_archive_get_stats(sd_archive_stats_t *stats);
+
+/**
+ * Queue a read of one archive block on core 1, which owns the card
+ *
+ * Safe to call from interrupt context. The request and its buffer must
+ * stay valid until state leaves SD_READ_PENDING.
+ *
+ * @return false if the archive is unavailable
+ */
+bool sd_archive_read_async(sd_archive_read_t *request);
+
+/**
+ * Measure sustained 4 KB block write throughput with a scratch file
+ *
+ * Must be called after sd_archive_init(); archiving pauses meanwhile.
+ *
+ * @param blocks Number of 4 KB blocks to write
+ * @return Throughput in KB/s, 0 on error
+ */
+float sd_archive_benchmark(uint32_t blocks);
+
+#endif // SD_ARCHIVE_H
@@ -0,0 +1,329 @@
+/**
+ * SD Card SPI Block Driver for Raspberry Pi Pico W
+ *
+ * Commands and responses are exchanged byte by byte; 512-byte sector
+ * payloads run through a pair of DMA channels (TX from the buffer, RX
+ * into a sink) so the bus runs back to back at the full SPI clock.
+ *
+ * Author: Smart Agriculture Team
+ * Date: October 2024
+ */
+
+#include "pico/stdlib.h"
+#include "hardware/dma.h"
+#include "hardware/gpio.h"
+#include "hardware/spi.h"
+#include "sd_spi.h"
+
+// Pin Configuration (SPI0)
+#define SD_SPI spi0
+#define SD_MISO_PIN 16
+#define SD_CS_PIN 17
+#define SD_SCK_PIN 18
+#define SD_MOSI_PIN 19
+
+#define SD_INIT_BAUD 400000       // Identification mode limit
+#define SD_DATA_BAUD 12500000     // 125 MHz / 10
+#define SD_READY_TIMEOUT_MS 500
+#define SD_TOKEN_TIMEOUT_MS 200
+#define SD_INIT_TIMEOUT_MS 1000
+
+// Commands
+#define CMD0 0      // GO_IDLE_STATE
+#define CMD8 8      // SEND_IF_COND
+#define CMD9 9      // SEND_CSD
+#define CMD12 12    // STOP_TRANSMISSION
+#define CMD16 16    // SET_BLOCKLEN
+#define CMD17 17    // READ_SINGLE_BLOCK
+#define CMD24 24    // WRITE_BLOCK
+#define CMD25 25    // WRITE_MULTIPLE_BLOCK
+#define CMD55 55    // APP_CMD
+#define CMD58 58    // READ_OCR
+#define ACMD41 (0x80 | 41)  // SD_SEND_OP_COND
+
+// Data tokens
+#define TOKEN_START_BLOCK 0xfe
+#define TOKEN_START_MULTI 0xfc
+#define TOKEN_STOP_MULTI 0xfd
+#define DATA_ACCEPTED 0x05
+
+// ==================== STATE ====================
+static bool card_ready = false;
+static bool block_addressing = false;   // SDHC/SDXC use sector numbers
+static int dma_tx = -1;
+static int dma_rx = -1;
+
+// ==================== SPI HELPERS ====================
+
+static uint8_t spi_byte(uint8_t out) {
+    uint8_t in;
+    spi_write_read_blocking(SD_SPI, &out, &in, 1);
+    return in;
+}
+
+static bool wait_ready(uint32_t timeout_ms) {
+    absolute_time_t deadline = make_timeout_time_ms(timeout_ms);
+    while (spi_byte(0xff) != 0xff) {
+        if (time_reached(deadline)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void cs_deselect(void) {
+    gpio_put(SD_CS_PIN, 1);
+    spi_byte(0xff);  // Card releases MISO on the next clock
+}
+
+static bool cs_select(void) {
+    gpio_put(SD_CS_PIN, 0);
+    if (!wait_ready(SD_READY_TIMEOUT_MS)) {
+        cs_deselect();
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Move a sector between memory and the card with DMA
+ *
+ * @param tx Data to send, or NULL to clock out 0xFF
+ * @param rx Buffer for received data, or NULL to discard
+ */
+static void spi_dma_transfer(const uint8_t *tx, uint8_t *rx, uint32_t length) {
+    static const uint8_t fill = 0xff;
+    static uint8_t sink;
+
+    dma_channel_config tx_cfg = dma_channel_get_default_config(dma_tx);
+    channel_config_set_transfer_data_size(&tx_cfg, DMA_SIZE_8);
+    channel_config_set_read_increment(&tx_cfg, tx != NULL);
+    channel_config_set_write_increment(&tx_cfg, false);
+    channel_config_set_dreq(&tx_cfg, spi_get_dreq(SD_SPI, true));
+    dma_channel_configure(dma_tx, &tx_cfg, &spi_get_hw(SD_SPI)->dr,
+                          tx != NULL ? tx : &fill, length, false);
+
+    dma_channel_config rx_cfg = dma_channel_get_default_config(dma_rx);
+    channel_config_set_transfer_data_size(&rx_cfg, DMA_SIZE_8);
+    channel_config_set_read_increment(&rx_cfg, false);
+    channel_config_set_write_increment(&rx_cfg, rx != NULL);
+    channel_config_set_dreq(&rx_cfg, spi_get_dreq(SD_SPI, false));
+    dma_channel_configure(dma_rx, &rx_cfg, rx != NULL ? rx : &sink,
+                          &spi_get_hw(SD_SPI)->dr, length, false);
+
+    dma_start_channel_mask((1u << dma_tx) | (1u << dma_rx));
+    dma_channel_wait_for_finish_blocking(dma_rx);
+}
+
+// ==================== COMMANDS ====================
+
+static uint8_t send_command(uint8_t cmd, uint32_t arg) {
+    if (cmd & 0x80) {
+        cmd &= 0x7f;
+        uint8_t r1 = send_command(CMD55, 0);
+        if (r1 > 1) {
+            return r1;
+        }
+    }
+
+    cs_deselect();
+    if (!cs_select()) {
+        return 0xff;
+    }
+
+    uint8_t crc = 0x01;
+    if (cmd == CMD0) crc = 0x95;
+    if (cmd == CMD8) crc = 0x87;
+
+    uint8_t frame[6] = {
+        (uint8_t)(0x40 | cmd),
+        (uint8_t)(arg >> 24), (uint8_t)(arg >> 16), (uint8_t)(arg >> 8), (uint8_t)arg,
+        crc
+    };
+    spi_write_blocking(SD_SPI, frame, sizeof(frame));
+
+    if (cmd == CMD12) {
+        spi_byte(0xff);  // Skip stuff byte
+    }
+
+    uint8_t r1 = 0xff;
+    for (int i = 0; i < 10 && (r1 & 0x80); i++) {
+        r1 = spi_byte(0xff);
+    }
+    return r1;
+}
+
+static bool wait_token(uint8_t token) {
+    absolute_time_t deadline = make_timeout_time_ms(SD_TOKEN_TIMEOUT_MS);
+    uint8_t b;
+    while ((b = spi_byte(0xff)) == 0xff) {
+        if (time_reached(deadline)) {
+            return false;
+        }
+    }
+    return b == token;
+}
+
+static uint32_t sector_address(uint32_t sector) {
+    return block_addressing ? sector : sector * SD_SECTOR_SIZE;
+}
+
+// ==================== PUBLIC API ====================
+
+bool sd_spi_init(void) {
+    card_ready = false;
+
+    spi_init(SD_SPI, SD_INIT_BAUD);
+    gpio_set_function(SD_MISO_PIN, GPIO_FUNC_SPI);
+    gpio_set_function(SD_SCK_PIN, GPIO_FUNC_SPI);
+    gpio_set_function(SD_MOSI_PIN, GPIO_FUNC_SPI);
+    gpio_pull_up(SD_MISO_PIN);
+    gpio_init(SD_CS_PIN);
+    gpio_set_dir(SD_CS_PIN, GPIO_OUT);
+    gpio_put(SD_CS_PIN, 1);
+
+    // At least 74 clocks with CS high to enter SPI mode
+    for (int i = 0; i < 10; i++) {
+        spi_byte(0xff);
+    }
+
+    uint8_t r1 = 0xff;
+    for (int i = 0; i < 10 && r1 != 0x01; i++) {
+        r1 = send_command(CMD0, 0);
+    }
+    if (r1 != 0x01) {
+        cs_deselect();
+        return false;
+    }
+
+    absolute_time_t deadline = make_timeout_time_ms(SD_INIT_TIMEOUT_MS);
+    bool version2 = false;
+
+    if (send_command(CMD8, 0x1aa) == 0x01) {
+        uint8_t r7[4];
+        for (int i = 0; i < 4; i++) {
+            r7[i] = spi_byte(0xff);
+        }
+        if (r7[2] != 0x01 || r7[3] != 0xaa) {
+            cs_deselect();
+            return false;  // Voltage range not supported
+        }
+        version2 = true;
+    }
+
+    // Leave idle state, advertising high capacity support on v2 cards
+    do {
+        r1 = send_command(ACMD41, version2 ? 0x40000000u : 0);
+    } while (r1 == 0x01 && !time_reached(deadline));
+    if (r1 != 0x00) {
+        cs_deselect();
+        return false;
+    }
+
+    block_addressing = false;
+    if (version2 && send_command(CMD58, 0) == 0x00) {
+        uint8_t ocr[4];
+        for (int i = 0; i < 4; i++) {
+            ocr[i] = spi_byte(0xff);
+        }
+        block_addressing = (ocr[0] & 0x40) != 0;
+    }
+    if (!block_addressing && send_command(CMD16, SD_SECTOR_SIZE) != 0x00) {
+        cs_deselect();
+        return false;
+    }
+    cs_deselect();
+
+    spi_set_baudrate(SD_SPI, SD_DATA_BAUD);
+
+    if (dma_tx < 0) {
+        dma_tx = dma_claim_unused_channel(true);
+        dma_rx = dma_claim_unused_channel(true);
+    }
+
+    card_ready = true;
+    return true;
+}
+
+bool sd_spi_ready(void) {
+    return card_ready;
+}
+
+bool sd_spi_read(uint8_t *buffer, uint32_t sector, uint32_t count) {
+    if (!card_ready) {
+        return false;
+    }
+
+    for (uint32_t i = 0; i < count; i++) {
+        if (send_command(CMD17, sector_address(sector + i)) != 0x00 ||
+            !wait_token(TOKEN_START_BLOCK)) {
+            cs_deselect();
+            return false;
+        }
+        spi_dma_transfer(NULL, buffer + i * SD_SECTOR_SIZE, SD_SECTOR_SIZE);
+        spi_byte(0xff);  // CRC
+        spi_byte(0xff);
+    }
+    cs_deselect();
+    return true;
+}
+
+bool sd_spi_write(const uint8_t *buffer, uint32_t sector, uint32_t count) {
+    if (!card_ready || count == 0) {
+        return false;
+    }
+
+    bool multi = count > 1;
+    if (send_command(multi ? CMD25 : CMD24, sector_address(sector)) != 0x00) {
+        cs_deselect();
+        return false;
+    }
+
+    bool ok = true;
+    for (uint32_t i = 0; i < count && ok; i++) {
+        if (!wait_ready(SD_READY_TIMEOUT_MS)) {
+            ok = false;
+            break;
+        }
+        spi_byte(multi ? TOKEN_START_MULTI : TOKEN_START_BLOCK);
+        spi_dma_transfer(buffer + i * SD_SECTOR_SIZE, NULL, SD_SECTOR_SIZE);
+        spi_byte(0xff);  // Dummy CRC
+        spi_byte(0xff);
+        ok = (spi_byte(0xff) & 0x1f) == DATA_ACCEPTED;
+    }
+
+    if (multi) {
+        wait_ready(SD_READY_TIMEOUT_MS);
+        spi_byte(TOKEN_STOP_MULTI);
+    }
+    ok = wait_ready(SD_READY_TIMEOUT_MS) && ok;
+    cs_deselect();
+    return ok;
+}
+
+uint32_t sd_spi_sector_count(void) {
+    uint8_t csd[16];
+
+    if (!card_ready || send_command(CMD9, 0) != 0x00 || !wait_token(TOKEN_START_BLOCK)) {
+        cs_deselect();
+        return 0;
+    }
+    for (int i = 0; i < 16; i++) {
+        csd[i] = spi_byte(0xff);
+    }
+    spi_byte(0xff);  // CRC
+    spi_byte(0xff);
+    cs_deselect();
+
+    if ((csd[0] >> 6) == 1) {
+        // CSD v2: capacity = (C_SIZE + 1) * 512 KB
+        uint32_t c_size = ((uint32_t)(csd[7] & 0x3f) << 16) | ((uint32_t)csd[8] << 8) | csd[9];
+        return (c_size + 1) * 1024;
+    }
+
+    // CSD v1
+    uint32_t read_bl_len = csd[5] & 0x0f;
+    uint32_t c_size = ((uint32_t)(csd[6] & 0x03) << 10) | ((uint32_t)csd[7] << 2) | (csd[8] >> 6);
+    uint32_t c_size_mult = ((csd[9] & 0x03) << 1) | (csd[10] >> 7);
+    return (c_size + 1) << (c_size_mult + 2 + read_bl_len - 9);
+}
@@ -0,0 +1,47 @@
+/**
+ * SD Card SPI Block Driver Header File
+ *
+ * Minimal SD/SDHC driver in SPI mode. Sector data is moved with DMA so a
+ * 4 KB block write keeps the SPI bus saturated. Used by the FatFS disk
+ * I/O layer (diskio.c).
+ *
+ * Author: Smart Agriculture Team
+ * Date: October 2024
+ */
+
+#ifndef SD_SPI_H
+#define SD_SPI_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define SD_SECTOR_SIZE 512
+
+/**
+ * Initialize the SPI bus and card
+ *
+ * @return true if a card was found and switched to data transfer mode
+ */
+bool sd_spi_init(void);
+
+/**
+ * Check whether sd_spi_init() succeeded
+ */
+bool sd_spi_ready(void);
+
+/**
+ * Read consecutive 512-byte sectors
+ */
+bool sd_spi_read(uint8_t *buffer, uint32_t sector, uint32_t count);
+
+/**
+ * Write consecutive 512-byte sectors with a single multi-block command
+ */
+bool sd_spi_write(const uint8_t *buffer, uint32_t sector, uint32_t count);
+
+/**
+ * Card capacity in sectors, read from the CSD register
+ */
+uint32_t sd_spi_sector_count(void);
+
+#endif // SD_SPI_H
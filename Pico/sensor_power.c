@@ -0,0 +1,264 @@
+/**
+ * Sensor Excitation Power Gating for Raspberry Pi Pico W
+ *
+ * Each rail is switched on right before an ADC burst and off straight
+ * after it. A hardware alarm forces the rail off once its sampling window
+ * has elapsed, so a stalled main loop can never leave a resistive probe
+ * energised. Sampling of a burst starts when its slowest rail is warm, so
+ * every rail's window is counted from that common ready time. On-time is
+ * accumulated per rail for the duty cycle and energy statistics sent with
+ * the telemetry.
+ *
+ * Author: Smart Agriculture Team
+ * Date: October 2024
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "pico/stdlib.h"
+#include "pico/time.h"
+#include "hardware/gpio.h"
+#include "sensor_power.h"
+
+// Learned warm-up settings
+#define LEARN_STEP_US 500           // Sampling period while learning
+#define LEARN_TIMEOUT_US 500000     // Give up after 0.5 s
+#define LEARN_STABLE_COUNT 3        // Consecutive agreeing samples
+#define LEARN_TOLERANCE 8           // ADC counts (12-bit) between samples
+#define LEARN_MARGIN_PCT 125        // Applied on top of the measured settle time
+
+// ==================== STATE ====================
+typedef struct {
+    sensor_power_rail_t config;
+    volatile bool powered;
+    uint64_t on_since_us;
+    uint64_t on_total_us;
+    alarm_id_t cutoff_alarm;
+    bool learned;
+} rail_state_t;
+
+static rail_state_t rails[SENSOR_POWER_MAX_RAILS];
+static uint8_t rail_count = 0;
+static uint64_t init_time_us = 0;
+
+// ==================== RAIL CONTROL ====================
+
+static void rail_drive(rail_state_t *rail, bool on) {
+    gpio_put(rail->config.gpio, on == rail->config.active_high);
+}
+
+/**
+ * Switch a rail off and account its on-time. Must run with interrupts
+ * disabled or from the cutoff alarm.
+ */
+static void rail_switch_off(rail_state_t *rail) {
+    if (!rail->powered) {
+        return;
+    }
+    rail_drive(rail, false);
+    rail->on_total_us += time_us_64() - rail->on_since_us;
+    rail->powered = false;
+}
+
+static int64_t cutoff_alarm_callback(alarm_id_t id, void *user_data) {
+    rail_state_t *rail = (rail_state_t *)user_data;
+    if (rail->cutoff_alarm == id) {
+        rail->cutoff_alarm = 0;
+        rail_switch_off(rail);
+    }
+    return 0;
+}
+
+/**
+ * Latest warm-up end across the powered rails in mask
+ */
+static uint64_t ready_time(uint32_t mask) {
+    uint64_t ready_at = 0;
+
+    for (uint8_t i = 0; i < rail_count; i++) {
+        if ((mask & (1u << i)) && rails[i].powered) {
+            uint64_t t = rails[i].on_since_us + rails[i].config.warmup_us;
+            if (t > ready_at) {
+                ready_at = t;
+            }
+        }
+    }
+    return ready_at;
+}
+
+/**
+ * (Re)arm the cutoff of every powered rail in mask to its sampling window
+ * after start_us
+ */
+static void arm_cutoffs(uint32_t mask, uint64_t start_us) {
+    for (uint8_t i = 0; i < rail_count; i++) {
+        rail_state_t *rail = &rails[i];
+        if (!(mask & (1u << i))) {
+            continue;
+        }
+
+        uint32_t irq_state = save_and_disable_interrupts();
+        alarm_id_t pending = rail->cutoff_alarm;
+        rail->cutoff_alarm = 0;
+        bool powered = rail->powered;
+        restore_interrupts(irq_state);
+
+        if (pending > 0) {
+            cancel_alarm(pending);
+        }
+        if (powered) {
+            uint64_t deadline = start_us + rail->config.sample_window_us;
+            alarm_id_t id = add_alarm_at(from_us_since_boot(deadline), cutoff_alarm_callback,
+                                         rail, true);
+            rail->cutoff_alarm = id > 0 ? id : 0;
+        }
+    }
+}
+
+// ==================== PUBLIC API ====================
+
+bool sensor_power_init(const sensor_power_rail_t *rail_table, uint8_t count) {
+    if (rail_table == NULL || count == 0 || count > SENSOR_POWER_MAX_RAILS) {
+        return false;
+    }
+
+    memset(rails, 0, sizeof(rails));
+    rail_count = count;
+    init_time_us = time_us_64();
+
+    for (uint8_t i = 0; i < count; i++) {
+        rails[i].config = rail_table[i];
+        gpio_init(rails[i].config.gpio);
+        gpio_set_dir(rails[i].config.gpio, GPIO_OUT);
+        rail_drive(&rails[i], false);
+    }
+    return true;
+}
+
+void sensor_power_on(uint32_t mask) {
+    uint64_t now = time_us_64();
+
+    for (uint8_t i = 0; i < rail_count; i++) {
+        rail_state_t *rail = &rails[i];
+        if (!(mask & (1u << i)) || rail->powered) {
+            continue;
+        }
+
+        rail->on_since_us = now;
+        rail->powered = true;
+        rail_drive(rail, true);
+    }
+
+    // No rail may switch off before the slowest one is warm
+    arm_cutoffs(mask, ready_time(mask));
+}
+
+void sensor_power_wait_ready(uint32_t mask) {
+    uint64_t ready_at = ready_time(mask);
+
+    uint64_t now = time_us_64();
+    if (ready_at > now) {
+        sleep_us(ready_at - now);
+    } else if (ready_at > 0) {
+        // Work done during warm-up overran it: the window starts now
+        arm_cutoffs(mask, now);
+    }
+}
+
+void sensor_power_off(uint32_t mask) {
+    for (uint8_t i = 0; i < rail_count; i++) {
+        rail_state_t *rail = &rails[i];
+        if (!(mask & (1u << i))) {
+            continue;
+        }
+
+        uint32_t irq_state = save_and_disable_interrupts();
+        alarm_id_t pending = rail->cutoff_alarm;
+        rail->cutoff_alarm = 0;
+        rail_switch_off(rail);
+        restore_interrupts(irq_state);
+
+        if (pending > 0) {
+            cancel_alarm(pending);
+        }
+    }
+}
+
+uint32_t sensor_power_learn_warmup(uint8_t index) {
+    if (index >= rail_count || rails[index].config.sample_fn == NULL) {
+        return 0;
+    }
+    rail_state_t *rail = &rails[index];
+
+    // Learning runs longer than the normal window, so switch manually
+    sensor_power_off(1u << index);
+    uint32_t irq_state = save_and_disable_interrupts();
+    rail->on_since_us = time_us_64();
+    rail->powered = true;
+    restore_interrupts(irq_state);
+    rail_drive(rail, true);
+
+    uint64_t start = rail->on_since_us;
+    int32_t previous = -1;
+    int stable = 0;
+    uint32_t settled_us = LEARN_TIMEOUT_US;
+
+    while (time_us_64() - start < LEARN_TIMEOUT_US) {
+        sleep_us(LEARN_STEP_US);
+        int32_t sample = rail->config.sample_fn();
+
+        if (previous >= 0 && abs(sample - previous) <= LEARN_TOLERANCE) {
+            if (++stable >= LEARN_STABLE_COUNT) {
+                settled_us = (uint32_t)(time_us_64() - start);
+                break;
+            }
+        } else {
+            stable = 0;
+        }
+        previous = sample;
+    }
+
+    sensor_power_off(1u << index);
+
+    uint32_t measured = settled_us * LEARN_MARGIN_PCT / 100;
+    if (rail->learned) {
+        // Smooth out single noisy measurements
+        rail->config.warmup_us = (rail->config.warmup_us * 3 + measured) / 4;
+    } else {
+        rail->config.warmup_us = measured;
+        rail->learned = true;
+    }
+    return rail->config.warmup_us;
+}
+
+void sensor_power_get_stats(sensor_power_stats_t *stats) {
+    memset(stats, 0, sizeof(*stats));
+
+    uint64_t now = time_us_64();
+    uint64_t elapsed = now - init_time_us;
+    if (elapsed == 0 || rail_count == 0) {
+        return;
+    }
+
+    float duty_sum = 0.0f;
+    for (uint8_t i = 0; i < rail_count; i++) {
+        rail_state_t *rail = &rails[i];
+
+        uint32_t irq_state = save_and_disable_interrupts();
+        uint64_t on_us = rail->on_total_us;
+        if (rail->powered) {
+            on_us += now - rail->on_since_us;
+        }
+        restore_interrupts(irq_state);
+
+        float duty = (float)on_us / (float)elapsed;
+        stats->duty_pct[i] = duty * 100.0f;
+        stats->warmup_us[i] = rail->config.warmup_us;
+        duty_sum += stats->duty_pct[i];
+
+        // mA * V * hours switched off = mWh
+        float off_hours = (float)(elapsed - on_us) / 3600e6f;
+        stats->energy_saved_mwh += rail->config.current_ma * SENSOR_POWER_SUPPLY_V * off_hours;
+    }
+    stats->avg_duty_pct = duty_sum / rail_count;
+}
@@ -0,0 +1,86 @@
+/**
+ * Sensor Excitation Power Gating Header File
+ *
+ * Switches the supply of analog probes (soil moisture, LDR divider, mux
+ * probe array) from GPIO driven MOSFETs so they are only powered for a
+ * warm-up period plus the ADC sampling window. This saves battery and
+ * stops DC electrolysis from corroding resistive probes.
+ *
+ * Author: Smart Agriculture Team
+ * Date: October 2024
+ */
+
+#ifndef SENSOR_POWER_H
+#define SENSOR_POWER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define SENSOR_POWER_MAX_RAILS 4
+#define SENSOR_POWER_SUPPLY_V 3.3f
+
+// One switched probe supply
+typedef struct {
+    const char *name;
+    uint8_t gpio;                 // Gate drive pin
+    bool active_high;             // false for a P-channel high-side switch
+    uint32_t warmup_us;           // Warm-up before sampling (initial value if learned)
+    uint32_t sample_window_us;    // Rail is forced off this long after the burst is ready
+    float current_ma;             // Rail draw while powered, for energy estimates
+    uint16_t (*sample_fn)(void);  // Optional ADC read enabling learned warm-up
+} sensor_power_rail_t;
+
+// Per-rail usage statistics since sensor_power_init()
+typedef struct {
+    float duty_pct[SENSOR_POWER_MAX_RAILS];
+    uint32_t warmup_us[SENSOR_POWER_MAX_RAILS];
+    float avg_duty_pct;           // Mean duty cycle across all rails
+    float energy_saved_mwh;       // Versus keeping every rail always on
+} sensor_power_stats_t;
+
+/**
+ * Configure rail GPIOs and switch every rail off
+ *
+ * @param rails Rail table, copied internally
+ * @param count Number of rails (at most SENSOR_POWER_MAX_RAILS)
+ * @return true on success
+ */
+bool sensor_power_init(const sensor_power_rail_t *rails, uint8_t count);
+
+/**
+ * Power the rails in mask (bit N = rail N) ahead of an ADC burst
+ *
+ * Every rail's cutoff is armed from the slowest rail's warm-up end, when
+ * sampling of the burst can start.
+ */
+void sensor_power_on(uint32_t mask);
+
+/**
+ * Sleep until every rail in mask has finished its warm-up. If that time
+ * has already passed, the cutoffs are re-armed to give a full sampling
+ * window from now.
+ */
+void sensor_power_wait_ready(uint32_t mask);
+
+/**
+ * Switch off the rails in mask once sampling is done
+ */
+void sensor_power_off(uint32_t mask);
+
+/**
+ * Measure how long a rail takes to settle and update its warm-up time
+ *
+ * Only rails with a sample_fn can be learned. The rail is powered, sampled
+ * until consecutive readings agree, then switched off again.
+ *
+ * @param rail Rail index
+ * @return Newly learned warm-up in microseconds, 0 if not learnable
+ */
+uint32_t sensor_power_learn_warmup(uint8_t rail);
+
+/**
+ * Collect duty cycle and energy statistics
+ */
+void sensor_power_get_stats(sensor_power_stats_t *stats);
+
+#endif // SENSOR_POWER_H
@@ -0,0 +1,128 @@
+/**
+ * Telemetry Schema - Single Source of Truth
+ *
+ * Every field a node can report is listed once here as an X-macro entry,
+ * and every producer's record layout is registered as a numbered record
+ * type. The firmware expands its record list into a struct and a JSON
+ * encoder whose format string is assembled at compile time. The backend
+ * side (sensor_data DDL, one insert statement and decoder per record
+ * type, payload converters) is generated from this file by
+ * backend/generate_schema.py into backend/app/telemetry_schema.py.
+ *
+ * Records carry their "schema_id"; payloads without one are decoded as
+ * LEGACY_JSON. A record type only writes its own columns, the others
+ * stay NULL in sensor_data.
+ *
+ * To add a field: add an X(...) line to TELEMETRY_COLUMNS and to the
+ * record types that carry it, rebuild the firmware and run
+ *   python backend/generate_schema.py
+ * Never change the fields of a released record type; register a new one.
+ *
+ * Author: Smart Agriculture Team
+ * Date: October 2024
+ */
+
+#ifndef TELEMETRY_SCHEMA_H
+#define TELEMETRY_SCHEMA_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+// Store columns (union of all record types), in sensor_data column order
+// X(name, c_type, sql_type, min, max, description)
+//   min/max  Validation bounds applied at ingest, NONE for unbounded
+#define TELEMETRY_COLUMNS(X) \
+    X(soil_moisture,        float, REAL,    0,    100,  "Soil moisture percentage") \
+    X(soil_temperature,     float, REAL,    NONE, NONE, "Soil temperature in Celsius") \
+    X(humidity,             float, REAL,    0,    100,  "Air humidity percentage") \
+    X(light_intensity,      float, REAL,    0,    100,  "Light intensity percentage") \
+    X(soil_ph,              float, REAL,    0,    14,   "Soil pH") \
+    X(nitrogen,             int,   INTEGER, 0,    NONE, "Nitrogen in mg/kg") \
+    X(phosphorus,           int,   INTEGER, 0,    NONE, "Phosphorus in mg/kg") \
+    X(potassium,            int,   INTEGER, 0,    NONE, "Potassium in mg/kg") \
+    X(soil_conductivity,    float, REAL,    0,    NONE, "Soil conductivity in uS/cm") \
+    X(air_temperature,      float, REAL,    NONE, NONE, "Air temperature in Celsius") \
+    X(atmospheric_pressure, float, REAL,    NONE, NONE, "Atmospheric pressure in hPa")
+
+// Registered record types: X(schema_id, NAME, field_list, description)
+#define TELEMETRY_RECORD_TYPES(X) \
+    X(1, LEGACY_JSON,    TELEMETRY_RECORD_LEGACY_JSON,    "Unversioned JSON from earlier firmware") \
+    X(2, PICO_ENV,       TELEMETRY_RECORD_PICO_ENV,       "Pico W node: soil moisture, DHT22, LDR") \
+    X(3, NPK_SERIAL,     TELEMETRY_RECORD_NPK_SERIAL,     "NPK probe node through relay.py") \
+    X(4, LEGACY_STATION, TELEMETRY_RECORD_LEGACY_STATION, "sensor_readings station layout")
+
+// Record fields: X(json_key, column, c_type, format)
+// A dotted key ("npk.nitrogen") reads a nested JSON object.
+
+#define TELEMETRY_RECORD_LEGACY_JSON(X) \
+    X("soil_moisture",    soil_moisture,    float, "%.2f") \
+    X("soil_temperature", soil_temperature, float, "%.2f") \
+    X("humidity",         humidity,         float, "%.2f") \
+    X("light_intensity",  light_intensity,  float, "%.2f") \
+    X("soil_ph",          soil_ph,          float, "%.2f") \
+    X("npk.nitrogen",     nitrogen,         int,   "%d") \
+    X("npk.phosphorus",   phosphorus,       int,   "%d") \
+    X("npk.potassium",    potassium,        int,   "%d")
+
+#define TELEMETRY_RECORD_PICO_ENV(X) \
+    X("soil_moisture",    soil_moisture,    float, "%.2f") \
+    X("soil_temperature", soil_temperature, float, "%.2f") \
+    X("humidity",         humidity,         float, "%.2f") \
+    X("light_intensity",  light_intensity,  float, "%.2f")
+
+#define TELEMETRY_RECORD_NPK_SERIAL(X) \
+    X("soil_moisture",     soil_moisture,     float, "%.2f") \
+    X("soil_temperature",  soil_temperature,  float, "%.2f") \
+    X("soil_ph",           soil_ph,           float, "%.2f") \
+    X("soil_conductivity", soil_conductivity, float, "%.0f") \
+    X("nitrogen",          nitrogen,          int,   "%d") \
+    X("phosphorus",        phosphorus,        int,   "%d") \
+    X("potassium",         potassium,         int,   "%d")
+
+#define TELEMETRY_RECORD_LEGACY_STATION(X) \
+    X("soil_moisture",        soil_moisture,        float, "%.2f") \
+    X("soil_temperature",     soil_temperature,     float, "%.2f") \
+    X("soil_ph",              soil_ph,              float, "%.2f") \
+    X("soil_conductivity",    soil_conductivity,    float, "%.1f") \
+    X("air_temperature",      air_temperature,      float, "%.2f") \
+    X("humidity",             humidity,             float, "%.2f") \
+    X("atmospheric_pressure", atmospheric_pressure, float, "%.1f") \
+    X("npk.nitrogen",         nitrogen,             int,   "%d") \
+    X("npk.phosphorus",       phosphorus,           int,   "%d") \
+    X("npk.potassium",        potassium,            int,   "%d")
+
+// ==================== EXPANSION HELPERS ====================
+
+#define TELEMETRY_SCHEMA_ENUM(id, name, fields, desc) TELEMETRY_SCHEMA_##name = id,
+enum { TELEMETRY_RECORD_TYPES(TELEMETRY_SCHEMA_ENUM) };
+
+// Flat record types only: every field follows timestamp, hence the comma
+#define TELEMETRY_STRUCT_MEMBER(key, column, c_type, format) c_type column;
+#define TELEMETRY_JSON_FORMAT(key, column, c_type, format) ",\"" key "\":" format
+#define TELEMETRY_JSON_VALUE(key, column, c_type, format) , reading->column
+
+/**
+ * Define <name>_t and <name>_encode_json() for a flat record type
+ *
+ * The encoder writes an (unterminated) JSON object so the caller can
+ * append extra members before closing it with "}", and returns the
+ * snprintf result.
+ */
+#define TELEMETRY_DEFINE_RECORD(name, schema_id, fields) \
+    typedef struct { \
+        uint64_t timestamp; \
+        fields(TELEMETRY_STRUCT_MEMBER) \
+    } name##_t; \
+    static inline int name##_encode_json(char *buffer, size_t size, const char *device_id, \
+                                         const name##_t *reading) { \
+        return snprintf(buffer, size, \
+            "{\"schema_id\":%d,\"device_id\":\"%s\",\"timestamp\":%llu" \
+            fields(TELEMETRY_JSON_FORMAT), \
+            schema_id, device_id, (unsigned long long)reading->timestamp \
+            fields(TELEMETRY_JSON_VALUE)); \
+    }
+
+// Record type produced by this firmware
+TELEMETRY_DEFINE_RECORD(telemetry_pico_env, TELEMETRY_SCHEMA_PICO_ENV, TELEMETRY_RECORD_PICO_ENV)
+
+#endif // TELEMETRY_SCHEMA_H
@@ -0,0 +1,35 @@
+/**
+ * TinyUSB Configuration for Raspberry Pi Pico W
+ *
+ * Replaces the SDK's stdio-only configuration: CDC carries stdio as
+ * before, and a vendor-class interface serves archive dumps (usb_dump.c).
+ * Descriptors are in usb_descriptors.c.
+ *
+ * Author: Smart Agriculture Team
+ * Date: October 2024
+ */
+
+#ifndef TUSB_CONFIG_H
+#define TUSB_CONFIG_H
+
+#define CFG_TUSB_RHPORT0_MODE (OPT_MODE_DEVICE)
+
+#define CFG_TUD_ENDPOINT0_SIZE 64
+
+// Interfaces
+#define CFG_TUD_CDC 1
+#define CFG_TUD_VENDOR 1
+#define CFG_TUD_MSC 0
+#define CFG_TUD_HID 0
+#define CFG_TUD_MIDI 0
+
+// CDC stdio, same sizes as the SDK default
+#define CFG_TUD_CDC_RX_BUFSIZE 256
+#define CFG_TUD_CDC_TX_BUFSIZE 256
+
+// Vendor bulk: a deep TX FIFO keeps the endpoint busy while the next
+// archive block is read from the card
+#define CFG_TUD_VENDOR_RX_BUFSIZE 64
+#define CFG_TUD_VENDOR_TX_BUFSIZE 4096
+
+#endif // TUSB_CONFIG_H
@@ -0,0 +1,120 @@
+/**
+ * USB Descriptors for Raspberry Pi Pico W
+ *
+ * Composite device: CDC ACM for stdio (interfaces 0-1) and a vendor-class
+ * bulk interface for archive dumps (interface 2). The SDK's default
+ * descriptors are disabled in CMakeLists.txt.
+ *
+ * Author: Smart Agriculture Team
+ * Date: October 2024
+ */
+
+#include <string.h>
+#include "pico/unique_id.h"
+#include "tusb.h"
+#include "usb_dump_protocol.h"
+
+enum {
+    ITF_NUM_CDC = 0,
+    ITF_NUM_CDC_DATA,
+    ITF_NUM_VENDOR,
+    ITF_NUM_TOTAL
+};
+
+#define EPNUM_CDC_NOTIF 0x81
+#define EPNUM_CDC_OUT 0x02
+#define EPNUM_CDC_IN 0x82
+
+#define CONFIG_TOTAL_LEN (TUD_CONFIG_DESC_LEN + TUD_CDC_DESC_LEN + TUD_VENDOR_DESC_LEN)
+
+// String indices
+enum {
+    STRID_LANGID = 0,
+    STRID_MANUFACTURER,
+    STRID_PRODUCT,
+    STRID_SERIAL,
+    STRID_CDC,
+    STRID_VENDOR
+};
+
+_Static_assert(ITF_NUM_VENDOR == USB_DUMP_INTERFACE, "vendor interface number");
+
+// ==================== DEVICE ====================
+
+static const tusb_desc_device_t device_descriptor = {
+    .bLength = sizeof(tusb_desc_device_t),
+    .bDescriptorType = TUSB_DESC_DEVICE,
+    .bcdUSB = 0x0200,
+    // Interface association for the CDC pair
+    .bDeviceClass = TUSB_CLASS_MISC,
+    .bDeviceSubClass = MISC_SUBCLASS_COMMON,
+    .bDeviceProtocol = MISC_PROTOCOL_IAD,
+    .bMaxPacketSize0 = CFG_TUD_ENDPOINT0_SIZE,
+    .idVendor = USB_DUMP_VID,
+    .idProduct = USB_DUMP_PID,
+    .bcdDevice = 0x0100,
+    .iManufacturer = STRID_MANUFACTURER,
+    .iProduct = STRID_PRODUCT,
+    .iSerialNumber = STRID_SERIAL,
+    .bNumConfigurations = 1
+};
+
+const uint8_t *tud_descriptor_device_cb(void) {
+    return (const uint8_t *)&device_descriptor;
+}
+
+// ==================== CONFIGURATION ====================
+
+static const uint8_t configuration_descriptor[] = {
+    TUD_CONFIG_DESCRIPTOR(1, ITF_NUM_TOTAL, 0, CONFIG_TOTAL_LEN, 0, 250),
+    TUD_CDC_DESCRIPTOR(ITF_NUM_CDC, STRID_CDC, EPNUM_CDC_NOTIF, 8,
+                       EPNUM_CDC_OUT, EPNUM_CDC_IN, 64),
+    TUD_VENDOR_DESCRIPTOR(ITF_NUM_VENDOR, STRID_VENDOR, USB_DUMP_EP_OUT,
+                          USB_DUMP_EP_IN, USB_DUMP_PACKET_SIZE)
+};
+
+const uint8_t *tud_descriptor_configuration_cb(uint8_t index) {
+    (void)index;
+    return configuration_descriptor;
+}
+
+// ==================== STRINGS ====================
+
+static const char *const strings[] = {
+    [STRID_MANUFACTURER] = "Smart Agriculture Team",
+    [STRID_PRODUCT] = "Smart Agriculture Node",
+    [STRID_CDC] = "Console",
+    [STRID_VENDOR] = "Archive Dump"
+};
+
+const uint16_t *tud_descriptor_string_cb(uint8_t index, uint16_t langid) {
+    static uint16_t descriptor[32];
+    char serial[2 * PICO_UNIQUE_BOARD_ID_SIZE_BYTES + 1];
+    const char *text;
+    (void)langid;
+
+    if (index == STRID_LANGID) {
+        descriptor[1] = 0x0409;  // English (US)
+        descriptor[0] = (uint16_t)((TUSB_DESC_STRING << 8) | 4);
+        return descriptor;
+    }
+
+    if (index == STRID_SERIAL) {
+        pico_get_unique_board_id_string(serial, sizeof(serial));
+        text = serial;
+    } else if (index < sizeof(strings) / sizeof(strings[0]) && strings[index] != NULL) {
+        text = strings[index];
+    } else {
+        return NULL;
+    }
+
+    size_t length = strlen(text);
+    if (length > 31) {
+        length = 31;
+    }
+    for (size_t i = 0; i < length; i++) {
+        descriptor[1 + i] = (uint8_t)text[i];
+    }
+    descriptor[0] = (uint16_t)((TUSB_DESC_STRING << 8) | (2 * length + 2));
+    return descriptor;
+}
@@ -0,0 +1,294 @@
+/**
+ * USB Archive Dump Interface for Raspberry Pi Pico W
+ *
+ * Runs entirely inside TinyUSB callbacks, which the SDK's stdio USB
+ * background task invokes from tud_task(), so no locking against the CDC
+ * console is needed. A READ response is streamed by keeping the vendor TX
+ * FIFO full: while one block is being copied into the FIFO, core 1 reads
+ * the next into the other half of a double buffer.
+ *
+ * Callbacks never wait for core 1. When the next block is not read yet the
+ * response pauses, and usb_dump_task() in the main loop hands it back to
+ * the USB task with usbd_defer_func() once the read completes. A read that
+ * does not complete in time is sent as a zeroed block, like a failed one,
+ * so the response keeps the length its header promised.
+ *
+ * Author: Smart Agriculture Team
+ * Date: October 2024
+ */
+
+#include <string.h>
+#include "pico/stdlib.h"
+#include "tusb.h"
+#include "device/usbd_pvt.h"
+#include "sd_archive.h"
+#include "usb_dump.h"
+#include "usb_dump_protocol.h"
+
+#define READ_TIMEOUT_US 250000    // Card busy with a sync can take a while
+
+// ==================== STATE ====================
+static bool enabled = false;
+static usb_dump_stats_t stats;
+
+static uint8_t block_buffers[2][ARCHIVE_BLOCK_SIZE] __attribute__((aligned(4)));
+static const uint8_t zero_block[ARCHIVE_BLOCK_SIZE];    // Stands in for a timed out read
+static sd_archive_read_t reads[2] = {
+    {block_buffers[0], 0, SD_READ_DONE},
+    {block_buffers[1], 0, SD_READ_DONE}
+};
+
+// Current response
+static bool streaming = false;
+static uint32_t next_read = 0;    // Next block to queue on core 1
+static uint32_t next_send = 0;    // Next block to copy into the TX FIFO
+static uint32_t stream_end = 0;
+
+static uint8_t header[sizeof(usb_dump_response_t) + sizeof(usb_dump_info_t)];
+static const uint8_t *tx_data = NULL;
+static uint32_t tx_remaining = 0;
+static bool tx_is_block = false;
+
+// Paused on core 1; polled by usb_dump_task() from the main loop
+static volatile bool stalled = false;
+static volatile bool resume_queued = false;
+static absolute_time_t stall_deadline;
+
+// ==================== BLOCK PIPELINE ====================
+
+/**
+ * Whether the buffer the paused response waits for is free: the next
+ * block's while streaming, otherwise both before a new request
+ */
+static bool reads_done(void) {
+    if (streaming) {
+        return reads[next_send & 1u].state != SD_READ_PENDING;
+    }
+    return reads[0].state != SD_READ_PENDING && reads[1].state != SD_READ_PENDING;
+}
+
+static void stall(void) {
+    if (!stalled) {
+        stall_deadline = make_timeout_time_us(READ_TIMEOUT_US);
+        stalled = true;
+    }
+}
+
+static void queue_read(void) {
+    if (next_read < stream_end) {
+        sd_archive_read_t *request = &reads[next_read & 1u];
+        if (request->state == SD_READ_PENDING) {
+            return;     // Still the target of a timed out read
+        }
+        request->block = next_read++;
+        sd_archive_read_async(request);
+    }
+}
+
+/**
+ * Point the TX cursor at the next block once core 1 has read it
+ */
+static bool next_block(void) {
+    if (next_send >= stream_end) {
+        streaming = false;
+        return false;
+    }
+
+    if (next_read <= next_send) {
+        queue_read();     // Deferred while its buffer was busy
+    }
+    sd_archive_read_t *request = &reads[next_send & 1u];
+    if (next_read <= next_send || request->state == SD_READ_PENDING) {
+        if (!stalled || !time_reached(stall_deadline)) {
+            stall();
+            return false;
+        }
+        // Keep the stream length; the zeroed block fails the host CRC check
+        if (next_read <= next_send) {
+            next_read = next_send + 1;    // Never queued, skip its read
+        }
+        stalled = false;
+        stats.read_errors++;
+        tx_data = zero_block;
+        tx_remaining = ARCHIVE_BLOCK_SIZE;
+        tx_is_block = true;
+        return true;
+    }
+    stalled = false;
+    if (request->state == SD_READ_ERROR) {
+        memset(request->buffer, 0, ARCHIVE_BLOCK_SIZE);
+        stats.read_errors++;
+    }
+
+    tx_data = request->buffer;
+    tx_remaining = ARCHIVE_BLOCK_SIZE;
+    tx_is_block = true;
+    return true;
+}
+
+/**
+ * Copy as much of the response as fits into the TX FIFO
+ */
+static void pump(void) {
+    while (tud_vendor_write_available() > 0) {
+        if (tx_remaining == 0) {
+            if (tx_is_block) {
+                // Block is in the FIFO, its buffer can take the next read
+                tx_is_block = false;
+                next_send++;
+                stats.blocks_sent++;
+                queue_read();
+            }
+            if (!streaming || !next_block()) {
+                break;
+            }
+        }
+
+        uint32_t available = tud_vendor_write_available();
+        uint32_t written = tud_vendor_write(tx_data, tx_remaining < available ? tx_remaining
+                                                                              : available);
+        if (written == 0) {
+            break;
+        }
+        tx_data += written;
+        tx_remaining -= written;
+    }
+    tud_vendor_write_flush();
+}
+
+// ==================== REQUESTS ====================
+
+static void handle_request(const usb_dump_request_t *request) {
+    usb_dump_response_t *response = (usb_dump_response_t *)header;
+    sd_archive_stats_t archive_stats;
+
+    stats.requests++;
+
+    memset(header, 0, sizeof(header));
+    response->magic = USB_DUMP_RESPONSE_MAGIC;
+    response->opcode = request->opcode;
+    tx_data = header;
+    tx_remaining = sizeof(*response);
+
+    if (request->magic != USB_DUMP_REQUEST_MAGIC) {
+        response->status = USB_DUMP_BAD_REQUEST;
+        return;
+    }
+    if (!enabled) {
+        response->status = USB_DUMP_NO_ARCHIVE;
+        return;
+    }
+    sd_archive_get_stats(&archive_stats);
+
+    switch (request->opcode) {
+        case USB_DUMP_OP_INFO: {
+            usb_dump_info_t info = {
+                ARCHIVE_BLOCK_SIZE, archive_stats.archive_blocks,
+                archive_stats.records, archive_stats.dropped
+            };
+            memcpy(header + sizeof(*response), &info, sizeof(info));
+            response->length = sizeof(info);
+            tx_remaining += sizeof(info);
+            break;
+        }
+
+        case USB_DUMP_OP_READ: {
+            // Clamp to the blocks already on the card
+            uint32_t first = request->arg0;
+            uint32_t count = request->arg1 > USB_DUMP_MAX_BLOCKS ? USB_DUMP_MAX_BLOCKS
+                                                                 : request->arg1;
+            if (first >= archive_stats.archive_blocks) {
+                count = 0;
+            } else if (count > archive_stats.archive_blocks - first) {
+                count = archive_stats.archive_blocks - first;
+            }
+
+            response->length = count * ARCHIVE_BLOCK_SIZE;
+            next_read = next_send = first;
+            stream_end = first + count;
+            streaming = count > 0;
+            queue_read();
+            queue_read();
+            break;
+        }
+
+        default:
+            response->status = USB_DUMP_BAD_REQUEST;
+            break;
+    }
+}
+
+// ==================== TINYUSB CALLBACKS ====================
+
+static void receive(void) {
+    usb_dump_request_t request;
+    while (tud_vendor_available() >= sizeof(request)) {
+        // A new request abandons the current response, but its buffers may
+        // still be the target of a read: leave the request in the RX FIFO
+        streaming = false;
+        tx_remaining = 0;
+        tx_is_block = false;
+        if (!reads_done()) {
+            if (stalled && time_reached(stall_deadline)) {
+                stalled = false;    // Keep waiting, polled at the read timeout
+            }
+            stall();
+            return;
+        }
+        stalled = false;
+        tud_vendor_read(&request, sizeof(request));
+        handle_request(&request);
+    }
+    pump();
+}
+
+/**
+ * Continue a paused response, in the USB task via usbd_defer_func()
+ */
+static void resume(void *param) {
+    (void)param;
+    resume_queued = false;
+    receive();
+}
+
+#if defined(TUSB_VERSION_MINOR) && (TUSB_VERSION_MAJOR > 0 || TUSB_VERSION_MINOR >= 17)
+void tud_vendor_rx_cb(uint8_t itf, const uint8_t *buffer, uint16_t bufsize) {
+    (void)itf;
+    (void)buffer;
+    (void)bufsize;
+    receive();
+}
+#else
+void tud_vendor_rx_cb(uint8_t itf) {
+    (void)itf;
+    receive();
+}
+#endif
+
+void tud_vendor_tx_cb(uint8_t itf, uint32_t sent_bytes) {
+    (void)itf;
+    (void)sent_bytes;
+    pump();
+}
+
+// ==================== PUBLIC API ====================
+
+void usb_dump_init(bool archive_available) {
+    memset(&stats, 0, sizeof(stats));
+    enabled = archive_available;
+}
+
+void usb_dump_task(void) {
+    if (stalled && !resume_queued && (reads_done() || time_reached(stall_deadline))) {
+        resume_queued = true;
+        usbd_defer_func(resume, NULL, false);
+    }
+}
+
+bool usb_dump_active(void) {
+    return streaming || tx_remaining > 0 || stalled;
+}
+
+void usb_dump_get_stats(usb_dump_stats_t *out) {
+    memcpy(out, &stats, sizeof(*out));
+}
@@ -0,0 +1,48 @@
+/**
+ * USB Archive Dump Interface Header File
+ *
+ * Serves the SD card archive over the vendor-class bulk interface at full
+ * speed USB rates, independent of the CDC stdio console. Protocol in
+ * usb_dump_protocol.h; host side in usb_pull.c.
+ *
+ * Author: Smart Agriculture Team
+ * Date: October 2024
+ */
+
+#ifndef USB_DUMP_H
+#define USB_DUMP_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+typedef struct {
+    uint32_t requests;
+    uint32_t blocks_sent;
+    uint32_t read_errors;     // Blocks sent zero filled after a failed or timed out read
+} usb_dump_stats_t;
+
+/**
+ * Enable the dump interface. Requests are answered with
+ * USB_DUMP_NO_ARCHIVE until this is called.
+ *
+ * @param archive_available Result of sd_archive_init()
+ */
+void usb_dump_init(bool archive_available);
+
+/**
+ * Resume a response paused on a card read. Call from the main loop; the
+ * TinyUSB callbacks never wait for core 1 themselves.
+ */
+void usb_dump_task(void);
+
+/**
+ * Check whether a dump is currently streaming
+ */
+bool usb_dump_active(void);
+
+/**
+ * Get dump statistics
+ */
+void usb_dump_get_stats(usb_dump_stats_t *stats);
+
+#endif // USB_DUMP_H
@@ -0,0 +1,71 @@
+/**
+ * USB Archive Dump Protocol
+ *
+ * Shared by the firmware (usb_dump.c) and the host pull tool
+ * (usb_pull.c). Plain C, no SDK dependencies.
+ *
+ * The node enumerates as a composite device: CDC for stdio, plus a
+ * vendor-class interface with one bulk OUT and one bulk IN endpoint.
+ * The host writes a 16-byte request to bulk OUT and reads the response
+ * from bulk IN: a 12-byte response header followed by `length` bytes.
+ * Requests are handled one at a time: a new request abandons whatever
+ * is left of the previous response, so read it completely first.
+ *
+ * All fields are little endian.
+ *
+ * Author: Smart Agriculture Team
+ * Date: October 2024
+ */
+
+#ifndef USB_DUMP_PROTOCOL_H
+#define USB_DUMP_PROTOCOL_H
+
+#include <stdint.h>
+
+// Development IDs; replace with an allocated VID/PID before shipping
+#define USB_DUMP_VID 0xcafe
+#define USB_DUMP_PID 0x4011
+
+#define USB_DUMP_INTERFACE 2      // After the two CDC interfaces
+#define USB_DUMP_EP_OUT 0x03
+#define USB_DUMP_EP_IN 0x83
+#define USB_DUMP_PACKET_SIZE 64   // Full speed bulk
+
+#define USB_DUMP_REQUEST_MAGIC 0x51524741u   // "AGRQ"
+#define USB_DUMP_RESPONSE_MAGIC 0x53524741u  // "AGRS"
+
+// Opcodes
+#define USB_DUMP_OP_INFO 1        // Response: usb_dump_info_t
+#define USB_DUMP_OP_READ 2        // arg0 first block, arg1 block count
+
+// Response status
+#define USB_DUMP_OK 0
+#define USB_DUMP_NO_ARCHIVE 1
+#define USB_DUMP_BAD_REQUEST 2
+
+#define USB_DUMP_MAX_BLOCKS 4096  // Per READ request (16 MB)
+
+typedef struct __attribute__((packed)) {
+    uint32_t magic;
+    uint8_t opcode;
+    uint8_t reserved[3];
+    uint32_t arg0;
+    uint32_t arg1;
+} usb_dump_request_t;
+
+typedef struct __attribute__((packed)) {
+    uint32_t magic;
+    uint8_t opcode;
+    uint8_t status;
+    uint16_t reserved;
+    uint32_t length;          // Bytes following this header
+} usb_dump_response_t;
+
+typedef struct __attribute__((packed)) {
+    uint32_t block_size;      // ARCHIVE_BLOCK_SIZE
+    uint32_t blocks;          // Blocks currently in the archive file
+    uint32_t records;         // Records appended since boot
+    uint32_t dropped;         // Records dropped since boot
+} usb_dump_info_t;
+
+#endif // USB_DUMP_PROTOCOL_H
@@ -0,0 +1,188 @@
+/**
+ * USB Archive Pull Tool (host build, libusb-1.0)
+ *
+ * Copies the node's SD card archive over the vendor bulk interface into a
+ * local file. Pulls are incremental: blocks already in the output file
+ * are skipped, so a weekly pull only transfers the new ones. Every block
+ * received is CRC checked; decode the result with archive_dump.
+ *
+ * Usage: usb_pull <AGRI.LOG> [--full]
+ *        usb_pull --info
+ *
+ * Author: Smart Agriculture Team
+ * Date: October 2024
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <libusb.h>
+#include "archive_format.h"
+#include "usb_dump_protocol.h"
+
+#define CHUNK_BLOCKS 256          // 1 MB per READ request
+#define TIMEOUT_MS 5000
+
+static libusb_device_handle *device = NULL;
+
+static double now_s(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int open_device(void) {
+    if (libusb_init(NULL) != 0) {
+        fprintf(stderr, "libusb init failed\n");
+        return 0;
+    }
+    device = libusb_open_device_with_vid_pid(NULL, USB_DUMP_VID, USB_DUMP_PID);
+    if (device == NULL) {
+        fprintf(stderr, "Node not found (%04x:%04x)\n", USB_DUMP_VID, USB_DUMP_PID);
+        return 0;
+    }
+    if (libusb_claim_interface(device, USB_DUMP_INTERFACE) != 0) {
+        fprintf(stderr, "Cannot claim the dump interface\n");
+        return 0;
+    }
+    return 1;
+}
+
+/**
+ * Send a request and read the response header plus up to `capacity`
+ * bytes of payload into `payload`
+ *
+ * @return Payload length, or -1 on error
+ */
+static long transact(uint8_t opcode, uint32_t arg0, uint32_t arg1,
+                     uint8_t *payload, uint32_t capacity) {
+    usb_dump_request_t request = {USB_DUMP_REQUEST_MAGIC, opcode, {0}, arg0, arg1};
+    int transferred = 0;
+
+    if (libusb_bulk_transfer(device, USB_DUMP_EP_OUT, (uint8_t *)&request, sizeof(request),
+                             &transferred, TIMEOUT_MS) != 0 ||
+        transferred != sizeof(request)) {
+        fprintf(stderr, "Request failed\n");
+        return -1;
+    }
+
+    // Header and payload arrive as one stream; a single transfer of the
+    // expected size ends early on the short packet of an error response
+    uint32_t size = sizeof(usb_dump_response_t) + capacity;
+    uint8_t *buffer = malloc(size);
+    if (buffer == NULL) {
+        return -1;
+    }
+    int rc = libusb_bulk_transfer(device, USB_DUMP_EP_IN, buffer, (int)size,
+                                  &transferred, TIMEOUT_MS);
+
+    usb_dump_response_t response;
+    if (rc != 0 || transferred < (int)sizeof(response)) {
+        fprintf(stderr, "Response failed: %s\n", libusb_error_name(rc));
+        free(buffer);
+        return -1;
+    }
+    memcpy(&response, buffer, sizeof(response));
+    if (response.magic != USB_DUMP_RESPONSE_MAGIC || response.status != USB_DUMP_OK) {
+        fprintf(stderr, "Node refused request (status %u)\n", response.status);
+        free(buffer);
+        return -1;
+    }
+    if (response.length > capacity ||
+        (uint32_t)transferred != sizeof(response) + response.length) {
+        fprintf(stderr, "Short response: %d of %u bytes\n", transferred,
+                (unsigned)(sizeof(response) + response.length));
+        free(buffer);
+        return -1;
+    }
+
+    memcpy(payload, buffer + sizeof(response), response.length);
+    free(buffer);
+    return response.length;
+}
+
+static int get_info(usb_dump_info_t *info) {
+    return transact(USB_DUMP_OP_INFO, 0, 0, (uint8_t *)info, sizeof(*info)) ==
+           (long)sizeof(*info);
+}
+
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        fprintf(stderr, "Usage: %s <AGRI.LOG> [--full] | --info\n", argv[0]);
+        return 1;
+    }
+    if (!open_device()) {
+        return 1;
+    }
+
+    usb_dump_info_t info;
+    if (!get_info(&info) || info.block_size != ARCHIVE_BLOCK_SIZE) {
+        fprintf(stderr, "Unexpected INFO response\n");
+        return 1;
+    }
+    if (strcmp(argv[1], "--info") == 0) {
+        printf("blocks: %u (%.1f MB)\nrecords since boot: %u\ndropped since boot: %u\n",
+               info.blocks, info.blocks * (ARCHIVE_BLOCK_SIZE / 1048576.0),
+               info.records, info.dropped);
+        return 0;
+    }
+
+    // Resume after the whole blocks already pulled
+    int full = argc > 2 && strcmp(argv[2], "--full") == 0;
+    FILE *file = fopen(argv[1], full ? "w+b" : "r+b");
+    if (file == NULL) {
+        file = fopen(argv[1], "w+b");
+    }
+    if (file == NULL) {
+        fprintf(stderr, "Cannot open %s\n", argv[1]);
+        return 1;
+    }
+    fseek(file, 0, SEEK_END);
+    uint32_t have = (uint32_t)(ftell(file) / ARCHIVE_BLOCK_SIZE);
+    if (have > info.blocks) {
+        fprintf(stderr, "Local copy is longer than the card archive; use --full\n");
+        fclose(file);
+        return 1;
+    }
+    fseek(file, (long)have * ARCHIVE_BLOCK_SIZE, SEEK_SET);
+
+    uint8_t *chunk = malloc((size_t)CHUNK_BLOCKS * ARCHIVE_BLOCK_SIZE);
+    uint32_t bad_blocks = 0;
+    uint32_t pulled = 0;
+    double start = now_s();
+
+    while (have + pulled < info.blocks) {
+        uint32_t count = info.blocks - have - pulled;
+        if (count > CHUNK_BLOCKS) {
+            count = CHUNK_BLOCKS;
+        }
+        long length = transact(USB_DUMP_OP_READ, have + pulled, count, chunk,
+                               count * ARCHIVE_BLOCK_SIZE);
+        if (length <= 0) {
+            break;
+        }
+
+        uint32_t received = (uint32_t)(length / ARCHIVE_BLOCK_SIZE);
+        for (uint32_t i = 0; i < received; i++) {
+            bad_blocks += !archive_block_valid(chunk + (size_t)i * ARCHIVE_BLOCK_SIZE);
+        }
+        fwrite(chunk, ARCHIVE_BLOCK_SIZE, received, file);
+        pulled += received;
+
+        fprintf(stderr, "\r%u / %u blocks", have + pulled, info.blocks);
+    }
+
+    double elapsed = now_s() - start;
+    fprintf(stderr, "\nPulled %u blocks (%.1f KB) in %.2f s, %.0f KB/s, %u failed CRC\n",
+            pulled, pulled * (ARCHIVE_BLOCK_SIZE / 1024.0), elapsed,
+            elapsed > 0 ? pulled * (ARCHIVE_BLOCK_SIZE / 1024.0) / elapsed : 0.0,
+            bad_blocks);
+
+    free(chunk);
+    fclose(file);
+    libusb_release_interface(device, USB_DUMP_INTERFACE);
+    libusb_close(device);
+    libusb_exit(NULL);
+    return have + pulled == info.blocks ? 0 : 1;
+}
@@ -0,0 +1,285 @@
+"""
+Bulk backfill of historical readings straight into sensor_data
+
+Sources:
+- relay.py console logs: "DATA:|moist|temp|ph|ec|N|P|K|" lines (record
+  type NPK_SERIAL). A leading Unix or ISO timestamp on the line is used
+  when present (e.g. logs captured through `ts`); untimed lines follow the
+  previous reading by --interval seconds, starting at --log-start.
+- Old agriculture_monitor.db files: their sensor_data rows (under the
+  record type they carry, legacy JSON if none) and sensor_readings rows
+  (legacy station layout, stored under --station-device).
+
+Files and rowid ranges of the legacy tables are parsed in a process pool,
+through the same generated decoders the API uses, so range checks are
+identical. The rows are then sorted by (device_id, timestamp), rows
+already in the store (warm sensor_data or the cold archive) are dropped,
+and the rest are written with executemany in large transactions in index
+order. No HTTP, no per-row commits, and the in-memory models rebuild from
+the store on the next start.
+
+Usage:
+    python -m app.backfill --db agriculture_monitor.db \
+        --log relay-may.log --log relay-june.log --device PICO_NPK_001 \
+        --legacy old/agriculture_monitor.db
+"""
+import os
+import re
+import sys
+import time
+import sqlite3
+import logging
+import argparse
+from datetime import datetime
+from concurrent.futures import ProcessPoolExecutor
+from operator import itemgetter
+from typing import Dict, List, Optional, Set, Tuple
+
+from app.tiered_store import TS, decode_day
+from app.telemetry_schema import (
+    SENSOR_DATA_DDL, SENSOR_DATA_MIGRATIONS, DECODERS, DEFAULT_SCHEMA_ID, SchemaError, decode,
+    decode_npk_serial, encode_legacy_json, encode_pico_env, encode_npk_serial, encode_legacy_station
+)
+
+logger = logging.getLogger(__name__)
+
+ENCODERS = {
+    1: encode_legacy_json,
+    2: encode_pico_env,
+    3: encode_npk_serial,
+    4: encode_legacy_station,
+}
+NPK_SERIAL_FIELDS = (
+    ("soil_moisture", float), ("soil_temperature", float), ("soil_ph", float),
+    ("soil_conductivity", int), ("nitrogen", int), ("phosphorus", int), ("potassium", int),
+)
+LINE_TIME = re.compile(r"^\W*(\d{4}-\d{2}-\d{2}[ T]\d{2}:\d{2}:\d{2}(?:\.\d+)?|\d{10}(?:\.\d+)?)")
+RANGE_ROWS = 200_000        # Legacy table rows per worker task
+COMMIT_ROWS = 100_000
+
+Parsed = Tuple[List[tuple], int]    # decoded parameter tuples, rejected count
+
+
+def parse_time(text: str) -> int:
+    if text[0:4].isdigit() and text[4:5] == "-":
+        # Naive times are local, as relay.py stamped them
+        return int(datetime.fromisoformat(text.replace(" ", "T")).timestamp())
+    return int(float(text))
+
+
+def parse_log(path: str, device_id: str, log_start: Optional[int], interval: int) -> Parsed:
+    """Worker: DATA lines of one relay console log"""
+    rows: List[tuple] = []
+    rejected = 0
+    previous = log_start - interval if log_start is not None else None
+    with open(path, encoding="utf-8", errors="replace") as f:
+        for line in f:
+            at = line.find("DATA:|")
+            if at < 0:
+                continue
+            stamp = LINE_TIME.match(line, 0, at)
+            try:
+                if stamp:
+                    timestamp = parse_time(stamp.group(1))
+                elif previous is not None:
+                    timestamp = previous + interval
+                else:
+                    rejected += 1
+                    continue
+                parts = line[at + 6:].split("|", 7)
+                payload = {name: kind(parts[i]) for i, (name, kind) in enumerate(NPK_SERIAL_FIELDS)}
+                payload["device_id"] = device_id
+                payload["timestamp"] = timestamp
+                rows.append(decode_npk_serial(payload))
+                previous = timestamp
+            except (SchemaError, ValueError, IndexError):
+                rejected += 1
+    return rows, rejected
+
+
+def _values(row, columns) -> Dict:
+    return {name: row[name] for name in columns}
+
+
+def parse_legacy(path: str, table: str, low: int, high: int, station_device: str) -> Parsed:
+    """Worker: rowids [low, high) of a legacy sensor_data or sensor_readings table"""
+    rows: List[tuple] = []
+    rejected = 0
+    db = sqlite3.connect(f"file:{path}?mode=ro", uri=True)
+    db.row_factory = sqlite3.Row
+    try:
+        columns = {r[1] for r in db.execute(f"PRAGMA table_info({table})")}
+        cursor = db.execute(f"SELECT * FROM {table} WHERE rowid >= ? AND rowid < ?", (low, high))
+        for row in cursor:
+            try:
+                if table == "sensor_readings":
+                    timestamp = parse_time(str(row["timestamp"]))
+                    payload = encode_legacy_station(station_device, timestamp, _values(row, columns))
+                    rows.append(decode(payload)[1])
+                else:
+                    schema_id = row["schema_id"] if "schema_id" in columns and row["schema_id"] else DEFAULT_SCHEMA_ID
+                    encoder = ENCODERS.get(schema_id)
+                    if encoder is None:
+                        raise SchemaError(f"unknown schema_id {schema_id}")
+                    payload = encoder(row["device_id"], parse_time(str(row["timestamp"])), _values(row, columns))
+                    is_dummy = row["is_dummy"] if "is_dummy" in columns else 0
+                    rows.append(decode(payload, is_dummy=is_dummy or 0)[1])
+            except (SchemaError, ValueError, TypeError):
+                rejected += 1
+    finally:
+        db.close()
+    return rows, rejected
+
+
+def legacy_tasks(path: str) -> List[Tuple[str, int, int]]:
+    """(table, low, high) rowid ranges of the legacy tables in a database"""
+    db = sqlite3.connect(f"file:{path}?mode=ro", uri=True)
+    try:
+        tables = {r[0] for r in db.execute("SELECT name FROM sqlite_master WHERE type = 'table'")}
+        tasks = []
+        for table in ("sensor_data", "sensor_readings"):
+            if table not in tables:
+                continue
+            low, high = db.execute(f"SELECT MIN(rowid), MAX(rowid) FROM {table}").fetchone()
+            if low is None:
+                continue
+            for start in range(low, high + 1, RANGE_ROWS):
+                tasks.append((table, start, min(start + RANGE_ROWS, high + 1)))
+        return tasks
+    finally:
+        db.close()
+
+
+def prepare_store(db: sqlite3.Connection):
+    """The server's schema, as init_db() would leave it"""
+    db.execute(SENSOR_DATA_DDL)
+    existing = {row[1] for row in db.execute("PRAGMA table_info(sensor_data)")}
+    for column, sql_type in SENSOR_DATA_MIGRATIONS:
+        if column not in existing:
+            db.execute(f"ALTER TABLE sensor_data ADD COLUMN {column} {sql_type}")
+    db.execute("CREATE INDEX IF NOT EXISTS idx_sensor_data_device_ts ON sensor_data (device_id, timestamp)")
+    db.commit()
+
+
+def archived_timestamps(db: sqlite3.Connection, device_id: str, low: int, high: int) -> Set[int]:
+    """Timestamps in [low, high] of a device's rows moved to the cold archive"""
+    if db.execute("SELECT 1 FROM sqlite_master WHERE type = 'table' AND name = 'archive_chunks'").fetchone() is None:
+        return set()
+    stamps = set()
+    for (path,) in db.execute(
+        "SELECT path FROM archive_chunks WHERE device_id = ? AND max_ts >= ? AND min_ts <= ?",
+        (device_id, low, high)
+    ):
+        with open(path, "rb") as f:
+            stamps.update(ts for ts in (row[TS] for row in decode_day(f.read(), device_id)) if low <= ts <= high)
+    return stamps
+
+
+def drop_existing(db: sqlite3.Connection, rows: List[tuple]) -> List[tuple]:
+    """Sorted rows minus duplicates and readings the store already has"""
+    kept = []
+    index = 0
+    while index < len(rows):
+        device_id = rows[index][0]
+        end = index
+        while end < len(rows) and rows[end][0] == device_id:
+            end += 1
+        stored = {ts for (ts,) in db.execute(
+            "SELECT timestamp FROM sensor_data WHERE device_id = ? AND timestamp BETWEEN ? AND ?",
+            (device_id, rows[index][1], rows[end - 1][1])
+        )}
+        stored |= archived_timestamps(db, device_id, rows[index][1], rows[end - 1][1])
+        previous = None
+        for row in rows[index:end]:
+            if row[1] != previous and row[1] not in stored:
+                kept.append(row)
+            previous = row[1]
+        index = end
+    return kept
+
+
+def write_rows(db: sqlite3.Connection, rows: List[tuple]) -> int:
+    """Insert sorted rows, consecutive runs of one record type per executemany"""
+    db.execute("PRAGMA synchronous = OFF")
+    written = uncommitted = 0
+    run: List[tuple] = []
+    for row in rows:
+        if run and (row[3] != run[0][3] or len(run) >= COMMIT_ROWS):
+            db.executemany(DECODERS[run[0][3]][0], run)
+            written += len(run)
+            uncommitted += len(run)
+            run = []
+            if uncommitted >= COMMIT_ROWS:
+                db.commit()
+                uncommitted = 0
+        run.append(row)
+    if run:
+        db.executemany(DECODERS[run[0][3]][0], run)
+        written += len(run)
+    db.commit()
+    db.execute("PRAGMA synchronous = FULL")
+    return written
+
+
+def backfill(db_path: str, logs: List[str], legacy: List[str], device_id: str,
+             log_start: Optional[int], interval: int, station_device: str,
+             workers: Optional[int] = None) -> Dict:
+    started = time.perf_counter()
+    rows: List[tuple] = []
+    rejected = 0
+    with ProcessPoolExecutor(max_workers=workers) as pool:
+        futures = [pool.submit(parse_log, path, device_id, log_start, interval) for path in logs]
+        for path in legacy:
+            futures += [pool.submit(parse_legacy, path, table, low, high, station_device)
+                        for table, low, high in legacy_tasks(path)]
+        for future in futures:
+            parsed, bad = future.result()
+            rows.extend(parsed)
+            rejected += bad
+    parsed_at = time.perf_counter()
+
+    rows.sort(key=itemgetter(0, 1))
+    db = sqlite3.connect(db_path)
+    try:
+        prepare_store(db)
+        fresh = drop_existing(db, rows)
+        written = write_rows(db, fresh)
+    finally:
+        db.close()
+    elapsed = time.perf_counter() - started
+    return {
+        "parsed": len(rows),
+        "rejected": rejected,
+        "duplicates": len(rows) - len(fresh),
+        "written": written,
+        "parse_seconds": round(parsed_at - started, 2),
+        "seconds": round(elapsed, 2),
+        "rows_per_second": int(written / elapsed) if elapsed else written,
+    }
+
+
+def main(argv: Optional[List[str]] = None) -> int:
+    parser = argparse.ArgumentParser(description="Bulk import relay logs and legacy databases")
+    parser.add_argument("--db", default=os.getenv("DATABASE_PATH", "agriculture_monitor.db"))
+    parser.add_argument("--log", action="append", default=[], help="relay.py console log (repeatable)")
+    parser.add_argument("--legacy", action="append", default=[], help="Old database file (repeatable)")
+    parser.add_argument("--device", default="PICO_NPK_001", help="Device id of the log readings")
+    parser.add_argument("--log-start", type=int, help="Unix time of the first untimed log line")
+    parser.add_argument("--interval", type=int, default=5, help="Seconds between untimed log lines")
+    parser.add_argument("--station-device", default="LEGACY_STATION",
+                        help="Device id for sensor_readings rows")
+    parser.add_argument("--workers", type=int, help="Parser processes (default: all cores)")
+    args = parser.parse_args(argv)
+    if not args.log and not args.legacy:
+        parser.error("nothing to import: give --log and/or --legacy")
+
+    report = backfill(args.db, args.log, args.legacy, args.device, args.log_start,
+                      args.interval, args.station_device, args.workers)
+    print(f"📥 {report['written']} rows written ({report['duplicates']} already stored, "
+          f"{report['rejected']} rejected) in {report['seconds']}s "
+          f"- {report['rows_per_second']} rows/s")
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
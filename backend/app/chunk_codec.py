@@ -0,0 +1,363 @@
+"""
+Columnar chunk encoding for archived readings
+
+A chunk holds one device's rows for a time range, column by column.
+Each column records which rows are non-null (a bitmap, omitted when all
+are) and encodes only the present values with one of:
+
+  NULL          every row is null; no data
+  RAW_F64       little-endian doubles
+  GORILLA       XOR of consecutive doubles with reused leading/trailing
+                zero windows (Facebook Gorilla); slowly moving sensor
+                values shrink to a few bits each
+  DELTA_VARINT  zigzag LEB128 of differences; small integer columns
+  DOD_VARINT    zigzag LEB128 of delta-of-deltas; regular timestamps
+                become one byte (usually 0) per row
+  RAW_I64       little-endian int64
+  SCALED_VARINT decimal places (one byte), then DELTA_VARINT of the
+                values times 10^places; floats that were rounded at
+                ingest, exactly
+
+The encoded columns are then compressed as a whole with zstd (level 19)
+when the zstandard module is available, else zlib level 9; the
+compressor is recorded per chunk so either kind can be read back.
+Writers use default_codec(); choose_codecs() tries every codec that fits
+a column and keeps the one that compresses smallest (the compactor).
+"""
+import zlib
+import struct
+from typing import Dict, List, Optional, Sequence, Tuple
+
+try:
+    import zstandard
+except ImportError:     # zlib is always there
+    zstandard = None
+
+MAGIC = b"AGC1"
+
+NULL, RAW_F64, GORILLA, DELTA_VARINT, DOD_VARINT, RAW_I64, SCALED_VARINT = range(7)
+CODEC_NAMES = ("null", "raw_f64", "gorilla", "delta_varint", "dod_varint", "raw_i64", "scaled_varint")
+CANDIDATES = {
+    "float": (GORILLA, SCALED_VARINT, RAW_F64),
+    "int": (DOD_VARINT, DELTA_VARINT, RAW_I64),
+}
+MAX_SCALE = 6
+
+COMPRESS_NONE, COMPRESS_ZLIB, COMPRESS_ZSTD = range(3)
+
+Column = Tuple[str, str, List]      # name, "int" | "float", values (None = null)
+
+
+# ---- bit and varint primitives ----
+
+class BitWriter:
+    __slots__ = ("buf", "acc", "nbits")
+
+    def __init__(self):
+        self.buf = bytearray()
+        self.acc = 0
+        self.nbits = 0
+
+    def write(self, value: int, n: int):
+        self.acc = (self.acc << n) | value
+        self.nbits += n
+        while self.nbits >= 8:
+            self.nbits -= 8
+            self.buf.append((self.acc >> self.nbits) & 0xFF)
+        self.acc &= (1 << self.nbits) - 1
+
+    def finish(self) -> bytes:
+        if self.nbits:
+            self.buf.append((self.acc << (8 - self.nbits)) & 0xFF)
+            self.acc = self.nbits = 0
+        return bytes(self.buf)
+
+
+class BitReader:
+    __slots__ = ("data", "pos", "acc", "nbits")
+
+    def __init__(self, data: bytes):
+        self.data = data
+        self.pos = 0
+        self.acc = 0
+        self.nbits = 0
+
+    def read(self, n: int) -> int:
+        while self.nbits < n:
+            self.acc = (self.acc << 8) | self.data[self.pos]
+            self.pos += 1
+            self.nbits += 8
+        self.nbits -= n
+        value = self.acc >> self.nbits
+        self.acc &= (1 << self.nbits) - 1
+        return value
+
+
+def _put_varints(values, out: bytearray):
+    for v in values:
+        z = v << 1 if v >= 0 else ((-v) << 1) - 1
+        while z >= 0x80:
+            out.append((z & 0x7F) | 0x80)
+            z >>= 7
+        out.append(z)
+
+
+def _get_varints(data: bytes, count: int) -> List[int]:
+    values = []
+    pos = 0
+    for _ in range(count):
+        z = shift = 0
+        while True:
+            byte = data[pos]
+            pos += 1
+            z |= (byte & 0x7F) << shift
+            if byte < 0x80:
+                break
+            shift += 7
+        values.append(z >> 1 if not z & 1 else -((z + 1) >> 1))
+    return values
+
+
+# ---- value codecs ----
+
+def _gorilla_encode(values: Sequence[float]) -> bytes:
+    bits = struct.unpack(f"<{len(values)}Q", struct.pack(f"<{len(values)}d", *values))
+    w = BitWriter()
+    prev = bits[0]
+    w.write(prev, 64)
+    window_lead = window_trail = -1
+    for b in bits[1:]:
+        x = b ^ prev
+        prev = b
+        if x == 0:
+            w.write(0, 1)
+            continue
+        lead = min(64 - x.bit_length(), 31)
+        trail = (x & -x).bit_length() - 1
+        if window_lead >= 0 and lead >= window_lead and trail >= window_trail:
+            w.write(0b10, 2)
+            w.write(x >> window_trail, 64 - window_lead - window_trail)
+        else:
+            significant = 64 - lead - trail
+            w.write(0b11, 2)
+            w.write(lead, 5)
+            w.write(significant - 1, 6)
+            w.write(x >> trail, significant)
+            window_lead, window_trail = lead, trail
+    return w.finish()
+
+
+def _gorilla_decode(data: bytes, count: int) -> List[float]:
+    r = BitReader(data)
+    prev = r.read(64)
+    bits = [prev]
+    window_lead = window_trail = 0
+    for _ in range(count - 1):
+        if r.read(1):
+            if r.read(1):
+                window_lead = r.read(5)
+                significant = r.read(6) + 1
+                window_trail = 64 - window_lead - significant
+            prev ^= r.read(64 - window_lead - window_trail) << window_trail
+        bits.append(prev)
+    return list(struct.unpack(f"<{count}d", struct.pack(f"<{count}Q", *bits)))
+
+
+def _scale(values: Sequence[float]) -> Optional[int]:
+    """Fewest decimal places that hold every value exactly, if at most MAX_SCALE"""
+    for places in range(MAX_SCALE + 1):
+        factor = 10 ** places
+        if all(abs(v) < 2 ** 53 / factor and round(v * factor) / factor == v for v in values):
+            return places
+    return None
+
+
+def encode_values(codec: int, values: Sequence) -> bytes:
+    if codec == NULL or not values:
+        return b""
+    if codec == RAW_F64:
+        return struct.pack(f"<{len(values)}d", *values)
+    if codec == RAW_I64:
+        return struct.pack(f"<{len(values)}q", *values)
+    if codec == GORILLA:
+        return _gorilla_encode(values)
+    out = bytearray()
+    if codec == SCALED_VARINT:
+        places = _scale(values)
+        if places is None:
+            raise ValueError("values are not short decimals")
+        scaled = [round(v * 10 ** places) for v in values]
+        out.append(places)
+        _put_varints((v - p for v, p in zip(scaled, [0, *scaled[:-1]])), out)
+    elif codec == DELTA_VARINT:
+        _put_varints((v - p for v, p in zip(values, [0, *values[:-1]])), out)
+    elif codec == DOD_VARINT:
+        deltas = [v - p for v, p in zip(values, [0, *values[:-1]])]
+        _put_varints((d - p for d, p in zip(deltas, [0, *deltas[:-1]])), out)
+    else:
+        raise ValueError(f"unknown codec {codec}")
+    return bytes(out)
+
+
+def decode_values(codec: int, data: bytes, count: int) -> List:
+    if codec == NULL or count == 0:
+        return []
+    if codec == RAW_F64:
+        return list(struct.unpack(f"<{count}d", data))
+    if codec == RAW_I64:
+        return list(struct.unpack(f"<{count}q", data))
+    if codec == GORILLA:
+        return _gorilla_decode(data, count)
+    if codec == SCALED_VARINT:
+        factor = 10 ** data[0]
+        total = 0
+        values = []
+        for d in _get_varints(data[1:], count):
+            total += d
+            values.append(total / factor)
+        return values
+    diffs = _get_varints(data, count)
+    if codec == DOD_VARINT:
+        total = 0
+        deltas = []
+        for d in diffs:
+            total += d
+            deltas.append(total)
+        diffs = deltas
+    elif codec != DELTA_VARINT:
+        raise ValueError(f"unknown codec {codec}")
+    values = []
+    total = 0
+    for d in diffs:
+        total += d
+        values.append(total)
+    return values
+
+
+def default_codec(kind: str, name: str) -> int:
+    if kind == "float":
+        return GORILLA
+    return DOD_VARINT if name == "timestamp" else DELTA_VARINT
+
+
+def _present(kind: str, values: Sequence) -> List:
+    if kind == "float":
+        return [float(v) for v in values if v is not None]
+    return [int(v) for v in values if v is not None]
+
+
+def _compress(body: bytes, level: Optional[int] = None) -> Tuple[int, bytes]:
+    if zstandard is not None:
+        return COMPRESS_ZSTD, zstandard.ZstdCompressor(level=level or 19).compress(body)
+    return COMPRESS_ZLIB, zlib.compress(body, level or 9)
+
+
+def choose_codecs(columns: Sequence[Column]) -> Dict[str, int]:
+    """Per column, the candidate codec whose output compresses smallest"""
+    chosen = {}
+    for name, kind, values in columns:
+        present = _present(kind, values)
+        if not present:
+            continue
+        best = None
+        for codec in CANDIDATES[kind]:
+            if codec == SCALED_VARINT and _scale(present) is None:
+                continue
+            size = len(_compress(encode_values(codec, present), level=3)[1])
+            if best is None or size < best[0]:
+                best = (size, codec)
+        chosen[name] = best[1]
+    return chosen
+
+
+# ---- chunks ----
+
+def _bitmap(values: Sequence) -> bytes:
+    if all(v is not None for v in values):
+        return b""
+    bitmap = bytearray((len(values) + 7) // 8)
+    for i, v in enumerate(values):
+        if v is not None:
+            bitmap[i >> 3] |= 1 << (i & 7)
+    return bytes(bitmap)
+
+
+def encode_chunk(columns: Sequence[Column], codecs: Optional[Dict[str, int]] = None,
+                 compress: bool = True) -> bytes:
+    """Encode equal-length columns; codecs overrides the default per column"""
+    rows = len(columns[0][2]) if columns else 0
+    body = bytearray(struct.pack("<IH", rows, len(columns)))
+    for name, kind, values in columns:
+        present = _present(kind, values)
+        codec = NULL if not present else (codecs or {}).get(name, default_codec(kind, name))
+        bitmap = _bitmap(values) if present else b""
+        data = encode_values(codec, present)
+        encoded_name = name.encode()
+        body += struct.pack("<B", len(encoded_name)) + encoded_name
+        body += struct.pack("<BBII", codec, kind == "float", len(bitmap), len(data))
+        body += bitmap + data
+    if not compress:
+        return MAGIC + struct.pack("<BI", COMPRESS_NONE, len(body)) + bytes(body)
+    method, packed = _compress(bytes(body))
+    return MAGIC + struct.pack("<BI", method, len(body)) + packed
+
+
+def _body(blob: bytes) -> bytes:
+    if blob[:4] != MAGIC:
+        raise ValueError("not an archive chunk")
+    method, size = struct.unpack_from("<BI", blob, 4)
+    packed = blob[9:]
+    if method == COMPRESS_NONE:
+        return packed
+    if method == COMPRESS_ZLIB:
+        return zlib.decompress(packed)
+    if method == COMPRESS_ZSTD:
+        if zstandard is None:
+            raise RuntimeError("chunk is zstd-compressed and zstandard is not installed")
+        return zstandard.ZstdDecompressor().decompress(packed, max_output_size=size)
+    raise ValueError(f"unknown compression {method}")
+
+
+def decode_chunk(blob: bytes) -> Tuple[int, Dict[str, List]]:
+    """(rows, {column: values with None for nulls})"""
+    return _decode_body(_body(blob))
+
+
+def chunk_codecs(blob: bytes) -> Dict[str, Tuple[int, int]]:
+    """{column: (codec, encoded bytes)} without decoding values"""
+    body = _body(blob)
+    out = {}
+    for name, codec, _, bitmap, data in _walk(body):
+        out[name] = (codec, len(bitmap) + len(data))
+    return out
+
+
+def _walk(body: bytes):
+    rows, ncols = struct.unpack_from("<IH", body, 0)
+    pos = 6
+    for _ in range(ncols):
+        name_len = body[pos]
+        name = body[pos + 1:pos + 1 + name_len].decode()
+        pos += 1 + name_len
+        codec, is_float, bitmap_len, data_len = struct.unpack_from("<BBII", body, pos)
+        pos += 10
+        bitmap = body[pos:pos + bitmap_len]
+        data = body[pos + bitmap_len:pos + bitmap_len + data_len]
+        pos += bitmap_len + data_len
+        yield name, codec, rows, bitmap, data
+
+
+def _decode_body(body: bytes) -> Tuple[int, Dict[str, List]]:
+    rows = struct.unpack_from("<I", body, 0)[0]
+    columns = {}
+    for name, codec, rows, bitmap, data in _walk(body):
+        if codec == NULL:
+            columns[name] = [None] * rows
+            continue
+        if not bitmap:
+            columns[name] = decode_values(codec, data, rows)
+            continue
+        mask = [bool(bitmap[i >> 3] & (1 << (i & 7))) for i in range(rows)]
+        present = iter(decode_values(codec, data, sum(mask)))
+        columns[name] = [next(present) if m else None for m in mask]
+    return rows, columns
@@ -0,0 +1,174 @@
+"""
+Clock-skew estimation and timestamp correction at ingest
+
+Nodes without NTP stamp readings with seconds since boot. For each boot of
+a device, the server's receive time r and the device time d satisfy
+
+    r = boot_epoch + (1 + drift) * d + delay,    delay >= 0
+
+so the offset r - d lies on or above the line boot_epoch + drift * d.
+Backlog uploads only add delay, never remove it. The estimator keeps the
+smallest offset seen in each BUCKET_S of device time (at most
+MAX_BUCKETS) and fits the line under the lower convex hull of those
+minima that minimises total delay (the linear-programming skew estimator
+used for network clocks). The optimum lies on a hull edge, and each edge
+is scored in O(1) from running sums, so a batch costs O(batch + buckets).
+
+Boots are told apart by the "boot_id" nonce the firmware sends. Without
+one, a backwards jump in device time or sequence number starts a new
+boot. Readings already stamped with Unix time (relay.py, NTP nodes) pass
+through unchanged.
+"""
+import logging
+from collections import OrderedDict
+from typing import Dict, List, Optional, Tuple
+
+logger = logging.getLogger(__name__)
+
+UNIX_TIME_MIN = 1_000_000_000   # Smaller device timestamps are uptime
+BUCKET_S = 600
+MAX_BUCKETS = 144               # One day of uptime at 10 minute buckets
+MAX_DRIFT = 500e-6              # Crystal drift beyond this is not believed
+REBOOT_SLACK_S = 60
+BOOTS_KEPT = 3                  # Late backlog from earlier boots still maps
+
+Sample = Tuple[int, Optional[int], Optional[int]]   # device_ts, seq, boot_id
+
+
+class BootClock:
+    """Offset line of one device boot"""
+
+    __slots__ = ("minima", "epoch", "drift", "last_device_ts", "last_seq")
+
+    def __init__(self):
+        self.minima: "OrderedDict[int, Tuple[float, float]]" = OrderedDict()
+        self.epoch = 0.0
+        self.drift = 0.0
+        self.last_device_ts = -1
+        self.last_seq = -1
+
+    def observe(self, device_ts: float, receive_time: float):
+        offset = receive_time - device_ts
+        bucket = int(device_ts // BUCKET_S)
+        current = self.minima.get(bucket)
+        if current is None:
+            self.minima[bucket] = (device_ts, offset)
+            if len(self.minima) > MAX_BUCKETS:
+                self.minima.pop(min(self.minima))
+        elif offset < current[1]:
+            self.minima[bucket] = (device_ts, offset)
+
+    def fit(self):
+        points = sorted(self.minima.values())
+        # Lower convex hull, left to right
+        hull: List[Tuple[float, float]] = []
+        for p in points:
+            while len(hull) >= 2:
+                (x1, y1), (x2, y2) = hull[-2], hull[-1]
+                if (x2 - x1) * (p[1] - y1) - (y2 - y1) * (p[0] - x1) <= 0:
+                    hull.pop()
+                else:
+                    break
+            hull.append(p)
+
+        # Minimise sum(offset_i - (epoch + drift * d_i)) over lines through hull edges
+        n = len(points)
+        sum_d = sum(p[0] for p in points)
+        sum_off = sum(p[1] for p in points)
+        best = None
+        for (x1, y1), (x2, y2) in zip(hull, hull[1:]):
+            if x2 == x1:
+                continue
+            drift = (y2 - y1) / (x2 - x1)
+            if abs(drift) > MAX_DRIFT:
+                continue
+            epoch = y1 - drift * x1
+            cost = sum_off - n * epoch - drift * sum_d
+            if best is None or cost < best[0]:
+                best = (cost, epoch, drift)
+        if best is None:
+            self.epoch = min(p[1] for p in points)
+            self.drift = 0.0
+        else:
+            self.epoch, self.drift = best[1], best[2]
+
+    def correct(self, device_ts: float) -> int:
+        return int(round(device_ts + self.epoch + self.drift * device_ts))
+
+
+class DeviceClock:
+    __slots__ = ("boots", "current", "anonymous_boots")
+
+    def __init__(self):
+        self.boots: "OrderedDict[object, BootClock]" = OrderedDict()
+        self.current = None
+        self.anonymous_boots = 0
+
+    def boot_for(self, device_ts: int, seq: Optional[int], boot_id: Optional[int]) -> BootClock:
+        if boot_id is not None:
+            key = ("id", boot_id)
+        else:
+            key = self.current
+            clock = self.boots.get(key)
+            if clock is None or device_ts < clock.last_device_ts - REBOOT_SLACK_S \
+                    or (seq is not None and 0 <= seq < clock.last_seq and device_ts < clock.last_device_ts):
+                self.anonymous_boots += 1
+                key = ("anon", self.anonymous_boots)
+
+        clock = self.boots.get(key)
+        if clock is None:
+            clock = self.boots[key] = BootClock()
+            if len(self.boots) > BOOTS_KEPT:
+                self.boots.popitem(last=False)
+        # Readings of the newest boot move "current"; late ones from older boots do not
+        if boot_id is None or device_ts >= clock.last_device_ts:
+            self.current = key
+        clock.last_device_ts = max(clock.last_device_ts, device_ts)
+        if seq is not None:
+            clock.last_seq = max(clock.last_seq, seq)
+        return clock
+
+
+class ClockSync:
+    """Per device boot clocks, corrected a batch at a time"""
+
+    def __init__(self):
+        self.devices: Dict[str, DeviceClock] = {}
+
+    def correct(self, device_id: str, samples: List[Sample], receive_time: float) -> List[int]:
+        """Corrected Unix timestamps for a batch of one device, in order"""
+        device = None
+        touched: Dict[int, BootClock] = {}
+        assigned: List[Optional[BootClock]] = []
+        for device_ts, seq, boot_id in samples:
+            if device_ts >= UNIX_TIME_MIN:
+                assigned.append(None)
+                continue
+            if device is None:
+                device = self.devices.get(device_id)
+                if device is None:
+                    device = self.devices[device_id] = DeviceClock()
+            clock = device.boot_for(device_ts, seq, boot_id)
+            clock.observe(device_ts, receive_time)
+            touched[id(clock)] = clock
+            assigned.append(clock)
+
+        for clock in touched.values():
+            clock.fit()
+        return [int(device_ts) if clock is None else clock.correct(device_ts)
+                for (device_ts, _, _), clock in zip(samples, assigned)]
+
+    def status(self, device_id: str) -> Optional[Dict]:
+        device = self.devices.get(device_id)
+        if device is None or device.current not in device.boots:
+            return None
+        clock = device.boots[device.current]
+        return {
+            "device_id": device_id,
+            "boot": str(device.current[1]),
+            "boot_epoch": round(clock.epoch, 3),
+            "drift_ppm": round(clock.drift * 1e6, 2),
+            "uptime_s": clock.last_device_ts,
+            "buckets": len(clock.minima),
+            "boots_tracked": len(device.boots),
+        }
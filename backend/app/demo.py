@@ -0,0 +1,115 @@
+"""
+Demo-mode readings, generated in memory
+
+Until a real device reports, the dashboard shows DEMO_DEVICE. Its
+readings are a pure function of time: the start-up ramp (blank for
+10 s, then a 30 s ramp to realistic values), then the daily cycles of
+app/sensors.py with sensor noise drawn from a generator seeded by the
+reading's 5 s step. The same instant always gives the same reading, so
+current values and history agree, and nothing is ever written to the
+store.
+
+DEMO_MODE selects the behaviour per deployment:
+  memory  (default) generated readings when there is no real data
+  off     no demo data; endpoints return empty results
+"""
+import os
+import math
+import random
+import time
+from typing import Dict, List, Optional
+
+DEMO_DEVICE = "DEMO_DEVICE"
+DEMO_MODE = os.getenv("DEMO_MODE", "memory")
+DEMO_SEED = int(os.getenv("DEMO_SEED", "0"))
+STEP_S = 5                  # Pico reporting interval
+BLANK_S = 10
+RAMP_S = 30
+
+# Stable values for agricultural soil, as the demo has always shown
+BASE = {
+    "soil_moisture": 35.5,
+    "soil_temperature": 26.0,
+    "humidity": 65.0,
+    "light_intensity": 70.0,
+    "soil_ph": 6.8,
+    "nitrogen": 128,
+    "phosphorus": 52,
+    "potassium": 180,
+}
+INTEGER_FIELDS = ("nitrogen", "phosphorus", "potassium")
+
+
+class DemoGenerator:
+    """Deterministic demo readings for any instant after start-up"""
+
+    def __init__(self, started: float, seed: int = DEMO_SEED):
+        self.started = started
+        self.seed = seed
+
+    @property
+    def enabled(self) -> bool:
+        return DEMO_MODE != "off"
+
+    def phase(self, t: float) -> str:
+        elapsed = t - self.started
+        if elapsed < BLANK_S:
+            return "initializing"
+        if elapsed < BLANK_S + RAMP_S:
+            return "transitioning"
+        return "initialized"
+
+    def _stable(self, step: int) -> Dict:
+        rng = random.Random((self.seed << 40) ^ step)
+        local = time.localtime(step * STEP_S)
+        day_progress = (local.tm_hour + local.tm_min / 60.0) / 24.0
+
+        # Daily cycles: warm afternoons, drier air and soil by day, light follows the sun
+        temp_variation = math.sin((day_progress - 0.25) * 2 * math.pi) * 5
+        daylight = max(0.0, math.sin((day_progress - 0.25) * 2 * math.pi))
+        return {
+            "soil_moisture": max(0, min(100, BASE["soil_moisture"] - abs(math.sin(day_progress * math.pi)) * 3
+                                        + rng.uniform(-2.5, 2.5))),
+            "soil_temperature": max(15, min(40, BASE["soil_temperature"] + temp_variation * 0.3
+                                           + rng.uniform(-0.8, 0.8))),
+            "humidity": max(0, min(100, BASE["humidity"] - temp_variation * 0.8 + rng.uniform(-3, 3))),
+            "light_intensity": max(0, min(100, BASE["light_intensity"] * (0.2 + 0.8 * daylight)
+                                          + rng.uniform(-5, 5))),
+            "soil_ph": max(3, min(9, BASE["soil_ph"] + rng.uniform(-0.3, 0.3))),
+            "nitrogen": max(0, int(BASE["nitrogen"] + rng.uniform(-15, 15))),
+            "phosphorus": max(0, int(BASE["phosphorus"] + rng.uniform(-8, 8))),
+            "potassium": max(0, int(BASE["potassium"] + rng.uniform(-20, 20))),
+        }
+
+    def reading(self, t: Optional[float] = None) -> Dict:
+        """Values at t (default now), with its timestamp and phase"""
+        if t is None:
+            t = time.time()
+        step = int(t // STEP_S)
+        phase = self.phase(t)
+        if phase == "initializing":
+            values = {name: 0 if name in INTEGER_FIELDS else 0.0 for name in BASE}
+        elif phase == "transitioning":
+            progress = (t - self.started - BLANK_S) / RAMP_S
+            values = {name: int(BASE[name] * progress) if name in INTEGER_FIELDS
+                      else BASE[name] * progress for name in BASE}
+        else:
+            values = self._stable(step)
+        for name in BASE:
+            if name not in INTEGER_FIELDS:
+                values[name] = round(values[name], 2)
+        values["timestamp"] = step * STEP_S
+        values["phase"] = phase
+        return values
+
+    def history(self, limit: int, now: Optional[float] = None) -> List[Dict]:
+        """The latest readings, newest first, back to the end of the blank phase"""
+        if now is None:
+            now = time.time()
+        first = math.ceil((self.started + BLANK_S) / STEP_S)
+        step = int(now // STEP_S)
+        readings = []
+        while step >= first and len(readings) < limit:
+            readings.append(self.reading(step * STEP_S))
+            step -= 1
+        return readings
@@ -0,0 +1,224 @@
+"""
+Streaming export of sensor history as CSV or Parquet
+
+Rows come in (device_id, timestamp) order: through the tiered store one
+device at a time (so archived days are exported too), or without one as
+a single scan of sensor_data that idx_sensor_data_device_ts serves
+without a sort.
+Each chunk is encoded and handed on before the next one is fetched, so
+memory stays at one chunk whatever the range:
+- CSV: one csv.writer pass per chunk into a reused buffer
+- Parquet: each chunk is transposed into column arrays and written as
+  one row group (snappy pages); the footer follows the last one
+
+Parquet needs pyarrow. The CLI writes the same streams to a file:
+
+    python -m app.export --db agriculture_monitor.db --device pico_1 \
+        --metric soil_moisture --metric humidity --start 1714521600 \
+        --end 1730419200 --format parquet -o season.parquet
+"""
+import io
+import csv
+import time
+import asyncio
+import argparse
+import logging
+import sys
+from typing import AsyncIterator, List, Optional, Sequence
+
+import aiosqlite
+
+from app.telemetry_schema import COLUMNS
+from app.tiered_store import TieredStore
+from app.timeseries import iter_chunks
+
+logger = logging.getLogger(__name__)
+
+EXPORT_FORMATS = ("csv", "parquet")
+METRIC_TYPES = {name: sql_type for name, sql_type, _ in COLUMNS}
+CSV_CHUNK_ROWS = 4096
+PARQUET_ROW_GROUP = 65536
+MAX_EXPORT_DEVICES = 500
+
+MEDIA_TYPES = {
+    "csv": "text/csv",
+    "parquet": "application/vnd.apache.parquet",
+}
+
+
+class ExportError(ValueError):
+    """Export request the store cannot serve"""
+
+
+def export_query(device_ids: Sequence[str], metrics: Sequence[str], start: int, end: int,
+                 include_demo: bool = False):
+    """SQL, parameters and output columns of an export selection"""
+    if not device_ids or len(device_ids) > MAX_EXPORT_DEVICES:
+        raise ExportError(f"select 1 to {MAX_EXPORT_DEVICES} devices")
+    unknown = [m for m in metrics if m not in METRIC_TYPES]
+    if unknown or not metrics:
+        raise ExportError(f"metrics must be from {sorted(METRIC_TYPES)}")
+    if end <= start:
+        raise ExportError("end must be after start")
+
+    columns = ["device_id", "timestamp", *metrics]
+    sql = (
+        f"SELECT {', '.join(columns)} FROM sensor_data "
+        f"WHERE device_id IN ({', '.join('?' * len(device_ids))}) "
+        "AND timestamp >= ? AND timestamp < ?"
+        + ("" if include_demo else " AND is_dummy = 0")
+        + " ORDER BY device_id, timestamp"
+    )
+    return sql, (*device_ids, start, end), columns
+
+
+async def csv_stream(chunks: AsyncIterator[List], columns: Sequence[str]) -> AsyncIterator[bytes]:
+    buffer = io.StringIO()
+    writer = csv.writer(buffer, lineterminator="\n")
+    writer.writerow(columns)
+    async for chunk in chunks:
+        writer.writerows(chunk)
+        yield buffer.getvalue().encode()
+        buffer.seek(0)
+        buffer.truncate()
+    if buffer.tell():
+        yield buffer.getvalue().encode()
+
+
+class _Sink:
+    """Write-only file object whose bytes are taken after every row group"""
+
+    def __init__(self):
+        self.parts: List[bytes] = []
+        self.closed = False
+
+    def write(self, data) -> int:
+        data = bytes(data)
+        self.parts.append(data)
+        return len(data)
+
+    def flush(self):
+        pass
+
+    def close(self):
+        self.closed = True
+
+    def take(self) -> bytes:
+        data, self.parts = b"".join(self.parts), []
+        return data
+
+
+def parquet_available() -> bool:
+    try:
+        import pyarrow.parquet  # noqa: F401
+    except ImportError:
+        return False
+    return True
+
+
+async def parquet_stream(chunks: AsyncIterator[List], columns: Sequence[str]) -> AsyncIterator[bytes]:
+    import pyarrow as pa
+    import pyarrow.parquet as pq
+
+    types = {"REAL": pa.float64(), "INTEGER": pa.int64()}
+    schema = pa.schema(
+        [("device_id", pa.string()), ("timestamp", pa.int64())]
+        + [(name, types[METRIC_TYPES[name]]) for name in columns[2:]]
+    )
+    sink = _Sink()
+    writer = pq.ParquetWriter(sink, schema, compression="snappy")
+    try:
+        async for chunk in chunks:
+            arrays = [pa.array(values, type=field.type)
+                      for values, field in zip(zip(*chunk), schema)]
+            writer.write_table(pa.Table.from_arrays(arrays, schema=schema))
+            yield sink.take()
+    finally:
+        writer.close()
+    yield sink.take()
+
+
+async def tiered_chunks(store: TieredStore, db, device_ids: Sequence[str], columns: Sequence[str],
+                        start: int, end: int, include_demo: bool, size: int) -> AsyncIterator[List]:
+    """The export selection through the tiered store, so archived days are included"""
+    for device_id in sorted(set(device_ids)):
+        async for chunk in store.iter_chunks(db, device_id, start, end, (*columns, "is_dummy"), size):
+            rows = [row[:-1] for row in chunk if include_demo or not row[-1]]
+            if rows:
+                yield rows
+
+
+async def export_stream(db_path: str, device_ids: Sequence[str], metrics: Sequence[str],
+                        start: int, end: int, fmt: str = "csv", include_demo: bool = False,
+                        store: Optional[TieredStore] = None) -> AsyncIterator[bytes]:
+    """Encoded export, produced as the rows are read; owns its connection"""
+    sql, params, columns = export_query(device_ids, metrics, start, end, include_demo)
+    if fmt == "csv":
+        encode, size = csv_stream, CSV_CHUNK_ROWS
+    elif fmt == "parquet":
+        encode, size = parquet_stream, PARQUET_ROW_GROUP
+    else:
+        raise ExportError(f"format must be one of {EXPORT_FORMATS}")
+
+    started = time.perf_counter()
+    written = 0
+    async with aiosqlite.connect(db_path) as db:
+        if store is not None:
+            chunks = tiered_chunks(store, db, device_ids, columns, start, end, include_demo, size)
+        else:
+            chunks = iter_chunks(db, sql, params, size)
+        async for data in encode(chunks, columns):
+            if data:
+                written += len(data)
+                yield data
+    elapsed = time.perf_counter() - started
+    logger.info(f"📤 Export {fmt}: {len(device_ids)} devices, {written / 1e6:.1f} MB "
+                f"in {elapsed:.1f}s")
+
+
+async def _export_to(out, args) -> int:
+    store = TieredStore(args.db)
+    async with aiosqlite.connect(args.db) as db:
+        await store.open_catalog(db)
+        await db.commit()
+    written = 0
+    async for data in export_stream(args.db, args.device, args.metric, args.start, args.end,
+                                    args.format, args.include_demo, store):
+        out.write(data)
+        written += len(data)
+    return written
+
+
+def main(argv: Optional[List[str]] = None) -> int:
+    parser = argparse.ArgumentParser(description="Export sensor history as CSV or Parquet")
+    parser.add_argument("--db", default="agriculture_monitor.db")
+    parser.add_argument("--device", action="append", required=True, help="Repeat for several devices")
+    parser.add_argument("--metric", action="append", help="Repeat for several metrics (default: all)")
+    parser.add_argument("--start", type=int, default=0)
+    parser.add_argument("--end", type=int, default=2 ** 62)
+    parser.add_argument("--format", choices=EXPORT_FORMATS, default="csv")
+    parser.add_argument("--include-demo", action="store_true")
+    parser.add_argument("-o", "--output", help="File to write (default: stdout)")
+    args = parser.parse_args(argv)
+    args.metric = args.metric or list(METRIC_TYPES)
+
+    if args.format == "parquet" and not parquet_available():
+        print("parquet export needs pyarrow", file=sys.stderr)
+        return 1
+    started = time.perf_counter()
+    try:
+        if args.output:
+            with open(args.output, "wb") as out:
+                written = asyncio.run(_export_to(out, args))
+        else:
+            written = asyncio.run(_export_to(sys.stdout.buffer, args))
+    except ExportError as e:
+        print(str(e), file=sys.stderr)
+        return 1
+    elapsed = time.perf_counter() - started
+    print(f"{written / 1e6:.1f} MB in {elapsed:.1f}s", file=sys.stderr)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,246 @@
+"""
+Keyset-paginated history over many devices
+
+Pages are addressed by the key of their last row, never by offset. Each
+device is read as its own range scan of idx_sensor_data_device_ts
+starting just past that key; SQLite keeps the rowid in every index
+entry, so (device_id, timestamp, id) is already the index order and the
+seek costs O(log n) however deep the page is. The table rows of a page
+are then fetched by rowid, O(page size).
+
+Merged pages interleave the device scans with a heap, pulling each scan
+a small chunk at a time, so a 20 device page reads about the page size
+plus one chunk per device instead of 20 pages.
+
+Days the archiver moved to the cold tier keep their row ids, so with the
+tiered store passed in, a device's archived rows are merged into its
+scan under the same (timestamp, id) key and pages run past the warm
+boundary. Rows archived by older releases have no id; they sort as id 0
+and are returned with id null.
+
+Cursors are opaque URL-safe strings:
+  merged:     [timestamp, device_id, id] of the last row returned
+  per_device: {device_id: [timestamp, id]} for devices with more rows
+"""
+import json
+import heapq
+import base64
+from typing import AsyncIterator, Dict, List, Optional, Sequence, Tuple
+
+from app.timeseries import iter_chunks
+from app.tiered_store import ROW_COLUMNS
+
+MAX_PAGE = 5000
+MAX_DEVICES = 100
+MIN_CHUNK = 16
+ID_MAX = 2 ** 63 - 1
+TS_MAX = 2 ** 62
+
+
+class CursorError(ValueError):
+    """Cursor that was not produced by this API"""
+
+
+def encode_cursor(key) -> str:
+    return base64.urlsafe_b64encode(json.dumps(key, separators=(",", ":")).encode()).decode().rstrip("=")
+
+
+def decode_cursor(cursor: str):
+    try:
+        return json.loads(base64.urlsafe_b64decode(cursor + "=" * (-len(cursor) % 4)))
+    except (ValueError, TypeError):
+        raise CursorError("invalid cursor") from None
+
+
+def _key(row) -> Tuple[int, int]:
+    """(timestamp, id) of a scanned row; archived rows without an id sort as 0"""
+    return row[2], row[0] if row[0] is not None else 0
+
+
+def warm_scan(db, device_id: str, metrics: Sequence[str], descending: bool,
+              after: Optional[Tuple[int, int]], size: int) -> AsyncIterator[List]:
+    """Chunks of one device's sensor_data rows in (timestamp, id) order, after a key"""
+    columns = ", ".join(("id", "device_id", "timestamp", *metrics))
+    order = "DESC" if descending else "ASC"
+    if after is None:
+        sql = f"SELECT {columns} FROM sensor_data WHERE device_id = ? ORDER BY timestamp {order}, id {order}"
+        params: tuple = (device_id,)
+    else:
+        # Range on the index for timestamp, then the tie-break on id
+        op, strict = ("<", "<=") if descending else (">", ">=")
+        sql = (
+            f"SELECT {columns} FROM sensor_data WHERE device_id = ? AND timestamp {strict} ? "
+            f"AND (timestamp {op} ? OR id {op} ?) ORDER BY timestamp {order}, id {order}"
+        )
+        params = (device_id, after[0], after[0], after[1])
+    return iter_chunks(db, sql, params, size)
+
+
+async def cold_scan(store, db, device_id: str, metrics: Sequence[str], descending: bool,
+                    after: Optional[Tuple[int, int]]) -> AsyncIterator[tuple]:
+    """One device's archived rows in (timestamp, id) order, after a key"""
+    start, end = 0, TS_MAX
+    if after is not None:
+        if descending:
+            end = after[0] + 1
+        else:
+            start = after[0]
+    picks = [ROW_COLUMNS.index(name) for name in ("id", "device_id", "timestamp", *metrics)]
+    days = store.cold_days(db, device_id, start, end, descending)
+    try:
+        async for day in days:
+            rows = sorted((tuple(row[i] for i in picks) for row in day), key=_key, reverse=descending)
+            for row in rows:
+                if after is None or (_key(row) < after if descending else _key(row) > after):
+                    yield row
+    finally:
+        await days.aclose()
+
+
+async def scan_device(db, device_id: str, metrics: Sequence[str], descending: bool,
+                      after: Optional[Tuple[int, int]], size: int, store=None) -> AsyncIterator[List]:
+    """Chunks of one device's rows in (timestamp, id) order, after a key, warm and cold"""
+    warm = warm_scan(db, device_id, metrics, descending, after, size)
+    archived = False
+    if store is not None:
+        cursor = await db.execute("SELECT 1 FROM archive_chunks WHERE device_id = ? LIMIT 1", (device_id,))
+        archived = await cursor.fetchone() is not None
+    try:
+        if not archived:
+            async for chunk in warm:
+                yield chunk
+            return
+
+        cold = cold_scan(store, db, device_id, metrics, descending, after)
+        try:
+            # The tiers hold disjoint rows: merge them row by row
+            a = await _next_row(cold)
+            b, chunk, index = None, await _next_chunk(warm), 0
+            if chunk:
+                b = chunk[0]
+            out: List = []
+            while a is not None or b is not None:
+                if b is None or (a is not None and (_key(a) > _key(b) if descending else _key(a) < _key(b))):
+                    out.append(a)
+                    a = await _next_row(cold)
+                else:
+                    out.append(b)
+                    index += 1
+                    if index == len(chunk):
+                        chunk, index = await _next_chunk(warm), 0
+                    b = chunk[index] if chunk else None
+                if len(out) == size:
+                    yield out
+                    out = []
+            if out:
+                yield out
+        finally:
+            await cold.aclose()
+    finally:
+        await warm.aclose()
+
+
+def _resume_key(device_id: str, cursor_key, descending: bool) -> Tuple[int, int]:
+    """Where a device's scan resumes after the merged cursor [ts, device, id]"""
+    ts, last_device, last_id = cursor_key
+    if device_id == last_device:
+        return ts, last_id
+    # At the cursor timestamp, devices before the cursor's are done, later ones untouched
+    passed = device_id < last_device
+    if descending:
+        return ts, -1 if passed else ID_MAX
+    return ts, ID_MAX if passed else -1
+
+
+def _row(row, metrics: Sequence[str]) -> Dict:
+    out = {"id": row[0], "device_id": row[1], "timestamp": row[2]}
+    for i, name in enumerate(metrics, 3):
+        out[name] = row[i]
+    return out
+
+
+def _is_int(value) -> bool:
+    return type(value) is int
+
+
+async def merged_page(db, device_ids: Sequence[str], metrics: Sequence[str], limit: int,
+                      cursor: Optional[str] = None, descending: bool = True, store=None) -> Dict:
+    """One page of all devices interleaved by (timestamp, device_id, id)"""
+    key = decode_cursor(cursor) if cursor else None
+    if key is not None and not (
+        isinstance(key, list) and len(key) == 3
+        and _is_int(key[0]) and isinstance(key[1], str) and _is_int(key[2])
+    ):
+        raise CursorError("invalid cursor")
+    size = max(MIN_CHUNK, limit // len(device_ids) + 1)
+    sign = -1 if descending else 1
+    scans = []
+    heap = []
+    data: List[Dict] = []
+    try:
+        for device_id in sorted(set(device_ids)):
+            after = _resume_key(device_id, key, descending) if key else None
+            scan = scan_device(db, device_id, metrics, descending, after, size, store)
+            scans.append(scan)
+            chunk = await _next_chunk(scan)
+            if chunk:
+                row = chunk[0]
+                heapq.heappush(heap, (sign * row[2], device_id, sign * _key(row)[1], 0, chunk, scan))
+        while heap and len(data) < limit:
+            _, device_id, _, index, chunk, scan = heapq.heappop(heap)
+            data.append(_row(chunk[index], metrics))
+            index += 1
+            if index == len(chunk):
+                chunk, index = await _next_chunk(scan), 0
+            if chunk:
+                row = chunk[index]
+                heapq.heappush(heap, (sign * row[2], device_id, sign * _key(row)[1], index, chunk, scan))
+    finally:
+        for scan in scans:
+            await scan.aclose()
+
+    last = data[-1] if data else None
+    return {
+        "data": data,
+        "next_cursor": encode_cursor([last["timestamp"], last["device_id"], last["id"] or 0])
+        if heap and last else None,
+    }
+
+
+async def per_device_page(db, device_ids: Sequence[str], metrics: Sequence[str], limit: int,
+                          cursor: Optional[str] = None, descending: bool = True, store=None) -> Dict:
+    """Up to limit rows of each device; the cursor only lists unfinished devices"""
+    keys = decode_cursor(cursor) if cursor else None
+    if keys is not None and not (isinstance(keys, dict) and all(
+        isinstance(k, list) and len(k) == 2 and _is_int(k[0]) and _is_int(k[1]) for k in keys.values()
+    )):
+        raise CursorError("invalid cursor")
+    devices: Dict[str, List[Dict]] = {}
+    resume: Dict[str, List[int]] = {}
+    for device_id in sorted(set(device_ids)):
+        if keys is not None and device_id not in keys:
+            continue    # Finished on an earlier page
+        after = tuple(keys[device_id]) if keys else None
+        scan = scan_device(db, device_id, metrics, descending, after, limit + 1, store)
+        try:
+            chunk = await _next_chunk(scan) or []
+        finally:
+            await scan.aclose()
+        devices[device_id] = [_row(row, metrics) for row in chunk[:limit]]
+        if len(chunk) > limit:
+            last = chunk[limit - 1]
+            resume[device_id] = list(_key(last))
+    return {
+        "devices": devices,
+        "next_cursor": encode_cursor(resume) if resume else None,
+    }
+
+
+async def _next_chunk(scan: AsyncIterator[List]) -> Optional[List]:
+    try:
+        return await scan.__anext__()
+    except StopAsyncIteration:
+        return None
+
+
+_next_row = _next_chunk
@@ -0,0 +1,87 @@
+"""
+Capture of ingest traffic for replay
+
+With INGEST_CAPTURE_PATH set, every POST to the ingest routes is
+appended to a gzip file: its route, its body exactly as received and the
+time since the previous one arrived. Pico/ingest_replay replays the file
+against a local backend at the recorded pace, 10x, or flat out, so a
+change to the ingest path can be measured on real traffic. The format is
+Pico/ingest_capture_format.h.
+
+The capture is an ASGI middleware that only watches the request body as
+the app reads it; the response is untouched and the recording costs one
+gzip write per request. "{pid}" in the path gives each uvicorn worker
+its own file.
+"""
+import os
+import gzip
+import time
+import struct
+import logging
+from typing import Optional
+
+logger = logging.getLogger(__name__)
+
+MAGIC = 0x43494741              # "AGIC"
+VERSION = 1
+HEADER = struct.Struct("<IHHQ")     # magic, version, reserved, start_unix_us
+RECORD = struct.Struct("<IIB")      # delta_us, length, route
+ROUTES = {"/api/sensors/data": 0, "/api/sensors/data/batch": 1}
+FLUSH_EVERY = 256
+MAX_DELTA_US = 0xFFFFFFFF
+
+
+class IngestCapture:
+    def __init__(self, path: str):
+        self.path = path.replace("{pid}", str(os.getpid()))
+        self.file = gzip.open(self.path, "wb", compresslevel=6)
+        self.file.write(HEADER.pack(MAGIC, VERSION, 0, int(time.time() * 1e6)))
+        self.last: Optional[float] = None
+        self.requests = 0
+        self.bytes = 0
+        logger.info(f"🎙️ Capturing ingest traffic to {self.path}")
+
+    def record(self, route: int, arrived: float, body: bytes):
+        """arrived: time.monotonic() when the request came in"""
+        if self.file is None:
+            return
+        delta = 0 if self.last is None else min(MAX_DELTA_US, max(0, int((arrived - self.last) * 1e6)))
+        self.last = arrived
+        self.file.write(RECORD.pack(delta, len(body), route))
+        self.file.write(body)
+        self.requests += 1
+        self.bytes += len(body)
+        if self.requests % FLUSH_EVERY == 0:
+            self.file.flush()
+
+    def close(self):
+        if self.file is not None:
+            self.file.close()
+            self.file = None
+            logger.info(f"🎙️ Captured {self.requests} ingest requests ({self.bytes / 1e6:.2f} MB) to {self.path}")
+
+
+class CaptureMiddleware:
+    """Records the bodies of ingest POSTs as the app reads them"""
+
+    def __init__(self, app, capture: IngestCapture):
+        self.app = app
+        self.capture = capture
+
+    async def __call__(self, scope, receive, send):
+        route = ROUTES.get(scope.get("path")) if scope["type"] == "http" else None
+        if route is None or scope["method"] != "POST":
+            return await self.app(scope, receive, send)
+
+        arrived = time.monotonic()
+        parts = []
+
+        async def recording_receive():
+            message = await receive()
+            if message["type"] == "http.request":
+                parts.append(message.get("body", b""))
+                if not message.get("more_body", False):
+                    self.capture.record(route, arrived, b"".join(parts))
+            return message
+
+        await self.app(scope, recording_receive, send)
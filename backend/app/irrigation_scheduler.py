@@ -0,0 +1,254 @@
+"""
+Multi-zone irrigation scheduler for a shared pump and mainline
+
+Zones with a water deficit (from the water balance engine) become jobs:
+a run of `liters / flow_lpm` minutes, rounded up to whole slots, inside
+the zone's daily time window. Jobs are packed onto a slotted timeline
+(default 5 minute slots over 24 hours) in priority order, then by how far
+the zone is past its readily available water. Every slot must satisfy
+
+    total flow          <= IRRIGATION_MAX_FLOW_LPM
+    mainline pressure   >= highest requirement of the open zones
+
+with mainline pressure modelled as the pump's static pressure minus a
+friction loss that grows with the square of the flow. A daily water
+budget, when set, caps the liters scheduled.
+
+Placement scans the timeline once per job (a failing slot restarts the
+run after it), so a full plan is O(jobs * slots). When moisture data
+arrives only the affected zones are released and placed again in the
+residual capacity; a full re-plan happens only when a changed zone can
+no longer fit and lower priority work stands in its way.
+"""
+import math
+import os
+import logging
+from typing import Dict, Iterable, List, Optional
+
+from app.water_balance import WaterBalanceEngine, Zone
+
+logger = logging.getLogger(__name__)
+
+MINUTES_PER_DAY = 1440
+
+
+class Job:
+    """One zone's irrigation run"""
+
+    __slots__ = ("zone_id", "priority", "urgency", "flow_lpm", "pressure_kpa",
+                 "window_start_min", "window_end_min", "liters", "slots", "start", "reason")
+
+    def __init__(self, zone: Zone, liters: float, slot_minutes: float):
+        self.zone_id = zone.zone_id
+        self.priority = zone.priority
+        self.urgency = zone.current_depletion_mm - zone.raw_mm
+        self.flow_lpm = zone.flow_lpm
+        self.pressure_kpa = zone.pressure_kpa or 0.0
+        self.window_start_min = zone.window_start_min
+        self.window_end_min = zone.window_end_min
+        self.liters = liters
+        self.slots = max(1, math.ceil(liters / zone.flow_lpm / slot_minutes)) if zone.flow_lpm else 0
+        self.start: Optional[int] = None
+        self.reason: Optional[str] = None
+
+    def sort_key(self):
+        return (-self.priority, -self.urgency, self.zone_id)
+
+    def in_window(self, minute_of_day: int) -> bool:
+        start, end = self.window_start_min, self.window_end_min
+        if start is None or end is None:
+            return True
+        if start <= end:
+            return start <= minute_of_day < end
+        return minute_of_day >= start or minute_of_day < end    # Window over midnight
+
+
+class IrrigationScheduler:
+    """Slotted schedule of irrigation runs under shared hydraulic limits"""
+
+    def __init__(self, engine: WaterBalanceEngine, slot_seconds: int = 300, horizon_seconds: int = 86400):
+        self.engine = engine
+        self.slot_seconds = slot_seconds
+        self.slot_count = horizon_seconds // slot_seconds
+        self.max_flow_lpm = float(os.getenv("IRRIGATION_MAX_FLOW_LPM", "200"))
+        self.static_pressure_kpa = float(os.getenv("IRRIGATION_STATIC_PRESSURE_KPA", "350"))
+        # Friction loss at full flow; loss(Q) = k * Q^2
+        friction_kpa = float(os.getenv("IRRIGATION_FRICTION_LOSS_KPA", "100"))
+        self.friction_k = friction_kpa / (self.max_flow_lpm ** 2)
+        self.daily_budget_liters = float(os.getenv("IRRIGATION_DAILY_BUDGET_L", "0")) or None
+
+        self.plan_start = 0
+        self.jobs: Dict[str, Job] = {}
+        self._reset(0)
+
+    def _reset(self, plan_start: int):
+        self.plan_start = plan_start - plan_start % self.slot_seconds
+        self.flow = [0.0] * self.slot_count
+        self.required_kpa = [0.0] * self.slot_count
+        self.occupants: List[List[Job]] = [[] for _ in range(self.slot_count)]
+        self.liters_used = 0.0
+        # Local minute of day of each slot, for window checks
+        offset = self.engine.day_offset
+        self.slot_minute = [
+            ((self.plan_start + i * self.slot_seconds + offset) % 86400) // 60
+            for i in range(self.slot_count)
+        ]
+
+    def _current_slot(self, now: int) -> int:
+        return max(0, (now - self.plan_start) // self.slot_seconds)
+
+    # ==================== PLACEMENT ====================
+
+    def _fits(self, job: Job, slot: int) -> bool:
+        total = self.flow[slot] + job.flow_lpm
+        if total > self.max_flow_lpm:
+            return False
+        available = self.static_pressure_kpa - self.friction_k * total * total
+        return available >= max(self.required_kpa[slot], job.pressure_kpa)
+
+    def _place(self, job: Job, first_slot: int) -> bool:
+        """Reserve the earliest feasible run at or after first_slot"""
+        if job.start is not None:
+            return True
+        if not job.flow_lpm:
+            job.reason = "no flow rate configured"
+            return False
+        if job.flow_lpm > self.max_flow_lpm:
+            job.reason = "zone flow exceeds mainline capacity"
+            return False
+        if self.daily_budget_liters is not None and self.liters_used + job.liters > self.daily_budget_liters:
+            job.reason = "daily water budget exhausted"
+            return False
+
+        run = 0
+        for slot in range(first_slot, self.slot_count):
+            if job.in_window(self.slot_minute[slot]) and self._fits(job, slot):
+                run += 1
+                if run == job.slots:
+                    self._reserve(job, slot - run + 1)
+                    return True
+            else:
+                run = 0
+        job.reason = "no capacity within window"
+        return False
+
+    def _reserve(self, job: Job, start: int):
+        job.start = start
+        job.reason = None
+        self.liters_used += job.liters
+        for slot in range(start, start + job.slots):
+            self.flow[slot] += job.flow_lpm
+            self.required_kpa[slot] = max(self.required_kpa[slot], job.pressure_kpa)
+            self.occupants[slot].append(job)
+
+    def _release(self, job: Job):
+        if job.start is None:
+            return
+        self.liters_used -= job.liters
+        for slot in range(job.start, job.start + job.slots):
+            occupants = self.occupants[slot]
+            occupants.remove(job)
+            self.flow[slot] = sum(j.flow_lpm for j in occupants)
+            self.required_kpa[slot] = max((j.pressure_kpa for j in occupants), default=0.0)
+        job.start = None
+
+    def _job_for(self, zone: Zone) -> Optional[Job]:
+        liters = zone.recommendation()["water_liters"]
+        if liters <= 0:
+            return None
+        return Job(zone, liters, self.slot_seconds / 60)
+
+    # ==================== PLANNING ====================
+
+    def plan(self, now: int) -> Dict:
+        """Plan every zone with a deficit from scratch, keeping runs in progress"""
+        old_start, old_jobs = self.plan_start, self.jobs
+        current = (now - old_start) // self.slot_seconds
+        self._reset(now)
+        self.jobs = {}
+
+        # A run in progress keeps its remaining slots from the new origin
+        for job in old_jobs.values():
+            if job.start is not None and job.start <= current < job.start + job.slots:
+                job.slots = job.start + job.slots - current
+                job.liters = job.flow_lpm * job.slots * self.slot_seconds / 60
+                job.start = None
+                self._reserve(job, 0)
+                self.jobs[job.zone_id] = job
+
+        pending = []
+        for zone in self.engine.zones.values():
+            if zone.zone_id not in self.jobs:
+                job = self._job_for(zone)
+                if job is not None:
+                    pending.append(job)
+                    self.jobs[job.zone_id] = job
+        for job in sorted(pending, key=Job.sort_key):
+            self._place(job, 0)
+        return self.schedule()
+
+    def update_zones(self, zone_ids: Iterable[str], now: int) -> Dict:
+        """Re-plan only the given zones after their deficit changed"""
+        current = self._current_slot(now)
+        if current >= self.slot_count // 2:
+            return self.plan(now)
+
+        changed = []
+        for zone_id in zone_ids:
+            old = self.jobs.get(zone_id)
+            if old is not None and old.start is not None and old.start < current:
+                continue    # Running or finished
+            if old is not None:
+                self._release(old)
+                del self.jobs[zone_id]
+            zone = self.engine.zones.get(zone_id)
+            job = self._job_for(zone) if zone is not None else None
+            if job is not None:
+                self.jobs[zone_id] = job
+                changed.append(job)
+
+        for job in sorted(changed, key=Job.sort_key):
+            if not self._place(job, current) and self._displaces(job, current):
+                logger.info(f"Irrigation: {job.zone_id} needs lower priority capacity, full re-plan")
+                return self.plan(now)
+
+        # Released capacity may now fit jobs that were left out
+        for job in sorted((j for j in self.jobs.values() if j.start is None), key=Job.sort_key):
+            self._place(job, current)
+        return self.schedule()
+
+    def _displaces(self, job: Job, current: int) -> bool:
+        """Whether a not yet started, lower ranked job holds capacity job could use"""
+        key = job.sort_key()
+        return any(
+            other.start is not None and other.start >= current and other.sort_key() > key
+            for other in self.jobs.values()
+        )
+
+    # ==================== OUTPUT ====================
+
+    def schedule(self) -> Dict:
+        runs, unscheduled = [], []
+        for job in sorted(self.jobs.values(), key=lambda j: (j.start is None, j.start or 0, j.sort_key())):
+            if job.start is None:
+                unscheduled.append({"zone_id": job.zone_id, "liters": job.liters, "reason": job.reason})
+                continue
+            start = self.plan_start + job.start * self.slot_seconds
+            runs.append({
+                "zone_id": job.zone_id,
+                "start": start,
+                "end": start + job.slots * self.slot_seconds,
+                "flow_lpm": job.flow_lpm,
+                "liters": job.liters,
+                "priority": job.priority,
+            })
+        peak = max(self.flow, default=0.0)
+        return {
+            "plan_start": self.plan_start,
+            "slot_seconds": self.slot_seconds,
+            "runs": runs,
+            "unscheduled": unscheduled,
+            "total_liters": round(self.liters_used, 1),
+            "peak_flow_lpm": round(peak, 1),
+            "min_pressure_kpa": round(self.static_pressure_kpa - self.friction_k * peak * peak, 1),
+        }
@@ -0,0 +1,284 @@
+"""
+Latest values and hourly rollups in a shared-memory segment
+
+Every uvicorn worker maps the same file under /dev/shm. Ingest publishes
+each device's latest reading and folds it into a ring of ROLLUP_BUCKETS
+hourly buckets (count, sum, min, max per column); any worker or other
+process reads them straight from the mapping, with no SQLite query and
+no system call.
+
+Layout (little endian):
+  header   magic, layout version, slot count, slot size, column-list CRC,
+           generation (bumped whenever the segment is re-initialised)
+  slots    seq | device_id | timestamp | latest values | rollup ring
+  bucket   start | readings | per column sum, count, min, max
+
+Devices are placed by CRC32 of their id with linear probing; a slot is
+claimed once and never released, so readers can probe without locks.
+Writers serialise on flock(2) of the segment file. Each slot is a
+seqlock: the writer makes seq odd (seq | 1, so a writer that died half
+way cannot leave the parity inverted), writes, then makes it even; a
+reader retries if seq was odd or changed while it copied the slot. A
+process whose layout differs from the header re-initialises the segment
+in place: it clears the header, zeroes the slots and writes its header
+last. The file only ever grows, so no mapping can fault on a page past
+the end, and readers of the old layout see the header change and return
+None, so callers fall back to the store.
+"""
+import os
+import mmap
+import time
+import zlib
+import fcntl
+import struct
+import logging
+import tempfile
+from contextlib import contextmanager
+from typing import Dict, Iterable, List, Optional, Sequence, Tuple
+
+from app.telemetry_schema import COLUMNS
+
+logger = logging.getLogger(__name__)
+
+MAGIC = b"AGLV"
+LAYOUT_VERSION = 1
+SEGMENT_SLOTS = int(os.getenv("LATEST_SEGMENT_SLOTS", "1024"))
+ROLLUP_BUCKETS = 24
+ROLLUP_S = 3600
+DEVICE_ID_BYTES = 40
+READ_RETRIES = 100
+ZERO_CHUNK = 1 << 20
+
+FIELDS = tuple(name for name, _, _ in COLUMNS)
+INTEGER_FIELDS = frozenset(name for name, sql_type, _ in COLUMNS if sql_type == "INTEGER")
+NAN = float("nan")
+
+HEADER = struct.Struct("<4sIIIIQ")
+HEADER_SIZE = 64
+SEQ = struct.Struct("<Q")
+SLOT_HEAD = struct.Struct(f"<Q{DEVICE_ID_BYTES}sq")     # seq, device_id, timestamp
+VALUES = struct.Struct(f"<{len(FIELDS)}d")
+BUCKET = struct.Struct(f"<qI4x{4 * len(FIELDS)}d")      # start, readings, sums, counts, mins, maxes
+SLOT_SIZE = SLOT_HEAD.size + VALUES.size + ROLLUP_BUCKETS * BUCKET.size
+
+
+def default_path() -> str:
+    base = "/dev/shm" if os.path.isdir("/dev/shm") else tempfile.gettempdir()
+    return os.getenv("LATEST_SEGMENT_PATH", os.path.join(base, "agri_latest_segment"))
+
+
+class LatestSegment:
+    """One process's mapping of the shared segment"""
+
+    def __init__(self, path: Optional[str] = None, slots: int = SEGMENT_SLOTS):
+        self.path = path or default_path()
+        self.slots = slots
+        self.size = HEADER_SIZE + slots * SLOT_SIZE
+        self.fields_crc = zlib.crc32(",".join(FIELDS).encode())
+        self.fd = os.open(self.path, os.O_RDWR | os.O_CREAT, 0o600)
+        with self._locked():
+            if not self._header_matches(os.pread(self.fd, HEADER.size, 0)):
+                self._initialise()
+        self.buf = mmap.mmap(self.fd, self.size)
+        self.view = memoryview(self.buf)
+        self.positions: Dict[str, int] = {}     # device_id -> slot offset, cached per process
+        self.positions_generation = self.generation()
+
+    # ---- header ----
+
+    def _header_matches(self, raw: bytes) -> bool:
+        if len(raw) < HEADER.size:
+            return False
+        magic, version, slots, slot_size, crc, _ = HEADER.unpack(raw)
+        return (magic, version, slots, slot_size, crc) == \
+            (MAGIC, LAYOUT_VERSION, self.slots, SLOT_SIZE, self.fields_crc)
+
+    def _initialise(self):
+        """Called with the lock held: zeroed segment in this layout, in place"""
+        # Other processes keep their mappings: invalidate first, never shrink
+        os.pwrite(self.fd, bytes(HEADER_SIZE), 0)
+        if os.fstat(self.fd).st_size < self.size:
+            os.ftruncate(self.fd, self.size)
+        zeros = bytes(ZERO_CHUNK)
+        for at in range(HEADER_SIZE, self.size, ZERO_CHUNK):
+            os.pwrite(self.fd, zeros[:min(ZERO_CHUNK, self.size - at)], at)
+        os.pwrite(self.fd, HEADER.pack(MAGIC, LAYOUT_VERSION, self.slots, SLOT_SIZE,
+                                       self.fields_crc, time.time_ns()), 0)
+        logger.info(f"🧠 Latest-value segment initialised: {self.path} ({self.size / 1e6:.1f} MB)")
+
+    def valid(self) -> bool:
+        if not self._header_matches(self.view[:HEADER.size]):
+            return False
+        generation = self.generation()
+        if generation != self.positions_generation:
+            self.positions.clear()      # Re-initialised by another process
+            self.positions_generation = generation
+        return True
+
+    def generation(self) -> int:
+        return HEADER.unpack_from(self.view, 0)[5]
+
+    # ---- slots ----
+
+    @contextmanager
+    def _locked(self):
+        fcntl.flock(self.fd, fcntl.LOCK_EX)
+        try:
+            yield
+        finally:
+            fcntl.flock(self.fd, fcntl.LOCK_UN)
+
+    def _find(self, device_id: str, claim: bool = False) -> Optional[int]:
+        offset = self.positions.get(device_id)
+        if offset is not None:
+            return offset
+        key = device_id.encode()[:DEVICE_ID_BYTES]
+        stored_key = key.ljust(DEVICE_ID_BYTES, b"\0")
+        start = zlib.crc32(key) % self.slots
+        for probe in range(self.slots):
+            offset = HEADER_SIZE + ((start + probe) % self.slots) * SLOT_SIZE
+            stored = bytes(self.view[offset + 8:offset + 8 + DEVICE_ID_BYTES])
+            if stored == stored_key:
+                self.positions[device_id] = offset
+                return offset
+            if stored[0] == 0:
+                if not claim:
+                    return None
+                self.view[offset + 8:offset + 8 + DEVICE_ID_BYTES] = stored_key
+                self.positions[device_id] = offset
+                return offset
+        return None     # Full
+
+    def _write(self, offset: int, timestamp: int, values: Dict, rollup: bool):
+        seq = SEQ.unpack_from(self.view, offset)[0] | 1
+        SEQ.pack_into(self.view, offset, seq)          # Odd: readers back off
+        current = SLOT_HEAD.unpack_from(self.view, offset)[2]
+        if timestamp >= current:
+            latest = [NAN if values.get(name) is None else float(values[name]) for name in FIELDS]
+            struct.pack_into("<q", self.view, offset + 8 + DEVICE_ID_BYTES, timestamp)
+            VALUES.pack_into(self.view, offset + SLOT_HEAD.size, *latest)
+        if rollup:
+            self._fold(offset, timestamp, values)
+        SEQ.pack_into(self.view, offset, seq + 1)
+
+    def _fold(self, offset: int, timestamp: int, values: Dict):
+        start = timestamp - timestamp % ROLLUP_S
+        at = offset + SLOT_HEAD.size + VALUES.size + (start // ROLLUP_S % ROLLUP_BUCKETS) * BUCKET.size
+        bucket = list(BUCKET.unpack_from(self.view, at))
+        if bucket[0] > start:
+            return      # Older than the ring
+        n = len(FIELDS)
+        if bucket[0] != start:
+            bucket = [start, 0] + [0.0] * (2 * n) + [NAN] * (2 * n)
+        bucket[1] += 1
+        for i, name in enumerate(FIELDS):
+            value = values.get(name)
+            if value is None:
+                continue
+            bucket[2 + i] += value
+            bucket[2 + n + i] += 1
+            low, high = bucket[2 + 2 * n + i], bucket[2 + 3 * n + i]
+            bucket[2 + 2 * n + i] = value if low != low or value < low else low
+            bucket[2 + 3 * n + i] = value if high != high or value > high else high
+        BUCKET.pack_into(self.view, at, *bucket)
+
+    def publish(self, readings: Iterable[Tuple[str, int, Dict]], rollup: bool = True) -> int:
+        """Ingest hook: (device_id, timestamp, {column: value}) readings, one lock"""
+        published = 0
+        with self._locked():
+            if not self.valid():
+                return 0
+            for device_id, timestamp, values in readings:
+                offset = self._find(device_id, claim=True)
+                if offset is None:
+                    continue
+                self._write(offset, timestamp, values, rollup)
+                published += 1
+        return published
+
+    # ---- readers: no locks, no system calls ----
+
+    def _read_slot(self, offset: int, rollups: bool = False) -> Optional[Tuple]:
+        view = self.view
+        for _ in range(READ_RETRIES):
+            before = SEQ.unpack_from(view, offset)[0]
+            if before & 1:
+                continue
+            head = SLOT_HEAD.unpack_from(view, offset)
+            latest = VALUES.unpack_from(view, offset + SLOT_HEAD.size)
+            ring = bytes(view[offset + SLOT_HEAD.size + VALUES.size:offset + SLOT_SIZE]) if rollups else b""
+            if SEQ.unpack_from(view, offset)[0] == before:
+                return head, latest, ring
+        return None
+
+    @staticmethod
+    def _values(numbers: Sequence[float], typed: bool = False) -> Dict:
+        """NaN back to None; typed restores INTEGER columns"""
+        return {name: None if v != v else int(v) if typed and name in INTEGER_FIELDS else v
+                for name, v in zip(FIELDS, numbers)}
+
+    def read(self, device_id: str, rollups: bool = False) -> Optional[Dict]:
+        """Latest reading of a device (and its hourly rollups), or None"""
+        if not self.valid():
+            return None
+        offset = self._find(device_id)
+        if offset is None:
+            return None
+        slot = self._read_slot(offset, rollups)
+        if slot is None or slot[0][2] == 0:
+            return None
+        return self._as_dict(device_id, slot, rollups)
+
+    def _as_dict(self, device_id: str, slot: Tuple, rollups: bool) -> Dict:
+        head, latest, ring = slot
+        out = {"device_id": device_id, "timestamp": head[2], **self._values(latest, typed=True)}
+        if rollups:
+            n = len(FIELDS)
+            buckets = []
+            for i in range(ROLLUP_BUCKETS):
+                bucket = BUCKET.unpack_from(ring, i * BUCKET.size)
+                if bucket[1] == 0:
+                    continue
+                buckets.append({
+                    "start": bucket[0],
+                    "samples": bucket[1],
+                    "mean": self._values([total / count if count else NAN
+                                          for total, count in zip(bucket[2:2 + n], bucket[2 + n:2 + 2 * n])]),
+                    "min": self._values(bucket[2 + 2 * n:2 + 3 * n]),
+                    "max": self._values(bucket[2 + 3 * n:2 + 4 * n]),
+                })
+            out["rollups"] = sorted(buckets, key=lambda b: b["start"])
+        return out
+
+    def latest(self, limit: Optional[int] = None) -> List[Dict]:
+        """Latest reading of every device in the segment, newest first"""
+        if not self.valid():
+            return []
+        found = []
+        for i in range(self.slots):
+            offset = HEADER_SIZE + i * SLOT_SIZE
+            key = bytes(self.view[offset + 8:offset + 8 + DEVICE_ID_BYTES])
+            if key[0] == 0:
+                continue
+            slot = self._read_slot(offset)
+            if slot is not None and slot[0][2]:
+                found.append(self._as_dict(key.rstrip(b"\0").decode(errors="replace"), slot, False))
+        found.sort(key=lambda r: r["timestamp"], reverse=True)
+        return found[:limit] if limit else found
+
+    def close(self):
+        self.view.release()
+        self.buf.close()
+        os.close(self.fd)
+
+
+_STATEMENT_COLUMNS: Dict[str, Tuple[str, ...]] = {}
+
+
+def statement_columns(statement: str) -> Tuple[str, ...]:
+    """Column names of a generated INSERT INTO sensor_data (...) statement"""
+    columns = _STATEMENT_COLUMNS.get(statement)
+    if columns is None:
+        inner = statement[statement.index("(") + 1:statement.index(")")]
+        columns = _STATEMENT_COLUMNS[statement] = tuple(c.strip() for c in inner.split(","))
+    return columns
@@ -0,0 +1,190 @@
+"""
+Device liveness: expected cadence per device and silence deadlines in a
+hierarchical timer wheel
+
+Every reading resets the device's deadline to
+
+    last_seen + max(MIN_SILENCE_S, CADENCE_FACTOR * expected interval)
+
+where the expected interval is an EWMA of the device's inter-arrival
+times. The wheel has LEVELS levels of SLOTS slots of one tick each
+(4 x 64 one second ticks cover ~194 days); insert, reset and cancel are
+O(1) dict operations and each tick touches one slot, with a timer
+cascading down at most LEVELS - 1 times over its life. A device whose
+deadline expires goes offline; its next reading brings it back online.
+Both transitions are recorded as events.
+
+Liveness runs on server receive time, not on device timestamps.
+"""
+import os
+import logging
+from collections import deque
+from typing import Dict, List, Optional, Tuple
+
+logger = logging.getLogger(__name__)
+
+SLOT_BITS = 6
+SLOTS = 1 << SLOT_BITS
+SLOT_MASK = SLOTS - 1
+LEVELS = 4
+
+MIN_SILENCE_S = float(os.getenv("LIVENESS_MIN_SILENCE_S", "60"))
+CADENCE_FACTOR = float(os.getenv("LIVENESS_CADENCE_FACTOR", "3"))
+CADENCE_ALPHA = 0.2
+EVENT_HISTORY = 1000
+
+DEVICE_EVENTS_DDL = """
+    CREATE TABLE IF NOT EXISTS device_events (
+        id INTEGER PRIMARY KEY AUTOINCREMENT,
+        device_id TEXT NOT NULL,
+        event TEXT NOT NULL,
+        timestamp INTEGER NOT NULL
+    )
+"""
+
+
+class TimerWheel:
+    """Hierarchical timing wheel keyed by an arbitrary hashable id"""
+
+    def __init__(self, now: float, tick: float = 1.0):
+        self.tick = tick
+        self.current = int(now // tick)
+        self.wheels: List[List[Dict]] = [[{} for _ in range(SLOTS)] for _ in range(LEVELS)]
+        self.where: Dict[object, Tuple[int, int]] = {}
+
+    def __len__(self):
+        return len(self.where)
+
+    def _insert(self, key, expiry: int):
+        delta = expiry - self.current
+        level = 0
+        while level < LEVELS - 1 and delta >= 1 << (SLOT_BITS * (level + 1)):
+            level += 1
+        if level == LEVELS - 1:
+            expiry = min(expiry, self.current + (1 << (SLOT_BITS * LEVELS)) - 1)
+        slot = (expiry >> (SLOT_BITS * level)) & SLOT_MASK
+        self.wheels[level][slot][key] = expiry
+        self.where[key] = (level, slot)
+
+    def schedule(self, key, deadline: float):
+        """Set (or reset) key's deadline"""
+        self.cancel(key)
+        self._insert(key, max(int(deadline // self.tick), self.current + 1))
+
+    def cancel(self, key):
+        position = self.where.pop(key, None)
+        if position is not None:
+            del self.wheels[position[0]][position[1]][key]
+
+    def advance(self, now: float) -> List:
+        """Move to now; returns the keys whose deadline passed"""
+        target = int(now // self.tick)
+        expired = []
+        while self.current < target:
+            self.current += 1
+            # Re-file the next block of each level whose lower digits wrapped,
+            # highest first so timers can fall through several levels
+            for level in range(LEVELS - 1, 0, -1):
+                if self.current & ((1 << (SLOT_BITS * level)) - 1):
+                    continue
+                slot = (self.current >> (SLOT_BITS * level)) & SLOT_MASK
+                bucket = self.wheels[level][slot]
+                if bucket:
+                    self.wheels[level][slot] = {}
+                    for key, expiry in bucket.items():
+                        self._insert(key, expiry)
+            slot = self.current & SLOT_MASK
+            bucket = self.wheels[0][slot]
+            if bucket:
+                self.wheels[0][slot] = {}
+                for key in bucket:
+                    del self.where[key]
+                expired.extend(bucket)
+        return expired
+
+
+class DeviceState:
+    __slots__ = ("device_id", "last_seen", "last_timestamp", "interval", "online", "readings")
+
+    def __init__(self, device_id: str):
+        self.device_id = device_id
+        self.last_seen = 0.0
+        self.last_timestamp = None
+        self.interval: Optional[float] = None
+        self.online = False
+        self.readings = 0
+
+    def silence_limit(self) -> float:
+        if self.interval is None:
+            return MIN_SILENCE_S
+        return max(MIN_SILENCE_S, CADENCE_FACTOR * self.interval)
+
+    def as_dict(self) -> Dict:
+        return {
+            "device_id": self.device_id,
+            "last_timestamp": self.last_timestamp,
+            "last_seen": int(self.last_seen),
+            "status": "online" if self.online else "offline",
+            "expected_interval_s": round(self.interval, 1) if self.interval else None,
+            "readings": self.readings,
+        }
+
+
+class LivenessTracker:
+    """In-memory device registry with online/offline detection"""
+
+    def __init__(self, now: float):
+        self.wheel = TimerWheel(now)
+        self.devices: Dict[str, DeviceState] = {}
+        self.events = deque(maxlen=EVENT_HISTORY)
+        self.pending_events: List[Tuple[str, str, int]] = []
+
+    def _event(self, device: DeviceState, event: str, at: float):
+        record = (device.device_id, event, int(at))
+        self.events.append(record)
+        self.pending_events.append(record)
+        logger.info(f"📶 {device.device_id} {event}")
+
+    def seed(self, device_id: str, last_timestamp: int, now: float):
+        """Restore a device known from storage without raising events"""
+        device = self.devices.setdefault(device_id, DeviceState(device_id))
+        device.last_timestamp = last_timestamp
+        device.last_seen = min(float(last_timestamp), now)
+        if now - device.last_seen < device.silence_limit():
+            device.online = True
+            self.wheel.schedule(device_id, device.last_seen + device.silence_limit())
+
+    def seen(self, device_id: str, timestamp: int, now: float):
+        """Ingest path hook: O(1)"""
+        device = self.devices.get(device_id)
+        if device is None:
+            device = self.devices[device_id] = DeviceState(device_id)
+        elif device.readings:
+            gap = now - device.last_seen
+            if gap > 0.5:   # Retries and bursts say nothing about cadence
+                device.interval = gap if device.interval is None \
+                    else device.interval + CADENCE_ALPHA * (gap - device.interval)
+        device.last_seen = now
+        device.readings += 1
+        if device.last_timestamp is None or timestamp > device.last_timestamp:
+            device.last_timestamp = timestamp
+        if not device.online:
+            device.online = True
+            self._event(device, "online", now)
+        self.wheel.schedule(device_id, now + device.silence_limit())
+
+    def advance(self, now: float) -> int:
+        """Expire silent devices; returns how many went offline"""
+        expired = self.wheel.advance(now)
+        for device_id in expired:
+            device = self.devices[device_id]
+            device.online = False
+            self._event(device, "offline", now)
+        return len(expired)
+
+    def take_pending_events(self) -> List[Tuple[str, str, int]]:
+        events, self.pending_events = self.pending_events, []
+        return events
+
+    def device_list(self) -> List[Dict]:
+        return [d.as_dict() for d in sorted(self.devices.values(), key=lambda d: d.device_id)]
@@ -7,6 +7,12 @@ from datetime import datetime
 from typing import Optional, List, Dict, Union
 from enum import Enum
 
+# Telemetry readings are generated from Pico/telemetry_schema.h; the
+# simulator and sensor_readings table use the station layout
+from app.telemetry_models import (
+    LegacyStationReading as SensorReading, LegacyStationNpk as NPKReading
+)
+
 class AlertSeverity(str, Enum):
     LOW = "low"
     MODERATE = "moderate"
@@ -34,28 +40,6 @@ class WeatherAlertType(str, Enum):
     FLOOD = "flood"
     FROST = "frost"
 
-class NPKReading(BaseModel):
-    nitrogen: float = Field(..., ge=0, le=500, description="Nitrogen level in ppm")
-    phosphorus: float = Field(..., ge=0, le=200, description="Phosphorus level in ppm")
-    potassium: float = Field(..., ge=0, le=500, description="Potassium level in ppm")
-    timestamp: datetime = Field(default_factory=datetime.utcnow)
-
-class SensorReading(BaseModel):
-    timestamp: datetime = Field(default_factory=datetime.utcnow)
-    soil_moisture: float = Field(..., ge=0, le=100, description="Soil moisture percentage")
-    soil_temperature: float = Field(..., ge=-10, le=60, description="Soil temperature in Celsius")
-    soil_ph: float = Field(..., ge=3.0, le=14.0, description="Soil pH level")
-    soil_conductivity: float = Field(..., ge=0, le=5000, description="Soil conductivity in μS/cm")
-    air_temperature: float = Field(..., ge=-50, le=70, description="Air temperature in Celsius")
-    humidity: float = Field(..., ge=0, le=100, description="Air humidity percentage")
-    atmospheric_pressure: float = Field(..., ge=800, le=1200, description="Atmospheric pressure in hPa")
-    npk: NPKReading
-
-    class Config:
-        json_encoders = {
-            datetime: lambda v: v.isoformat()
-        }
-
 class WeatherAlert(BaseModel):
     id: str
     type: WeatherAlertType
@@ -0,0 +1,404 @@
+"""
+Spatial soil moisture map: IDW / ordinary kriging rendered as cached tiles
+
+Devices with a registered location are projected onto a local metric grid
+around the farm (FARM_LATITUDE / FARM_LONGITUDE). The map covers their
+bounding box, padded and snapped to whole tiles of TILE_PX pixels.
+
+Every pixel is interpolated only from devices within MAP_RADIUS_M of it,
+so a tile depends on the devices within that radius of its bounds and
+nothing else. The ingest path bumps a global generation and stamps the
+device with it; a cached tile stays valid while none of its devices has
+a newer stamp, so new readings re-render only the tiles around the
+devices that reported. Tiles render in a process pool, one task per
+tile, so a full raster uses every core.
+
+Ordinary kriging is a global estimator: a spherical variogram is fitted
+to all current values and the system is solved once per render (dual
+form, O(n) per pixel), so any device change invalidates every kriging
+tile. The radius still masks pixels far from all devices.
+"""
+import math
+import os
+import struct
+import zlib
+import asyncio
+import logging
+from collections import OrderedDict
+from concurrent.futures import ProcessPoolExecutor
+from typing import Dict, List, Optional, Sequence, Tuple
+
+import aiosqlite
+
+logger = logging.getLogger(__name__)
+
+TILE_PX = 64
+MAP_RESOLUTION_M = float(os.getenv("MAP_RESOLUTION_M", "2"))
+MAP_RADIUS_M = float(os.getenv("MAP_RADIUS_M", "150"))
+IDW_POWER = 2.0
+TILE_CACHE_SIZE = 512
+
+# Colour ramp over soil moisture %, dry to wet
+RAMP = ((0.0, (140, 81, 10)), (15.0, (216, 179, 101)), (30.0, (199, 234, 229)),
+        (45.0, (90, 180, 172)), (60.0, (1, 102, 94)))
+
+DEVICE_LOCATIONS_DDL = """
+    CREATE TABLE IF NOT EXISTS device_locations (
+        device_id TEXT PRIMARY KEY,
+        latitude REAL NOT NULL,
+        longitude REAL NOT NULL
+    )
+"""
+
+Point = Tuple[float, float, float]     # x, y (m), value
+
+# ==================== INTERPOLATION (pool workers) ====================
+
+def spherical(h: float, nugget: float, sill: float, range_m: float) -> float:
+    """Spherical semivariogram"""
+    if h <= 0:
+        return 0.0
+    if h >= range_m:
+        return nugget + sill
+    r = h / range_m
+    return nugget + sill * (1.5 * r - 0.5 * r * r * r)
+
+
+def fit_variogram(points: Sequence[Point], max_range: float) -> Tuple[float, float, float]:
+    """(nugget, sill, range) fitted to the binned empirical semivariogram"""
+    n = len(points)
+    mean = sum(p[2] for p in points) / n
+    variance = sum((p[2] - mean) ** 2 for p in points) / n or 1e-6
+    bins = [[0.0, 0] for _ in range(10)]
+    width = max_range / len(bins)
+    for i in range(n):
+        xi, yi, zi = points[i]
+        for j in range(i + 1, n):
+            xj, yj, zj = points[j]
+            k = int(math.hypot(xi - xj, yi - yj) / width)
+            if k < len(bins):
+                bins[k][0] += 0.5 * (zi - zj) ** 2
+                bins[k][1] += 1
+    empirical = [((k + 0.5) * width, s / c) for k, (s, c) in enumerate(bins) if c]
+    if len(empirical) < 3:
+        return 0.0, variance, max_range
+
+    best = None
+    for nugget_share in (0.0, 0.1, 0.25):
+        nugget, sill = variance * nugget_share, variance * (1 - nugget_share)
+        for step in range(1, 11):
+            range_m = max_range * step / 10
+            error = sum((g - spherical(h, nugget, sill, range_m)) ** 2 for h, g in empirical)
+            if best is None or error < best[0]:
+                best = (error, nugget, sill, range_m)
+    return best[1], best[2], best[3]
+
+
+def solve(matrix: List[List[float]], rhs: List[float]) -> Optional[List[float]]:
+    """Gaussian elimination with partial pivoting; None if singular"""
+    n = len(rhs)
+    a = [row[:] + [rhs[i]] for i, row in enumerate(matrix)]
+    for col in range(n):
+        pivot = max(range(col, n), key=lambda r: abs(a[r][col]))
+        if abs(a[pivot][col]) < 1e-12:
+            return None
+        a[col], a[pivot] = a[pivot], a[col]
+        for r in range(col + 1, n):
+            f = a[r][col] / a[col][col]
+            if f:
+                for c in range(col, n + 1):
+                    a[r][c] -= f * a[col][c]
+    x = [0.0] * n
+    for r in range(n - 1, -1, -1):
+        x[r] = (a[r][n] - sum(a[r][c] * x[c] for c in range(r + 1, n))) / a[r][r]
+    return x
+
+
+def kriging_weights(points: Sequence[Point], variogram) -> Optional[List[float]]:
+    """Dual ordinary kriging weights: z(x) = sum(w_i * gamma(x, x_i)) + w_n"""
+    n = len(points)
+    matrix = [[spherical(math.hypot(p[0] - q[0], p[1] - q[1]), *variogram) for q in points] + [1.0]
+              for p in points]
+    matrix.append([1.0] * n + [0.0])
+    return solve(matrix, [p[2] for p in points] + [0.0])
+
+
+def render_tile(points: Sequence[Point], x0: float, y0: float, resolution: float,
+                radius: float, weights=None, variogram=None) -> List[Optional[float]]:
+    """
+    Interpolate a TILE_PX x TILE_PX tile whose top-left corner is (x0, y0)
+
+    IDW unless kriging weights are given. Rows run north to south. Pixels
+    with no device within radius are None.
+    """
+    size = TILE_PX
+    values: List[Optional[float]] = [None] * (size * size)
+    if not points:
+        return values
+    r2 = radius * radius
+
+    for row in range(size):
+        y = y0 - (row + 0.5) * resolution
+        for col in range(size):
+            x = x0 + (col + 0.5) * resolution
+            near = False
+            num = den = 0.0
+            exact = None
+            for px, py, pz in points:
+                d2 = (px - x) ** 2 + (py - y) ** 2
+                if d2 > r2:
+                    continue
+                near = True
+                if weights is None:
+                    if d2 < 1e-9:
+                        exact = pz
+                        break
+                    w = 1.0 / d2 ** (IDW_POWER / 2)
+                    num += w * pz
+                    den += w
+            if not near:
+                continue
+            if exact is not None:
+                values[row * size + col] = exact
+            elif weights is not None:
+                z = weights[-1]
+                for (px, py, _), w in zip(points, weights):
+                    z += w * spherical(math.hypot(px - x, py - y), *variogram)
+                values[row * size + col] = z
+            else:
+                values[row * size + col] = num / den
+    return values
+
+# ==================== PNG ====================
+
+def ramp_colour(value: float) -> Tuple[int, int, int]:
+    if value <= RAMP[0][0]:
+        return RAMP[0][1]
+    for (v0, c0), (v1, c1) in zip(RAMP, RAMP[1:]):
+        if value <= v1:
+            t = (value - v0) / (v1 - v0)
+            return tuple(int(a + (b - a) * t) for a, b in zip(c0, c1))
+    return RAMP[-1][1]
+
+
+def encode_png(values: Sequence[Optional[float]], width: int, height: int) -> bytes:
+    """RGBA PNG of a value grid; None pixels are transparent"""
+    raw = bytearray()
+    for row in range(height):
+        raw.append(0)   # Filter: none
+        for v in values[row * width:(row + 1) * width]:
+            if v is None:
+                raw += b"\x00\x00\x00\x00"
+            else:
+                raw += bytes(ramp_colour(v)) + b"\xff"
+
+    def chunk(kind: bytes, data: bytes) -> bytes:
+        return struct.pack(">I", len(data)) + kind + data + struct.pack(">I", zlib.crc32(kind + data))
+
+    return (b"\x89PNG\r\n\x1a\n"
+            + chunk(b"IHDR", struct.pack(">IIBBBBB", width, height, 8, 6, 0, 0, 0))
+            + chunk(b"IDAT", zlib.compress(bytes(raw), 6))
+            + chunk(b"IEND", b""))
+
+# ==================== MAP STATE ====================
+
+class MoistureMap:
+    """Device positions, latest moisture and the tile cache"""
+
+    def __init__(self, db_path: str):
+        self.db_path = db_path
+        self.lat0 = float(os.getenv("FARM_LATITUDE", "0"))
+        self.lon0 = float(os.getenv("FARM_LONGITUDE", "0"))
+        self.positions: Dict[str, Tuple[float, float]] = {}
+        self.latest: Dict[str, Tuple[int, float]] = {}
+        self.generation = 0
+        self.changed_at: Dict[str, int] = {}
+        self.layout: Optional[Tuple[float, float, int, int]] = None
+        self.cache: "OrderedDict[tuple, tuple]" = OrderedDict()
+        self.executor: Optional[ProcessPoolExecutor] = None
+
+    def project(self, latitude: float, longitude: float) -> Tuple[float, float]:
+        """Equirectangular metres from the farm origin, adequate at field scale"""
+        return ((longitude - self.lon0) * 111320.0 * math.cos(math.radians(self.lat0)),
+                (latitude - self.lat0) * 110540.0)
+
+    async def initialize(self, db: aiosqlite.Connection):
+        await db.execute(DEVICE_LOCATIONS_DDL)
+        cursor = await db.execute("SELECT device_id, latitude, longitude FROM device_locations")
+        for device_id, latitude, longitude in await cursor.fetchall():
+            self.positions[device_id] = self.project(latitude, longitude)
+        # Bare columns of a MAX() aggregate come from the row holding the maximum
+        cursor = await db.execute(
+            "SELECT device_id, MAX(timestamp), soil_moisture FROM sensor_data "
+            "WHERE is_dummy = 0 AND soil_moisture IS NOT NULL GROUP BY device_id"
+        )
+        for device_id, timestamp, soil_moisture in await cursor.fetchall():
+            if device_id in self.positions:
+                self.latest[device_id] = (timestamp, soil_moisture)
+        self._relayout()
+
+    def _bump(self, device_id: str):
+        self.generation += 1
+        self.changed_at[device_id] = self.generation
+
+    def _relayout(self):
+        if not self.positions:
+            self.layout = None
+            self.cache.clear()
+            return
+        span = TILE_PX * MAP_RESOLUTION_M
+        pad = MAP_RADIUS_M / 2
+        xs = [p[0] for p in self.positions.values()]
+        ys = [p[1] for p in self.positions.values()]
+        x0 = math.floor((min(xs) - pad) / span) * span
+        y1 = math.ceil((max(ys) + pad) / span) * span
+        layout = (x0, y1,
+                  max(1, math.ceil((max(xs) + pad - x0) / span)),
+                  max(1, math.ceil((y1 - (min(ys) - pad)) / span)))
+        if layout != self.layout:
+            self.layout = layout
+            self.cache.clear()
+
+    async def set_location(self, device_id: str, latitude: float, longitude: float):
+        async with aiosqlite.connect(self.db_path) as db:
+            await db.execute(
+                "INSERT OR REPLACE INTO device_locations (device_id, latitude, longitude) VALUES (?, ?, ?)",
+                (device_id, latitude, longitude)
+            )
+            await db.commit()
+        self.positions[device_id] = self.project(latitude, longitude)
+        self._bump(device_id)
+        self._relayout()
+
+    def ingest_reading(self, device_id: str, timestamp: int, soil_moisture: Optional[float]):
+        """Ingest path hook: O(1), only marks the device as changed"""
+        if soil_moisture is None or device_id not in self.positions:
+            return
+        current = self.latest.get(device_id)
+        if current is None or timestamp >= current[0]:
+            self.latest[device_id] = (timestamp, soil_moisture)
+        self._bump(device_id)
+
+    # ==================== TILES ====================
+
+    def tile_origin(self, tx: int, ty: int) -> Tuple[float, float]:
+        x0, y1, _, _ = self.layout
+        span = TILE_PX * MAP_RESOLUTION_M
+        return x0 + tx * span, y1 - ty * span
+
+    def _tile_devices(self, tx: int, ty: int) -> List[str]:
+        """Devices within the interpolation radius of the tile's bounds"""
+        left, top = self.tile_origin(tx, ty)
+        span = TILE_PX * MAP_RESOLUTION_M
+        out = []
+        for device_id, (x, y) in self.positions.items():
+            dx = max(left - x, 0.0, x - (left + span))
+            dy = max((top - span) - y, 0.0, y - top)
+            if dx * dx + dy * dy <= MAP_RADIUS_M * MAP_RADIUS_M:
+                out.append(device_id)
+        return sorted(out)
+
+    async def _values(self, window: int, end: Optional[int]) -> Dict[str, float]:
+        """Latest value per device, or its mean over [end - window, end)"""
+        if not window:
+            return {d: v for d, (_, v) in self.latest.items()}
+        async with aiosqlite.connect(self.db_path) as db:
+            cursor = await db.execute(
+                "SELECT device_id, AVG(soil_moisture) FROM sensor_data "
+                "WHERE timestamp >= ? AND timestamp < ? AND is_dummy = 0 AND soil_moisture IS NOT NULL "
+                "GROUP BY device_id",
+                (end - window, end)
+            )
+            return {d: v for d, v in await cursor.fetchall() if d in self.positions}
+
+    @staticmethod
+    def _kriging_model(points: Sequence[Point]):
+        """(weights, variogram) shared by all tiles of a render; IDW below 3 devices"""
+        if len(points) < 3:
+            return None, None
+        variogram = fit_variogram(points, MAP_RADIUS_M)
+        return kriging_weights(points, variogram), variogram
+
+    def _pool(self) -> ProcessPoolExecutor:
+        if self.executor is None:
+            self.executor = ProcessPoolExecutor(max_workers=os.cpu_count() or 1)
+        return self.executor
+
+    async def tile(self, tx: int, ty: int, method: str = "idw", window: int = 0,
+                   end: Optional[int] = None, values: Optional[Dict[str, float]] = None,
+                   model=None) -> List[Optional[float]]:
+        """Values of one tile, from cache unless one of its devices changed"""
+        _, _, tiles_x, tiles_y = self.layout
+        if not (0 <= tx < tiles_x and 0 <= ty < tiles_y):
+            raise IndexError(f"tile {tx},{ty} outside {tiles_x}x{tiles_y}")
+
+        kriging = method == "kriging"
+        devices = sorted(self.positions) if kriging else self._tile_devices(tx, ty)
+        key = (tx, ty, method, window, end)
+        cached = self.cache.get(key)
+        if cached is not None:
+            generation, cached_devices, payload = cached
+            if cached_devices == devices and all(self.changed_at.get(d, 0) <= generation for d in devices):
+                self.cache.move_to_end(key)
+                return payload
+
+        generation = self.generation
+        if values is None:
+            values = await self._values(window, end)
+        points = [self.positions[d] + (values[d],) for d in devices if d in values]
+        weights = variogram = None
+        if kriging:
+            if model is None:
+                model = self._kriging_model(points)
+            weights, variogram = model
+        x0, y0 = self.tile_origin(tx, ty)
+        payload = await asyncio.get_running_loop().run_in_executor(
+            self._pool(), render_tile, points, x0, y0, MAP_RESOLUTION_M, MAP_RADIUS_M, weights, variogram
+        )
+        self.cache[key] = (generation, devices, payload)
+        if len(self.cache) > TILE_CACHE_SIZE:
+            self.cache.popitem(last=False)
+        return payload
+
+    async def raster(self, method: str = "idw", window: int = 0,
+                     end: Optional[int] = None) -> Tuple[List[Optional[float]], int, int]:
+        """Whole map, tiles rendered concurrently across the pool"""
+        _, _, tiles_x, tiles_y = self.layout
+        values = await self._values(window, end)
+        model = None
+        if method == "kriging":
+            model = self._kriging_model(
+                [self.positions[d] + (values[d],) for d in sorted(self.positions) if d in values]
+            )
+        tiles = await asyncio.gather(*(
+            self.tile(tx, ty, method, window, end, values, model)
+            for ty in range(tiles_y) for tx in range(tiles_x)
+        ))
+
+        width, height = tiles_x * TILE_PX, tiles_y * TILE_PX
+        grid: List[Optional[float]] = [None] * (width * height)
+        for index, payload in enumerate(tiles):
+            tx, ty = index % tiles_x, index // tiles_x
+            for row in range(TILE_PX):
+                start = (ty * TILE_PX + row) * width + tx * TILE_PX
+                grid[start:start + TILE_PX] = payload[row * TILE_PX:(row + 1) * TILE_PX]
+        return grid, width, height
+
+    def metadata(self) -> Dict:
+        if self.layout is None:
+            return {"tiles_x": 0, "tiles_y": 0, "devices": []}
+        x0, y1, tiles_x, tiles_y = self.layout
+        return {
+            "tile_px": TILE_PX,
+            "resolution_m": MAP_RESOLUTION_M,
+            "radius_m": MAP_RADIUS_M,
+            "origin_m": [x0, y1],
+            "tiles_x": tiles_x,
+            "tiles_y": tiles_y,
+            "generation": self.generation,
+            "devices": [
+                {"device_id": d, "x_m": round(x, 1), "y_m": round(y, 1),
+                 "soil_moisture": self.latest.get(d, (None, None))[1]}
+                for d, (x, y) in sorted(self.positions.items())
+            ],
+        }
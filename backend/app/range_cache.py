@@ -0,0 +1,180 @@
+"""
+Cache of bucketed history ranges, extended at the tail
+
+Dashboards ask for the same 24 h and 7 day series again and again, and
+between two asks only the newest buckets change. For each (device,
+metric, resolution) the cache keeps count/sum/min/max of a run of whole
+buckets [start, covered). A request (widened to whole buckets) is served
+from that run and only [covered, end) is read from the tiered store; the
+buckets of it that are complete (ended before now) are appended, the
+open one is recomputed every time.
+
+Invalidation follows ingest: the tiered store tails sensor_data by rowid,
+so it sees the rows of every worker and of backfills. Each tailed row
+is a per-device watermark: a cached run of that device covering the row's
+timestamp is cut back to the row's bucket and re-read from there on the
+next request. Rows in order (the usual case) land past `covered` and cut
+nothing. Runs also expire after CACHE_MAX_AGE_S, which bounds staleness
+from archive compaction dropping duplicates.
+"""
+import os
+import time
+from bisect import bisect_left
+from collections import OrderedDict
+from typing import Dict, List, Sequence, Set, Tuple
+
+from app.tiered_store import TieredStore, TS
+
+CACHE_ENTRIES = int(os.getenv("RANGE_CACHE_ENTRIES", "512"))
+CACHE_MAX_AGE_S = 3600
+MAX_RUN_BUCKETS = 20000
+
+Key = Tuple[str, str, int]      # device_id, metric, resolution
+
+
+class Run:
+    """Whole-bucket aggregates of one series, [start, covered)"""
+    __slots__ = ("start", "covered", "starts", "aggs", "created")
+
+    def __init__(self, start: int, now: float):
+        self.start = start
+        self.covered = start
+        self.starts: List[int] = []
+        self.aggs: List[List] = []      # [count, sum, min, max] of non-empty buckets
+        self.created = now
+
+    def cut(self, at: int):
+        """Forget buckets from `at` on"""
+        if at < self.covered:
+            keep = bisect_left(self.starts, at)
+            del self.starts[keep:]
+            del self.aggs[keep:]
+            self.covered = max(self.start, at)
+
+    def extend(self, buckets: Dict[int, List], covered: int):
+        for start in sorted(buckets):
+            if self.covered <= start < covered:
+                self.starts.append(start)
+                self.aggs.append(buckets[start])
+        self.covered = covered
+        if len(self.starts) > MAX_RUN_BUCKETS:
+            drop = len(self.starts) - MAX_RUN_BUCKETS
+            self.start = self.starts[drop]
+            del self.starts[:drop]
+            del self.aggs[:drop]
+
+    def between(self, start: int, end: int) -> List[Tuple[int, List]]:
+        lo = bisect_left(self.starts, start)
+        hi = bisect_left(self.starts, end)
+        return list(zip(self.starts[lo:hi], self.aggs[lo:hi]))
+
+
+class RangeCache:
+    def __init__(self, store: TieredStore, entries: int = CACHE_ENTRIES):
+        self.store = store
+        self.entries = entries
+        self.runs: "OrderedDict[Key, Run]" = OrderedDict()
+        self.by_device: Dict[str, Set[Key]] = {}
+        self.hits = 0
+        self.misses = 0
+        store.tail_listeners.append(self.observe)
+
+    def observe(self, rows: List[tuple]):
+        """Tail hook: earliest new timestamp per device cuts its runs back"""
+        low: Dict[str, int] = {}
+        for row in rows:
+            device_id, ts = row[1], row[TS]
+            if ts < low.get(device_id, ts + 1):
+                low[device_id] = ts
+        for device_id, ts in low.items():
+            for key in list(self.by_device.get(device_id, ())):
+                run = self.runs[key]
+                run.cut(ts - ts % key[2])
+                if run.covered <= run.start:
+                    self._drop(key)
+
+    def _drop(self, key: Key):
+        del self.runs[key]
+        keys = self.by_device[key[0]]
+        keys.discard(key)
+        if not keys:
+            del self.by_device[key[0]]
+
+    def _run(self, key: Key, start: int, now: float) -> Run:
+        run = self.runs.get(key)
+        if run is not None and (run.start > start or run.covered < start
+                                or now - run.created > CACHE_MAX_AGE_S):
+            self._drop(key)
+            run = None
+        if run is None:
+            run = self.runs[key] = Run(start, now)
+            self.by_device.setdefault(key[0], set()).add(key)
+            while len(self.runs) > self.entries:
+                self._drop(next(iter(self.runs)))
+        else:
+            self.runs.move_to_end(key)
+        return run
+
+    async def series(self, db, device_id: str, metrics: Sequence[str], start: int, end: int,
+                     resolution: int) -> Tuple[List[Dict], Dict]:
+        """Per-bucket mean/min/max/count of metrics over whole buckets covering [start, end)"""
+        start -= start % resolution
+        end += -end % resolution
+        await self.store.refresh(db)        # Applies any watermarks first
+        now = time.time()
+        complete = min(end, int(now) - int(now) % resolution)
+
+        runs = {metric: self._run((device_id, metric, resolution), start, now) for metric in metrics}
+        # Snapshot before reading: the read itself tails the store and may cut runs
+        covered = {metric: run.covered for metric, run in runs.items()}
+        served = {metric: run.between(start, min(run.covered, end)) for metric, run in runs.items()}
+        fetch_from = min(max(c, start) for c in covered.values())
+        cached = sum(max(0, min(c, end) - start) // resolution for c in covered.values())
+
+        fresh: Dict[str, Dict[int, List]] = {metric: {} for metric in metrics}
+        rows_read = 0
+        if fetch_from < end:
+            picks = list(metrics)
+            async for chunk in self.store.iter_chunks(db, device_id, fetch_from, end, ("timestamp", *picks)):
+                rows_read += len(chunk)
+                for row in chunk:
+                    ts = row[0]
+                    bucket = ts - ts % resolution
+                    for i, metric in enumerate(picks, 1):
+                        value = row[i]
+                        if value is None or ts < covered[metric]:
+                            continue
+                        agg = fresh[metric].get(bucket)
+                        if agg is None:
+                            fresh[metric][bucket] = [1, value, value, value]
+                        else:
+                            agg[0] += 1
+                            agg[1] += value
+                            if value < agg[2]:
+                                agg[2] = value
+                            if value > agg[3]:
+                                agg[3] = value
+
+        by_bucket: Dict[int, Dict] = {}
+        for metric, run in runs.items():
+            current = self.runs.get((device_id, metric, resolution)) is run and run.covered == covered[metric]
+            if current and complete > run.covered:
+                run.extend(fresh[metric], complete)
+            for bucket, (count, total, low, high) in served[metric] + sorted(fresh[metric].items()):
+                by_bucket.setdefault(bucket, {})[metric] = {
+                    "mean": round(total / count, 3), "min": low, "max": high, "count": count
+                }
+        if cached:
+            self.hits += 1
+        else:
+            self.misses += 1
+        data = [{"timestamp": bucket, **by_bucket[bucket]} for bucket in sorted(by_bucket)]
+        return data, {"cached_buckets": cached, "fetched_from": fetch_from, "rows_read": rows_read}
+
+    def stats(self) -> Dict:
+        return {
+            "runs": len(self.runs),
+            "buckets": sum(len(run.starts) for run in self.runs.values()),
+            "hits": self.hits,
+            "misses": self.misses,
+        }
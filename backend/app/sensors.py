@@ -124,10 +124,9 @@ class SensorManager:
 
         # NPK readings (change more slowly)
         npk_readings = NPKReading(
-            nitrogen=max(50, min(250, self.base_values['nitrogen'] + random.gauss(0, 2))),
-            phosphorus=max(20, min(80, self.base_values['phosphorus'] + random.gauss(0, 1))),
-            potassium=max(100, min(300, self.base_values['potassium'] + random.gauss(0, 3))),
-            timestamp=now
+            nitrogen=round(max(50, min(250, self.base_values['nitrogen'] + random.gauss(0, 2)))),
+            phosphorus=round(max(20, min(80, self.base_values['phosphorus'] + random.gauss(0, 1)))),
+            potassium=round(max(100, min(300, self.base_values['potassium'] + random.gauss(0, 3))))
         )
 
         # Create sensor reading
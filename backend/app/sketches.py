@@ -0,0 +1,332 @@
+"""
+Hourly quantile sketches per device and metric
+
+Each metric of each device gets a DDSketch per SKETCH_BUCKET_S bucket.
+Values land in logarithmic bins of width gamma = (1 + a) / (1 - a), so
+any quantile comes back within relative error a (SKETCH_RELATIVE_ACCURACY,
+default 1%) of a true value; zero and near-zero values are counted apart.
+A sketch keeps at most SKETCH_MAX_BINS bins per sign and collapses its
+lowest bins when it would grow past that, so storage is bounded and the
+upper quantiles stay exact to a. Sketches merge by adding bin counts, so
+p5/p50/p95 over any range is the merge of its bucket sketches, with no
+scan of raw data.
+
+Ingest adds readings to this worker's in-memory sketches; a background
+flush merges them into rollup_sketches under one write transaction, so
+workers never overwrite each other. Queries merge this worker's unflushed
+sketches too; other workers' last SKETCH_FLUSH_S seconds show up after
+their next flush. Rows imported around ingest (app/backfill.py) are
+sketched with the rebuild CLI:
+
+    python -m app.sketches --db agriculture_monitor.db --device pico_1 \
+        --start 1714521600 --end 1730419200
+"""
+import os
+import sys
+import math
+import time
+import struct
+import asyncio
+import argparse
+import logging
+from typing import Dict, Iterable, List, Optional, Sequence, Tuple
+
+import aiosqlite
+
+from app.telemetry_schema import COLUMNS
+from app.tiered_store import TieredStore
+
+logger = logging.getLogger(__name__)
+
+SKETCH_RELATIVE_ACCURACY = float(os.getenv("SKETCH_RELATIVE_ACCURACY", "0.01"))
+SKETCH_MAX_BINS = int(os.getenv("SKETCH_MAX_BINS", "256"))
+SKETCH_BUCKET_S = 3600
+SKETCH_FLUSH_S = 60
+MIN_INDEXABLE = 1e-9
+METRICS = tuple(name for name, _, _ in COLUMNS)
+
+SKETCH_DDL = """
+    CREATE TABLE IF NOT EXISTS rollup_sketches (
+        device_id TEXT NOT NULL,
+        metric TEXT NOT NULL,
+        bucket_start INTEGER NOT NULL,
+        count INTEGER NOT NULL,
+        sketch BLOB NOT NULL,
+        PRIMARY KEY (device_id, metric, bucket_start)
+    ) WITHOUT ROWID
+"""
+
+HEADER = struct.Struct("<dHQQdddHH")    # accuracy, max bins, zeros, count, min, max, sum, bins, negative bins
+
+
+class DDSketch:
+    """Mergeable relative-error quantile sketch with bounded bins"""
+    __slots__ = ("accuracy", "max_bins", "log_gamma", "bins", "negative",
+                 "zeros", "count", "min", "max", "sum")
+
+    def __init__(self, accuracy: float = SKETCH_RELATIVE_ACCURACY, max_bins: int = SKETCH_MAX_BINS):
+        self.accuracy = accuracy
+        self.max_bins = max_bins
+        self.log_gamma = math.log((1 + accuracy) / (1 - accuracy))
+        self.bins: Dict[int, int] = {}          # key -> count, positive values
+        self.negative: Dict[int, int] = {}      # key of -x -> count
+        self.zeros = 0
+        self.count = 0
+        self.min = math.inf
+        self.max = -math.inf
+        self.sum = 0.0
+
+    def _key(self, x: float) -> int:
+        return math.ceil(math.log(x) / self.log_gamma)
+
+    def _value(self, key: int) -> float:
+        """Bin midpoint: within the relative accuracy of every value in the bin"""
+        return 2 * math.exp(key * self.log_gamma) / (1 + math.exp(self.log_gamma))
+
+    def _collapse(self, store: Dict[int, int]):
+        """Fold the lowest keys into one so at most max_bins remain"""
+        keys = sorted(store)
+        cut = len(keys) - self.max_bins
+        store[keys[cut]] += sum(store.pop(k) for k in keys[:cut])
+
+    def add(self, x: float, n: int = 1):
+        if x != x:
+            return
+        if x > MIN_INDEXABLE:
+            store, key = self.bins, self._key(x)
+        elif x < -MIN_INDEXABLE:
+            store, key = self.negative, self._key(-x)
+        else:
+            store = None
+            self.zeros += n
+        if store is not None:
+            store[key] = store.get(key, 0) + n
+            if len(store) > self.max_bins:
+                self._collapse(store)
+        self.count += n
+        self.sum += x * n
+        if x < self.min:
+            self.min = x
+        if x > self.max:
+            self.max = x
+
+    def merge(self, other: "DDSketch"):
+        if not other.count:
+            return
+        if other.accuracy != self.accuracy:
+            # Written under another setting: re-bin its bin midpoints
+            kept = (self.count, self.sum, self.min, self.max)
+            for key, n in other.bins.items():
+                self.add(other._value(key), n)
+            for key, n in other.negative.items():
+                self.add(-other._value(key), n)
+            self.count, self.sum, self.min, self.max = kept
+        else:
+            for store, theirs in ((self.bins, other.bins), (self.negative, other.negative)):
+                for key, n in theirs.items():
+                    store[key] = store.get(key, 0) + n
+                if len(store) > self.max_bins:
+                    self._collapse(store)
+        self.zeros += other.zeros
+        self.count += other.count
+        self.sum += other.sum
+        self.min = min(self.min, other.min)
+        self.max = max(self.max, other.max)
+
+    def quantile(self, q: float) -> Optional[float]:
+        if not self.count:
+            return None
+        rank = q * (self.count - 1)
+        seen = 0
+        for key in sorted(self.negative, reverse=True):
+            seen += self.negative[key]
+            if seen > rank:
+                return max(self.min, -self._value(key))
+        seen += self.zeros
+        if seen > rank:
+            return 0.0
+        for key in sorted(self.bins):
+            seen += self.bins[key]
+            if seen > rank:
+                return min(self.max, max(self.min, self._value(key)))
+        return self.max
+
+    def fraction_below(self, x: float) -> Optional[float]:
+        """Share of values under x, to bin resolution"""
+        if not self.count:
+            return None
+        if x <= self.min:
+            return 0.0
+        if x > self.max:
+            return 1.0
+        below = sum(n for key, n in self.negative.items() if -self._value(key) < x)
+        below += self.zeros if x > 0 else 0
+        below += sum(n for key, n in self.bins.items() if self._value(key) < x)
+        return below / self.count
+
+    def to_bytes(self) -> bytes:
+        out = [HEADER.pack(self.accuracy, self.max_bins, self.zeros, self.count,
+                           self.min, self.max, self.sum, len(self.bins), len(self.negative))]
+        for store in (self.bins, self.negative):
+            keys = sorted(store)
+            out.append(struct.pack(f"<{len(keys)}i{len(keys)}Q", *keys, *(store[k] for k in keys)))
+        return b"".join(out)
+
+    @classmethod
+    def from_bytes(cls, blob: bytes) -> "DDSketch":
+        accuracy, max_bins, zeros, count, low, high, total, n_bins, n_negative = HEADER.unpack_from(blob, 0)
+        sketch = cls(accuracy, max_bins)
+        sketch.zeros, sketch.count, sketch.min, sketch.max, sketch.sum = zeros, count, low, high, total
+        pos = HEADER.size
+        for store, n in ((sketch.bins, n_bins), (sketch.negative, n_negative)):
+            values = struct.unpack_from(f"<{n}i{n}Q", blob, pos)
+            store.update(zip(values[:n], values[n:]))
+            pos += 12 * n
+        return sketch
+
+
+class SketchRollups:
+    """This worker's unflushed bucket sketches, and the stored ones"""
+
+    def __init__(self):
+        self.pending: Dict[Tuple[str, str, int], DDSketch] = {}
+
+    def add(self, readings: Iterable[Tuple[str, int, Dict]]):
+        """Ingest hook: (device_id, timestamp, {column: value}) readings"""
+        for device_id, timestamp, values in readings:
+            start = timestamp - timestamp % SKETCH_BUCKET_S
+            for name in METRICS:
+                value = values.get(name)
+                if value is None:
+                    continue
+                key = (device_id, name, start)
+                sketch = self.pending.get(key)
+                if sketch is None:
+                    sketch = self.pending[key] = DDSketch()
+                sketch.add(float(value))
+
+    async def flush(self, db) -> int:
+        """Merge pending sketches into the store; one transaction"""
+        pending, self.pending = self.pending, {}
+        if not pending:
+            return 0
+        try:
+            await db.execute("BEGIN IMMEDIATE")
+            for key, sketch in pending.items():
+                await merge_into(db, key, sketch)
+            await db.commit()
+        except Exception:
+            # Keep them for the next flush
+            for key, sketch in pending.items():
+                if key in self.pending:
+                    sketch.merge(self.pending[key])
+                self.pending[key] = sketch
+            raise
+        return len(pending)
+
+    async def buckets(self, db, device_id: str, metric: str, start: int, end: int) -> List[Tuple[int, DDSketch]]:
+        """(bucket_start, sketch) of every bucket that starts in [start, end)"""
+        cursor = await db.execute(
+            "SELECT bucket_start, sketch FROM rollup_sketches "
+            "WHERE device_id = ? AND metric = ? AND bucket_start >= ? AND bucket_start < ?",
+            (device_id, metric, start - start % SKETCH_BUCKET_S, end)
+        )
+        found = {bucket_start: DDSketch.from_bytes(blob) for bucket_start, blob in await cursor.fetchall()}
+        for (pending_device, pending_metric, bucket_start), sketch in self.pending.items():
+            if pending_device == device_id and pending_metric == metric and \
+                    start - start % SKETCH_BUCKET_S <= bucket_start < end:
+                found.setdefault(bucket_start, DDSketch()).merge(sketch)
+        return sorted(found.items())
+
+
+async def merge_into(db, key: Tuple[str, str, int], sketch: DDSketch):
+    """Add a sketch to the stored one of its bucket"""
+    cursor = await db.execute(
+        "SELECT sketch FROM rollup_sketches WHERE device_id = ? AND metric = ? AND bucket_start = ?", key
+    )
+    row = await cursor.fetchone()
+    if row is not None:
+        stored = DDSketch.from_bytes(row[0])
+        stored.merge(sketch)
+        sketch = stored
+    await db.execute(
+        "INSERT OR REPLACE INTO rollup_sketches (device_id, metric, bucket_start, count, sketch) "
+        "VALUES (?, ?, ?, ?, ?)",
+        (*key, sketch.count, sketch.to_bytes())
+    )
+
+
+def summarize(buckets: Sequence[Tuple[int, DDSketch]], quantiles: Sequence[float],
+              below: Optional[float] = None) -> Dict:
+    """Quantiles over merged buckets; hours_below sums each bucket's share under `below`"""
+    merged = DDSketch()
+    for _, sketch in buckets:
+        merged.merge(sketch)
+    summary = {
+        "buckets": len(buckets),
+        "count": merged.count,
+        "min": merged.min if merged.count else None,
+        "max": merged.max if merged.count else None,
+        "mean": round(merged.sum / merged.count, 4) if merged.count else None,
+        "quantiles": {str(q): merged.quantile(q) for q in quantiles},
+        "relative_accuracy": merged.accuracy,
+    }
+    if below is not None:
+        # Readings are evenly spaced within an hour, so the share of
+        # readings is the share of time
+        summary["below"] = below
+        summary["fraction_below"] = merged.fraction_below(below)
+        summary["hours_below"] = round(sum(
+            sketch.fraction_below(below) * SKETCH_BUCKET_S for _, sketch in buckets if sketch.count
+        ) / 3600, 2)
+    return summary
+
+
+async def rebuild(db, store: TieredStore, device_ids: Sequence[str], start: int, end: int) -> int:
+    """Replace the sketches of whole buckets in [start, end) from stored rows"""
+    start -= start % SKETCH_BUCKET_S
+    end += -end % SKETCH_BUCKET_S
+    written = 0
+    for device_id in device_ids:
+        rollups = SketchRollups()
+        async for chunk in store.iter_chunks(db, device_id, start, end, ("timestamp", *METRICS, "is_dummy")):
+            rollups.add(
+                (device_id, row[0], dict(zip(METRICS, row[1:-1]))) for row in chunk if not row[-1]
+            )
+        await db.execute("BEGIN IMMEDIATE")
+        await db.execute(
+            "DELETE FROM rollup_sketches WHERE device_id = ? AND bucket_start >= ? AND bucket_start < ?",
+            (device_id, start, end)
+        )
+        for key, sketch in rollups.pending.items():
+            await merge_into(db, key, sketch)
+        await db.commit()
+        written += len(rollups.pending)
+    return written
+
+
+async def _rebuild(args) -> int:
+    async with aiosqlite.connect(args.db) as db:
+        store = TieredStore(args.db)
+        await store.open_catalog(db)
+        await db.execute(SKETCH_DDL)
+        await db.commit()
+        return await rebuild(db, store, args.device, args.start, args.end)
+
+
+def main(argv: Optional[List[str]] = None) -> int:
+    parser = argparse.ArgumentParser(description="Rebuild hourly quantile sketches from stored readings")
+    parser.add_argument("--db", default=os.getenv("DATABASE_PATH", "agriculture_monitor.db"))
+    parser.add_argument("--device", action="append", required=True, help="Repeat for several devices")
+    parser.add_argument("--start", type=int, default=0)
+    parser.add_argument("--end", type=int, default=int(time.time()) + SKETCH_BUCKET_S)
+    args = parser.parse_args(argv)
+
+    started = time.perf_counter()
+    written = asyncio.run(_rebuild(args))
+    print(f"📐 {written} bucket sketches in {time.perf_counter() - started:.1f}s", file=sys.stderr)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,99 @@
+"""
+Telemetry Pydantic models - GENERATED by generate_schema.py from Pico/telemetry_schema.h
+Do not edit by hand: change the X-macro header and re-run the generator.
+
+One model per record type, in the API shape (dotted keys nest). Fields
+are optional like the decoders' columns: absent ones stay None.
+"""
+from datetime import datetime
+from typing import Optional
+
+from pydantic import BaseModel, Field
+
+
+class LegacyJsonNpk(BaseModel):
+    """Schema 1 "npk" object"""
+    nitrogen: Optional[int] = Field(None, ge=0, description="Nitrogen in mg/kg")
+    phosphorus: Optional[int] = Field(None, ge=0, description="Phosphorus in mg/kg")
+    potassium: Optional[int] = Field(None, ge=0, description="Potassium in mg/kg")
+
+
+class LegacyJsonReading(BaseModel):
+    """Schema 1: Unversioned JSON from earlier firmware"""
+    timestamp: datetime = Field(default_factory=datetime.utcnow)
+    soil_moisture: Optional[float] = Field(None, ge=0, le=100, description="Soil moisture percentage")
+    soil_temperature: Optional[float] = Field(None, description="Soil temperature in Celsius")
+    humidity: Optional[float] = Field(None, ge=0, le=100, description="Air humidity percentage")
+    light_intensity: Optional[float] = Field(None, ge=0, le=100, description="Light intensity percentage")
+    soil_ph: Optional[float] = Field(None, ge=0, le=14, description="Soil pH")
+    npk: LegacyJsonNpk = Field(default_factory=LegacyJsonNpk)
+
+    class Config:
+        json_encoders = {
+            datetime: lambda v: v.isoformat()
+        }
+
+
+class PicoEnvReading(BaseModel):
+    """Schema 2: Pico W node: soil moisture, DHT22, LDR"""
+    timestamp: datetime = Field(default_factory=datetime.utcnow)
+    soil_moisture: Optional[float] = Field(None, ge=0, le=100, description="Soil moisture percentage")
+    soil_temperature: Optional[float] = Field(None, description="Soil temperature in Celsius")
+    humidity: Optional[float] = Field(None, ge=0, le=100, description="Air humidity percentage")
+    light_intensity: Optional[float] = Field(None, ge=0, le=100, description="Light intensity percentage")
+
+    class Config:
+        json_encoders = {
+            datetime: lambda v: v.isoformat()
+        }
+
+
+class NpkSerialReading(BaseModel):
+    """Schema 3: NPK probe node through relay.py"""
+    timestamp: datetime = Field(default_factory=datetime.utcnow)
+    soil_moisture: Optional[float] = Field(None, ge=0, le=100, description="Soil moisture percentage")
+    soil_temperature: Optional[float] = Field(None, description="Soil temperature in Celsius")
+    soil_ph: Optional[float] = Field(None, ge=0, le=14, description="Soil pH")
+    soil_conductivity: Optional[float] = Field(None, ge=0, description="Soil conductivity in uS/cm")
+    nitrogen: Optional[int] = Field(None, ge=0, description="Nitrogen in mg/kg")
+    phosphorus: Optional[int] = Field(None, ge=0, description="Phosphorus in mg/kg")
+    potassium: Optional[int] = Field(None, ge=0, description="Potassium in mg/kg")
+
+    class Config:
+        json_encoders = {
+            datetime: lambda v: v.isoformat()
+        }
+
+
+class LegacyStationNpk(BaseModel):
+    """Schema 4 "npk" object"""
+    nitrogen: Optional[int] = Field(None, ge=0, description="Nitrogen in mg/kg")
+    phosphorus: Optional[int] = Field(None, ge=0, description="Phosphorus in mg/kg")
+    potassium: Optional[int] = Field(None, ge=0, description="Potassium in mg/kg")
+
+
+class LegacyStationReading(BaseModel):
+    """Schema 4: sensor_readings station layout"""
+    timestamp: datetime = Field(default_factory=datetime.utcnow)
+    soil_moisture: Optional[float] = Field(None, ge=0, le=100, description="Soil moisture percentage")
+    soil_temperature: Optional[float] = Field(None, description="Soil temperature in Celsius")
+    soil_ph: Optional[float] = Field(None, ge=0, le=14, description="Soil pH")
+    soil_conductivity: Optional[float] = Field(None, ge=0, description="Soil conductivity in uS/cm")
+    air_temperature: Optional[float] = Field(None, description="Air temperature in Celsius")
+    humidity: Optional[float] = Field(None, ge=0, le=100, description="Air humidity percentage")
+    atmospheric_pressure: Optional[float] = Field(None, description="Atmospheric pressure in hPa")
+    npk: LegacyStationNpk = Field(default_factory=LegacyStationNpk)
+
+    class Config:
+        json_encoders = {
+            datetime: lambda v: v.isoformat()
+        }
+
+
+# schema_id -> model
+MODELS = {
+    1: LegacyJsonReading,
+    2: PicoEnvReading,
+    3: NpkSerialReading,
+    4: LegacyStationReading,
+}
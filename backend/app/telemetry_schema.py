@@ -0,0 +1,532 @@
+"""
+Telemetry schema - GENERATED by generate_schema.py from Pico/telemetry_schema.h
+Do not edit by hand: change the X-macro header and re-run the generator.
+"""
+from math import isfinite
+
+
+class SchemaError(ValueError):
+    """Payload does not match its record type"""
+
+
+# JSON numbers; exact types, so booleans (an int subclass) are rejected.
+# NaN and Infinity parse as floats and are rejected with isfinite().
+NUMBER_TYPES = (int, float)
+
+
+# schema_id -> (name, description)
+RECORD_TYPES = {
+    1: ("legacy_json", "Unversioned JSON from earlier firmware"),
+    2: ("pico_env", "Pico W node: soil moisture, DHT22, LDR"),
+    3: ("npk_serial", "NPK probe node through relay.py"),
+    4: ("legacy_station", "sensor_readings station layout"),
+}
+
+DEFAULT_SCHEMA_ID = 1  # Payloads without schema_id
+
+# Store columns: (name, sql type, description)
+COLUMNS = (
+    ("soil_moisture", "REAL", "Soil moisture percentage"),
+    ("soil_temperature", "REAL", "Soil temperature in Celsius"),
+    ("humidity", "REAL", "Air humidity percentage"),
+    ("light_intensity", "REAL", "Light intensity percentage"),
+    ("soil_ph", "REAL", "Soil pH"),
+    ("nitrogen", "INTEGER", "Nitrogen in mg/kg"),
+    ("phosphorus", "INTEGER", "Phosphorus in mg/kg"),
+    ("potassium", "INTEGER", "Potassium in mg/kg"),
+    ("soil_conductivity", "REAL", "Soil conductivity in uS/cm"),
+    ("air_temperature", "REAL", "Air temperature in Celsius"),
+    ("atmospheric_pressure", "REAL", "Atmospheric pressure in hPa"),
+)
+
+SENSOR_DATA_DDL = """
+    CREATE TABLE IF NOT EXISTS sensor_data (
+        id INTEGER PRIMARY KEY AUTOINCREMENT,
+        device_id TEXT NOT NULL,
+        timestamp INTEGER NOT NULL,
+        raw_timestamp INTEGER,
+        schema_id INTEGER,
+        seq INTEGER,
+        boot_id INTEGER,
+        soil_moisture REAL,
+        soil_temperature REAL,
+        humidity REAL,
+        light_intensity REAL,
+        soil_ph REAL,
+        nitrogen INTEGER,
+        phosphorus INTEGER,
+        potassium INTEGER,
+        soil_conductivity REAL,
+        air_temperature REAL,
+        atmospheric_pressure REAL,
+        is_dummy INTEGER DEFAULT 0,
+        created_at DATETIME DEFAULT CURRENT_TIMESTAMP
+    )
+"""
+
+# Every optional column; databases created by older releases get the
+# missing ones with ALTER TABLE ADD COLUMN
+SENSOR_DATA_MIGRATIONS = (
+    ("raw_timestamp", "INTEGER"),
+    ("schema_id", "INTEGER"),
+    ("seq", "INTEGER"),
+    ("boot_id", "INTEGER"),
+    ("soil_moisture", "REAL"),
+    ("soil_temperature", "REAL"),
+    ("humidity", "REAL"),
+    ("light_intensity", "REAL"),
+    ("soil_ph", "REAL"),
+    ("nitrogen", "INTEGER"),
+    ("phosphorus", "INTEGER"),
+    ("potassium", "INTEGER"),
+    ("soil_conductivity", "REAL"),
+    ("air_temperature", "REAL"),
+    ("atmospheric_pressure", "REAL"),
+)
+
+INSERT_LEGACY_JSON = (
+    "INSERT INTO sensor_data (device_id, timestamp, raw_timestamp, schema_id, seq, boot_id, soil_moisture, soil_temperature, humidity, light_intensity, soil_ph, nitrogen, phosphorus, potassium, is_dummy) "
+    "VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?)"
+)
+
+
+def decode_legacy_json(payload, is_dummy=0):
+    """Schema 1: Unversioned JSON from earlier firmware"""
+    device_id = payload["device_id"]
+    if type(device_id) is not str:
+        raise SchemaError("device_id must be a string")
+    timestamp = payload["timestamp"]
+    if type(timestamp) not in NUMBER_TYPES or not isfinite(timestamp):
+        raise SchemaError("timestamp must be a finite number")
+    timestamp = int(timestamp)
+    seq = payload.get("seq")
+    if seq is not None and (type(seq) is not int or seq < 0):
+        raise SchemaError("seq must be a non-negative integer")
+    boot_id = payload.get("boot_id")
+    if boot_id is not None and (type(boot_id) is not int or boot_id < 0):
+        raise SchemaError("boot_id must be a non-negative integer")
+    npk = payload.get("npk") or {}
+    if type(npk) is not dict:
+        raise SchemaError("npk must be an object")
+    soil_moisture = payload.get("soil_moisture")
+    if soil_moisture is not None:
+        if type(soil_moisture) not in NUMBER_TYPES or not isfinite(soil_moisture):
+            raise SchemaError("soil_moisture must be a finite number")
+        if soil_moisture < 0 or soil_moisture > 100:
+            raise SchemaError("soil_moisture out of range")
+    soil_temperature = payload.get("soil_temperature")
+    if soil_temperature is not None:
+        if type(soil_temperature) not in NUMBER_TYPES or not isfinite(soil_temperature):
+            raise SchemaError("soil_temperature must be a finite number")
+    humidity = payload.get("humidity")
+    if humidity is not None:
+        if type(humidity) not in NUMBER_TYPES or not isfinite(humidity):
+            raise SchemaError("humidity must be a finite number")
+        if humidity < 0 or humidity > 100:
+            raise SchemaError("humidity out of range")
+    light_intensity = payload.get("light_intensity")
+    if light_intensity is not None:
+        if type(light_intensity) not in NUMBER_TYPES or not isfinite(light_intensity):
+            raise SchemaError("light_intensity must be a finite number")
+        if light_intensity < 0 or light_intensity > 100:
+            raise SchemaError("light_intensity out of range")
+    soil_ph = payload.get("soil_ph")
+    if soil_ph is not None:
+        if type(soil_ph) not in NUMBER_TYPES or not isfinite(soil_ph):
+            raise SchemaError("soil_ph must be a finite number")
+        if soil_ph < 0 or soil_ph > 14:
+            raise SchemaError("soil_ph out of range")
+    nitrogen = npk.get("nitrogen")
+    if nitrogen is not None:
+        if type(nitrogen) not in NUMBER_TYPES or not isfinite(nitrogen):
+            raise SchemaError("nitrogen must be a finite number")
+        if nitrogen < 0:
+            raise SchemaError("nitrogen out of range")
+    phosphorus = npk.get("phosphorus")
+    if phosphorus is not None:
+        if type(phosphorus) not in NUMBER_TYPES or not isfinite(phosphorus):
+            raise SchemaError("phosphorus must be a finite number")
+        if phosphorus < 0:
+            raise SchemaError("phosphorus out of range")
+    potassium = npk.get("potassium")
+    if potassium is not None:
+        if type(potassium) not in NUMBER_TYPES or not isfinite(potassium):
+            raise SchemaError("potassium must be a finite number")
+        if potassium < 0:
+            raise SchemaError("potassium out of range")
+    return (
+        device_id,
+        timestamp,
+        timestamp,
+        1,
+        seq,
+        boot_id,
+        soil_moisture,
+        soil_temperature,
+        humidity,
+        light_intensity,
+        soil_ph,
+        nitrogen,
+        phosphorus,
+        potassium,
+        is_dummy,
+    )
+
+INSERT_PICO_ENV = (
+    "INSERT INTO sensor_data (device_id, timestamp, raw_timestamp, schema_id, seq, boot_id, soil_moisture, soil_temperature, humidity, light_intensity, is_dummy) "
+    "VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?)"
+)
+
+
+def decode_pico_env(payload, is_dummy=0):
+    """Schema 2: Pico W node: soil moisture, DHT22, LDR"""
+    device_id = payload["device_id"]
+    if type(device_id) is not str:
+        raise SchemaError("device_id must be a string")
+    timestamp = payload["timestamp"]
+    if type(timestamp) not in NUMBER_TYPES or not isfinite(timestamp):
+        raise SchemaError("timestamp must be a finite number")
+    timestamp = int(timestamp)
+    seq = payload.get("seq")
+    if seq is not None and (type(seq) is not int or seq < 0):
+        raise SchemaError("seq must be a non-negative integer")
+    boot_id = payload.get("boot_id")
+    if boot_id is not None and (type(boot_id) is not int or boot_id < 0):
+        raise SchemaError("boot_id must be a non-negative integer")
+    soil_moisture = payload.get("soil_moisture")
+    if soil_moisture is not None:
+        if type(soil_moisture) not in NUMBER_TYPES or not isfinite(soil_moisture):
+            raise SchemaError("soil_moisture must be a finite number")
+        if soil_moisture < 0 or soil_moisture > 100:
+            raise SchemaError("soil_moisture out of range")
+    soil_temperature = payload.get("soil_temperature")
+    if soil_temperature is not None:
+        if type(soil_temperature) not in NUMBER_TYPES or not isfinite(soil_temperature):
+            raise SchemaError("soil_temperature must be a finite number")
+    humidity = payload.get("humidity")
+    if humidity is not None:
+        if type(humidity) not in NUMBER_TYPES or not isfinite(humidity):
+            raise SchemaError("humidity must be a finite number")
+        if humidity < 0 or humidity > 100:
+            raise SchemaError("humidity out of range")
+    light_intensity = payload.get("light_intensity")
+    if light_intensity is not None:
+        if type(light_intensity) not in NUMBER_TYPES or not isfinite(light_intensity):
+            raise SchemaError("light_intensity must be a finite number")
+        if light_intensity < 0 or light_intensity > 100:
+            raise SchemaError("light_intensity out of range")
+    return (
+        device_id,
+        timestamp,
+        timestamp,
+        2,
+        seq,
+        boot_id,
+        soil_moisture,
+        soil_temperature,
+        humidity,
+        light_intensity,
+        is_dummy,
+    )
+
+INSERT_NPK_SERIAL = (
+    "INSERT INTO sensor_data (device_id, timestamp, raw_timestamp, schema_id, seq, boot_id, soil_moisture, soil_temperature, soil_ph, soil_conductivity, nitrogen, phosphorus, potassium, is_dummy) "
+    "VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?)"
+)
+
+
+def decode_npk_serial(payload, is_dummy=0):
+    """Schema 3: NPK probe node through relay.py"""
+    device_id = payload["device_id"]
+    if type(device_id) is not str:
+        raise SchemaError("device_id must be a string")
+    timestamp = payload["timestamp"]
+    if type(timestamp) not in NUMBER_TYPES or not isfinite(timestamp):
+        raise SchemaError("timestamp must be a finite number")
+    timestamp = int(timestamp)
+    seq = payload.get("seq")
+    if seq is not None and (type(seq) is not int or seq < 0):
+        raise SchemaError("seq must be a non-negative integer")
+    boot_id = payload.get("boot_id")
+    if boot_id is not None and (type(boot_id) is not int or boot_id < 0):
+        raise SchemaError("boot_id must be a non-negative integer")
+    soil_moisture = payload.get("soil_moisture")
+    if soil_moisture is not None:
+        if type(soil_moisture) not in NUMBER_TYPES or not isfinite(soil_moisture):
+            raise SchemaError("soil_moisture must be a finite number")
+        if soil_moisture < 0 or soil_moisture > 100:
+            raise SchemaError("soil_moisture out of range")
+    soil_temperature = payload.get("soil_temperature")
+    if soil_temperature is not None:
+        if type(soil_temperature) not in NUMBER_TYPES or not isfinite(soil_temperature):
+            raise SchemaError("soil_temperature must be a finite number")
+    soil_ph = payload.get("soil_ph")
+    if soil_ph is not None:
+        if type(soil_ph) not in NUMBER_TYPES or not isfinite(soil_ph):
+            raise SchemaError("soil_ph must be a finite number")
+        if soil_ph < 0 or soil_ph > 14:
+            raise SchemaError("soil_ph out of range")
+    soil_conductivity = payload.get("soil_conductivity")
+    if soil_conductivity is not None:
+        if type(soil_conductivity) not in NUMBER_TYPES or not isfinite(soil_conductivity):
+            raise SchemaError("soil_conductivity must be a finite number")
+        if soil_conductivity < 0:
+            raise SchemaError("soil_conductivity out of range")
+    nitrogen = payload.get("nitrogen")
+    if nitrogen is not None:
+        if type(nitrogen) not in NUMBER_TYPES or not isfinite(nitrogen):
+            raise SchemaError("nitrogen must be a finite number")
+        if nitrogen < 0:
+            raise SchemaError("nitrogen out of range")
+    phosphorus = payload.get("phosphorus")
+    if phosphorus is not None:
+        if type(phosphorus) not in NUMBER_TYPES or not isfinite(phosphorus):
+            raise SchemaError("phosphorus must be a finite number")
+        if phosphorus < 0:
+            raise SchemaError("phosphorus out of range")
+    potassium = payload.get("potassium")
+    if potassium is not None:
+        if type(potassium) not in NUMBER_TYPES or not isfinite(potassium):
+            raise SchemaError("potassium must be a finite number")
+        if potassium < 0:
+            raise SchemaError("potassium out of range")
+    return (
+        device_id,
+        timestamp,
+        timestamp,
+        3,
+        seq,
+        boot_id,
+        soil_moisture,
+        soil_temperature,
+        soil_ph,
+        soil_conductivity,
+        nitrogen,
+        phosphorus,
+        potassium,
+        is_dummy,
+    )
+
+INSERT_LEGACY_STATION = (
+    "INSERT INTO sensor_data (device_id, timestamp, raw_timestamp, schema_id, seq, boot_id, soil_moisture, soil_temperature, soil_ph, soil_conductivity, air_temperature, humidity, atmospheric_pressure, nitrogen, phosphorus, potassium, is_dummy) "
+    "VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?)"
+)
+
+
+def decode_legacy_station(payload, is_dummy=0):
+    """Schema 4: sensor_readings station layout"""
+    device_id = payload["device_id"]
+    if type(device_id) is not str:
+        raise SchemaError("device_id must be a string")
+    timestamp = payload["timestamp"]
+    if type(timestamp) not in NUMBER_TYPES or not isfinite(timestamp):
+        raise SchemaError("timestamp must be a finite number")
+    timestamp = int(timestamp)
+    seq = payload.get("seq")
+    if seq is not None and (type(seq) is not int or seq < 0):
+        raise SchemaError("seq must be a non-negative integer")
+    boot_id = payload.get("boot_id")
+    if boot_id is not None and (type(boot_id) is not int or boot_id < 0):
+        raise SchemaError("boot_id must be a non-negative integer")
+    npk = payload.get("npk") or {}
+    if type(npk) is not dict:
+        raise SchemaError("npk must be an object")
+    soil_moisture = payload.get("soil_moisture")
+    if soil_moisture is not None:
+        if type(soil_moisture) not in NUMBER_TYPES or not isfinite(soil_moisture):
+            raise SchemaError("soil_moisture must be a finite number")
+        if soil_moisture < 0 or soil_moisture > 100:
+            raise SchemaError("soil_moisture out of range")
+    soil_temperature = payload.get("soil_temperature")
+    if soil_temperature is not None:
+        if type(soil_temperature) not in NUMBER_TYPES or not isfinite(soil_temperature):
+            raise SchemaError("soil_temperature must be a finite number")
+    soil_ph = payload.get("soil_ph")
+    if soil_ph is not None:
+        if type(soil_ph) not in NUMBER_TYPES or not isfinite(soil_ph):
+            raise SchemaError("soil_ph must be a finite number")
+        if soil_ph < 0 or soil_ph > 14:
+            raise SchemaError("soil_ph out of range")
+    soil_conductivity = payload.get("soil_conductivity")
+    if soil_conductivity is not None:
+        if type(soil_conductivity) not in NUMBER_TYPES or not isfinite(soil_conductivity):
+            raise SchemaError("soil_conductivity must be a finite number")
+        if soil_conductivity < 0:
+            raise SchemaError("soil_conductivity out of range")
+    air_temperature = payload.get("air_temperature")
+    if air_temperature is not None:
+        if type(air_temperature) not in NUMBER_TYPES or not isfinite(air_temperature):
+            raise SchemaError("air_temperature must be a finite number")
+    humidity = payload.get("humidity")
+    if humidity is not None:
+        if type(humidity) not in NUMBER_TYPES or not isfinite(humidity):
+            raise SchemaError("humidity must be a finite number")
+        if humidity < 0 or humidity > 100:
+            raise SchemaError("humidity out of range")
+    atmospheric_pressure = payload.get("atmospheric_pressure")
+    if atmospheric_pressure is not None:
+        if type(atmospheric_pressure) not in NUMBER_TYPES or not isfinite(atmospheric_pressure):
+            raise SchemaError("atmospheric_pressure must be a finite number")
+    nitrogen = npk.get("nitrogen")
+    if nitrogen is not None:
+        if type(nitrogen) not in NUMBER_TYPES or not isfinite(nitrogen):
+            raise SchemaError("nitrogen must be a finite number")
+        if nitrogen < 0:
+            raise SchemaError("nitrogen out of range")
+    phosphorus = npk.get("phosphorus")
+    if phosphorus is not None:
+        if type(phosphorus) not in NUMBER_TYPES or not isfinite(phosphorus):
+            raise SchemaError("phosphorus must be a finite number")
+        if phosphorus < 0:
+            raise SchemaError("phosphorus out of range")
+    potassium = npk.get("potassium")
+    if potassium is not None:
+        if type(potassium) not in NUMBER_TYPES or not isfinite(potassium):
+            raise SchemaError("potassium must be a finite number")
+        if potassium < 0:
+            raise SchemaError("potassium out of range")
+    return (
+        device_id,
+        timestamp,
+        timestamp,
+        4,
+        seq,
+        boot_id,
+        soil_moisture,
+        soil_temperature,
+        soil_ph,
+        soil_conductivity,
+        air_temperature,
+        humidity,
+        atmospheric_pressure,
+        nitrogen,
+        phosphorus,
+        potassium,
+        is_dummy,
+    )
+
+
+# schema_id -> (insert statement, decoder)
+DECODERS = {
+    1: (INSERT_LEGACY_JSON, decode_legacy_json),
+    2: (INSERT_PICO_ENV, decode_pico_env),
+    3: (INSERT_NPK_SERIAL, decode_npk_serial),
+    4: (INSERT_LEGACY_STATION, decode_legacy_station),
+}
+
+
+def decode(payload, is_dummy=0):
+    """
+    Dispatch a payload to the decoder of its record type
+
+    Returns (insert statement, parameters); parameters start with
+    device_id, timestamp, raw_timestamp, schema_id, seq, boot_id.
+    timestamp is the device's own until the caller replaces it with a
+    corrected one; seq and boot_id are None when the device sends none.
+    Raises SchemaError for an unknown schema_id or a payload that does
+    not fit its record type.
+    """
+    if type(payload) is not dict:
+        raise SchemaError("payload must be an object")
+    schema_id = payload.get("schema_id", DEFAULT_SCHEMA_ID)
+    entry = DECODERS.get(schema_id) if type(schema_id) is int else None
+    if entry is None:
+        raise SchemaError(f"unknown schema_id {schema_id}")
+    statement, decoder = entry
+    try:
+        return statement, decoder(payload, is_dummy)
+    except SchemaError:
+        raise
+    except KeyError as e:
+        raise SchemaError(f"schema {schema_id}: missing {e}") from None
+    except (TypeError, ValueError, AttributeError, OverflowError) as e:
+        raise SchemaError(f"schema {schema_id}: {e}") from None
+
+
+def encode_legacy_json(device_id, timestamp, values):
+    """Schema 1 payload from a flat dict keyed by column name"""
+    return {
+        "schema_id": 1,
+        "device_id": device_id,
+        "timestamp": timestamp,
+        "soil_moisture": values.get("soil_moisture"),
+        "soil_temperature": values.get("soil_temperature"),
+        "humidity": values.get("humidity"),
+        "light_intensity": values.get("light_intensity"),
+        "soil_ph": values.get("soil_ph"),
+        "npk": {
+            "nitrogen": values.get("nitrogen"),
+            "phosphorus": values.get("phosphorus"),
+            "potassium": values.get("potassium"),
+        },
+    }
+
+
+def encode_pico_env(device_id, timestamp, values):
+    """Schema 2 payload from a flat dict keyed by column name"""
+    return {
+        "schema_id": 2,
+        "device_id": device_id,
+        "timestamp": timestamp,
+        "soil_moisture": values.get("soil_moisture"),
+        "soil_temperature": values.get("soil_temperature"),
+        "humidity": values.get("humidity"),
+        "light_intensity": values.get("light_intensity"),
+    }
+
+
+def encode_npk_serial(device_id, timestamp, values):
+    """Schema 3 payload from a flat dict keyed by column name"""
+    return {
+        "schema_id": 3,
+        "device_id": device_id,
+        "timestamp": timestamp,
+        "soil_moisture": values.get("soil_moisture"),
+        "soil_temperature": values.get("soil_temperature"),
+        "soil_ph": values.get("soil_ph"),
+        "soil_conductivity": values.get("soil_conductivity"),
+        "nitrogen": values.get("nitrogen"),
+        "phosphorus": values.get("phosphorus"),
+        "potassium": values.get("potassium"),
+    }
+
+
+def encode_legacy_station(device_id, timestamp, values):
+    """Schema 4 payload from a flat dict keyed by column name"""
+    return {
+        "schema_id": 4,
+        "device_id": device_id,
+        "timestamp": timestamp,
+        "soil_moisture": values.get("soil_moisture"),
+        "soil_temperature": values.get("soil_temperature"),
+        "soil_ph": values.get("soil_ph"),
+        "soil_conductivity": values.get("soil_conductivity"),
+        "air_temperature": values.get("air_temperature"),
+        "humidity": values.get("humidity"),
+        "atmospheric_pressure": values.get("atmospheric_pressure"),
+        "npk": {
+            "nitrogen": values.get("nitrogen"),
+            "phosphorus": values.get("phosphorus"),
+            "potassium": values.get("potassium"),
+        },
+    }
+
+
+def payload_from_row(row):
+    """Schema fields of a sensor_data row in the API shape (absent -> None)"""
+    return {
+        "schema_id": row["schema_id"],
+        "soil_moisture": row["soil_moisture"],
+        "soil_temperature": row["soil_temperature"],
+        "humidity": row["humidity"],
+        "light_intensity": row["light_intensity"],
+        "soil_ph": row["soil_ph"],
+        "soil_conductivity": row["soil_conductivity"],
+        "air_temperature": row["air_temperature"],
+        "atmospheric_pressure": row["atmospheric_pressure"],
+        "npk": {
+            "nitrogen": row["nitrogen"],
+            "phosphorus": row["phosphorus"],
+            "potassium": row["potassium"],
+        },
+    }
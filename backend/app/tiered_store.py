@@ -0,0 +1,483 @@
+"""
+Tiered sensor storage: hot RAM rings, warm SQLite, cold compressed archive
+
+  hot   the last HOT_HOURS of every device in sorted in-memory rings,
+        kept current by tailing sensor_data by rowid (so every worker
+        sees every other worker's inserts)
+  warm  sensor_data itself, read through a memory-mapped connection
+  cold  whole UTC days older than WARM_DAYS, moved by the archiver into
+        one columnar chunk file per device-day (Gorilla / delta-of-delta
+        columns, zstd) and listed in archive_chunks
+
+A row is stored in exactly one of warm or cold (the archiver writes the
+chunk, then catalogues it and deletes the rows in one transaction); hot
+only caches warm rows. iter_chunks() stitches the tiers for a device and
+range: cold and warm merged by timestamp, then the hot tail, so callers
+see one sorted series whichever tiers it came from.
+"""
+import os
+import re
+import math
+import time
+import zlib
+import fcntl
+import heapq
+import asyncio
+import logging
+from bisect import bisect_left, bisect_right
+from collections import Counter, OrderedDict
+from contextlib import contextmanager
+from typing import AsyncIterator, Callable, Dict, List, Optional, Sequence, Tuple
+
+import aiosqlite
+
+from app.chunk_codec import encode_chunk, decode_chunk
+from app.telemetry_schema import COLUMNS
+from app.timeseries import CHUNK_ROWS, iter_chunks
+
+logger = logging.getLogger(__name__)
+
+HOT_HOURS = float(os.getenv("TIER_HOT_HOURS", "6"))
+WARM_DAYS = float(os.getenv("TIER_WARM_DAYS", "28"))
+ARCHIVE_INTERVAL_S = int(os.getenv("TIER_ARCHIVE_INTERVAL_S", "3600"))
+ARCHIVE_PAUSE_S = 0.05          # Between device-days: ingest keeps priority
+WARM_MMAP_BYTES = 256 * 1024 * 1024
+DAY_S = 86400
+TAIL_BATCH = 5000
+CHUNK_CACHE = 32
+
+# Every stored column, in one fixed order for all tiers
+ROW_COLUMNS = (
+    "id", "device_id", "timestamp", "raw_timestamp", "schema_id", "seq", "boot_id",
+    *(name for name, _, _ in COLUMNS), "is_dummy", "created_at",
+)
+TS = ROW_COLUMNS.index("timestamp")
+ID = ROW_COLUMNS.index("id")
+# Archived columns and their kind; created_at is not kept. id is, so
+# history cursors work across tiers (None in chunks of older releases).
+ARCHIVE_COLUMNS = (
+    ("id", "int"), ("timestamp", "int"), ("raw_timestamp", "int"), ("schema_id", "int"),
+    ("seq", "int"), ("boot_id", "int"),
+    *((name, "float" if sql_type == "REAL" else "int") for name, sql_type, _ in COLUMNS),
+    ("is_dummy", "int"),
+)
+SELECT_ROWS = f"SELECT {', '.join(ROW_COLUMNS)} FROM sensor_data"
+
+ARCHIVE_DDL = """
+    CREATE TABLE IF NOT EXISTS archive_chunks (
+        id INTEGER PRIMARY KEY AUTOINCREMENT,
+        device_id TEXT NOT NULL,
+        day INTEGER NOT NULL,
+        min_ts INTEGER NOT NULL,
+        max_ts INTEGER NOT NULL,
+        rows INTEGER NOT NULL,
+        bytes INTEGER NOT NULL,
+        path TEXT NOT NULL,
+        compacted INTEGER NOT NULL DEFAULT 0,
+        created_at DATETIME DEFAULT CURRENT_TIMESTAMP
+    )
+"""
+
+
+def day_columns(rows: Sequence[tuple]) -> List[Tuple[str, str, List]]:
+    """Archived columns of sorted full rows"""
+    return [
+        (name, kind, [row[ROW_COLUMNS.index(name)] for row in rows])
+        for name, kind in ARCHIVE_COLUMNS
+    ]
+
+
+def encode_day(rows: Sequence[tuple]) -> bytes:
+    """Chunk file contents for sorted full rows, default codecs"""
+    return encode_chunk(day_columns(rows))
+
+
+def decode_day(blob: bytes, device_id: str) -> List[tuple]:
+    """Full rows (created_at None) of a chunk file"""
+    count, columns = decode_chunk(blob)
+    blank = [None] * count
+    values = [columns.get(name, blank) for name in ROW_COLUMNS]
+    values[ROW_COLUMNS.index("device_id")] = [device_id] * count
+    return list(zip(*values))
+
+
+class HotRing:
+    """Sorted recent rows per device, complete from an integer floor on"""
+
+    def __init__(self, horizon_s: float):
+        self.horizon_s = horizon_s
+        self.floor: Optional[int] = None    # None until filled: no hot tier
+        self.rows: Dict[str, List[tuple]] = {}
+        self.keys: Dict[str, List[Tuple[int, int]]] = {}    # (timestamp, id) per row
+
+    def target(self, now: float) -> int:
+        return math.ceil(now - self.horizon_s)
+
+    def add(self, row: tuple):
+        if self.floor is None or row[TS] < self.floor:
+            return
+        device_id = row[1]
+        keys = self.keys.setdefault(device_id, [])
+        key = (row[TS], row[ID])
+        at = bisect_right(keys, key)
+        keys.insert(at, key)
+        self.rows.setdefault(device_id, []).insert(at, row)
+
+    def evict(self, floor: int):
+        """Drop rows before floor; the floor only moves up"""
+        if self.floor is None or floor <= self.floor:
+            return
+        self.floor = floor
+        cutoff = (floor, -1)
+        for device_id, keys in self.keys.items():
+            drop = bisect_left(keys, cutoff)
+            if drop:
+                del keys[:drop]
+                del self.rows[device_id][:drop]
+
+    def range(self, device_id: str, start: int, end: int) -> List[tuple]:
+        keys = self.keys.get(device_id, [])
+        return self.rows.get(device_id, [])[bisect_left(keys, (start, -1)):bisect_left(keys, (end, -1))]
+
+    def size(self) -> int:
+        return sum(len(rows) for rows in self.rows.values())
+
+
+class TieredStore:
+    def __init__(self, db_path: str, archive_dir: Optional[str] = None):
+        self.db_path = db_path
+        self.archive_dir = archive_dir or os.getenv(
+            "ARCHIVE_DIR", os.path.join(os.path.dirname(os.path.abspath(db_path)), "archive")
+        )
+        self.hot = HotRing(HOT_HOURS * 3600)
+        self.read_floors: Counter = Counter()     # Hot floors of reads in progress
+        self.last_id = 0
+        self.tail_lock = asyncio.Lock()
+        self.chunk_cache: "OrderedDict[str, List[tuple]]" = OrderedDict()
+        self.last_archive: Dict = {}
+        self.tail_listeners: List[Callable[[List[tuple]], None]] = []     # Told of every tailed row
+
+    async def open_catalog(self, db):
+        """Archive catalogue only (CLIs): reads then cover warm and cold"""
+        await db.execute(ARCHIVE_DDL)
+        await db.execute(
+            "CREATE INDEX IF NOT EXISTS idx_archive_chunks_device_day ON archive_chunks (device_id, day)"
+        )
+        cursor = await db.execute("PRAGMA table_info(archive_chunks)")
+        if "compacted" not in {row[1] for row in await cursor.fetchall()}:
+            await db.execute("ALTER TABLE archive_chunks ADD COLUMN compacted INTEGER NOT NULL DEFAULT 0")
+        os.makedirs(self.archive_dir, exist_ok=True)
+
+    async def initialize(self, db, device_ids: Sequence[str]):
+        """Catalogue table; hot rings from the store"""
+        await self.open_catalog(db)
+
+        cursor = await db.execute("SELECT MAX(id) FROM sensor_data")
+        self.last_id = (await cursor.fetchone())[0] or 0
+        since = self.hot.target(time.time())
+        self.hot.floor = since
+        for device_id in device_ids:
+            cursor = await db.execute(
+                f"{SELECT_ROWS} WHERE device_id = ? AND timestamp >= ? AND id <= ?",
+                (device_id, since, self.last_id)
+            )
+            for row in await cursor.fetchall():
+                self.hot.add(tuple(row))
+        logger.info(f"🔥 Hot tier: {self.hot.size()} rows of {len(device_ids)} devices")
+
+    async def refresh(self, db):
+        """Pull rows inserted since the last look (by any worker) into the rings"""
+        async with self.tail_lock:
+            while True:
+                cursor = await db.execute(
+                    f"{SELECT_ROWS} WHERE id > ? ORDER BY id LIMIT ?", (self.last_id, TAIL_BATCH)
+                )
+                rows = [tuple(row) for row in await cursor.fetchall()]
+                for row in rows:
+                    self.hot.add(row)
+                if rows:
+                    self.last_id = rows[-1][ID]
+                    for listener in self.tail_listeners:
+                        listener(rows)
+                if len(rows) < TAIL_BATCH:
+                    break
+            # Never above a floor a read in progress still relies on
+            self.hot.evict(min([self.hot.target(time.time()), *self.read_floors]))
+
+    # ---- cold tier ----
+
+    def _load(self, path: str, device_id: str) -> List[tuple]:
+        rows = self.chunk_cache.get(path)
+        if rows is None:
+            with open(path, "rb") as f:
+                rows = decode_day(f.read(), device_id)
+            self.chunk_cache[path] = rows
+            if len(self.chunk_cache) > CHUNK_CACHE:
+                self.chunk_cache.popitem(last=False)
+        else:
+            self.chunk_cache.move_to_end(path)
+        return rows
+
+    async def cold_days(self, db, device_id: str, start: int, end: int, descending: bool = False):
+        """Lists of a device's archived rows per day, in order, within [start, end)"""
+        cursor = await db.execute(
+            "SELECT day, path FROM archive_chunks WHERE device_id = ? AND max_ts >= ? AND min_ts < ? "
+            f"ORDER BY day {'DESC' if descending else 'ASC'}, id",
+            (device_id, start, end)
+        )
+        by_day: "OrderedDict[int, List[str]]" = OrderedDict()
+        for day, path in await cursor.fetchall():
+            by_day.setdefault(day, []).append(path)
+        loop = asyncio.get_running_loop()
+        for paths in by_day.values():
+            parts = [await loop.run_in_executor(None, self._load, path, device_id) for path in paths]
+            rows = parts[0] if len(parts) == 1 else list(heapq.merge(*parts, key=lambda r: r[TS]))
+            lo = bisect_left(rows, start, key=lambda r: r[TS])
+            hi = bisect_left(rows, end, key=lambda r: r[TS])
+            if lo < hi:
+                yield rows[lo:hi] if not descending else rows[lo:hi][::-1]
+
+    # ---- stitched reads ----
+
+    async def _rows(self, db, device_id: str, start: int, end: int, size: int) -> AsyncIterator[List[tuple]]:
+        # One integer floor for the whole read: warm [start, floor), hot
+        # [floor, end). It is pinned so refreshes cannot evict past it.
+        floor = self.hot.floor
+        if floor is None:
+            async for chunk in self._stored(db, device_id, start, end, size):
+                yield chunk
+            return
+        self.read_floors[floor] += 1
+        try:
+            async for chunk in self._stored(db, device_id, start, min(end, floor), size):
+                yield chunk
+            if end > floor:
+                await self.refresh(db)
+                hot = self.hot.range(device_id, max(start, floor), end)
+                for i in range(0, len(hot), size):
+                    yield hot[i:i + size]
+        finally:
+            self.read_floors[floor] -= 1
+            if not self.read_floors[floor]:
+                del self.read_floors[floor]
+
+    async def _stored(self, db, device_id: str, start: int, warm_end: int,
+                      size: int) -> AsyncIterator[List[tuple]]:
+        """Cold and warm rows in [start, warm_end), merged by timestamp"""
+
+        # Cold and warm are disjoint sets of rows, but late rows of an
+        # archived day stay warm until the next archive pass: merge them
+        async def warm():
+            if start < warm_end:
+                async for chunk in iter_chunks(
+                    db, f"{SELECT_ROWS} WHERE device_id = ? AND timestamp >= ? AND timestamp < ? "
+                        "ORDER BY timestamp, id", (device_id, start, warm_end), size
+                ):
+                    yield chunk
+
+        cold = self.cold_days(db, device_id, start, warm_end)
+        warm_chunks = warm()
+        try:
+            a = await _anext_or_none(cold)
+            b = await _anext_or_none(warm_chunks)
+            while a is not None and b is not None:
+                if a[-1][TS] <= b[0][TS]:
+                    yield a
+                    a = await _anext_or_none(cold)
+                elif b[-1][TS] < a[0][TS]:
+                    yield b
+                    b = await _anext_or_none(warm_chunks)
+                else:
+                    # Overlap: emit the merged prefix up to the earlier chunk end
+                    limit = min(a[-1][TS], b[-1][TS])
+                    i = bisect_right(a, limit, key=lambda r: r[TS])
+                    j = bisect_right(b, limit, key=lambda r: r[TS])
+                    yield list(heapq.merge(a[:i], b[:j], key=lambda r: r[TS]))
+                    a = a[i:] or await _anext_or_none(cold)
+                    b = b[j:] or await _anext_or_none(warm_chunks)
+            rest, stream = (a, cold) if a is not None else (b, warm_chunks)
+            while rest is not None:
+                yield rest
+                rest = await _anext_or_none(stream)
+        finally:
+            await cold.aclose()
+            await warm_chunks.aclose()
+
+    async def iter_chunks(self, db, device_id: str, start: int, end: int,
+                          columns: Sequence[str] = ROW_COLUMNS,
+                          size: int = CHUNK_ROWS) -> AsyncIterator[List[tuple]]:
+        """A device's rows in [start, end), timestamp order, projected to columns"""
+        await db.execute(f"PRAGMA mmap_size = {WARM_MMAP_BYTES}")
+        if tuple(columns) == ROW_COLUMNS:
+            async for chunk in self._rows(db, device_id, start, end, size):
+                yield chunk
+            return
+        picks = [ROW_COLUMNS.index(name) for name in columns]
+        async for chunk in self._rows(db, device_id, start, end, size):
+            yield [tuple(row[i] for i in picks) for row in chunk]
+
+    async def iter_rows(self, db, device_id: str, start: int, end: int) -> AsyncIterator[Dict]:
+        """Row-at-a-time form of iter_chunks, keyed by column name like sqlite rows"""
+        async for chunk in self.iter_chunks(db, device_id, start, end):
+            for row in chunk:
+                yield dict(zip(ROW_COLUMNS, row))
+
+    async def latest(self, db, device_id: str, limit: int) -> List[Dict]:
+        """A device's newest rows, newest first, from whichever tiers hold them"""
+        await self.refresh(db)
+        hot = self.hot.rows.get(device_id, [])
+        if len(hot) >= limit:
+            return [dict(zip(ROW_COLUMNS, row)) for row in reversed(hot[-limit:])]
+
+        cursor = await db.execute(
+            f"{SELECT_ROWS} WHERE device_id = ? ORDER BY timestamp DESC, id DESC LIMIT ?",
+            (device_id, limit)
+        )
+        rows = [tuple(row) for row in await cursor.fetchall()]
+        if len(rows) < limit:
+            # Warm ran out: continue into the archive
+            before = rows[-1][TS] if rows else 2 ** 62
+            days = self.cold_days(db, device_id, 0, before, descending=True)
+            try:
+                async for day in days:
+                    rows.extend(day[:limit - len(rows)])
+                    if len(rows) >= limit:
+                        break
+            finally:
+                await days.aclose()
+        return [dict(zip(ROW_COLUMNS, row)) for row in rows]
+
+    # ---- archiver ----
+
+    def chunk_path(self, device_id: str, day: int) -> str:
+        safe = re.sub(r"[^\w.-]", "_", device_id)[:48]
+        directory = os.path.join(self.archive_dir, f"{safe}-{zlib.crc32(device_id.encode()):08x}")
+        os.makedirs(directory, exist_ok=True)
+        return os.path.join(directory, f"{day}-{time.time_ns()}.agc")
+
+    @staticmethod
+    def write_chunk(path: str, blob: bytes):
+        tmp = path + ".tmp"
+        with open(tmp, "wb") as f:
+            f.write(blob)
+            f.flush()
+            os.fsync(f.fileno())
+        os.replace(tmp, path)
+
+    async def archive_day(self, db, device_id: str, day: int) -> Tuple[int, int]:
+        """Move one device-day from warm to cold; returns (rows, bytes)"""
+        cursor = await db.execute(
+            f"{SELECT_ROWS} WHERE device_id = ? AND timestamp >= ? AND timestamp < ? ORDER BY timestamp, id",
+            (device_id, day * DAY_S, (day + 1) * DAY_S)
+        )
+        rows = [tuple(row) for row in await cursor.fetchall()]
+        if not rows:
+            return 0, 0
+        loop = asyncio.get_running_loop()
+        blob = await loop.run_in_executor(None, encode_day, rows)
+        path = self.chunk_path(device_id, day)
+        await loop.run_in_executor(None, self.write_chunk, path, blob)
+
+        # Rows inserted after the SELECT have larger ids and stay warm
+        max_id = max(row[ID] for row in rows)
+        await db.execute(
+            "INSERT INTO archive_chunks (device_id, day, min_ts, max_ts, rows, bytes, path) "
+            "VALUES (?, ?, ?, ?, ?, ?, ?)",
+            (device_id, day, rows[0][TS], rows[-1][TS], len(rows), len(blob), path)
+        )
+        await db.execute(
+            "DELETE FROM sensor_data WHERE device_id = ? AND timestamp >= ? AND timestamp < ? AND id <= ?",
+            (device_id, day * DAY_S, (day + 1) * DAY_S, max_id)
+        )
+        await db.commit()
+        return len(rows), len(blob)
+
+    async def _devices(self, db) -> List[str]:
+        """Distinct devices by skipping along the (device_id, timestamp) index"""
+        devices = []
+        last = ""
+        while True:
+            cursor = await db.execute(
+                "SELECT device_id FROM sensor_data WHERE device_id > ? ORDER BY device_id LIMIT 1", (last,)
+            )
+            row = await cursor.fetchone()
+            if row is None:
+                return devices
+            last = row[0]
+            devices.append(last)
+
+    async def archive_once(self, db, now: float) -> Dict:
+        """Archive every whole day older than WARM_DAYS"""
+        started = time.perf_counter()
+        cutoff_day = int((now - WARM_DAYS * DAY_S) // DAY_S)
+        moved = written = days = 0
+        for device_id in await self._devices(db):
+            while True:
+                cursor = await db.execute(
+                    "SELECT MIN(timestamp) FROM sensor_data WHERE device_id = ?", (device_id,)
+                )
+                oldest = (await cursor.fetchone())[0]
+                if oldest is None or oldest // DAY_S >= cutoff_day:
+                    break
+                rows, size = await self.archive_day(db, device_id, oldest // DAY_S)
+                moved += rows
+                written += size
+                days += 1
+                await asyncio.sleep(ARCHIVE_PAUSE_S)
+        self.last_archive = {
+            "at": int(now),
+            "device_days": days,
+            "rows": moved,
+            "bytes": written,
+            "seconds": round(time.perf_counter() - started, 2),
+        }
+        if days:
+            logger.info(f"🧊 Archived {moved} rows in {days} device-days to {written / 1e6:.2f} MB")
+        return self.last_archive
+
+    @contextmanager
+    def archive_lock(self):
+        """One archiver or compactor at a time across workers; yields False when taken"""
+        fd = os.open(os.path.join(self.archive_dir, ".lock"), os.O_RDWR | os.O_CREAT, 0o600)
+        try:
+            try:
+                fcntl.flock(fd, fcntl.LOCK_EX | fcntl.LOCK_NB)
+            except BlockingIOError:
+                yield False
+                return
+            yield True
+        finally:
+            os.close(fd)
+
+    async def archive_loop(self):
+        while True:
+            await asyncio.sleep(ARCHIVE_INTERVAL_S)
+            try:
+                with self.archive_lock() as held:
+                    if held:
+                        async with aiosqlite.connect(self.db_path) as db:
+                            await self.archive_once(db, time.time())
+            except Exception as e:
+                logger.error(f"❌ Archive error: {str(e)}")
+
+    async def stats(self, db) -> Dict:
+        cursor = await db.execute(
+            "SELECT COUNT(*), COALESCE(SUM(rows), 0), COALESCE(SUM(bytes), 0), MIN(min_ts), MAX(max_ts) "
+            "FROM archive_chunks"
+        )
+        chunks, rows, size, oldest, newest = await cursor.fetchone()
+        return {
+            "hot": {"devices": len(self.hot.rows), "rows": self.hot.size(), "hours": HOT_HOURS},
+            "warm": {"days": WARM_DAYS},
+            "cold": {"chunks": chunks, "rows": rows, "bytes": size,
+                     "bytes_per_row": round(size / rows, 2) if rows else None,
+                     "oldest": oldest, "newest": newest},
+            "last_archive": self.last_archive,
+        }
+
+
+async def _anext_or_none(it: AsyncIterator):
+    try:
+        return await it.__anext__()
+    except StopAsyncIteration:
+        return None
@@ -0,0 +1,290 @@
+"""
+Streaming operators over timestamp-ordered series
+
+Every operator consumes (async) iterators already sorted by timestamp -
+typically cursors over an ORDER BY timestamp scan - and yields results as
+it goes, so a join is a single pass over both inputs with no per-row
+lookups and nothing materialized beyond the current bucket.
+"""
+from collections import deque
+from typing import AsyncIterator, Dict, Iterable, List, Optional, Sequence, Tuple
+
+# Rows per fetch from the store
+CHUNK_ROWS = 1024
+
+# Aggregations understood by bucketize(): output name -> (input field, op)
+#   op is one of "mean", "sum", "min", "max"
+Spec = Dict[str, Tuple[str, str]]
+
+SENSOR_BUCKET_SPEC: Spec = {
+    "soil_moisture": ("soil_moisture", "mean"),
+    "soil_temperature": ("soil_temperature", "mean"),
+    "humidity": ("humidity", "mean"),
+    "light_intensity": ("light_intensity", "mean"),
+    "soil_ph": ("soil_ph", "mean"),
+    "soil_conductivity": ("soil_conductivity", "mean"),
+}
+
+WEATHER_BUCKET_SPEC: Spec = {
+    "air_temperature": ("temperature", "mean"),
+    "air_temperature_min": ("temperature", "min"),
+    "air_temperature_max": ("temperature", "max"),
+    "air_humidity": ("humidity", "mean"),
+    "pressure": ("pressure", "mean"),
+    "wind_speed": ("wind_speed", "mean"),
+    "rain_mm": ("rain_mm", "sum"),
+    "solar_radiation": ("solar_radiation", "mean"),
+}
+
+
+async def iter_chunks(db, sql: str, params: Sequence, size: int = CHUNK_ROWS) -> AsyncIterator[List]:
+    """The store's chunk iterator: an ordered query, size rows at a time"""
+    async with db.execute(sql, params) as cursor:
+        while True:
+            chunk = await cursor.fetchmany(size)
+            if not chunk:
+                return
+            yield chunk
+
+
+async def iter_rows(chunks: AsyncIterator[List]) -> AsyncIterator:
+    """Flatten a chunk iterator for row-at-a-time operators"""
+    async for chunk in chunks:
+        for row in chunk:
+            yield row
+
+
+class _Bucket:
+    """Running aggregates for one time bucket"""
+
+    __slots__ = ("start", "count", "values", "counts")
+
+    def __init__(self, start: int, spec: Spec):
+        self.start = start
+        self.count = 0
+        self.values = dict.fromkeys(spec)
+        self.counts = dict.fromkeys(spec, 0)
+
+    def add(self, row, spec: Spec):
+        self.count += 1
+        for name, (field, op) in spec.items():
+            value = row[field]
+            if value is None:
+                continue
+            current = self.values[name]
+            if current is None:
+                self.values[name] = value
+            elif op == "min":
+                self.values[name] = min(current, value)
+            elif op == "max":
+                self.values[name] = max(current, value)
+            else:
+                self.values[name] = current + value
+            self.counts[name] += 1
+
+    def result(self, spec: Spec) -> Dict:
+        out = {"samples": self.count}
+        for name, (_, op) in spec.items():
+            value = self.values[name]
+            if op == "mean" and value is not None:
+                value = value / self.counts[name]
+            out[name] = round(value, 3) if value is not None else None
+        return out
+
+
+async def bucketize(rows: AsyncIterator, bucket_seconds: int, spec: Spec,
+                    key: str = "timestamp") -> AsyncIterator[Tuple[int, Dict]]:
+    """
+    Aggregate a sorted series into fixed, epoch-aligned buckets
+
+    Yields (bucket_start, aggregates) for non-empty buckets only, in order.
+    """
+    bucket: Optional[_Bucket] = None
+    async for row in rows:
+        start = row[key] - row[key] % bucket_seconds
+        if bucket is None or start != bucket.start:
+            if bucket is not None:
+                yield bucket.start, bucket.result(spec)
+            bucket = _Bucket(start, spec)
+        bucket.add(row, spec)
+    if bucket is not None:
+        yield bucket.start, bucket.result(spec)
+
+
+async def _next(it: AsyncIterator):
+    try:
+        return await it.__anext__()
+    except StopAsyncIteration:
+        return None
+
+
+async def merge_join(left: AsyncIterator[Tuple[int, Dict]],
+                     right: AsyncIterator[Tuple[int, Dict]]) -> AsyncIterator[Tuple[int, Optional[Dict], Optional[Dict]]]:
+    """
+    Full outer merge join of two keyed, sorted streams (e.g. bucketize output)
+
+    Yields (key, left_value, right_value); the side without an entry for a
+    key is None. Each input is advanced exactly once per element.
+    """
+    l = await _next(left)
+    r = await _next(right)
+    while l is not None or r is not None:
+        if r is None or (l is not None and l[0] < r[0]):
+            yield l[0], l[1], None
+            l = await _next(left)
+        elif l is None or r[0] < l[0]:
+            yield r[0], None, r[1]
+            r = await _next(right)
+        else:
+            yield l[0], l[1], r[1]
+            l = await _next(left)
+            r = await _next(right)
+
+
+async def asof_join(left: AsyncIterator, right: AsyncIterator, tolerance_seconds: int,
+                    key: str = "timestamp") -> AsyncIterator[Tuple[object, Optional[object]]]:
+    """
+    As-of join: pair each left row with the latest right row at or before it
+
+    Right rows older than tolerance_seconds relative to the left row are not
+    matched (None). Both inputs must be sorted on key; the right stream is
+    read one row ahead and never rewound.
+    """
+    current = None
+    ahead = await _next(right)
+    async for row in left:
+        ts = row[key]
+        while ahead is not None and ahead[key] <= ts:
+            current = ahead
+            ahead = await _next(right)
+        if current is not None and ts - current[key] <= tolerance_seconds:
+            yield row, current
+        else:
+            yield row, None
+
+
+FILL_POLICIES = ("none", "previous", "linear", "bounded")
+
+
+class _Field:
+    """Resampling state of one field"""
+
+    __slots__ = ("name", "total", "count", "anchor_ts", "anchor_value", "waiting")
+
+    def __init__(self, name: str):
+        self.name = name
+        self.total = 0.0
+        self.count = 0
+        self.anchor_ts: Optional[int] = None     # Last grid point (or raw sample) with data
+        self.anchor_value: Optional[float] = None
+        self.waiting: List[Dict] = []            # Empty grid points awaiting the next anchor
+
+
+async def resample(rows: AsyncIterator, fields: Sequence[str], start: int, end: int, step: int,
+                   fill: str = "none", max_gap: Optional[int] = None,
+                   key: str = "timestamp") -> AsyncIterator[Dict]:
+    """
+    Align a sorted series to the grid start, start + step, ... < end
+
+    A grid point takes the mean of the samples in [t, t + step). Empty
+    points are filled per field according to fill:
+      none      gap
+      previous  last value, if no older than max_gap (when given)
+      linear    interpolated between the neighbouring points with data
+      bounded   linear, only across gaps of at most max_gap seconds
+    Points that stay empty are emitted with value None and quality "gap",
+    so the grid is always complete. Rows before start only seed the fill
+    state. Memory is one bucket plus the grid points of an open gap; raw
+    rows are never held.
+
+    Yields {"timestamp", "values": {field: value}, "quality": {field: q}}
+    with q one of "measured", "filled", "gap".
+    """
+    if fill not in FILL_POLICIES:
+        raise ValueError(f"fill must be one of {FILL_POLICIES}")
+    interpolate = fill in ("linear", "bounded")
+    limit = max_gap if fill != "linear" else None
+    states = [_Field(name) for name in fields]
+    ready: deque = deque()       # Grid points in order; emitted once resolved
+    unresolved = {}              # id(point) -> fields still waiting
+
+    def close(t: int):
+        point = {"timestamp": t, "values": {}, "quality": {}}
+        ready.append(point)
+        for f in states:
+            if f.count:
+                value = f.total / f.count
+                point["values"][f.name] = round(value, 4)
+                point["quality"][f.name] = "measured"
+                if f.waiting:
+                    fillable = f.anchor_ts is not None and (limit is None or t - f.anchor_ts <= limit)
+                    for p in f.waiting:
+                        if fillable:
+                            share = (p["timestamp"] - f.anchor_ts) / (t - f.anchor_ts)
+                            p["values"][f.name] = round(f.anchor_value + share * (value - f.anchor_value), 4)
+                            p["quality"][f.name] = "filled"
+                        else:
+                            p["values"][f.name] = None
+                            p["quality"][f.name] = "gap"
+                        unresolved[id(p)] -= 1
+                    f.waiting = []
+                f.anchor_ts, f.anchor_value = t, value
+                f.total, f.count = 0.0, 0
+            elif fill == "previous" and f.anchor_ts is not None and (limit is None or t - f.anchor_ts <= limit):
+                point["values"][f.name] = round(f.anchor_value, 4)
+                point["quality"][f.name] = "filled"
+            elif interpolate and f.anchor_ts is not None and (limit is None or t - f.anchor_ts < limit):
+                f.waiting.append(point)
+                unresolved[id(point)] = unresolved.get(id(point), 0) + 1
+            else:
+                point["values"][f.name] = None
+                point["quality"][f.name] = "gap"
+
+    def flush():
+        while ready and not unresolved.get(id(ready[0])):
+            unresolved.pop(id(ready[0]), None)
+            yield ready.popleft()
+
+    t = start
+    previous_ts = None
+    async for row in rows:
+        ts = row[key]
+        if ts == previous_ts:
+            continue    # Retried upload of the same reading
+        previous_ts = ts
+        if ts < start:
+            for f in states:
+                if row[f.name] is not None:
+                    f.anchor_ts, f.anchor_value = ts, row[f.name]
+            continue
+        if ts >= end:
+            break
+        while ts >= t + step:
+            close(t)
+            t += step
+            for point in flush():
+                yield point
+        for f in states:
+            value = row[f.name]
+            if value is not None:
+                f.total += value
+                f.count += 1
+
+    while t < end:
+        close(t)
+        t += step
+    # Gaps still open at the end have no right-hand neighbour
+    for f in states:
+        for p in f.waiting:
+            p["values"][f.name] = None
+            p["quality"][f.name] = "gap"
+            unresolved[id(p)] -= 1
+        f.waiting = []
+    for point in flush():
+        yield point
+
+
+async def aiter_rows(rows: Iterable) -> AsyncIterator:
+    """Adapt an in-memory sorted sequence to the operators above"""
+    for row in rows:
+        yield row
@@ -0,0 +1,485 @@
+"""
+Reference evapotranspiration and soil water balance for irrigation scheduling
+
+Daily reference ET0 follows FAO-56 Penman-Monteith (Allen et al. 1998,
+eq. 6) and the root zone depletion follows the FAO-56 chapter 8 single
+crop coefficient balance:
+
+    Dr[i] = Dr[i-1] - rain[i] - irrigation[i] + Ks * Kc * ET0[i]
+
+clamped to [0, TAW] (excess water drains, depletion cannot exceed the
+available water). A zone needs water once Dr reaches RAW = p * TAW.
+
+Everything is incremental: weather observations fold into a running
+aggregate for the open day of their station, and when a station day
+closes its ET0 is computed once and every zone on that station advances
+by exactly one step. Soil moisture readings fold into a per zone daily
+mean that replaces the modelled depletion when the day closes. The only
+state is one open day per station and one depletion value per zone, both
+persisted, so nothing is ever recomputed from history.
+"""
+import math
+import os
+import logging
+from datetime import datetime
+from typing import Dict, List, Optional
+
+import aiosqlite
+
+from app.weather import WEATHER_FIELDS
+
+logger = logging.getLogger(__name__)
+
+DAY_SECONDS = 86400
+STEFAN_BOLTZMANN = 4.903e-9     # MJ K-4 m-2 day-1
+SOLAR_CONSTANT = 0.0820         # MJ m-2 min-1
+KRS_INTERIOR = 0.16             # Hargreaves radiation coefficient (FAO-56 eq. 50)
+
+IRRIGATION_DDL = (
+    """
+    CREATE TABLE IF NOT EXISTS irrigation_zones (
+        zone_id TEXT PRIMARY KEY,
+        station_id TEXT NOT NULL DEFAULT 'default',
+        device_id TEXT,
+        area_m2 REAL NOT NULL,
+        root_depth_m REAL NOT NULL,
+        field_capacity REAL NOT NULL,
+        wilting_point REAL NOT NULL,
+        depletion_fraction REAL NOT NULL DEFAULT 0.5,
+        crop_coefficient REAL NOT NULL DEFAULT 1.0,
+        efficiency REAL NOT NULL DEFAULT 0.85,
+        depletion_mm REAL NOT NULL DEFAULT 0,
+        pending_irrigation_mm REAL NOT NULL DEFAULT 0,
+        last_day INTEGER,
+        flow_lpm REAL,
+        pressure_kpa REAL,
+        priority INTEGER NOT NULL DEFAULT 0,
+        window_start_min INTEGER,
+        window_end_min INTEGER
+    )
+    """,
+    """
+    CREATE TABLE IF NOT EXISTS et0_daily (
+        station_id TEXT NOT NULL,
+        day INTEGER NOT NULL,
+        et0_mm REAL NOT NULL,
+        rain_mm REAL NOT NULL,
+        temperature_min REAL,
+        temperature_max REAL,
+        samples INTEGER NOT NULL,
+        PRIMARY KEY (station_id, day)
+    )
+    """,
+)
+
+# Scheduling columns added after the first release of irrigation_zones
+ZONE_MIGRATIONS = (
+    ("flow_lpm", "REAL"),
+    ("pressure_kpa", "REAL"),
+    ("priority", "INTEGER NOT NULL DEFAULT 0"),
+    ("window_start_min", "INTEGER"),
+    ("window_end_min", "INTEGER"),
+)
+
+# ==================== FAO-56 ====================
+
+def saturation_vapour_pressure(t: float) -> float:
+    """e°(T) in kPa (eq. 11)"""
+    return 0.6108 * math.exp(17.27 * t / (t + 237.3))
+
+
+def extraterrestrial_radiation(latitude_rad: float, day_of_year: int) -> float:
+    """Ra in MJ m-2 day-1 (eq. 21)"""
+    dr = 1 + 0.033 * math.cos(2 * math.pi * day_of_year / 365)
+    declination = 0.409 * math.sin(2 * math.pi * day_of_year / 365 - 1.39)
+    ws = math.acos(max(-1.0, min(1.0, -math.tan(latitude_rad) * math.tan(declination))))
+    return (24 * 60 / math.pi) * SOLAR_CONSTANT * dr * (
+        ws * math.sin(latitude_rad) * math.sin(declination)
+        + math.cos(latitude_rad) * math.cos(declination) * math.sin(ws)
+    )
+
+
+def et0_penman_monteith(t_min: float, t_max: float, wind_2m: float, day_of_year: int,
+                        latitude_rad: float, elevation_m: float,
+                        rh_min: Optional[float] = None, rh_max: Optional[float] = None,
+                        rh_mean: Optional[float] = None,
+                        solar_radiation: Optional[float] = None) -> float:
+    """
+    Daily reference ET0 in mm (eq. 6)
+
+    wind_2m is in m/s, solar_radiation (Rs) in MJ m-2 day-1. Without Rs the
+    Hargreaves estimate from the temperature range is used (eq. 50);
+    without RH extremes the mean is used (eq. 19), and without either the
+    dew point is taken as Tmin (eq. 48).
+    """
+    t_mean = (t_max + t_min) / 2
+    pressure = 101.3 * ((293 - 0.0065 * elevation_m) / 293) ** 5.26
+    gamma = 0.000665 * pressure
+    delta = 4098 * saturation_vapour_pressure(t_mean) / (t_mean + 237.3) ** 2
+
+    e_tmin = saturation_vapour_pressure(t_min)
+    e_tmax = saturation_vapour_pressure(t_max)
+    es = (e_tmin + e_tmax) / 2
+    if rh_min is not None and rh_max is not None:
+        ea = (e_tmin * rh_max / 100 + e_tmax * rh_min / 100) / 2
+    elif rh_mean is not None:
+        ea = rh_mean / 100 * es
+    else:
+        ea = e_tmin
+
+    ra = extraterrestrial_radiation(latitude_rad, day_of_year)
+    if solar_radiation is None:
+        solar_radiation = KRS_INTERIOR * math.sqrt(max(0.0, t_max - t_min)) * ra
+    rso = (0.75 + 2e-5 * elevation_m) * ra
+    rns = 0.77 * solar_radiation
+    relative_shortwave = min(1.0, solar_radiation / rso) if rso > 0 else 1.0
+    rnl = STEFAN_BOLTZMANN * ((t_max + 273.16) ** 4 + (t_min + 273.16) ** 4) / 2 \
+        * (0.34 - 0.14 * math.sqrt(max(0.0, ea))) * (1.35 * relative_shortwave - 0.35)
+    rn = rns - rnl
+
+    et0 = (0.408 * delta * rn + gamma * 900 / (t_mean + 273) * wind_2m * (es - ea)) \
+        / (delta + gamma * (1 + 0.34 * wind_2m))
+    return max(0.0, et0)
+
+
+def wind_at_2m(wind_kmh: float, height_m: float = 10.0) -> float:
+    """Convert a km/h reading at height_m to m/s at 2 m (eq. 47)"""
+    return wind_kmh / 3.6 * 4.87 / math.log(67.8 * height_m - 5.42)
+
+# ==================== RUNNING AGGREGATES ====================
+
+class DayAggregate:
+    """Weather of one station day, folded one observation at a time"""
+
+    __slots__ = ("day", "samples", "t_min", "t_max", "rh_min", "rh_max", "rh_sum", "rh_count",
+                 "wind_sum", "wind_count", "radiation_sum", "radiation_count", "rain_mm")
+
+    def __init__(self, day: int):
+        self.day = day
+        self.samples = 0
+        self.t_min = self.t_max = None
+        self.rh_min = self.rh_max = None
+        self.rh_sum = 0.0
+        self.rh_count = 0
+        self.wind_sum = 0.0
+        self.wind_count = 0
+        self.radiation_sum = 0.0
+        self.radiation_count = 0
+        self.rain_mm = 0.0
+
+    def add(self, obs):
+        self.samples += 1
+        t = obs["temperature"]
+        if t is not None:
+            self.t_min = t if self.t_min is None else min(self.t_min, t)
+            self.t_max = t if self.t_max is None else max(self.t_max, t)
+        rh = obs["humidity"]
+        if rh is not None:
+            self.rh_min = rh if self.rh_min is None else min(self.rh_min, rh)
+            self.rh_max = rh if self.rh_max is None else max(self.rh_max, rh)
+            self.rh_sum += rh
+            self.rh_count += 1
+        if obs["wind_speed"] is not None:
+            self.wind_sum += obs["wind_speed"]
+            self.wind_count += 1
+        if obs["solar_radiation"] is not None:
+            self.radiation_sum += obs["solar_radiation"]
+            self.radiation_count += 1
+        if obs["rain_mm"] is not None:
+            self.rain_mm += obs["rain_mm"]
+
+    def et0(self, latitude_rad: float, elevation_m: float) -> Optional[float]:
+        """ET0 for the day, None without a temperature range"""
+        if self.t_min is None or self.t_max is None:
+            return None
+        # Extremes from a single sample say nothing about the daily range
+        hourly = self.samples >= 12
+        return et0_penman_monteith(
+            self.t_min, self.t_max,
+            # FAO-56 recommends 2 m/s where wind data is missing
+            wind_at_2m(self.wind_sum / self.wind_count) if self.wind_count else 2.0,
+            day_of_year(self.day), latitude_rad, elevation_m,
+            rh_min=self.rh_min if hourly else None,
+            rh_max=self.rh_max if hourly else None,
+            rh_mean=self.rh_sum / self.rh_count if self.rh_count else None,
+            # Mean W/m2 over the day -> MJ m-2 day-1
+            solar_radiation=self.radiation_sum / self.radiation_count * 0.0864
+            if self.radiation_count else None,
+        )
+
+
+def day_of_year(day: int) -> int:
+    """Day of year of a day number (days since the epoch)"""
+    return datetime.utcfromtimestamp(day * DAY_SECONDS).timetuple().tm_yday
+
+
+class Zone:
+    """Per zone configuration and water balance state"""
+
+    __slots__ = ("zone_id", "station_id", "device_id", "area_m2", "root_depth_m",
+                 "field_capacity", "wilting_point", "depletion_fraction", "crop_coefficient",
+                 "efficiency", "depletion_mm", "pending_irrigation_mm", "last_day",
+                 "flow_lpm", "pressure_kpa", "priority", "window_start_min", "window_end_min",
+                 "moisture_day", "moisture_sum", "moisture_count", "moisture_last")
+
+    FIELDS = ("zone_id", "station_id", "device_id", "area_m2", "root_depth_m",
+              "field_capacity", "wilting_point", "depletion_fraction", "crop_coefficient",
+              "efficiency", "depletion_mm", "pending_irrigation_mm", "last_day",
+              "flow_lpm", "pressure_kpa", "priority", "window_start_min", "window_end_min")
+
+    def __init__(self, **config):
+        for name in self.FIELDS:
+            setattr(self, name, config.get(name))
+        self.depletion_mm = self.depletion_mm or 0.0
+        self.pending_irrigation_mm = self.pending_irrigation_mm or 0.0
+        self.priority = self.priority or 0
+        self.moisture_day = None
+        self.moisture_sum = 0.0
+        self.moisture_count = 0
+        self.moisture_last = None
+
+    @property
+    def taw_mm(self) -> float:
+        """Total available water in the root zone (eq. 82); moisture in vol %"""
+        return 10 * (self.field_capacity - self.wilting_point) * self.root_depth_m
+
+    @property
+    def raw_mm(self) -> float:
+        """Readily available water (eq. 83)"""
+        return self.depletion_fraction * self.taw_mm
+
+    def step(self, day: int, et0: float, rain_mm: float):
+        """Advance the balance by one closed day"""
+        taw, raw = self.taw_mm, self.raw_mm
+        # Water stress reduces uptake once depletion passes RAW (eq. 84)
+        ks = 1.0 if self.depletion_mm <= raw else max(0.0, (taw - self.depletion_mm) / (taw - raw))
+        depletion = self.depletion_mm - rain_mm - self.pending_irrigation_mm \
+            + ks * self.crop_coefficient * et0
+        self.pending_irrigation_mm = 0.0
+
+        # A measured daily mean overrides the model
+        if self.moisture_day == day and self.moisture_count:
+            measured = self.moisture_sum / self.moisture_count
+            depletion = 10 * (self.field_capacity - measured) * self.root_depth_m
+        self.moisture_day = None
+        self.moisture_last = None
+
+        self.depletion_mm = max(0.0, min(taw, depletion))
+        self.last_day = day
+
+    def add_moisture(self, day: int, soil_moisture: float):
+        if self.moisture_day != day:
+            self.moisture_day = day
+            self.moisture_sum = 0.0
+            self.moisture_count = 0
+        self.moisture_sum += soil_moisture
+        self.moisture_count += 1
+        self.moisture_last = soil_moisture
+
+    @property
+    def current_depletion_mm(self) -> float:
+        """Depletion now: the latest reading of the open day, else the model"""
+        if self.moisture_day is not None:
+            depletion = 10 * (self.field_capacity - self.moisture_last) * self.root_depth_m
+        else:
+            depletion = self.depletion_mm - self.pending_irrigation_mm
+        return max(0.0, min(self.taw_mm, depletion))
+
+    def recommendation(self) -> Dict:
+        depletion = self.current_depletion_mm
+        net = depletion if depletion >= self.raw_mm else 0.0
+        gross = net / self.efficiency
+        return {
+            "zone_id": self.zone_id,
+            "depletion_mm": round(depletion, 2),
+            "raw_mm": round(self.raw_mm, 2),
+            "taw_mm": round(self.taw_mm, 2),
+            "irrigate": net > 0,
+            "net_mm": round(net, 2),
+            "gross_mm": round(gross, 2),
+            "water_liters": round(gross * self.area_m2, 1),   # 1 mm over 1 m2 = 1 L
+            "last_day": self.last_day,
+        }
+
+    def row(self):
+        return tuple(getattr(self, name) for name in self.FIELDS)
+
+# ==================== ENGINE ====================
+
+class WaterBalanceEngine:
+    """Incremental ET0 and per zone water balance over ingested data"""
+
+    def __init__(self, db_path: str):
+        self.db_path = db_path
+        self.latitude_rad = math.radians(float(os.getenv("FARM_LATITUDE", "0")))
+        self.elevation_m = float(os.getenv("FARM_ELEVATION", "0"))
+        # Days run on local solar time so a day's Tmin/Tmax are not split
+        self.day_offset = int(float(os.getenv("FARM_LONGITUDE", "0")) / 15 * 3600)
+        self.zones: Dict[str, Zone] = {}
+        self.zones_by_station: Dict[str, List[Zone]] = {}
+        self.zones_by_device: Dict[str, List[Zone]] = {}
+        self.open_days: Dict[str, DayAggregate] = {}
+        self.closed_through: Dict[str, int] = {}
+        self.last_et0: Dict[str, float] = {}
+
+    def day_of(self, timestamp: int) -> int:
+        return (timestamp + self.day_offset) // DAY_SECONDS
+
+    async def initialize(self, db: aiosqlite.Connection):
+        """Create tables and restore zones and the open day of each station"""
+        for ddl in IRRIGATION_DDL:
+            await db.execute(ddl)
+        cursor = await db.execute("PRAGMA table_info(irrigation_zones)")
+        existing = {row[1] for row in await cursor.fetchall()}
+        for column, sql_type in ZONE_MIGRATIONS:
+            if column not in existing:
+                await db.execute(f"ALTER TABLE irrigation_zones ADD COLUMN {column} {sql_type}")
+
+        db.row_factory = aiosqlite.Row
+        cursor = await db.execute("SELECT * FROM irrigation_zones")
+        for row in await cursor.fetchall():
+            self._index(Zone(**dict(row)))
+
+        cursor = await db.execute("SELECT station_id, MAX(day) FROM et0_daily GROUP BY station_id")
+        self.closed_through = {row[0]: row[1] for row in await cursor.fetchall()}
+        cursor = await db.execute(
+            "SELECT e.station_id, e.et0_mm FROM et0_daily e JOIN "
+            "(SELECT station_id, MAX(day) AS day FROM et0_daily GROUP BY station_id) m "
+            "ON e.station_id = m.station_id AND e.day = m.day"
+        )
+        self.last_et0 = {row[0]: row[1] for row in await cursor.fetchall()}
+
+        # Only the observations of each still open day are replayed
+        for station_id, last_day in self.closed_through.items():
+            start = (last_day + 1) * DAY_SECONDS - self.day_offset
+            cursor = await db.execute(
+                "SELECT timestamp, " + ", ".join(WEATHER_FIELDS) + " FROM weather_observations "
+                "WHERE station_id = ? AND timestamp >= ? ORDER BY timestamp",
+                (station_id, start)
+            )
+            self._fold(station_id, await cursor.fetchall())
+        db.row_factory = None
+        logger.info(f"Water balance: {len(self.zones)} zones, {len(self.closed_through)} stations")
+
+    def _index(self, zone: Zone):
+        old = self.zones.get(zone.zone_id)
+        if old is not None:
+            self.zones_by_station[old.station_id].remove(old)
+            if old.device_id:
+                self.zones_by_device[old.device_id].remove(old)
+        self.zones[zone.zone_id] = zone
+        self.zones_by_station.setdefault(zone.station_id, []).append(zone)
+        if zone.device_id:
+            self.zones_by_device.setdefault(zone.device_id, []).append(zone)
+
+    def _fold(self, station_id: str, observations) -> List[tuple]:
+        """Fold sorted observations; returns et0_daily rows of days they closed"""
+        closed = []
+        for obs in observations:
+            day = self.day_of(obs["timestamp"])
+            if day <= self.closed_through.get(station_id, -1):
+                continue    # Late data for a day already settled
+            current = self.open_days.get(station_id)
+            if current is not None and day > current.day:
+                closed.append(self._close(station_id, current))
+                current = None
+            if current is None:
+                current = self.open_days[station_id] = DayAggregate(day)
+            current.add(obs)
+        return closed
+
+    def _close(self, station_id: str, aggregate: DayAggregate) -> tuple:
+        et0 = aggregate.et0(self.latitude_rad, self.elevation_m)
+        if et0 is None:
+            et0 = 0.0
+            logger.warning(f"Water balance: no temperature range for {station_id} day {aggregate.day}")
+        for zone in self.zones_by_station.get(station_id, ()):
+            zone.step(aggregate.day, et0, aggregate.rain_mm)
+        self.closed_through[station_id] = aggregate.day
+        self.last_et0[station_id] = et0
+        del self.open_days[station_id]
+        return (station_id, aggregate.day, round(et0, 3), round(aggregate.rain_mm, 2),
+                aggregate.t_min, aggregate.t_max, aggregate.samples)
+
+    async def ingest_weather(self, observations: List[Dict]) -> List[tuple]:
+        """Fold a batch of observations; returns the et0_daily rows of closed days"""
+        by_station: Dict[str, List[Dict]] = {}
+        for obs in observations:
+            by_station.setdefault(obs.get("station_id", "default"), []).append(obs)
+
+        closed = []
+        for station_id, batch in by_station.items():
+            batch.sort(key=lambda obs: obs["timestamp"])
+            closed.extend(self._fold(station_id, batch))
+        if closed:
+            await self._persist(closed, {row[0] for row in closed})
+        return closed
+
+    def ingest_reading(self, device_id: str, timestamp: int, soil_moisture: Optional[float]) -> List[str]:
+        """Fold a soil moisture reading into the zones it measures; returns their ids"""
+        if soil_moisture is None:
+            return []
+        updated = []
+        for zone in self.zones_by_device.get(device_id, ()):
+            day = self.day_of(timestamp)
+            if day > self.closed_through.get(zone.station_id, -1):
+                zone.add_moisture(day, soil_moisture)
+                updated.append(zone.zone_id)
+        return updated
+
+    async def record_irrigation(self, zone_id: str, depth_mm: float):
+        """Water applied to a zone; it counts on the open day"""
+        zone = self.zones[zone_id]
+        zone.pending_irrigation_mm += depth_mm
+        async with aiosqlite.connect(self.db_path) as db:
+            await db.execute(
+                "UPDATE irrigation_zones SET pending_irrigation_mm = ? WHERE zone_id = ?",
+                (zone.pending_irrigation_mm, zone_id)
+            )
+            await db.commit()
+
+    async def upsert_zone(self, config: Dict) -> Zone:
+        """Create or reconfigure a zone, keeping the state of an existing one"""
+        old = self.zones.get(config["zone_id"])
+        if old is not None:
+            config.setdefault("depletion_mm", old.depletion_mm)
+            config.setdefault("pending_irrigation_mm", old.pending_irrigation_mm)
+            config.setdefault("last_day", old.last_day)
+        zone = Zone(**config)
+        zone.depletion_mm = min(zone.depletion_mm, zone.taw_mm)
+        self._index(zone)
+        async with aiosqlite.connect(self.db_path) as db:
+            await db.execute(
+                "INSERT OR REPLACE INTO irrigation_zones (" + ", ".join(Zone.FIELDS) + ") "
+                "VALUES (" + ", ".join("?" * len(Zone.FIELDS)) + ")",
+                zone.row()
+            )
+            await db.commit()
+        return zone
+
+    async def _persist(self, et0_rows: List[tuple], stations: set):
+        zones = [z for s in stations for z in self.zones_by_station.get(s, ())]
+        async with aiosqlite.connect(self.db_path) as db:
+            await db.executemany(
+                "INSERT OR REPLACE INTO et0_daily (station_id, day, et0_mm, rain_mm, "
+                "temperature_min, temperature_max, samples) VALUES (?, ?, ?, ?, ?, ?, ?)",
+                et0_rows
+            )
+            await db.executemany(
+                "UPDATE irrigation_zones SET depletion_mm = ?, pending_irrigation_mm = ?, "
+                "last_day = ? WHERE zone_id = ?",
+                [(z.depletion_mm, z.pending_irrigation_mm, z.last_day, z.zone_id) for z in zones]
+            )
+            await db.commit()
+
+    def device_et0(self, device_id: str) -> Optional[float]:
+        """ET0 of the last closed day at the station of a device's zone"""
+        zones = self.zones_by_device.get(device_id)
+        station_id = zones[0].station_id if zones else "default"
+        return self.last_et0.get(station_id)
+
+    def recommendations(self, only_due: bool = False) -> List[Dict]:
+        out = [zone.recommendation() for zone in self.zones.values()]
+        if only_due:
+            out = [r for r in out if r["irrigate"]]
+        return sorted(out, key=lambda r: r["depletion_mm"] - r["raw_mm"], reverse=True)
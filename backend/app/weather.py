@@ -9,14 +9,81 @@ from datetime import datetime, timedelta
 from typing import Dict, List, Optional
 import json
 
+import aiosqlite
+
 from app.models import WeatherData, WeatherAlert
 
 logger = logging.getLogger(__name__)
 
+# Observation columns after station_id and timestamp
+WEATHER_FIELDS = (
+    "temperature",        # Celsius
+    "humidity",           # %
+    "pressure",           # hPa
+    "wind_speed",         # km/h at 10 m
+    "rain_mm",            # Precipitation since the previous observation
+    "solar_radiation",    # W/m2, mean over the observation interval
+)
+
+WEATHER_DDL = """
+    CREATE TABLE IF NOT EXISTS weather_observations (
+        id INTEGER PRIMARY KEY AUTOINCREMENT,
+        station_id TEXT NOT NULL,
+        timestamp INTEGER NOT NULL,
+        temperature REAL,
+        humidity REAL,
+        pressure REAL,
+        wind_speed REAL,
+        rain_mm REAL,
+        solar_radiation REAL,
+        UNIQUE (station_id, timestamp)
+    )
+"""
+
+class WeatherStore:
+    """Weather observations in the time-series database, keyed by station and time"""
+
+    def __init__(self, db_path: str):
+        self.db_path = db_path
+
+    async def initialize(self, db: aiosqlite.Connection):
+        """Create the table; the unique key doubles as the time-ordered scan index"""
+        await db.execute(WEATHER_DDL)
+
+    async def insert_observations(self, observations: List[Dict]) -> int:
+        """Store observations, replacing any with the same station and timestamp"""
+        rows = [
+            (obs.get("station_id", "default"), int(obs["timestamp"]))
+            + tuple(obs.get(field) for field in WEATHER_FIELDS)
+            for obs in observations
+        ]
+        async with aiosqlite.connect(self.db_path) as db:
+            await db.executemany(
+                "INSERT OR REPLACE INTO weather_observations (station_id, timestamp, "
+                + ", ".join(WEATHER_FIELDS) + ") VALUES (?, ?, "
+                + ", ".join("?" * len(WEATHER_FIELDS)) + ")",
+                rows
+            )
+            await db.commit()
+        return len(rows)
+
+    @staticmethod
+    async def iter_observations(db: aiosqlite.Connection, station_id: str, start: int, end: int):
+        """Yield observations in [start, end) in timestamp order without materializing them"""
+        db.row_factory = aiosqlite.Row
+        async with db.execute(
+            "SELECT timestamp, " + ", ".join(WEATHER_FIELDS) + " FROM weather_observations "
+            "WHERE station_id = ? AND timestamp >= ? AND timestamp < ? ORDER BY timestamp",
+            (station_id, start, end)
+        ) as cursor:
+            async for row in cursor:
+                yield row
+
 class WeatherService:
-    def __init__(self):
+    def __init__(self, store: Optional[WeatherStore] = None):
         self.monitoring_active = False
         self.current_weather = None
+        self.store = store
 
     async def start_monitoring(self):
         """Start weather monitoring"""
@@ -34,6 +101,8 @@ class WeatherService:
         while self.monitoring_active:
             try:
                 self._generate_weather_data()
+                if self.store:
+                    await self.store.insert_observations([self._as_observation(self.current_weather)])
                 await asyncio.sleep(600)  # Update every 10 minutes
             except Exception as e:
                 logger.error(f"Error in weather update loop: {e}")
@@ -44,6 +113,7 @@ class WeatherService:
         conditions = ["Clear Sky", "Partly Cloudy", "Cloudy", "Light Rain", "Sunny", "Overcast"]
         wind_directions = ["N", "NE", "E", "SE", "S", "SW", "W", "NW"]
 
+        description = random.choice(conditions)
         self.current_weather = {
             "timestamp": datetime.utcnow().isoformat(),
             "temperature": round(random.uniform(22, 38), 1),
@@ -51,12 +121,27 @@ class WeatherService:
             "pressure": round(random.uniform(995, 1030), 1),
             "wind_speed": round(random.uniform(5, 25), 1),
             "wind_direction": random.choice(wind_directions),
-            "description": random.choice(conditions),
+            "description": description,
             "uv_index": random.randint(1, 10),
             "visibility": round(random.uniform(8, 25), 1),
+            "rain_mm": round(random.uniform(0, 4), 1) if "Rain" in description else 0.0,
             "alerts": []
         }
 
+    @staticmethod
+    def _as_observation(weather: Dict) -> Dict:
+        """Map a current weather snapshot to a stored observation"""
+        return {
+            "station_id": "mock",
+            "timestamp": int(datetime.fromisoformat(weather["timestamp"]).timestamp()),
+            "temperature": weather["temperature"],
+            "humidity": weather["humidity"],
+            "pressure": weather["pressure"],
+            "wind_speed": weather["wind_speed"],
+            "rain_mm": weather.get("rain_mm"),
+            "solar_radiation": None,
+        }
+
     async def get_current_weather(self) -> Dict:
         """Get current weather data"""
         if self.current_weather is None:
@@ -0,0 +1,398 @@
+#!/usr/bin/env python3
+"""
+Telemetry schema generator
+
+Reads the X-macro lists in Pico/telemetry_schema.h and writes
+app/telemetry_schema.py:
+- the sensor_data DDL and its column list (for migrations)
+- one INSERT statement and one decoder per registered record type; each
+  names only its own columns, so absent fields stay NULL, plus the
+  optional seq and boot_id any record may carry (resend detection)
+- a schema_id -> (statement, decoder) dispatch table
+- per record type payload encoders (relay, demo data) and the API row
+  converter
+
+and app/telemetry_models.py, the Pydantic model of each record type
+(kept apart so relay.py can import the decoders without pydantic).
+
+Decoders and encoders are straight-line code with every field, type and
+bound spelled out, so ingest never loops over field lists or probes for
+keys it cannot have. Decoders reject wrong JSON types (strings, lists or
+booleans for numeric columns, a non-string device_id, a missing or
+non-numeric timestamp) and the NaN and Infinity Python's JSON parser
+accepts with SchemaError, before anything is stored.
+
+Usage: python generate_schema.py [--check]
+    --check  Exit non-zero if the generated file is out of date
+"""
+import re
+import sys
+from pathlib import Path
+
+ROOT = Path(__file__).resolve().parent
+HEADER = ROOT.parent / "Pico" / "telemetry_schema.h"
+OUTPUT = ROOT / "app" / "telemetry_schema.py"
+MODELS_OUTPUT = ROOT / "app" / "telemetry_models.py"
+PYTHON_TYPES = {"float": "float", "int": "int"}
+
+COLUMN = re.compile(r'X\(\s*(\w+)\s*,\s*(\w+)\s*,\s*(\w+)\s*,\s*([-\w.]+)\s*,'
+                    r'\s*([-\w.]+)\s*,\s*"([^"]*)"\s*\)')
+RECORD_TYPE = re.compile(r'X\(\s*(\d+)\s*,\s*(\w+)\s*,\s*(\w+)\s*,\s*"([^"]*)"\s*\)')
+RECORD_FIELD = re.compile(r'X\(\s*"([\w.]+)"\s*,\s*(\w+)\s*,\s*(\w+)\s*,\s*"[^"]*"\s*\)')
+
+# Columns the API nests under "npk", as the original payload did
+NPK_COLUMNS = ("nitrogen", "phosphorus", "potassium")
+
+
+def macro_body(text, name):
+    """Text of a multi-line #define"""
+    match = re.search(r"#define %s\(X\)((?:.*\\\n)*.*)" % name, text)
+    if match is None:
+        raise SystemExit(f"{name} not found in {HEADER}")
+    return match.group(1)
+
+
+def parse_header(text):
+    """Return (columns, record_types) in declaration order"""
+    columns = []
+    for name, c_type, sql_type, low, high, desc in COLUMN.findall(
+            macro_body(text, "TELEMETRY_COLUMNS")):
+        columns.append({
+            "name": name,
+            "c_type": c_type,
+            "sql_type": sql_type,
+            "min": None if low == "NONE" else low,
+            "max": None if high == "NONE" else high,
+            "desc": desc,
+        })
+    by_name = {c["name"]: c for c in columns}
+
+    record_types = []
+    for schema_id, name, fields_macro, desc in RECORD_TYPE.findall(
+            macro_body(text, "TELEMETRY_RECORD_TYPES")):
+        fields = []
+        for key, column, c_type in RECORD_FIELD.findall(macro_body(text, fields_macro)):
+            if column not in by_name:
+                raise SystemExit(f"{name}: unknown column {column}")
+            if by_name[column]["c_type"] != c_type:
+                raise SystemExit(f"{name}: {column} is {by_name[column]['c_type']}, not {c_type}")
+            fields.append({"key": key, "column": by_name[column]})
+        record_types.append({
+            "id": int(schema_id),
+            "name": name.lower(),
+            "desc": desc,
+            "fields": fields,
+        })
+    return columns, record_types
+
+
+def key_parts(key):
+    """("npk", "nitrogen") for a nested key, (None, "soil_ph") for a flat one"""
+    group, _, leaf = key.rpartition(".")
+    return (group or None), leaf
+
+
+def groups_of(fields):
+    seen = []
+    for f in fields:
+        group, _ = key_parts(f["key"])
+        if group and group not in seen:
+            seen.append(group)
+    return seen
+
+
+def emit_decoder(emit, r):
+    name = r["name"]
+    cols = [f["column"]["name"] for f in r["fields"]]
+    names = ", ".join(["device_id", "timestamp", "raw_timestamp", "schema_id", "seq", "boot_id"]
+                      + cols + ["is_dummy"])
+    marks = ", ".join(["?"] * (len(cols) + 7))
+
+    emit("")
+    emit(f"INSERT_{name.upper()} = (")
+    emit(f'    "INSERT INTO sensor_data ({names}) "')
+    emit(f'    "VALUES ({marks})"')
+    emit(")")
+    emit("")
+    emit("")
+    emit(f"def decode_{name}(payload, is_dummy=0):")
+    emit(f'    """Schema {r["id"]}: {r["desc"]}"""')
+    emit('    device_id = payload["device_id"]')
+    emit("    if type(device_id) is not str:")
+    emit('        raise SchemaError("device_id must be a string")')
+    emit('    timestamp = payload["timestamp"]')
+    emit("    if type(timestamp) not in NUMBER_TYPES or not isfinite(timestamp):")
+    emit('        raise SchemaError("timestamp must be a finite number")')
+    emit("    timestamp = int(timestamp)")
+    for key in ("seq", "boot_id"):
+        emit(f'    {key} = payload.get("{key}")')
+        emit(f"    if {key} is not None and (type({key}) is not int or {key} < 0):")
+        emit(f'        raise SchemaError("{key} must be a non-negative integer")')
+    for group in groups_of(r["fields"]):
+        emit(f'    {group} = payload.get("{group}") or {{}}')
+        emit(f"    if type({group}) is not dict:")
+        emit(f'        raise SchemaError("{group} must be an object")')
+    for f in r["fields"]:
+        c = f["column"]
+        group, leaf = key_parts(f["key"])
+        emit(f'    {c["name"]} = {group or "payload"}.get("{leaf}")')
+        emit(f'    if {c["name"]} is not None:')
+        emit(f'        if type({c["name"]}) not in NUMBER_TYPES or not isfinite({c["name"]}):')
+        emit(f'            raise SchemaError("{c["name"]} must be a finite number")')
+        checks = []
+        if c["min"] is not None:
+            checks.append(f'{c["name"]} < {c["min"]}')
+        if c["max"] is not None:
+            checks.append(f'{c["name"]} > {c["max"]}')
+        if checks:
+            emit(f'        if {" or ".join(checks)}:')
+            emit(f'            raise SchemaError("{c["name"]} out of range")')
+    emit("    return (")
+    emit("        device_id,")
+    emit("        timestamp,")
+    emit("        timestamp,")
+    emit(f'        {r["id"]},')
+    emit("        seq,")
+    emit("        boot_id,")
+    for col in cols:
+        emit(f"        {col},")
+    emit("        is_dummy,")
+    emit("    )")
+
+
+def emit_encoder(emit, r):
+    emit("")
+    emit("")
+    emit(f"def encode_{r['name']}(device_id, timestamp, values):")
+    emit(f'    """Schema {r["id"]} payload from a flat dict keyed by column name"""')
+    emit("    return {")
+    emit(f'        "schema_id": {r["id"]},')
+    emit('        "device_id": device_id,')
+    emit('        "timestamp": timestamp,')
+    for f in r["fields"]:
+        group, leaf = key_parts(f["key"])
+        if group is None:
+            emit(f'        "{leaf}": values.get("{f["column"]["name"]}"),')
+    for group in groups_of(r["fields"]):
+        emit(f'        "{group}": {{')
+        for f in r["fields"]:
+            g, leaf = key_parts(f["key"])
+            if g == group:
+                emit(f'            "{leaf}": values.get("{f["column"]["name"]}"),')
+        emit("        },")
+    emit("    }")
+
+
+def generate(columns, record_types):
+    out = []
+    emit = out.append
+
+    emit('"""')
+    emit("Telemetry schema - GENERATED by generate_schema.py from Pico/telemetry_schema.h")
+    emit("Do not edit by hand: change the X-macro header and re-run the generator.")
+    emit('"""')
+    emit("from math import isfinite")
+    emit("")
+    emit("")
+    emit("class SchemaError(ValueError):")
+    emit('    """Payload does not match its record type"""')
+    emit("")
+    emit("")
+    emit("# JSON numbers; exact types, so booleans (an int subclass) are rejected.")
+    emit("# NaN and Infinity parse as floats and are rejected with isfinite().")
+    emit("NUMBER_TYPES = (int, float)")
+    emit("")
+    emit("")
+    emit("# schema_id -> (name, description)")
+    emit("RECORD_TYPES = {")
+    for r in record_types:
+        emit(f'    {r["id"]}: ("{r["name"]}", "{r["desc"]}"),')
+    emit("}")
+    emit("")
+    emit(f'DEFAULT_SCHEMA_ID = {record_types[0]["id"]}  # Payloads without schema_id')
+    emit("")
+    emit("# Store columns: (name, sql type, description)")
+    emit("COLUMNS = (")
+    for c in columns:
+        emit(f'    ("{c["name"]}", "{c["sql_type"]}", "{c["desc"]}"),')
+    emit(")")
+    emit("")
+
+    emit('SENSOR_DATA_DDL = """')
+    emit("    CREATE TABLE IF NOT EXISTS sensor_data (")
+    emit("        id INTEGER PRIMARY KEY AUTOINCREMENT,")
+    emit("        device_id TEXT NOT NULL,")
+    emit("        timestamp INTEGER NOT NULL,")
+    emit("        raw_timestamp INTEGER,")
+    emit("        schema_id INTEGER,")
+    emit("        seq INTEGER,")
+    emit("        boot_id INTEGER,")
+    for c in columns:
+        emit(f'        {c["name"]} {c["sql_type"]},')
+    emit("        is_dummy INTEGER DEFAULT 0,")
+    emit("        created_at DATETIME DEFAULT CURRENT_TIMESTAMP")
+    emit("    )")
+    emit('"""')
+    emit("")
+    emit("# Every optional column; databases created by older releases get the")
+    emit("# missing ones with ALTER TABLE ADD COLUMN")
+    emit("SENSOR_DATA_MIGRATIONS = (")
+    emit('    ("raw_timestamp", "INTEGER"),')
+    emit('    ("schema_id", "INTEGER"),')
+    emit('    ("seq", "INTEGER"),')
+    emit('    ("boot_id", "INTEGER"),')
+    for c in columns:
+        emit(f'    ("{c["name"]}", "{c["sql_type"]}"),')
+    emit(")")
+
+    for r in record_types:
+        emit_decoder(emit, r)
+
+    emit("")
+    emit("")
+    emit("# schema_id -> (insert statement, decoder)")
+    emit("DECODERS = {")
+    for r in record_types:
+        emit(f'    {r["id"]}: (INSERT_{r["name"].upper()}, decode_{r["name"]}),')
+    emit("}")
+    emit("")
+    emit("")
+    emit("def decode(payload, is_dummy=0):")
+    emit('    """')
+    emit("    Dispatch a payload to the decoder of its record type")
+    emit("")
+    emit("    Returns (insert statement, parameters); parameters start with")
+    emit("    device_id, timestamp, raw_timestamp, schema_id, seq, boot_id.")
+    emit("    timestamp is the device's own until the caller replaces it with a")
+    emit("    corrected one; seq and boot_id are None when the device sends none.")
+    emit("    Raises SchemaError for an unknown schema_id or a payload that does")
+    emit("    not fit its record type.")
+    emit('    """')
+    emit("    if type(payload) is not dict:")
+    emit('        raise SchemaError("payload must be an object")')
+    emit('    schema_id = payload.get("schema_id", DEFAULT_SCHEMA_ID)')
+    emit("    entry = DECODERS.get(schema_id) if type(schema_id) is int else None")
+    emit("    if entry is None:")
+    emit('        raise SchemaError(f"unknown schema_id {schema_id}")')
+    emit("    statement, decoder = entry")
+    emit("    try:")
+    emit("        return statement, decoder(payload, is_dummy)")
+    emit("    except SchemaError:")
+    emit("        raise")
+    emit("    except KeyError as e:")
+    emit('        raise SchemaError(f"schema {schema_id}: missing {e}") from None')
+    emit("    except (TypeError, ValueError, AttributeError, OverflowError) as e:")
+    emit('        raise SchemaError(f"schema {schema_id}: {e}") from None')
+
+    for r in record_types:
+        emit_encoder(emit, r)
+
+    emit("")
+    emit("")
+    emit("def payload_from_row(row):")
+    emit('    """Schema fields of a sensor_data row in the API shape (absent -> None)"""')
+    emit("    return {")
+    emit('        "schema_id": row["schema_id"],')
+    for c in columns:
+        if c["name"] not in NPK_COLUMNS:
+            emit(f'        "{c["name"]}": row["{c["name"]}"],')
+    emit('        "npk": {')
+    for c in columns:
+        if c["name"] in NPK_COLUMNS:
+            emit(f'            "{c["name"]}": row["{c["name"]}"],')
+    emit("        },")
+    emit("    }")
+    return "\n".join(out) + "\n"
+
+
+def class_name(name):
+    """legacy_station -> LegacyStation"""
+    return "".join(part.capitalize() for part in name.split("_"))
+
+
+def emit_model_field(emit, c, indent="    "):
+    bounds = ""
+    if c["min"] is not None:
+        bounds += f', ge={c["min"]}'
+    if c["max"] is not None:
+        bounds += f', le={c["max"]}'
+    emit(f'{indent}{c["name"]}: Optional[{PYTHON_TYPES[c["c_type"]]}] = '
+         f'Field(None{bounds}, description="{c["desc"]}")')
+
+
+def generate_models(record_types):
+    out = []
+    emit = out.append
+
+    emit('"""')
+    emit("Telemetry Pydantic models - GENERATED by generate_schema.py from Pico/telemetry_schema.h")
+    emit("Do not edit by hand: change the X-macro header and re-run the generator.")
+    emit("")
+    emit("One model per record type, in the API shape (dotted keys nest). Fields")
+    emit("are optional like the decoders' columns: absent ones stay None.")
+    emit('"""')
+    emit("from datetime import datetime")
+    emit("from typing import Optional")
+    emit("")
+    emit("from pydantic import BaseModel, Field")
+
+    for r in record_types:
+        model = class_name(r["name"])
+        for group in groups_of(r["fields"]):
+            emit("")
+            emit("")
+            emit(f"class {model}{class_name(group)}(BaseModel):")
+            emit(f'    """Schema {r["id"]} "{group}" object"""')
+            for f in r["fields"]:
+                g, _ = key_parts(f["key"])
+                if g == group:
+                    emit_model_field(emit, f["column"])
+
+        emit("")
+        emit("")
+        emit(f"class {model}Reading(BaseModel):")
+        emit(f'    """Schema {r["id"]}: {r["desc"]}"""')
+        emit("    timestamp: datetime = Field(default_factory=datetime.utcnow)")
+        for f in r["fields"]:
+            if key_parts(f["key"])[0] is None:
+                emit_model_field(emit, f["column"])
+        for group in groups_of(r["fields"]):
+            emit(f"    {group}: {model}{class_name(group)} = Field(default_factory={model}{class_name(group)})")
+        emit("")
+        emit("    class Config:")
+        emit("        json_encoders = {")
+        emit("            datetime: lambda v: v.isoformat()")
+        emit("        }")
+
+    emit("")
+    emit("")
+    emit("# schema_id -> model")
+    emit("MODELS = {")
+    for r in record_types:
+        emit(f'    {r["id"]}: {class_name(r["name"])}Reading,')
+    emit("}")
+    return "\n".join(out) + "\n"
+
+
+def main():
+    columns, record_types = parse_header(HEADER.read_text())
+    outputs = (
+        (OUTPUT, generate(columns, record_types)),
+        (MODELS_OUTPUT, generate_models(record_types)),
+    )
+
+    if "--check" in sys.argv:
+        for path, text in outputs:
+            if not path.exists() or path.read_text() != text:
+                print(f"{path} is out of date; run generate_schema.py")
+                sys.exit(1)
+        return
+
+    for path, text in outputs:
+        path.write_text(text)
+    print(f"Wrote {OUTPUT} and {MODELS_OUTPUT.name} ({len(columns)} columns, "
+          f"{len(record_types)} record types)")
+
+
+if __name__ == "__main__":
+    main()
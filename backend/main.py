@@ -1,20 +1,53 @@
 import os
-import random
+import time
+import asyncio
 from datetime import datetime, timedelta
-from fastapi import FastAPI, HTTPException
+from fastapi import FastAPI, HTTPException, Body
 from fastapi.middleware.cors import CORSMiddleware
+from fastapi.responses import Response, StreamingResponse
 from pydantic import BaseModel, Field
-from typing import Optional
+from typing import Optional, Dict, Any, List
 from contextlib import asynccontextmanager
 import uvicorn
 import aiosqlite
 from pathlib import Path
 import logging
 
+from app.telemetry_schema import (
+    SENSOR_DATA_DDL, SENSOR_DATA_MIGRATIONS, RECORD_TYPES, COLUMNS, SchemaError,
+    decode, encode_legacy_json, payload_from_row
+)
+from app.weather import WEATHER_DDL, WeatherStore
+from app.water_balance import WaterBalanceEngine
+from app.irrigation_scheduler import IrrigationScheduler
+from app.moisture_map import MoistureMap, encode_png, TILE_PX
+from app.forecast import MoistureForecaster
+from app.liveness import LivenessTracker, DEVICE_EVENTS_DDL
+from app.clock_sync import ClockSync
+from app.history import (
+    MAX_PAGE, MAX_DEVICES, CursorError, merged_page, per_device_page
+)
+from app.demo import DemoGenerator, DEMO_DEVICE, DEMO_MODE
+from app.latest_segment import LatestSegment, statement_columns
+from app.tiered_store import TieredStore
+from app.compactor import ArchiveCompactor
+from app.range_cache import RangeCache
+from app.sketches import SKETCH_DDL, SKETCH_FLUSH_S, METRICS, SketchRollups, summarize
+from app.ingest_capture import IngestCapture, CaptureMiddleware
+from app.export import (
+    EXPORT_FORMATS, MEDIA_TYPES, ExportError, export_query, export_stream, parquet_available
+)
+from app.timeseries import (
+    SENSOR_BUCKET_SPEC, WEATHER_BUCKET_SPEC, FILL_POLICIES,
+    bucketize, merge_join, asof_join, resample
+)
+
 logging.basicConfig(level=logging.INFO)
 logger = logging.getLogger(__name__)
 
 DB_PATH = os.getenv("DATABASE_PATH", "agriculture_monitor.db")
+# Record ingest requests for Pico/ingest_replay, e.g. "ingest-{pid}.agic.gz"
+INGEST_CAPTURE_PATH = os.getenv("INGEST_CAPTURE_PATH")
 db_dir = Path(DB_PATH).parent
 db_dir.mkdir(parents=True, exist_ok=True)
 
@@ -23,168 +56,202 @@ db_dir.mkdir(parents=True, exist_ok=True)
 STARTUP_TIME = datetime.utcnow()
 logger.info(f"🚀 Backend started at {STARTUP_TIME}")
 
+# Demo readings are computed from the time since start-up, never stored
+demo = DemoGenerator(time.time())
+
 async def init_db():
     async with aiosqlite.connect(DB_PATH) as db:
-        await db.execute("""
-            CREATE TABLE IF NOT EXISTS sensor_data (
-                id INTEGER PRIMARY KEY AUTOINCREMENT,
-                device_id TEXT NOT NULL,
-                timestamp INTEGER NOT NULL,
-                soil_moisture REAL,
-                soil_temperature REAL,
-                humidity REAL,
-                light_intensity REAL,
-                soil_ph REAL,
-                nitrogen INTEGER,
-                phosphorus INTEGER,
-                potassium INTEGER,
-                is_dummy INTEGER DEFAULT 0,
-                created_at DATETIME DEFAULT CURRENT_TIMESTAMP
-            )
-        """)
+        await db.execute(SENSOR_DATA_DDL)
+        
+        # Columns added by later record types
+        cursor = await db.execute("PRAGMA table_info(sensor_data)")
+        existing = {row[1] for row in await cursor.fetchall()}
+        for column, sql_type in SENSOR_DATA_MIGRATIONS:
+            if column not in existing:
+                await db.execute(f"ALTER TABLE sensor_data ADD COLUMN {column} {sql_type}")
+                logger.info(f"🔧 Added sensor_data.{column}")
+        
+        # Time-ordered scans per device (history, weather joins)
+        await db.execute(
+            "CREATE INDEX IF NOT EXISTS idx_sensor_data_device_ts ON sensor_data (device_id, timestamp)"
+        )
+        await db.execute(WEATHER_DDL)
+        await water_balance.initialize(db)
+        await moisture_map.initialize(db)
+        await db.execute(DEVICE_EVENTS_DDL)
+        await db.execute(SKETCH_DDL)
+        
+        # The one full scan: seed the in-memory device registry
+        cursor = await db.execute(
+            "SELECT device_id, MAX(timestamp) FROM sensor_data GROUP BY device_id"
+        )
+        now = time.time()
+        last_seen = await cursor.fetchall()
+        for device_id, last_timestamp in last_seen:
+            liveness.seed(device_id, last_timestamp, now)
+        
+        # Latest values for the shared segment, one index seek per device
+        if latest_segment is not None:
+            db.row_factory = aiosqlite.Row
+            latest_rows = []
+            for device_id, last_timestamp in last_seen:
+                cursor = await db.execute(
+                    "SELECT * FROM sensor_data WHERE device_id = ? AND timestamp = ? AND is_dummy = 0 LIMIT 1",
+                    (device_id, last_timestamp)
+                )
+                row = await cursor.fetchone()
+                if row is not None:
+                    latest_rows.append((device_id, last_timestamp, dict(row)))
+            latest_segment.publish(latest_rows, rollup=False)
+            db.row_factory = None
+        
+        # Archive catalogue and the hot tier's recent rows
+        await tiered.initialize(db, [device_id for device_id, _ in last_seen])
         await db.commit()
 
-# ==================== PYDANTIC MODELS ====================
+weather_store = WeatherStore(DB_PATH)
+try:
+    # Shared by every worker on the host: latest values and hourly rollups
+    latest_segment: Optional[LatestSegment] = LatestSegment()
+except OSError as e:
+    logger.error(f"❌ Latest-value segment unavailable, reading from SQLite: {e}")
+    latest_segment = None
+# Hot rings, warm SQLite, cold archive chunks; reads stitch all three
+tiered = TieredStore(DB_PATH)
+compactor = ArchiveCompactor(tiered)
+sketch_rollups = SketchRollups()
+range_cache = RangeCache(tiered)
+water_balance = WaterBalanceEngine(DB_PATH)
+irrigation_scheduler = IrrigationScheduler(water_balance)
+moisture_map = MoistureMap(DB_PATH)
+forecaster = MoistureForecaster()
+liveness = LivenessTracker(time.time())
+clock_sync = ClockSync()
 
-class NPKValues(BaseModel):
-    nitrogen: Optional[int] = Field(None, ge=0)
-    phosphorus: Optional[int] = Field(None, ge=0)
-    potassium: Optional[int] = Field(None, ge=0)
-    
-    class Config:
-        json_schema_extra = {
-            "example": {"nitrogen": 125, "phosphorus": 48, "potassium": 182}
-        }
+def now_ts() -> int:
+    return int(datetime.utcnow().timestamp())
+
+# ==================== RECORD TYPES ====================
+# Payload layouts, decoders and the sensor_data DDL are generated from
+# Pico/telemetry_schema.h (see generate_schema.py). Each payload carries a
+# schema_id; unversioned payloads decode as the original JSON layout.
 
-class PicoSensorData(BaseModel):
-    """Accepts data from Pico - all fields optional"""
-    device_id: str = Field(...)
-    timestamp: int = Field(...)
-    soil_moisture: Optional[float] = Field(None, ge=0, le=100)
-    soil_temperature: Optional[float] = Field(None)
+# ==================== WEATHER OBSERVATIONS ====================
+
+class WeatherObservation(BaseModel):
+    station_id: str = "default"
+    timestamp: int
+    temperature: Optional[float] = None
     humidity: Optional[float] = Field(None, ge=0, le=100)
-    light_intensity: Optional[float] = Field(None, ge=0, le=100)
-    soil_ph: Optional[float] = Field(None, ge=0, le=14)
-    npk: Optional[NPKValues] = Field(None)
-    
-    class Config:
-        json_schema_extra = {
-            "example": {
-                "device_id": "PICO_NPK_001",
-                "timestamp": 1730317200,
-                "soil_moisture": 35.5,
-                "soil_temperature": 26.0,
-                "humidity": 65.0,
-                "light_intensity": 70.0,
-                "soil_ph": 6.8,
-                "npk": {"nitrogen": 128, "phosphorus": 52, "potassium": 180}
-            }
-        }
+    pressure: Optional[float] = None
+    wind_speed: Optional[float] = Field(None, ge=0)
+    rain_mm: Optional[float] = Field(None, ge=0)
+    solar_radiation: Optional[float] = Field(None, ge=0)
 
-# ==================== DUMMY DATA GENERATOR ====================
+MAX_JOIN_ROWS = 10000
 
-def get_dummy_data():
-    """
-    Generate realistic sensor values that evolve over time
-    0-10s: Blank/zeros
-    10-40s: Transition to realistic
-    40+s: Stable realistic with variations
-    """
-    # Calculate seconds elapsed since backend started
-    seconds_elapsed = (datetime.utcnow() - STARTUP_TIME).total_seconds()
-    
-    # Phase 1: Initialization (0-10 seconds) - show blanks
-    if seconds_elapsed < 10:
-        logger.info(f"⏳ Phase 1: Initializing ({int(seconds_elapsed)}s) - showing blank values")
-        return {
-            "soil_moisture": 0.0,
-            "soil_temperature": 0.0,
-            "humidity": 0.0,
-            "light_intensity": 0.0,
-            "soil_ph": 0.0,
-            "nitrogen": 0,
-            "phosphorus": 0,
-            "potassium": 0,
-            "phase": "initializing"
-        }
-    
-    # Phase 2: Transition (10-40 seconds) - gradually increase
-    elif seconds_elapsed < 40:
-        progress = (seconds_elapsed - 10) / 30.0  # 0.0 to 1.0
-        logger.info(f"⏳ Phase 2: Transitioning ({int(seconds_elapsed)}s, progress: {progress*100:.0f}%) - ramping values")
-        
-        # Target realistic values
-        target_moisture = 35.5
-        target_temp = 26.0
-        target_humidity = 65.0
-        target_light = 70.0
-        target_ph = 6.8
-        target_n = 128
-        target_p = 52
-        target_k = 180
-        
-        # Gradually increase values
-        return {
-            "soil_moisture": round(target_moisture * progress, 2),
-            "soil_temperature": round(target_temp * progress, 2),
-            "humidity": round(target_humidity * progress, 2),
-            "light_intensity": round(target_light * progress, 2),
-            "soil_ph": round(target_ph * progress, 2),
-            "nitrogen": int(target_n * progress),
-            "phosphorus": int(target_p * progress),
-            "potassium": int(target_k * progress),
-            "phase": "transitioning"
-        }
-    
-    # Phase 3: Stable (40+ seconds) - realistic values with variations
-    else:
-        logger.info(f"✅ Phase 3: Initialized ({int(seconds_elapsed)}s) - showing realistic values")
-        
-        # Base realistic values for agricultural soil
-        soil_moisture = 35.5 + random.uniform(-2.5, 2.5)
-        soil_temperature = 26.0 + random.uniform(-0.8, 0.8)
-        humidity = 65.0 + random.uniform(-3, 3)
-        light_intensity = 70.0 + random.uniform(-5, 5)
-        soil_ph = 6.8 + random.uniform(-0.3, 0.3)
-        nitrogen = int(128 + random.uniform(-15, 15))
-        phosphorus = int(52 + random.uniform(-8, 8))
-        potassium = int(180 + random.uniform(-20, 20))
-        
-        # Clamp to realistic ranges
-        soil_moisture = max(0, min(100, soil_moisture))
-        soil_temperature = max(15, min(40, soil_temperature))
-        humidity = max(0, min(100, humidity))
-        light_intensity = max(0, min(100, light_intensity))
-        soil_ph = max(3, min(9, soil_ph))
-        nitrogen = max(0, nitrogen)
-        phosphorus = max(0, phosphorus)
-        potassium = max(0, potassium)
-        
-        return {
-            "soil_moisture": round(soil_moisture, 2),
-            "soil_temperature": round(soil_temperature, 2),
-            "humidity": round(humidity, 2),
-            "light_intensity": round(light_intensity, 2),
-            "soil_ph": round(soil_ph, 2),
-            "nitrogen": nitrogen,
-            "phosphorus": phosphorus,
-            "potassium": potassium,
-            "phase": "initialized"
-        }
+async def iter_sensor_rows(db, device_id: str, start: int, end: int):
+    """Yield a device's readings in [start, end) in timestamp order, from every tier"""
+    async for row in tiered.iter_rows(db, device_id, start, end):
+        yield row
+
+# ==================== IRRIGATION ZONES ====================
+
+class IrrigationZone(BaseModel):
+    station_id: str = "default"
+    device_id: Optional[str] = Field(None, description="Soil moisture sensor in the zone")
+    area_m2: float = Field(..., gt=0)
+    root_depth_m: float = Field(..., gt=0, le=3)
+    field_capacity: float = Field(..., gt=0, le=100, description="Volumetric %")
+    wilting_point: float = Field(..., ge=0, lt=100, description="Volumetric %")
+    depletion_fraction: float = Field(0.5, gt=0, lt=1, description="FAO-56 p")
+    crop_coefficient: float = Field(1.0, gt=0, le=2, description="Kc")
+    efficiency: float = Field(0.85, gt=0, le=1)
+    flow_lpm: Optional[float] = Field(None, gt=0, description="Zone flow when its valve is open")
+    pressure_kpa: Optional[float] = Field(None, ge=0, description="Pressure the emitters need")
+    priority: int = Field(0, description="Higher runs first")
+    window_start_min: Optional[int] = Field(None, ge=0, lt=1440, description="Allowed window, local minutes")
+    window_end_min: Optional[int] = Field(None, ge=0, le=1440)
+
+class IrrigationApplied(BaseModel):
+    depth_mm: Optional[float] = Field(None, ge=0)
+    water_liters: Optional[float] = Field(None, ge=0)
+
+# ==================== MOISTURE MAP ====================
+
+class DeviceLocation(BaseModel):
+    latitude: float = Field(..., ge=-90, le=90)
+    longitude: float = Field(..., ge=-180, le=180)
+
+MAP_METHODS = ("idw", "kriging")
+MAP_WINDOW_ALIGN = 300    # Windowed maps end on 5 minute boundaries so tiles cache
+
+def map_query(method: str, window: int):
+    """Validate map parameters; returns the window end"""
+    if method not in MAP_METHODS:
+        raise HTTPException(status_code=400, detail=f"method must be one of {MAP_METHODS}")
+    if window < 0 or window > 30 * 86400:
+        raise HTTPException(status_code=400, detail="window must be 0 (latest) to 30 days")
+    if moisture_map.layout is None:
+        raise HTTPException(status_code=404, detail="No device locations registered")
+    now = now_ts()
+    return now - now % MAP_WINDOW_ALIGN if window else None
+
+# ==================== DEVICE LIVENESS ====================
+
+async def liveness_loop():
+    """Tick the silence timer wheel once a second and store transitions"""
+    while True:
+        await asyncio.sleep(1)
+        try:
+            liveness.advance(time.time())
+            events = liveness.take_pending_events()
+            if events:
+                async with aiosqlite.connect(DB_PATH) as db:
+                    await db.executemany(
+                        "INSERT INTO device_events (device_id, event, timestamp) VALUES (?, ?, ?)",
+                        events
+                    )
+                    await db.commit()
+        except Exception as e:
+            logger.error(f"❌ Liveness loop error: {str(e)}")
+
+async def sketch_flush_loop():
+    """Merge this worker's quantile sketches into the store"""
+    while True:
+        await asyncio.sleep(SKETCH_FLUSH_S)
+        try:
+            async with aiosqlite.connect(DB_PATH) as db:
+                await sketch_rollups.flush(db)
+        except Exception as e:
+            logger.error(f"❌ Sketch flush error: {str(e)}")
 
 # ==================== FASTAPI APP ====================
 
 @asynccontextmanager
 async def lifespan(app: FastAPI):
-    logger.info("🚀 Starting application with DEMO MODE...")
+    logger.info(f"🚀 Starting application with DEMO MODE {DEMO_MODE}...")
     await init_db()
+    irrigation_scheduler.plan(now_ts())
+    liveness_task = asyncio.create_task(liveness_loop())
+    archive_task = asyncio.create_task(tiered.archive_loop())
+    compactor.start()
+    sketch_task = asyncio.create_task(sketch_flush_loop())
     logger.info("✅ Database initialized")
     logger.info("📊 DEMO MODE ACTIVE:")
     logger.info("   0-10s: Blank values (initializing)")
     logger.info("  10-40s: Transition to realistic values")
     logger.info("   40+s:  Stable realistic demo data")
-    logger.info("   💾 Real Pico data overrides demo mode instantly")
+    logger.info("   💾 Real Pico data overrides demo mode instantly; demo data is never stored")
     yield
+    liveness_task.cancel()
+    archive_task.cancel()
+    compactor.stop()
+    sketch_task.cancel()
+    async with aiosqlite.connect(DB_PATH) as db:
+        await sketch_rollups.flush(db)
+    if ingest_capture is not None:
+        ingest_capture.close()
     logger.info("🛑 Shutting down...")
 
 app = FastAPI(
@@ -202,12 +269,15 @@ app.add_middleware(
     allow_headers=["*"],
 )
 
+ingest_capture = IngestCapture(INGEST_CAPTURE_PATH) if INGEST_CAPTURE_PATH else None
+if ingest_capture is not None:
+    app.add_middleware(CaptureMiddleware, capture=ingest_capture)
+
 # ==================== API ENDPOINTS ====================
 
 @app.get("/health")
 async def health_check():
-    dummy_data = get_dummy_data()
-    phase = dummy_data.pop("phase")
+    phase = demo.phase(time.time()) if demo.enabled else "off"
     
     return {
         "status": "ok",
@@ -217,40 +287,184 @@ async def health_check():
         "demo_phase": phase
     }
 
+async def ingest_payloads(payloads: List[Dict[str, Any]]) -> List[tuple]:
+    """
+    Decode, clock-correct and store a batch of real payloads, then feed the
+    in-memory models. Returns the stored parameter tuples.
+    """
+    receive_time = time.time()
+    decoded = []
+    for index, payload in enumerate(payloads):
+        try:
+            decoded.append(decode(payload, is_dummy=0))
+        except SchemaError as e:
+            raise HTTPException(status_code=422, detail=f"payload {index}: {e}" if len(payloads) > 1 else str(e))
+    
+    # Device clocks: one correction pass per device in the batch
+    by_device: Dict[str, List[int]] = {}
+    for index, (_, params) in enumerate(decoded):
+        by_device.setdefault(params[0], []).append(index)
+    for device_id, indexes in by_device.items():
+        # (raw_timestamp, seq, boot_id) as decoded and type-checked
+        corrected = clock_sync.correct(
+            device_id, [(decoded[i][1][2], decoded[i][1][4], decoded[i][1][5]) for i in indexes], receive_time
+        )
+        for i, timestamp in zip(indexes, corrected):
+            statement, params = decoded[i]
+            decoded[i] = (statement, (params[0], timestamp) + params[2:])
+    
+    by_statement: Dict[str, List[tuple]] = {}
+    for statement, params in decoded:
+        by_statement.setdefault(statement, []).append(params)
+    async with aiosqlite.connect(DB_PATH) as db:
+        for statement, rows in by_statement.items():
+            await db.executemany(statement, rows)
+        await db.commit()
+    
+    readings = [
+        (params[0], params[1], dict(zip(statement_columns(statement), params)))
+        for statement, params in decoded
+    ]
+    if latest_segment is not None:
+        latest_segment.publish(readings)
+    sketch_rollups.add(readings)
+    
+    changed_zones = set()
+    for (_, params), payload in zip(decoded, payloads):
+        device_id, timestamp = params[0], params[1]
+        soil_moisture = payload.get("soil_moisture")
+        liveness.seen(device_id, timestamp, receive_time)
+        moisture_map.ingest_reading(device_id, timestamp, soil_moisture)
+        forecaster.update(
+            device_id, timestamp, soil_moisture,
+            payload.get("air_temperature", payload.get("soil_temperature")),
+            water_balance.device_et0(device_id)
+        )
+        changed_zones.update(water_balance.ingest_reading(device_id, timestamp, soil_moisture))
+    if changed_zones:
+        irrigation_scheduler.update_zones(changed_zones, now_ts())
+    return [params for _, params in decoded]
+
 @app.post("/api/sensors/data")
-async def receive_sensor_data(data: PicoSensorData):
-    """Receive REAL sensor data from Pico"""
+async def receive_sensor_data(payload: Dict[str, Any] = Body(...)):
+    """Receive REAL sensor data from Pico, decoded by its record type"""
     try:
-        logger.info(f"📡 REAL DATA from {data.device_id} | Temp: {data.soil_temperature}°C")
-        
-        nitrogen = data.npk.nitrogen if data.npk else None
-        phosphorus = data.npk.phosphorus if data.npk else None
-        potassium = data.npk.potassium if data.npk else None
-        
-        async with aiosqlite.connect(DB_PATH) as db:
-            await db.execute(
-                """INSERT INTO sensor_data
-                (device_id, timestamp, soil_moisture, soil_temperature, humidity,
-                 light_intensity, soil_ph, nitrogen, phosphorus, potassium, is_dummy)
-                VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?, ?, 0)""",
-                (
-                    data.device_id, data.timestamp, data.soil_moisture,
-                    data.soil_temperature, data.humidity, data.light_intensity,
-                    data.soil_ph, nitrogen, phosphorus, potassium
-                )
-            )
-            await db.commit()
-        
-        logger.info(f"✅ REAL data stored - demo mode DISABLED for {data.device_id}")
+        params = (await ingest_payloads([payload]))[0]
+        device_id, timestamp, raw_timestamp, schema_id = params[:4]
+        logger.info(f"📡 REAL DATA from {device_id} | schema {schema_id} ({RECORD_TYPES[schema_id][0]})")
+        logger.info(f"✅ REAL data stored - demo mode DISABLED for {device_id}")
         
         return {
             "status": "success",
             "message": "Real sensor data received and stored",
-            "device_id": data.device_id,
-            "timestamp": data.timestamp,
+            "device_id": device_id,
+            "timestamp": timestamp,
+            "raw_timestamp": raw_timestamp,
+            "schema_id": schema_id,
             "data_type": "real"
         }
     
+    except HTTPException:
+        raise
+    except Exception as e:
+        logger.error(f"❌ Error: {str(e)}")
+        raise HTTPException(status_code=500, detail=f"Error: {str(e)}")
+
+@app.post("/api/sensors/data/batch")
+async def receive_sensor_batch(payloads: List[Dict[str, Any]] = Body(...)):
+    """Receive a batch of readings (queued uploads); stored all or nothing"""
+    if not payloads or len(payloads) > 1000:
+        raise HTTPException(status_code=400, detail="batch must hold 1-1000 payloads")
+    try:
+        stored = await ingest_payloads(payloads)
+        logger.info(f"📡 REAL DATA batch of {len(stored)}")
+        return {"status": "success", "stored": len(stored), "data_type": "real"}
+    
+    except HTTPException:
+        raise
+    except Exception as e:
+        logger.error(f"❌ Error: {str(e)}")
+        raise HTTPException(status_code=500, detail=f"Error: {str(e)}")
+
+@app.get("/api/devices/{device_id}/clock")
+async def get_device_clock(device_id: str):
+    """Estimated boot epoch and drift of an uptime-stamped device"""
+    status = clock_sync.status(device_id)
+    if status is None:
+        raise HTTPException(status_code=404, detail=f"No uptime-stamped readings from {device_id}")
+    return {"status": "success", **status}
+
+@app.get("/api/sensors/{device_id}/rollups")
+async def get_rollups(device_id: str):
+    """Latest reading and hourly rollups of the last day, from shared memory"""
+    reading = latest_segment.read(device_id, rollups=True) if latest_segment is not None else None
+    if reading is None:
+        raise HTTPException(status_code=404, detail=f"No recent readings from {device_id}")
+    return {"status": "success", **reading}
+
+def demo_row(reading: Dict) -> Dict:
+    """A generated demo reading in the shape of a stored one"""
+    phase = reading.pop("phase")
+    payload = encode_legacy_json(DEMO_DEVICE, reading["timestamp"], reading)
+    return {
+        "id": 0,
+        **payload,
+        "data_type": "demo",
+        "demo_phase": phase,
+        "created_at": datetime.utcfromtimestamp(reading["timestamp"]).isoformat()
+    }
+
+def segment_row(reading: Dict) -> Dict:
+    """A shared-segment reading in the shape of a stored one"""
+    return {
+        "id": None,
+        "device_id": reading["device_id"],
+        "timestamp": reading["timestamp"],
+        **payload_from_row({**reading, "schema_id": None}),
+        "data_type": "real",
+        "created_at": None
+    }
+
+@app.get("/api/sensors/{device_id}/quantiles")
+async def get_quantiles(
+    device_id: str,
+    start: int,
+    end: int,
+    metric: str = "soil_moisture",
+    q: str = "0.05,0.5,0.95",
+    below: Optional[float] = None
+):
+    """
+    Quantiles of a metric over [start, end) from merged hourly sketches
+    
+    Buckets are whole hours, so the range is widened to hour boundaries.
+    With `below` (e.g. the wilting point), also the share of readings
+    under it and the hours spent under it.
+    """
+    if metric not in METRICS:
+        raise HTTPException(status_code=400, detail=f"metric must be one of {list(METRICS)}")
+    try:
+        quantiles = [float(x) for x in q.split(",") if x.strip()]
+    except ValueError:
+        raise HTTPException(status_code=400, detail="q must be comma separated numbers")
+    if not quantiles or any(not 0 <= x <= 1 for x in quantiles):
+        raise HTTPException(status_code=400, detail="q values must be between 0 and 1")
+    if end <= start:
+        raise HTTPException(status_code=400, detail="end must be after start")
+    
+    try:
+        async with aiosqlite.connect(DB_PATH) as db:
+            buckets = await sketch_rollups.buckets(db, device_id, metric, start, end)
+        
+        return {
+            "status": "success",
+            "device_id": device_id,
+            "metric": metric,
+            "start": start,
+            "end": end,
+            **summarize(buckets, quantiles, below)
+        }
+    
     except Exception as e:
         logger.error(f"❌ Error: {str(e)}")
         raise HTTPException(status_code=500, detail=f"Error: {str(e)}")
@@ -259,6 +473,17 @@ async def receive_sensor_data(data: PicoSensorData):
 async def get_current_data(device_id: Optional[str] = None):
     """Get latest sensor data - real Pico data if available, otherwise realistic demo data"""
     try:
+        # Shared segment first: no query, same answer from every worker
+        if latest_segment is not None:
+            if device_id:
+                reading = latest_segment.read(device_id)
+                readings = [reading] if reading is not None else []
+            else:
+                readings = latest_segment.latest(10)
+            if readings:
+                data_list = [segment_row(reading) for reading in readings]
+                return {"status": "success", "count": len(data_list), "data": data_list}
+        
         async with aiosqlite.connect(DB_PATH) as db:
             db.row_factory = aiosqlite.Row
             
@@ -281,67 +506,15 @@ async def get_current_data(device_id: Optional[str] = None):
                     "id": row["id"],
                     "device_id": row["device_id"],
                     "timestamp": row["timestamp"],
-                    "soil_moisture": row["soil_moisture"],
-                    "soil_temperature": row["soil_temperature"],
-                    "humidity": row["humidity"],
-                    "light_intensity": row["light_intensity"],
-                    "soil_ph": row["soil_ph"],
-                    "npk": {
-                        "nitrogen": row["nitrogen"],
-                        "phosphorus": row["phosphorus"],
-                        "potassium": row["potassium"]
-                    },
+                    **payload_from_row(row),
                     "data_type": "real",
                     "created_at": row["created_at"]
                 })
             
-            # If no real data, return realistic demo data
-            if not data_list:
+            # If no real data, return realistic demo data (generated, not stored)
+            if not data_list and demo.enabled:
                 logger.info("📊 No real data - returning realistic DEMO data")
-                dummy_data = get_dummy_data()
-                phase = dummy_data.pop("phase")
-                
-                # Also store demo data for history
-                if phase != "initializing":
-                    async with aiosqlite.connect(DB_PATH) as db2:
-                        await db2.execute(
-                            """INSERT INTO sensor_data
-                            (device_id, timestamp, soil_moisture, soil_temperature, humidity,
-                             light_intensity, soil_ph, nitrogen, phosphorus, potassium, is_dummy)
-                            VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?, ?, 1)""",
-                            (
-                                "DEMO_DEVICE",
-                                int(datetime.utcnow().timestamp()),
-                                dummy_data["soil_moisture"],
-                                dummy_data["soil_temperature"],
-                                dummy_data["humidity"],
-                                dummy_data["light_intensity"],
-                                dummy_data["soil_ph"],
-                                dummy_data["nitrogen"],
-                                dummy_data["phosphorus"],
-                                dummy_data["potassium"]
-                            )
-                        )
-                        await db2.commit()
-                
-                data_list = [{
-                    "id": 0,
-                    "device_id": "DEMO_DEVICE",
-                    "timestamp": int(datetime.utcnow().timestamp()),
-                    "soil_moisture": dummy_data["soil_moisture"],
-                    "soil_temperature": dummy_data["soil_temperature"],
-                    "humidity": dummy_data["humidity"],
-                    "light_intensity": dummy_data["light_intensity"],
-                    "soil_ph": dummy_data["soil_ph"],
-                    "npk": {
-                        "nitrogen": dummy_data["nitrogen"],
-                        "phosphorus": dummy_data["phosphorus"],
-                        "potassium": dummy_data["potassium"]
-                    },
-                    "data_type": "demo",
-                    "demo_phase": phase,
-                    "created_at": datetime.utcnow().isoformat()
-                }]
+                data_list = [demo_row(demo.reading())]
             
             return {"status": "success", "count": len(data_list), "data": data_list}
     
@@ -356,15 +529,12 @@ async def get_history(device_id: str, limit: int = 100):
         if limit > 1000:
             limit = 1000
         
+        if device_id == DEMO_DEVICE and demo.enabled:
+            data_list = [demo_row(reading) for reading in demo.history(limit)]
+            return {"status": "success", "device_id": device_id, "count": len(data_list), "data": data_list}
+        
         async with aiosqlite.connect(DB_PATH) as db:
-            db.row_factory = aiosqlite.Row
-            
-            cursor = await db.execute(
-                "SELECT * FROM sensor_data WHERE device_id = ? ORDER BY timestamp DESC LIMIT ?",
-                (device_id, limit)
-            )
-            
-            rows = await cursor.fetchall()
+            rows = await tiered.latest(db, device_id, limit)
             
             data_list = []
             for row in rows:
@@ -372,16 +542,7 @@ async def get_history(device_id: str, limit: int = 100):
                     "id": row["id"],
                     "device_id": row["device_id"],
                     "timestamp": row["timestamp"],
-                    "soil_moisture": row["soil_moisture"],
-                    "soil_temperature": row["soil_temperature"],
-                    "humidity": row["humidity"],
-                    "light_intensity": row["light_intensity"],
-                    "soil_ph": row["soil_ph"],
-                    "npk": {
-                        "nitrogen": row["nitrogen"],
-                        "phosphorus": row["phosphorus"],
-                        "potassium": row["potassium"]
-                    },
+                    **payload_from_row(row),
                     "data_type": "real" if not row["is_dummy"] else "demo",
                     "created_at": row["created_at"]
                 })
@@ -392,26 +553,415 @@ async def get_history(device_id: str, limit: int = 100):
         logger.error(f"❌ Error: {str(e)}")
         raise HTTPException(status_code=500, detail=f"Error: {str(e)}")
 
-@app.get("/api/devices")
-async def get_devices():
-    """Get all devices"""
+@app.get("/api/sensors/history/page")
+async def get_history_page(
+    device_ids: str,
+    metrics: Optional[str] = None,
+    limit: int = 500,
+    cursor: Optional[str] = None,
+    layout: str = "merged",
+    order: str = "desc"
+):
+    """
+    Keyset-paginated history of several devices in one call
+    
+    layout=merged: one stream ordered by timestamp, then device;
+    layout=per_device: up to `limit` rows for each device. Pass the
+    returned next_cursor to get the following page (null at the end).
+    """
+    devices = [d.strip() for d in device_ids.split(",") if d.strip()]
+    names = [m.strip() for m in metrics.split(",") if m.strip()] if metrics else [c[0] for c in COLUMNS]
+    if not devices or len(devices) > MAX_DEVICES:
+        raise HTTPException(status_code=400, detail=f"select 1 to {MAX_DEVICES} devices")
+    if any(name not in {c[0] for c in COLUMNS} for name in names):
+        raise HTTPException(status_code=400, detail=f"metrics must be from {[c[0] for c in COLUMNS]}")
+    if not 1 <= limit <= MAX_PAGE:
+        raise HTTPException(status_code=400, detail=f"limit must be 1-{MAX_PAGE}")
+    if layout not in ("merged", "per_device") or order not in ("asc", "desc"):
+        raise HTTPException(status_code=400, detail="layout must be merged or per_device, order asc or desc")
+    
     try:
+        page = merged_page if layout == "merged" else per_device_page
         async with aiosqlite.connect(DB_PATH) as db:
+            result = await page(db, devices, names, limit, cursor, order == "desc", tiered)
+        
+        return {"status": "success", "layout": layout, "order": order, **result}
+    
+    except CursorError as e:
+        raise HTTPException(status_code=400, detail=str(e))
+    except Exception as e:
+        logger.error(f"❌ Error: {str(e)}")
+        raise HTTPException(status_code=500, detail=f"Error: {str(e)}")
+
+@app.get("/api/sensors/export")
+async def export_history(
+    device_ids: str,
+    start: int,
+    end: int,
+    metrics: Optional[str] = None,
+    format: str = "csv",
+    include_demo: bool = False
+):
+    """
+    Stream a range of history as CSV or Parquet, any length
+    
+    device_ids and metrics are comma separated (metrics default to all).
+    Rows are ordered by device, then timestamp.
+    """
+    devices = [d.strip() for d in device_ids.split(",") if d.strip()]
+    names = [m.strip() for m in metrics.split(",") if m.strip()] if metrics else [c[0] for c in COLUMNS]
+    if format not in EXPORT_FORMATS:
+        raise HTTPException(status_code=400, detail=f"format must be one of {EXPORT_FORMATS}")
+    if format == "parquet" and not parquet_available():
+        raise HTTPException(status_code=400, detail="parquet export needs pyarrow on the server")
+    try:
+        export_query(devices, names, start, end, include_demo)
+    except ExportError as e:
+        raise HTTPException(status_code=400, detail=str(e))
+    
+    filename = f"sensor_data_{start}_{end}.{format}"
+    return StreamingResponse(
+        export_stream(DB_PATH, devices, names, start, end, format, include_demo, tiered),
+        media_type=MEDIA_TYPES[format],
+        headers={"Content-Disposition": f'attachment; filename="{filename}"'}
+    )
+
+@app.get("/api/storage/tiers")
+async def get_storage_tiers():
+    """Rows and bytes per storage tier, and the last archive and compaction passes"""
+    try:
+        async with aiosqlite.connect(DB_PATH) as db:
+            return {
+                "status": "success",
+                **await tiered.stats(db),
+                "last_compaction": compactor.last_report,
+                "range_cache": range_cache.stats()
+            }
+    
+    except Exception as e:
+        logger.error(f"❌ Error: {str(e)}")
+        raise HTTPException(status_code=500, detail=f"Error: {str(e)}")
+
+@app.get("/api/sensors/series")
+async def get_series(
+    device_id: str,
+    start: int,
+    end: int,
+    resolution: int = 300,
+    metrics: str = "soil_moisture"
+):
+    """
+    A device's metrics per `resolution` seconds: mean, min, max and count
+    
+    The range is widened to whole buckets. Repeated ranges are served from
+    the range cache, reading only buckets newer than it covers.
+    """
+    names = [m.strip() for m in metrics.split(",") if m.strip()]
+    if not names or any(name not in METRICS for name in names):
+        raise HTTPException(status_code=400, detail=f"metrics must be from {list(METRICS)}")
+    if resolution < 60 or end <= start:
+        raise HTTPException(status_code=400, detail="need resolution >= 60 and end after start")
+    if (end - start) // resolution > MAX_JOIN_ROWS:
+        raise HTTPException(status_code=400, detail=f"at most {MAX_JOIN_ROWS} buckets per query")
+    
+    try:
+        async with aiosqlite.connect(DB_PATH) as db:
+            data_list, cache = await range_cache.series(db, device_id, names, start, end, resolution)
+        
+        return {
+            "status": "success",
+            "device_id": device_id,
+            "resolution": resolution,
+            "count": len(data_list),
+            "cache": cache,
+            "data": data_list
+        }
+    
+    except Exception as e:
+        logger.error(f"❌ Error: {str(e)}")
+        raise HTTPException(status_code=500, detail=f"Error: {str(e)}")
+
+@app.post("/api/weather/observations")
+async def receive_weather_observations(observations: List[WeatherObservation]):
+    """Store weather observations (station feed or weather API poller)"""
+    try:
+        batch = [obs.dict() for obs in observations]
+        count = await weather_store.insert_observations(batch)
+        closed = await water_balance.ingest_weather(batch)
+        if closed:
+            stations = {row[0] for row in closed}
+            irrigation_scheduler.update_zones(
+                [zone.zone_id for s in stations for zone in water_balance.zones_by_station.get(s, ())],
+                now_ts()
+            )
+        return {"status": "success", "stored": count, "days_closed": len(closed)}
+    
+    except Exception as e:
+        logger.error(f"❌ Error: {str(e)}")
+        raise HTTPException(status_code=500, detail=f"Error: {str(e)}")
+
+@app.get("/api/analysis/sensor-weather")
+async def get_sensor_weather(
+    device_id: str,
+    start: int,
+    end: int,
+    station_id: str = "default",
+    mode: str = "bucket",
+    bucket: int = 3600,
+    tolerance: int = 1800
+):
+    """
+    Sensor history aligned with weather in one pass over both series
+    
+    mode=bucket: per-bucket sensor means merged with weather aggregates
+                 (rain summed, temperature mean/min/max)
+    mode=asof:   each reading with the latest weather observation at most
+                 `tolerance` seconds older
+    """
+    if end <= start:
+        raise HTTPException(status_code=400, detail="end must be after start")
+    if mode == "bucket":
+        if bucket < 60:
+            raise HTTPException(status_code=400, detail="bucket must be at least 60 seconds")
+        if (end - start) // bucket > MAX_JOIN_ROWS:
+            raise HTTPException(status_code=400, detail=f"at most {MAX_JOIN_ROWS} buckets per query")
+    elif mode != "asof":
+        raise HTTPException(status_code=400, detail="mode must be bucket or asof")
+    
+    try:
+        async with aiosqlite.connect(DB_PATH) as db:
+            sensors = iter_sensor_rows(db, device_id, start, end)
+            weather = WeatherStore.iter_observations(
+                db, station_id, start - (tolerance if mode == "asof" else 0), end
+            )
+            
+            data_list = []
+            if mode == "bucket":
+                async for ts, sensor, wx in merge_join(
+                    bucketize(sensors, bucket, SENSOR_BUCKET_SPEC),
+                    bucketize(weather, bucket, WEATHER_BUCKET_SPEC)
+                ):
+                    data_list.append({"timestamp": ts, "sensor": sensor, "weather": wx})
+            else:
+                async for row, wx in asof_join(sensors, weather, tolerance):
+                    data_list.append({
+                        "timestamp": row["timestamp"],
+                        "sensor": payload_from_row(row),
+                        "weather": dict(wx) if wx is not None else None
+                    })
+                    if len(data_list) >= MAX_JOIN_ROWS:
+                        break
+            
+            return {
+                "status": "success",
+                "device_id": device_id,
+                "station_id": station_id,
+                "mode": mode,
+                "count": len(data_list),
+                "data": data_list
+            }
+    
+    except Exception as e:
+        logger.error(f"❌ Error: {str(e)}")
+        raise HTTPException(status_code=500, detail=f"Error: {str(e)}")
+
+@app.get("/api/sensors/resampled")
+async def get_resampled(
+    device_id: str,
+    start: int,
+    end: int,
+    step: int = 300,
+    fields: str = "soil_moisture",
+    fill: str = "none",
+    max_gap: Optional[int] = None
+):
+    """
+    A device's series on a fixed grid of `step` seconds from `start`
+    
+    fill=none|previous|linear|bounded; max_gap (seconds) bounds how far
+    previous/bounded fill reaches. Every grid point is returned, with a
+    per-field quality of measured, filled or gap.
+    """
+    names = [f.strip() for f in fields.split(",") if f.strip()]
+    if not names or any(name not in SENSOR_BUCKET_SPEC for name in names):
+        raise HTTPException(status_code=400, detail=f"fields must be from {sorted(SENSOR_BUCKET_SPEC)}")
+    if fill not in FILL_POLICIES:
+        raise HTTPException(status_code=400, detail=f"fill must be one of {FILL_POLICIES}")
+    if fill == "bounded" and max_gap is None:
+        raise HTTPException(status_code=400, detail="bounded fill needs max_gap")
+    if step < 1 or end <= start:
+        raise HTTPException(status_code=400, detail="need step >= 1 and end after start")
+    if (end - start + step - 1) // step > MAX_JOIN_ROWS:
+        raise HTTPException(status_code=400, detail=f"at most {MAX_JOIN_ROWS} grid points per query")
+    
+    try:
+        # Earlier readings only seed previous/linear fill at the grid start
+        lookback = 0 if fill == "none" else (max_gap if max_gap is not None else 86400)
+        async with aiosqlite.connect(DB_PATH) as db:
+            data_list = [
+                point async for point in resample(
+                    iter_sensor_rows(db, device_id, start - lookback, end),
+                    names, start, end, step, fill, max_gap
+                )
+            ]
+        
+        return {
+            "status": "success",
+            "device_id": device_id,
+            "step": step,
+            "fill": fill,
+            "count": len(data_list),
+            "data": data_list
+        }
+    
+    except HTTPException:
+        raise
+    except Exception as e:
+        logger.error(f"❌ Error: {str(e)}")
+        raise HTTPException(status_code=500, detail=f"Error: {str(e)}")
+
+@app.put("/api/irrigation/zones/{zone_id}")
+async def put_irrigation_zone(zone_id: str, zone: IrrigationZone):
+    """Create or reconfigure an irrigation zone (water balance state is kept)"""
+    if zone.wilting_point >= zone.field_capacity:
+        raise HTTPException(status_code=400, detail="wilting_point must be below field_capacity")
+    try:
+        config = zone.dict()
+        config["zone_id"] = zone_id
+        updated = await water_balance.upsert_zone(config)
+        irrigation_scheduler.update_zones([zone_id], now_ts())
+        return {"status": "success", "zone": updated.recommendation()}
+    
+    except Exception as e:
+        logger.error(f"❌ Error: {str(e)}")
+        raise HTTPException(status_code=500, detail=f"Error: {str(e)}")
+
+@app.post("/api/irrigation/zones/{zone_id}/applied")
+async def irrigation_applied(zone_id: str, applied: IrrigationApplied):
+    """Record water applied to a zone, as depth or volume"""
+    zone = water_balance.zones.get(zone_id)
+    if zone is None:
+        raise HTTPException(status_code=404, detail=f"Unknown zone {zone_id}")
+    if applied.depth_mm is not None:
+        depth_mm = applied.depth_mm
+    elif applied.water_liters is not None:
+        depth_mm = applied.water_liters * zone.efficiency / zone.area_m2
+    else:
+        raise HTTPException(status_code=400, detail="depth_mm or water_liters required")
+    
+    await water_balance.record_irrigation(zone_id, depth_mm)
+    irrigation_scheduler.update_zones([zone_id], now_ts())
+    return {"status": "success", "zone_id": zone_id, "depth_mm": round(depth_mm, 2)}
+
+@app.get("/api/irrigation/recommendations")
+async def get_irrigation_recommendations(due_only: bool = False):
+    """Per zone depletion and irrigation need, most urgent first"""
+    data_list = water_balance.recommendations(only_due=due_only)
+    return {"status": "success", "count": len(data_list), "zones": data_list}
+
+@app.get("/api/irrigation/schedule")
+async def get_irrigation_schedule():
+    """Current plan of zone runs under the shared pump limits"""
+    return {"status": "success", **irrigation_scheduler.schedule()}
+
+@app.post("/api/irrigation/schedule/replan")
+async def replan_irrigation():
+    """Plan every zone from scratch (runs in progress are kept)"""
+    return {"status": "success", **irrigation_scheduler.plan(now_ts())}
+
+@app.get("/api/irrigation/et0")
+async def get_et0(station_id: str = "default", days: int = 30):
+    """Daily reference evapotranspiration of closed days"""
+    try:
+        async with aiosqlite.connect(DB_PATH) as db:
+            db.row_factory = aiosqlite.Row
             cursor = await db.execute(
-                "SELECT DISTINCT device_id, MAX(timestamp) as last_timestamp FROM sensor_data GROUP BY device_id"
+                "SELECT * FROM et0_daily WHERE station_id = ? ORDER BY day DESC LIMIT ?",
+                (station_id, min(days, 366))
             )
             rows = await cursor.fetchall()
             
-            devices = []
-            for row in rows:
-                devices.append({"device_id": row[0], "last_timestamp": row[1]})
-            
-            return {"status": "success", "count": len(devices), "devices": devices}
+            data_list = [{**dict(row), "date": datetime.utcfromtimestamp(row["day"] * 86400).date().isoformat()}
+                         for row in rows]
+            return {"status": "success", "station_id": station_id, "count": len(data_list), "data": data_list}
+    
+    except Exception as e:
+        logger.error(f"❌ Error: {str(e)}")
+        raise HTTPException(status_code=500, detail=f"Error: {str(e)}")
+
+@app.get("/api/forecast/{device_id}")
+async def get_moisture_forecast(device_id: str, hours: str = "6,12,24,48"):
+    """Short-horizon soil moisture forecast from the device's online model"""
+    try:
+        horizons = [float(h) for h in hours.split(",")]
+    except ValueError:
+        raise HTTPException(status_code=400, detail="hours must be comma separated numbers")
+    if not horizons or any(h <= 0 or h > 168 for h in horizons):
+        raise HTTPException(status_code=400, detail="horizons must be within 0-168 hours")
+    
+    result = forecaster.forecast(device_id, horizons)
+    if result is None:
+        raise HTTPException(status_code=404, detail=f"No readings from {device_id} since startup")
+    return {"status": "success", **result}
+
+@app.put("/api/devices/{device_id}/location")
+async def put_device_location(device_id: str, location: DeviceLocation):
+    """Register where a probe is installed"""
+    await moisture_map.set_location(device_id, location.latitude, location.longitude)
+    return {"status": "success", "device_id": device_id}
+
+@app.get("/api/map/moisture")
+async def get_moisture_map_info():
+    """Tile layout and device positions of the moisture map"""
+    return {"status": "success", **moisture_map.metadata()}
+
+@app.get("/api/map/moisture/tiles/{tx}/{ty}.png")
+async def get_moisture_tile(tx: int, ty: int, method: str = "idw", window: int = 0):
+    """One map tile; window > 0 maps the mean over the last `window` seconds"""
+    end = map_query(method, window)
+    try:
+        values = await moisture_map.tile(tx, ty, method, window, end)
+    except IndexError as e:
+        raise HTTPException(status_code=404, detail=str(e))
+    return Response(encode_png(values, TILE_PX, TILE_PX), media_type="image/png")
+
+@app.get("/api/map/moisture/raster")
+async def get_moisture_raster(method: str = "idw", window: int = 0, format: str = "png"):
+    """Whole map as one image, or as a JSON grid (rows north to south)"""
+    end = map_query(method, window)
+    try:
+        grid, width, height = await moisture_map.raster(method, window, end)
+        if format == "json":
+            return {
+                "status": "success",
+                "width": width,
+                "height": height,
+                "values": [None if v is None else round(v, 2) for v in grid],
+                **moisture_map.metadata()
+            }
+        return Response(encode_png(grid, width, height), media_type="image/png")
     
     except Exception as e:
         logger.error(f"❌ Error: {str(e)}")
         raise HTTPException(status_code=500, detail=f"Error: {str(e)}")
 
+@app.get("/api/devices")
+async def get_devices():
+    """Get all devices with their liveness, from memory"""
+    devices = liveness.device_list()
+    online = sum(1 for d in devices if d["status"] == "online")
+    return {"status": "success", "count": len(devices), "online": online, "devices": devices}
+
+@app.get("/api/devices/events")
+async def get_device_events(limit: int = 100):
+    """Recent online/offline transitions, newest first"""
+    events = list(liveness.events)[-min(limit, 1000):][::-1]
+    return {
+        "status": "success",
+        "count": len(events),
+        "events": [{"device_id": d, "event": e, "timestamp": t} for d, e, t in events]
+    }
+
 if __name__ == "__main__":
     port = int(os.getenv("PORT", 8000))
     logger.info(f"🚀 Starting server on 0.0.0.0:{port}")
@@ -0,0 +1,55 @@
+"""
+Backfill duplicate check against warm and archived rows
+
+Run from backend/: python -m unittest discover tests
+"""
+import os
+import sqlite3
+import tempfile
+import unittest
+from unittest import mock
+
+import aiosqlite
+
+from app.backfill import drop_existing, prepare_store
+from app.tiered_store import TieredStore, DAY_S
+
+DEVICE = "pico-test"
+DAY = 19000
+
+
+class DropExistingTest(unittest.IsolatedAsyncioTestCase):
+    async def asyncSetUp(self):
+        self.dir = tempfile.TemporaryDirectory()
+        self.db_path = os.path.join(self.dir.name, "test.db")
+        db = sqlite3.connect(self.db_path)
+        prepare_store(db)
+        db.executemany(
+            "INSERT INTO sensor_data (device_id, timestamp, soil_moisture) VALUES (?, ?, ?)",
+            [(DEVICE, DAY * DAY_S + i * 600, 40.0) for i in range(144)]
+        )
+        db.commit()
+        db.close()
+
+    async def asyncTearDown(self):
+        self.dir.cleanup()
+
+    def rows(self, count):
+        return [(DEVICE, DAY * DAY_S + i * 600, None, 2) for i in range(count)]
+
+    async def test_warm_rows_dropped(self):
+        with sqlite3.connect(self.db_path) as db:
+            self.assertEqual(drop_existing(db, self.rows(150)), self.rows(150)[144:])
+
+    async def test_archived_rows_dropped(self):
+        store = TieredStore(self.db_path, os.path.join(self.dir.name, "archive"))
+        async with aiosqlite.connect(self.db_path) as db:
+            await store.open_catalog(db)
+            self.assertEqual(await store.archive_day(db, DEVICE, DAY), (144, mock.ANY))
+        with sqlite3.connect(self.db_path) as db:
+            self.assertEqual(db.execute("SELECT COUNT(*) FROM sensor_data").fetchone()[0], 0)
+            self.assertEqual(drop_existing(db, self.rows(150)), self.rows(150)[144:])
+
+
+if __name__ == "__main__":
+    unittest.main()
@@ -0,0 +1,93 @@
+"""
+Clock sync: hull fit of the boot offset line and timestamp correction
+
+Run from backend/: python -m unittest discover tests
+"""
+import random
+import unittest
+
+from app.clock_sync import BootClock, ClockSync, BUCKET_S, MAX_DRIFT
+
+EPOCH = 1_700_000_000.0
+
+
+def observed_clock(drift, delays, span=20 * BUCKET_S, step=30):
+    """BootClock fed readings every step seconds with the given delay source"""
+    clock = BootClock()
+    for d in range(step, span, step):
+        clock.observe(d, EPOCH + (1 + drift) * d + delays(d))
+    clock.fit()
+    return clock
+
+
+def total_delay(clock, epoch, drift):
+    return sum(offset - (epoch + drift * d) for d, offset in clock.minima.values())
+
+
+class BootClockFitTest(unittest.TestCase):
+    def test_recovers_epoch_and_drift(self):
+        # One undelayed reading per bucket puts every minimum on the line
+        rng = random.Random(89)
+        for drift in (0.0, 40e-6, -120e-6):
+            clock = observed_clock(drift, lambda d: 0.0 if d % BUCKET_S == 300 else rng.uniform(0.05, 30))
+            self.assertAlmostEqual(clock.epoch, EPOCH, delta=1e-3)
+            self.assertAlmostEqual(clock.drift, drift, delta=1e-9)
+            self.assertEqual(clock.correct(9000), round(EPOCH + (1 + drift) * 9000))
+
+    def test_line_under_minima_with_least_delay(self):
+        rng = random.Random(7)
+        clock = observed_clock(25e-6, lambda d: rng.expovariate(1 / 5))
+        minima = list(clock.minima.values())
+        for d, offset in minima:
+            self.assertGreaterEqual(offset, clock.epoch + clock.drift * d - 1e-6)
+
+        # Brute force: every line through two minima that stays under all of them
+        best = None
+        for i, (x1, y1) in enumerate(minima):
+            for x2, y2 in minima[i + 1:]:
+                drift = (y2 - y1) / (x2 - x1)
+                epoch = y1 - drift * x1
+                if abs(drift) > MAX_DRIFT or any(y < epoch + drift * x - 1e-9 for x, y in minima):
+                    continue
+                cost = total_delay(clock, epoch, drift)
+                best = cost if best is None else min(best, cost)
+        self.assertAlmostEqual(total_delay(clock, clock.epoch, clock.drift), best, delta=1e-6)
+
+    def test_excessive_drift_rejected(self):
+        clock = observed_clock(10 * MAX_DRIFT, lambda d: 0.0)
+        self.assertEqual(clock.drift, 0.0)
+        self.assertEqual(clock.epoch, min(offset for _, offset in clock.minima.values()))
+
+    def test_single_minimum(self):
+        clock = BootClock()
+        clock.observe(120, EPOCH + 125)
+        clock.observe(150, EPOCH + 152)
+        clock.fit()
+        self.assertEqual((clock.epoch, clock.drift), (EPOCH + 2, 0.0))
+
+    def test_backlog_delay_does_not_move_fit(self):
+        clock = observed_clock(0.0, lambda d: 0.0)
+        epoch, drift = clock.epoch, clock.drift
+        # An hour late upload of old readings only raises offsets
+        for d in range(60, 3000, 60):
+            clock.observe(d, EPOCH + d + 3600)
+        clock.fit()
+        self.assertEqual((clock.epoch, clock.drift), (epoch, drift))
+
+
+class ClockSyncTest(unittest.TestCase):
+    def test_unix_timestamps_pass_through(self):
+        sync = ClockSync()
+        self.assertEqual(sync.correct("node", [(1_700_000_123, 1, None)], EPOCH), [1_700_000_123])
+        self.assertIsNone(sync.status("node"))
+
+    def test_uptime_corrected_per_boot(self):
+        sync = ClockSync()
+        self.assertEqual(sync.correct("node", [(100, 1, 5), (160, 2, 5)], EPOCH + 160), [EPOCH + 100, EPOCH + 160])
+        # New boot: uptime restarts, the old boot's line must not apply
+        self.assertEqual(sync.correct("node", [(10, 1, 6)], EPOCH + 1000), [EPOCH + 1000])
+        self.assertEqual(sync.status("node")["boots_tracked"], 2)
+
+
+if __name__ == "__main__":
+    unittest.main()
@@ -0,0 +1,36 @@
+"""
+Compaction dedup keys
+
+Run from backend/: python -m unittest discover tests
+"""
+import unittest
+
+from app.compactor import dedup
+from app.tiered_store import ROW_COLUMNS
+
+
+def row(timestamp, raw_timestamp, seq=None, boot_id=None, nitrogen=40):
+    values = dict.fromkeys(ROW_COLUMNS)
+    values.update(device_id="pico", timestamp=timestamp, raw_timestamp=raw_timestamp, schema_id=3,
+                  seq=seq, boot_id=boot_id, nitrogen=nitrogen, is_dummy=0)
+    return tuple(values[name] for name in ROW_COLUMNS)
+
+
+class DedupTest(unittest.TestCase):
+    def test_same_uptime_after_reboot_kept(self):
+        # Uptime stamps repeat after a reboot; identical values are two readings
+        rows = [row(1000, 60, seq=1, boot_id=7), row(5000, 60, seq=1, boot_id=8)]
+        self.assertEqual(dedup(rows), rows)
+
+    def test_resend_with_other_correction_dropped(self):
+        # A retry corrected to another time is still the same (boot_id, seq)
+        rows = [row(1000, 60, seq=5, boot_id=7), row(1003, 60, seq=5, boot_id=7)]
+        self.assertEqual(dedup(rows), rows[:1])
+
+    def test_legacy_rows_keyed_on_raw_timestamp(self):
+        rows = [row(1000, 60), row(1000, 60), row(1001, 61)]
+        self.assertEqual(dedup(rows), [rows[0], rows[2]])
+
+
+if __name__ == "__main__":
+    unittest.main()
@@ -0,0 +1,163 @@
+"""
+Keyset history pages: archived days and cursor tie-breaks
+
+Run from backend/: python -m unittest discover tests
+"""
+import os
+import tempfile
+import unittest
+
+import aiosqlite
+
+from app.history import (
+    ID_MAX, CursorError, encode_cursor, merged_page, per_device_page, _resume_key
+)
+from app.telemetry_schema import SENSOR_DATA_DDL
+from app.tiered_store import TieredStore, DAY_S
+
+DAY = 19000
+
+
+def merged_order(row, descending):
+    """Merged pages: timestamp in page order, then device_id, then id in page order"""
+    sign = -1 if descending else 1
+    return sign * row[1], row[0], sign * row[2]
+
+
+class HistoryTestCase(unittest.IsolatedAsyncioTestCase):
+    async def asyncSetUp(self):
+        self.dir = tempfile.TemporaryDirectory()
+        self.store = TieredStore(os.path.join(self.dir.name, "test.db"), os.path.join(self.dir.name, "archive"))
+        self.db = await aiosqlite.connect(self.store.db_path)
+        await self.db.execute(SENSOR_DATA_DDL)
+        await self.store.open_catalog(self.db)
+
+    async def asyncTearDown(self):
+        await self.db.close()
+        self.dir.cleanup()
+
+    async def insert(self, rows):
+        """(device_id, timestamp) pairs, ids in list order"""
+        await self.db.executemany(
+            "INSERT INTO sensor_data (device_id, timestamp, soil_moisture) VALUES (?, ?, ?)",
+            [(device_id, ts, 40.0) for device_id, ts in rows]
+        )
+        await self.db.commit()
+
+    async def pages(self, page, devices, limit, descending, store=None):
+        """Every page's rows as (device_id, timestamp, id), following cursors to the end"""
+        rows, cursor = [], None
+        while True:
+            result = await page(self.db, devices, ["soil_moisture"], limit, cursor, descending, store)
+            if page is merged_page:
+                rows.extend((r["device_id"], r["timestamp"], r["id"]) for r in result["data"])
+            else:
+                for device_id, data in result["devices"].items():
+                    rows.extend((device_id, r["timestamp"], r["id"]) for r in data)
+            cursor = result["next_cursor"]
+            if cursor is None:
+                return rows
+
+
+class ArchivedPagesTest(HistoryTestCase):
+    async def asyncSetUp(self):
+        await super().asyncSetUp()
+        # Two days per device; the first is archived
+        await self.insert([(d, (DAY + day) * DAY_S + i * 3600)
+                           for day in (0, 1) for d in ("a", "b") for i in range(24)])
+        for device_id in ("a", "b"):
+            await self.store.archive_day(self.db, device_id, DAY)
+
+    async def test_merged_pages_reach_archived_days(self):
+        for descending in (True, False):
+            rows = await self.pages(merged_page, ["a", "b"], 7, descending, self.store)
+            self.assertEqual(len(rows), 96)
+            self.assertEqual(len(set(rows)), 96)
+            self.assertEqual(rows, sorted(rows, key=lambda r: merged_order(r, descending)))
+
+    async def test_per_device_pages_reach_archived_days(self):
+        for descending in (True, False):
+            rows = await self.pages(per_device_page, ["a", "b"], 10, descending, self.store)
+            self.assertEqual(len(set(rows)), 96)
+
+    async def test_archived_rows_keep_ids(self):
+        rows = await self.pages(merged_page, ["a"], 100, False, self.store)
+        self.assertEqual([r[2] for r in rows], sorted(r[2] for r in rows))
+        self.assertNotIn(None, [r[2] for r in rows])
+
+    async def test_warm_only_without_store(self):
+        rows = await self.pages(merged_page, ["a", "b"], 50, True)
+        self.assertEqual(len(rows), 48)
+
+
+class ResumeKeyTest(unittest.TestCase):
+    def test_cursor_device_resumes_after_its_id(self):
+        self.assertEqual(_resume_key("b", [100, "b", 7], True), (100, 7))
+        self.assertEqual(_resume_key("b", [100, "b", 7], False), (100, 7))
+
+    def test_devices_before_cursor_device_are_done_at_its_timestamp(self):
+        # Descending scans continue below (100, -1); ascending above (100, ID_MAX)
+        self.assertEqual(_resume_key("a", [100, "b", 7], True), (100, -1))
+        self.assertEqual(_resume_key("a", [100, "b", 7], False), (100, ID_MAX))
+
+    def test_devices_after_cursor_device_are_untouched_at_its_timestamp(self):
+        self.assertEqual(_resume_key("c", [100, "b", 7], True), (100, ID_MAX))
+        self.assertEqual(_resume_key("c", [100, "b", 7], False), (100, -1))
+
+
+class MergedPageTest(HistoryTestCase):
+    async def test_equal_timestamps_across_devices(self):
+        # Every device reports at the same instants
+        await self.insert([(d, ts) for ts in (10, 20, 30) for d in ("c", "a", "b")])
+        for descending in (True, False):
+            for limit in (1, 2, 4, 9):
+                rows = await self.pages(merged_page, ["a", "b", "c"], limit, descending)
+                self.assertEqual(len(rows), 9)
+                self.assertEqual(rows, sorted(rows, key=lambda r: merged_order(r, descending)))
+
+    async def test_resume_within_one_device_timestamp(self):
+        # Several rows of one device share a timestamp; pages split them
+        await self.insert([("a", 10)] * 5 + [("b", 10)] * 3 + [("a", 20)] * 2)
+        for descending in (True, False):
+            rows = await self.pages(merged_page, ["a", "b"], 2, descending)
+            self.assertEqual(len(set(rows)), 10)
+            self.assertEqual(rows, sorted(rows, key=lambda r: merged_order(r, descending)))
+
+    async def test_cursor_is_last_row(self):
+        await self.insert([("a", 10), ("b", 10), ("a", 20)])
+        page = await merged_page(self.db, ["a", "b"], ["soil_moisture"], 2, None, True)
+        self.assertEqual([(r["device_id"], r["timestamp"]) for r in page["data"]], [("a", 20), ("a", 10)])
+        rest = await merged_page(self.db, ["a", "b"], ["soil_moisture"], 2, page["next_cursor"], True)
+        self.assertEqual([(r["device_id"], r["timestamp"]) for r in rest["data"]], [("b", 10)])
+        self.assertIsNone(rest["next_cursor"])
+
+    async def test_devices_without_rows(self):
+        await self.insert([("a", 10)])
+        rows = await self.pages(merged_page, ["a", "missing"], 5, True)
+        self.assertEqual([r[0] for r in rows], ["a"])
+
+    async def test_per_device_pages(self):
+        await self.insert([("a", ts) for ts in range(7)] + [("b", 3)] * 4)
+        for descending in (True, False):
+            rows = await self.pages(per_device_page, ["a", "b"], 3, descending)
+            self.assertEqual(len(set(rows)), 11)
+            for device_id in ("a", "b"):
+                mine = [r for r in rows if r[0] == device_id]
+                self.assertEqual(mine, sorted(mine, key=lambda r: (r[1], r[2]), reverse=descending))
+
+    async def test_invalid_cursors_rejected(self):
+        await self.insert([("a", 10)])
+        merged_bad = ["!!not base64", encode_cursor({"a": [1, 2]}), encode_cursor([1, "a"]),
+                      encode_cursor(["10", "a", 1]), encode_cursor([10, 3, 1]), encode_cursor([10, "a", None])]
+        for cursor in merged_bad:
+            with self.assertRaises(CursorError, msg=cursor):
+                await merged_page(self.db, ["a"], ["soil_moisture"], 5, cursor, True)
+        per_device_bad = [encode_cursor([10, "a", 1]), encode_cursor({"a": [10]}),
+                          encode_cursor({"a": ["10", 1]}), encode_cursor({"a": 10})]
+        for cursor in per_device_bad:
+            with self.assertRaises(CursorError, msg=cursor):
+                await per_device_page(self.db, ["a"], ["soil_moisture"], 5, cursor, True)
+
+
+if __name__ == "__main__":
+    unittest.main()
@@ -0,0 +1,63 @@
+"""
+Latest-value segment: seqlock parity and in-place re-initialisation
+
+Run from backend/: python -m unittest discover tests
+"""
+import os
+import tempfile
+import unittest
+
+from app.latest_segment import LatestSegment, SEQ
+
+DEVICE = "pico-test"
+
+
+class LatestSegmentTest(unittest.TestCase):
+    def setUp(self):
+        self.dir = tempfile.TemporaryDirectory()
+        self.path = os.path.join(self.dir.name, "segment")
+
+    def tearDown(self):
+        self.dir.cleanup()
+
+    def test_write_recovers_from_odd_seq(self):
+        segment = LatestSegment(self.path, slots=8)
+        segment.publish([(DEVICE, 100, {"soil_moisture": 40.0})])
+        offset = segment._find(DEVICE)
+        SEQ.pack_into(segment.view, offset, 7)      # A writer died half way
+        self.assertIsNone(segment.read(DEVICE))
+        segment.publish([(DEVICE, 200, {"soil_moisture": 41.0})])
+        self.assertEqual(SEQ.unpack_from(segment.view, offset)[0], 8)
+        self.assertEqual(segment.read(DEVICE)["soil_moisture"], 41.0)
+        segment.close()
+
+    def test_reinitialise_in_place_keeps_old_mapping_valid(self):
+        old = LatestSegment(self.path, slots=16)
+        old.publish([(DEVICE, 100, {"soil_moisture": 40.0})])
+        size = os.path.getsize(self.path)
+
+        # A process with fewer slots takes over: the file must not shrink
+        new = LatestSegment(self.path, slots=8)
+        self.assertEqual(os.path.getsize(self.path), size)
+        self.assertIsNone(old.read(DEVICE))
+        self.assertEqual(old.latest(), [])
+        # Every page of the old mapping is still backed by the file
+        self.assertEqual(bytes(old.view[-8:]), bytes(8))
+
+        self.assertIsNone(new.read(DEVICE))
+        new.publish([(DEVICE, 300, {"soil_moisture": 42.0})])
+        self.assertEqual(new.read(DEVICE)["timestamp"], 300)
+        old.close()
+        new.close()
+
+    def test_reinitialise_grows(self):
+        LatestSegment(self.path, slots=4).close()
+        segment = LatestSegment(self.path, slots=32)
+        self.assertGreaterEqual(os.path.getsize(self.path), segment.size)
+        segment.publish([(DEVICE, 100, {"nitrogen": 12})])
+        self.assertEqual(segment.read(DEVICE)["nitrogen"], 12)
+        segment.close()
+
+
+if __name__ == "__main__":
+    unittest.main()
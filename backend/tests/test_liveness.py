@@ -0,0 +1,104 @@
+"""
+Timer wheel: expiry on the right tick across level cascades
+
+Run from backend/: python -m unittest discover tests
+"""
+import random
+import unittest
+
+from app.liveness import TimerWheel, SLOT_BITS, LEVELS
+
+START = 1_000_003    # Not aligned to any level, so the first cascades come early
+
+
+class TimerWheelTest(unittest.TestCase):
+    def expire_ticks(self, wheel, until, step=1):
+        """Advance in steps; {key: tick of the advance that returned it}"""
+        fired = {}
+        now = wheel.current
+        while now < until:
+            now = min(now + step, until)
+            for key in wheel.advance(now):
+                self.assertNotIn(key, fired)
+                fired[key] = now
+        return fired
+
+    def test_single_level(self):
+        wheel = TimerWheel(START)
+        for delta in range(1, 64):
+            wheel.schedule(delta, START + delta)
+        fired = self.expire_ticks(wheel, START + 64)
+        self.assertEqual(fired, {delta: START + delta for delta in range(1, 64)})
+        self.assertEqual(len(wheel), 0)
+
+    def test_cascade_through_every_level(self):
+        # Deadlines just below, on and above each level boundary
+        wheel = TimerWheel(START)
+        deltas = set()
+        for level in range(1, LEVELS):
+            span = 1 << (SLOT_BITS * level)
+            deltas.update((span - 1, span, span + 1, 2 * span + 7))
+        for delta in deltas:
+            wheel.schedule(delta, START + delta)
+        fired = self.expire_ticks(wheel, START + max(deltas) + 1)
+        self.assertEqual(fired, {delta: START + delta for delta in deltas})
+
+    def test_random_deadlines_match_brute_force(self):
+        rng = random.Random(88)
+        wheel = TimerWheel(START)
+        deadlines = {}
+        for key in range(2000):
+            deadline = START + rng.choice((rng.uniform(0, 70), rng.uniform(0, 5000), rng.uniform(0, 300000)))
+            wheel.schedule(key, deadline)
+            deadlines[key] = max(int(deadline), START + 1)
+
+        # Uneven jumps, some crossing several level boundaries at once
+        fired, now = {}, START
+        while wheel:
+            now += rng.choice((1, 3, 64, 500, 4096))
+            for key in wheel.advance(now):
+                fired[key] = now
+        for key, expiry in deadlines.items():
+            self.assertGreaterEqual(fired[key], expiry)
+        # Fired on the first advance that reached the deadline: no earlier step passed it
+        steps = sorted(set(fired.values()))
+        for key, expiry in deadlines.items():
+            earlier = [t for t in steps if t < fired[key]]
+            self.assertTrue(not earlier or earlier[-1] < expiry)
+
+    def test_past_deadline_fires_on_next_tick(self):
+        wheel = TimerWheel(START)
+        wheel.schedule("late", START - 10)
+        self.assertEqual(wheel.advance(START), [])
+        self.assertEqual(wheel.advance(START + 1), ["late"])
+
+    def test_reschedule_and_cancel(self):
+        wheel = TimerWheel(START)
+        wheel.schedule("moved", START + 10)
+        wheel.schedule("moved", START + 5000)
+        wheel.schedule("cancelled", START + 20)
+        wheel.cancel("cancelled")
+        wheel.cancel("unknown")
+        self.assertEqual(len(wheel), 1)
+        fired = self.expire_ticks(wheel, START + 6000)
+        self.assertEqual(fired, {"moved": START + 5000})
+
+    def test_far_deadline_clamped_to_wheel_range(self):
+        wheel = TimerWheel(START)
+        horizon = 1 << (SLOT_BITS * LEVELS)
+        wheel.schedule("far", START + 10 * horizon)
+        level, slot = wheel.where["far"]
+        self.assertEqual(level, LEVELS - 1)
+        self.assertEqual(wheel.wheels[level][slot]["far"], START + horizon - 1)
+        # Survives the top-level cascades without firing early
+        self.assertEqual(self.expire_ticks(wheel, START + 3 * (1 << (SLOT_BITS * (LEVELS - 1))), 4096), {})
+
+    def test_fractional_tick(self):
+        wheel = TimerWheel(START, tick=0.5)
+        wheel.schedule("half", START + 2.5)
+        self.assertEqual(wheel.advance(START + 2.25), [])
+        self.assertEqual(wheel.advance(START + 2.5), ["half"])
+
+
+if __name__ == "__main__":
+    unittest.main()
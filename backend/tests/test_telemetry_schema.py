@@ -0,0 +1,91 @@
+"""
+Generated decoders: types and required fields
+
+Run from backend/: python -m unittest discover tests
+"""
+import json
+import unittest
+
+from app.telemetry_schema import SchemaError, decode
+
+
+def payload(**fields):
+    base = {"schema_id": 3, "device_id": "PICO_NPK_001", "timestamp": 1700000000,
+            "soil_temperature": 21.5, "nitrogen": 40}
+    base.update(fields)
+    return {k: v for k, v in base.items() if v is not ...}
+
+
+class DecodeTypesTest(unittest.TestCase):
+    def assertRejected(self, body):
+        with self.assertRaises(SchemaError):
+            decode(body)
+
+    def test_valid(self):
+        _, params = decode(payload(soil_temperature=21, nitrogen=40.0))
+        self.assertEqual(params[:4], ("PICO_NPK_001", 1700000000, 1700000000, 3))
+
+    def test_numeric_column_rejects_string(self):
+        self.assertRejected(payload(soil_temperature="hot"))
+
+    def test_numeric_column_rejects_list(self):
+        self.assertRejected(payload(soil_temperature=[1]))
+
+    def test_numeric_column_rejects_bool(self):
+        self.assertRejected(payload(soil_temperature=True))
+        self.assertRejected(payload(nitrogen=False))
+
+    def test_device_id_must_be_string(self):
+        self.assertRejected(payload(device_id=None))
+        self.assertRejected(payload(device_id=7))
+        self.assertRejected(payload(device_id=...))
+
+    def test_timestamp_required_and_numeric(self):
+        self.assertRejected(payload(timestamp=...))
+        self.assertRejected(payload(timestamp=None))
+        self.assertRejected(payload(timestamp="1700000000"))
+        self.assertRejected(payload(timestamp=True))
+        self.assertRejected(payload(timestamp=float("nan")))
+
+    def test_nested_group_must_be_object(self):
+        self.assertRejected({"schema_id": 1, "device_id": "pico", "timestamp": 1, "npk": [1, 2, 3]})
+        self.assertRejected({"schema_id": 1, "device_id": "pico", "timestamp": 1, "npk": {"nitrogen": "high"}})
+
+    def test_payload_and_schema_id_shapes(self):
+        self.assertRejected([payload()])
+        self.assertRejected(payload(schema_id=[3]))
+        self.assertRejected(payload(schema_id="3"))
+
+    def test_seq_and_boot_id(self):
+        _, params = decode(payload(seq=12, boot_id=0xDEADBEEF))
+        self.assertEqual(params[4:6], (12, 0xDEADBEEF))
+        self.assertEqual(decode(payload())[1][4:6], (None, None))
+        self.assertRejected(payload(seq="12"))
+        self.assertRejected(payload(seq=True))
+        self.assertRejected(payload(boot_id=-1))
+
+    def test_nan_and_infinity_rejected(self):
+        for value in (float("nan"), float("inf"), float("-inf")):
+            self.assertRejected(payload(soil_moisture=value))
+            self.assertRejected(payload(soil_temperature=value))
+            self.assertRejected(payload(nitrogen=value))
+            self.assertRejected(payload(timestamp=value))
+        self.assertRejected({"schema_id": 1, "device_id": "pico", "timestamp": 1,
+                             "npk": {"nitrogen": float("inf")}})
+
+    def test_nan_and_infinity_from_json(self):
+        for text in ('{"device_id": "p", "timestamp": Infinity, "schema_id": 3}',
+                     '{"device_id": "p", "timestamp": 1, "schema_id": 3, "soil_moisture": NaN}',
+                     '{"device_id": "p", "timestamp": 1, "schema_id": 3, "nitrogen": -Infinity}'):
+            self.assertRejected(json.loads(text))
+
+    def test_huge_integer_rejected(self):
+        self.assertRejected(payload(timestamp=10 ** 400))
+        self.assertRejected(payload(nitrogen=10 ** 400))
+
+    def test_range_still_checked(self):
+        self.assertRejected(payload(soil_moisture=101))
+
+
+if __name__ == "__main__":
+    unittest.main()
@@ -0,0 +1,82 @@
+"""
+Stitched reads across the hot/warm boundary
+
+Run from backend/: python -m unittest discover tests
+"""
+import os
+import tempfile
+import unittest
+from unittest import mock
+
+import aiosqlite
+
+from app.telemetry_schema import SENSOR_DATA_DDL
+from app.tiered_store import TieredStore, HotRing, TS
+
+DEVICE = "pico-test"
+
+
+class HotBoundaryTest(unittest.IsolatedAsyncioTestCase):
+    async def asyncSetUp(self):
+        self.dir = tempfile.TemporaryDirectory()
+        self.store = TieredStore(os.path.join(self.dir.name, "test.db"), os.path.join(self.dir.name, "archive"))
+        self.store.hot = HotRing(10)
+        self.db = await aiosqlite.connect(self.store.db_path)
+        await self.db.execute(SENSOR_DATA_DDL)
+        self.now = 1000.5       # Fractional: the hot floor is ceil(990.5) = 991
+        self.clock = mock.patch("time.time", lambda: self.now)
+        self.clock.start()
+
+    async def asyncTearDown(self):
+        self.clock.stop()
+        await self.db.close()
+        self.dir.cleanup()
+
+    async def insert(self, timestamps):
+        await self.db.executemany(
+            "INSERT INTO sensor_data (device_id, timestamp, soil_moisture) VALUES (?, ?, ?)",
+            [(DEVICE, ts, 40.0) for ts in timestamps]
+        )
+        await self.db.commit()
+
+    async def read(self, size=1000):
+        rows = []
+        async for chunk in self.store.iter_chunks(self.db, DEVICE, 0, 5000, size=size):
+            rows.extend(chunk)
+        return [row[TS] for row in rows]
+
+    async def test_row_at_floor_read_once(self):
+        await self.insert(range(985, 1000))
+        await self.store.initialize(self.db, [DEVICE])
+        self.assertEqual(self.store.hot.floor, 991)
+        self.assertEqual(await self.read(), list(range(985, 1000)))
+
+    async def test_floor_pinned_during_read(self):
+        await self.insert(range(985, 1000))
+        await self.store.initialize(self.db, [DEVICE])
+        timestamps = []
+        reader = self.store.iter_chunks(self.db, DEVICE, 0, 5000, size=2)
+        async for chunk in reader:
+            if not timestamps:
+                # Time passes and rows arrive between two chunks of the read
+                self.now += 5
+                await self.insert(range(1000, 1005))
+            timestamps.extend(row[TS] for row in chunk)
+        self.assertEqual(timestamps, list(range(985, 1005)))
+        self.assertEqual(self.store.hot.floor, 991)
+
+        # With no read in flight the next refresh moves the floor up
+        await self.store.refresh(self.db)
+        self.assertEqual(self.store.hot.floor, 996)
+        self.assertEqual(await self.read(), list(range(985, 1005)))
+
+    async def test_reads_between_inserts(self):
+        await self.store.initialize(self.db, [DEVICE])
+        for ts in range(1000, 1040):
+            self.now = ts + 0.5
+            await self.insert([ts])
+            self.assertEqual(await self.read(), list(range(1000, ts + 1)))
+
+
+if __name__ == "__main__":
+    unittest.main()
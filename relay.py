@@ -6,11 +6,15 @@ Reads USB serial data from Pico, sends to FastAPI backend, updates dashboard
 
 import serial
 import requests
-import json
 import time
 import sys
+import os
 from datetime import datetime
 
+# Payload layout is generated from Pico/telemetry_schema.h
+sys.path.insert(0, os.path.join(os.path.dirname(os.path.abspath(__file__)), 'backend', 'app'))
+from telemetry_schema import encode_npk_serial
+
 # ==================== CONFIGURATION ====================
 SERIAL_PORT = 'COM3'  # Windows: COM3, COM4, etc
 # SERIAL_PORT = '/dev/ttyACM0'  # Linux: /dev/ttyACM0, /dev/ttyACM1
@@ -74,21 +78,18 @@ def parse_sensor_data(line):
         return None
 
 def build_json_payload(sensor_data):
-    """Build JSON payload for backend"""
-    return {
-        "device_id": DEVICE_ID,
-        "timestamp": int(datetime.now().timestamp()),
+    """Build JSON payload for backend (record type NPK_SERIAL)"""
+    # No humidity or light sensor on this node: those fields are absent,
+    # not zero
+    return encode_npk_serial(DEVICE_ID, int(datetime.now().timestamp()), {
         "soil_moisture": sensor_data['moist'],
         "soil_temperature": sensor_data['temp'],
-        "humidity": 0,
-        "light_intensity": 0,
         "soil_ph": sensor_data['ph'],
-        "npk": {
-            "nitrogen": sensor_data['N'],
-            "phosphorus": sensor_data['P'],
-            "potassium": sensor_data['K']
-        }
-    }
+        "soil_conductivity": sensor_data['ec'],
+        "nitrogen": sensor_data['N'],
+        "phosphorus": sensor_data['P'],
+        "potassium": sensor_data['K']
+    })
 
 def send_to_backend(payload):
     """Send payload to backend API"""